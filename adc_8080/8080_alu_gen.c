@@ -0,0 +1,123 @@
+// Generates the precomputed ALU result and flag tables used by adc_8080_cpu
+// when it is compiled with ADC_8080_CPU_ALU_TABLES defined.
+//
+// Every table entry packs the 8-bit result in the high byte and the resulting
+// PSW in the low byte, using the same layout as PUSH PSW:
+// S Z 0 AC 0 P 1 CY.
+//
+// Usage: 8080_alu_gen <output header>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static bool parity(uint8_t v) {
+  int ones = 0;
+  for (int b = 0; b < 8; b++)
+    ones += (v >> b) & 1;
+  return (ones % 2) == 0;
+}
+
+static uint16_t pack(uint8_t res, bool ac, bool cy) {
+  uint8_t psw = 1 << 1;
+  psw |= (res >> 7) << 7;
+  psw |= (res == 0) << 6;
+  psw |= ac << 4;
+  psw |= parity(res) << 2;
+  psw |= cy << 0;
+  return (uint16_t)((res << 8) | psw);
+}
+
+// Mirrors op_add() in adc_8080_cpu.c.
+static uint16_t alu_add(uint8_t a, uint8_t val, bool c) {
+  uint8_t res = a + val + c;
+  int16_t carry = (a + val + c) ^ a ^ val;
+  return pack(res, carry & (1 << 4), carry & (1 << 8));
+}
+
+// Mirrors op_sub() in adc_8080_cpu.c, c is the borrow in.
+static uint16_t alu_sub(uint8_t a, uint8_t val, bool c) {
+  uint16_t packed = alu_add(a, ~val, !c);
+  return packed ^ 1;
+}
+
+// Mirrors op_daa() in adc_8080_cpu.c.
+static uint16_t alu_daa(uint8_t a, bool ac, bool cy) {
+  uint8_t lownib = a & 0x0F;
+  uint8_t highnib = a >> 4;
+  bool carrybit = cy;
+  uint8_t addition = 0;
+
+  if (lownib > 9 || ac)
+    addition += 0x06;
+
+  if (highnib > 9 || cy || (highnib >= 9 && lownib > 9)) {
+    addition += 0x60;
+    carrybit = 1;
+  }
+
+  uint16_t packed = alu_add(a, addition, 0);
+  return (packed & ~1) | carrybit;
+}
+
+static void write_table(FILE *file, const char *name, const uint16_t *table,
+                        size_t size) {
+  fprintf(file, "static const uint16_t %s[%zu] = {\n", name, size);
+  for (size_t i = 0; i < size; i++) {
+    fprintf(file, "%s0x%04X,%s", (i % 12) == 0 ? "  " : "", table[i],
+            (i % 12) == 11 || i == size - 1 ? "\n" : " ");
+  }
+  fprintf(file, "};\n\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <output header>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // Indexed by (carry << 16) | (a << 8) | operand.
+  static uint16_t add_lut[2 * 256 * 256];
+  static uint16_t sub_lut[2 * 256 * 256];
+  for (int c = 0; c < 2; c++) {
+    for (int a = 0; a < 256; a++) {
+      for (int val = 0; val < 256; val++) {
+        int i = (c << 16) | (a << 8) | val;
+        add_lut[i] = alu_add(a, val, c);
+        sub_lut[i] = alu_sub(a, val, c);
+      }
+    }
+  }
+
+  // Indexed by (cy << 9) | (ac << 8) | a.
+  static uint16_t daa_lut[2 * 2 * 256];
+  for (int cy = 0; cy < 2; cy++) {
+    for (int ac = 0; ac < 2; ac++) {
+      for (int a = 0; a < 256; a++)
+        daa_lut[(cy << 9) | (ac << 8) | a] = alu_daa(a, ac, cy);
+    }
+  }
+
+  FILE *file = fopen(argv[1], "w");
+  if (!file) {
+    fprintf(stderr, "Failed to fopen() '%s'!\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  fprintf(file, "// Generated by 8080_alu_gen.c. Do not edit.\n\n"
+                "#ifndef _ADC_8080_CPU_ALU_H_\n"
+                "#define _ADC_8080_CPU_ALU_H_\n\n"
+                "#include <stdint.h>\n\n");
+  write_table(file, "s_alu_add_lut", add_lut, 2 * 256 * 256);
+  write_table(file, "s_alu_sub_lut", sub_lut, 2 * 256 * 256);
+  write_table(file, "s_alu_daa_lut", daa_lut, 2 * 2 * 256);
+  fprintf(file, "#endif // _ADC_8080_CPU_ALU_H_\n");
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Failed to write '%s'!\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
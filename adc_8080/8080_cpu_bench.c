@@ -0,0 +1,1608 @@
+// Benchmarks for adc_8080_cpu.
+//
+// Usage: 8080_cpu_bench [exm [section index...] | fork | states | codec |
+//                        trace | profile | debug | coverage | pctrace |
+//                        stats | fuzz | suite [options] | rom file... |
+//                        cpm file [argument...]]
+//
+// exm  - Runs selected sections of the 8080EXM.COM instruction exerciser
+//        headless (BDOS output is discarded) and reports the emulated cycles,
+//        host time and effective clock speed of each section. With no section
+//        indices the 'aluop nn', 'aluop <b,c,d,e,h,l,m,a>' and
+//        '<daa,cma,stc,cmc>' sections are run. This is the default.
+// fork - Measures forks per second and resident memory per fork of
+//        adc_8080_cow machines against copying the cpu and full memory.
+// states - Measures starting a batch of machines from a file of saved states
+//          by mapping them with adc_8080_statefile against reading every
+//          memory image into a fresh buffer.
+// codec  - Measures the size and encode and decode speed of adc_8080_codec
+//          snapshots of memory images captured while running the test roms.
+// trace  - Measures the 8080EXM 'aluop nn' section with a binary trace of the
+//          last TRACE_RECORDS instructions against formatting the cpu state
+//          with adc_8080_cpu_print() every step, then dumps the last records.
+// profile - Measures the 8080EXM 'aluop nn' section with and without
+//           adc_8080_profiler sampling, writes the folded stacks to
+//           build/8080EXM.folded and prints the first of them.
+// debug   - Measures the 8080EXM 'aluop nn' section stepped, run with a
+//           conditional breakpoint on its test loop and 15 more breakpoints,
+//           and stepped with the same breakpoints checked by the host.
+// coverage - Measures the 8080EXM 'aluop nn' section with and without code
+//            coverage, writes it to build/8080EXM.coverage and reports the
+//            covered addresses and the file size.
+// pctrace  - Runs each test rom (8080EXM up to PCTRACE_EXM_CYCLES) with and
+//            without a compressed pc trace, reports its size per instruction
+//            and checks that replaying it gives the executed pcs.
+// stats    - Measures the 8080EXM 'aluop nn' section with and without run
+//            statistics and prints them.
+// fuzz     - Fuzzes a small command parser with adc_8080_fuzzer, restoring
+//            the snapshot every case and in persistent mode, then with
+//            FUZZ_WORKERS processes sharing build/fuzz_corpus, and reports
+//            the cases per second and the failing inputs found.
+// suite    - Runs the fixed workloads of the benchmark suite, see 'make
+//            bench'. Options: --json <file> writes the results as JSON,
+//            --baseline <file> compares them with the results of an earlier
+//            run and fails if a workload got slower than --threshold <percent>
+//            (SUITE_THRESHOLD), --trials <n> sets the timed trials.
+// rom      - Runs .COM files such as those of 8080_rom_gen like a workload
+//            of the suite and reports their speed.
+// cpm      - Runs a CP/M program such as an assembler under adc_8080_bdos,
+//            with its files in the current directory and the arguments as
+//            its command tail, and reports its speed to stderr.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "adc_8080_bdos.h"
+#include "adc_8080_codec.h"
+#include "adc_8080_cond.h"
+#include "adc_8080_coverage.h"
+#include "adc_8080_cow.h"
+#include "adc_8080_cpu.h"
+#include "adc_8080_fuzzer.h"
+#include "adc_8080_pctrace.h"
+#include "adc_8080_profiler.h"
+#include "adc_8080_statefile.h"
+#include "adc_8080_trace.h"
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MEMORY_TOTAL 0x10000
+
+// Address of the zero terminated test descriptor list in 8080EXM.COM, see
+// 'tests:' in roms/8080EXM.PRN.
+#define EXM_TESTS_ADDR 0x013A
+#define EXM_NUM_TESTS 25
+
+// Address of the test loop of 8080EXM.COM, see 'tlp:' in roms/8080EXM.PRN.
+#define EXM_TLP_ADDR 0x0B23
+
+// Cycles per adc_8080_cpu_run() call with breakpoints, a 60 Hz frame at
+// 2 MHz.
+#define DEBUG_RUN_CYCLES 33333
+
+// Cycles per adc_8080_bdos_run() call of the cpm benchmark.
+#define CPM_RUN_CYCLES 1000000
+
+// Cycles between profiler samples, about 5000 samples per second at 2 MHz.
+#define PROFILE_INTERVAL 400
+
+static uint8_t s_memory[MEMORY_TOTAL];
+static bool s_done;
+
+static uint8_t handle_memory_read(void *userdata, uint16_t addr) {
+  (void)userdata;
+  return s_memory[addr];
+}
+
+static void handle_memory_write(void *userdata, uint16_t addr, uint8_t value) {
+  (void)userdata;
+  s_memory[addr] = value;
+}
+
+static uint8_t handle_device_read(void *userdata, uint8_t device) {
+  (void)userdata;
+  (void)device;
+  return 0;
+}
+
+static void handle_device_write(void *userdata, uint8_t device,
+                                uint8_t output) {
+  (void)userdata;
+  (void)output;
+  // BDOS console output is discarded, only warm boot is handled.
+  if (device == 0)
+    s_done = true;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static bool load_rom(const char *filename) {
+  memset(s_memory, 0, MEMORY_TOTAL);
+  // Same BDOS injection as 8080_cpu_test.c.
+  s_memory[0x0000] = 0xD3;
+  s_memory[0x0001] = 0x00;
+  s_memory[0x0005] = 0xD3;
+  s_memory[0x0006] = 0x01;
+  s_memory[0x0007] = 0xC9;
+
+  FILE *file = fopen(filename, "rb");
+  if (!file) {
+    fprintf(stderr, "Failed to fopen() '%s'!\n", filename);
+    return false;
+  }
+  size_t size = fread(s_memory + 0x100, 1, MEMORY_TOTAL - 0x100, file);
+  fclose(file);
+  return size > 0;
+}
+
+// Rewrite the 8080EXM test list so that only the given section runs.
+static void select_exm_section(const uint8_t *rom_tests, int section) {
+  memcpy(s_memory + EXM_TESTS_ADDR, rom_tests + section * 2, 2);
+  s_memory[EXM_TESTS_ADDR + 2] = 0x00;
+  s_memory[EXM_TESTS_ADDR + 3] = 0x00;
+}
+
+#ifdef ADC_8080_CPU_HEATMAP
+// Bytes of 8080EXM.COM counted per byte, the code and the test descriptors.
+#define HEATMAP_RANGE_START 0x0100
+#define HEATMAP_RANGE_LENGTH 0x0E00
+#define HEATMAP_TOP_PAGES 8
+
+static uint64_t
+    s_heatmap_counts[HEATMAP_RANGE_LENGTH * ADC_8080_CPU_ACCESS_KINDS];
+
+// Print the busiest pages of a section and write its heatmap as CSV and
+// binary files to the build directory.
+static void heatmap_report(const adc_8080_cpu *cpu, int section) {
+  const adc_8080_cpu_heatmap *heatmap = &cpu->heatmap;
+  int order[256];
+  uint64_t totals[256];
+  int n = 0;
+  for (int page = 0; page < 256; page++) {
+    const uint64_t *c = heatmap->pages[page];
+    totals[page] = c[0] + c[1] + c[2];
+    if (totals[page] == 0)
+      continue;
+
+    // Insertion sort by accesses, descending.
+    int i = n++;
+    while (i > 0 && totals[order[i - 1]] < totals[page]) {
+      order[i] = order[i - 1];
+      i--;
+    }
+    order[i] = page;
+  }
+
+  printf("  page %14s %14s %14s\n", "fetch", "read", "write");
+  for (int i = 0; i < n && i < HEATMAP_TOP_PAGES; i++) {
+    const uint64_t *c = heatmap->pages[order[i]];
+    printf("  0x%02X %14llu %14llu %14llu\n", order[i],
+           (unsigned long long)c[0], (unsigned long long)c[1],
+           (unsigned long long)c[2]);
+  }
+
+  char path[64];
+  snprintf(path, sizeof(path), "build/8080EXM_%d.heatmap.csv", section);
+  FILE *file = fopen(path, "w");
+  if (file) {
+    adc_8080_cpu_heatmap_write_csv(cpu, file);
+    fclose(file);
+  }
+  snprintf(path, sizeof(path), "build/8080EXM_%d.heatmap", section);
+  file = fopen(path, "wb");
+  if (!file || !adc_8080_cpu_heatmap_write_binary(cpu, file))
+    fprintf(stderr, "Failed to write %s!\n", path);
+  if (file)
+    fclose(file);
+}
+#endif
+
+// Run a section of 8080EXM, with the given trace, profiler and coverage
+// attached and through adc_8080_cpu_run() with the given breakpoints if not
+// NULL.
+static void bench_exm_section(const uint8_t *rom_image, int section,
+                              adc_8080_cpu_trace *trace,
+                              adc_8080_profiler *profiler,
+                              adc_8080_cpu_debug *debug,
+                              adc_8080_cpu_coverage *coverage) {
+  memcpy(s_memory, rom_image, MEMORY_TOTAL);
+  select_exm_section(rom_image + EXM_TESTS_ADDR, section);
+
+  adc_8080_cpu cpu;
+  adc_8080_cpu_init(&cpu);
+  cpu.userdata = &cpu;
+  cpu.read_byte = handle_memory_read;
+  cpu.write_byte = handle_memory_write;
+  cpu.read_device = handle_device_read;
+  cpu.write_device = handle_device_write;
+  cpu.pc = 0x100;
+  if (trace)
+    adc_8080_cpu_trace_attach(&cpu, trace, trace->records, trace->capacity);
+  if (profiler)
+    adc_8080_profiler_attach(profiler, &cpu, PROFILE_INTERVAL);
+  if (coverage)
+    adc_8080_cpu_coverage_attach(&cpu, coverage);
+#ifdef ADC_8080_CPU_HEATMAP
+  adc_8080_cpu_heatmap_add_range(&cpu, HEATMAP_RANGE_START,
+                                 HEATMAP_RANGE_LENGTH, s_heatmap_counts);
+#endif
+
+  s_done = false;
+  uint64_t cycles = 0;
+  double start = now_seconds();
+  while (!s_done) {
+    if (debug)
+      cycles += adc_8080_cpu_run(&cpu, debug, DEBUG_RUN_CYCLES, NULL);
+    else
+      cycles += adc_8080_cpu_step(&cpu);
+  }
+  double elapsed = now_seconds() - start;
+
+  printf("section %2d: %12llu cycles %8.3f s %8.2f MHz\n", section,
+         (unsigned long long)cycles, elapsed, cycles / elapsed / 1e6);
+  if (profiler)
+    adc_8080_profiler_detach(profiler, &cpu);
+
+#ifdef ADC_8080_CPU_OPCODE_STATS
+  adc_8080_cpu_opstats_print(&cpu, stdout);
+#endif
+#ifdef ADC_8080_CPU_HEATMAP
+  heatmap_report(&cpu, section);
+#endif
+}
+
+static int bench_exm(int argc, char *argv[]) {
+#ifdef ADC_8080_CPU_ALU_TABLES
+  printf("ALU: tables\n");
+#else
+  printf("ALU: arithmetic\n");
+#endif
+
+  if (!load_rom("roms/8080EXM.COM"))
+    return EXIT_FAILURE;
+
+  static uint8_t rom_image[MEMORY_TOTAL];
+  memcpy(rom_image, s_memory, MEMORY_TOTAL);
+
+  if (argc == 0) {
+    // aluop nn, aluop <b,c,d,e,h,l,m,a> and <daa,cma,stc,cmc>.
+    bench_exm_section(rom_image, 1, NULL, NULL, NULL, NULL);
+    bench_exm_section(rom_image, 2, NULL, NULL, NULL, NULL);
+    bench_exm_section(rom_image, 3, NULL, NULL, NULL, NULL);
+    return EXIT_SUCCESS;
+  }
+
+  for (int i = 0; i < argc; i++) {
+    int section = atoi(argv[i]);
+    if (section < 0 || section >= EXM_NUM_TESTS) {
+      fprintf(stderr, "Invalid section '%s'!\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    bench_exm_section(rom_image, section, NULL, NULL, NULL, NULL);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Fork benchmark. Every branch is given a different IN value, as if trying
+// every input at a decision point, and runs for FORK_BRANCH_CYCLES.
+#define FORK_BRANCHES 100000
+#define FORK_BRANCH_CYCLES 10000
+
+static uint8_t handle_cow_device_read(void *userdata, uint8_t device) {
+  adc_8080_cow_machine *machine = userdata;
+  (void)device;
+  return (uint8_t)(uintptr_t)machine->userdata;
+}
+
+static void handle_cow_device_write(void *userdata, uint8_t device,
+                                    uint8_t output) {
+  (void)userdata;
+  (void)device;
+  (void)output;
+}
+
+static void run_cycles(adc_8080_cpu *cpu, int cycles) {
+  while (cycles > 0)
+    cycles -= adc_8080_cpu_step(cpu);
+}
+
+static int bench_fork(void) {
+  if (!load_rom("roms/8080EXM.COM"))
+    return EXIT_FAILURE;
+
+  adc_8080_cow_machine *parent = adc_8080_cow_new(s_memory);
+  if (!parent) {
+    fprintf(stderr, "Failed to create the machine!\n");
+    return EXIT_FAILURE;
+  }
+  parent->cpu.read_device = handle_cow_device_read;
+  parent->cpu.write_device = handle_cow_device_write;
+  parent->cpu.pc = 0x100;
+  run_cycles(&parent->cpu, 1000000);
+  if (parent->error) {
+    fprintf(stderr, "Failed to copy a page of the machine!\n");
+    adc_8080_cow_free(&parent);
+    return EXIT_FAILURE;
+  }
+
+  // Fork and discard only.
+  double start = now_seconds();
+  for (int i = 0; i < FORK_BRANCHES; i++) {
+    adc_8080_cow_machine *child = adc_8080_cow_fork(parent);
+    adc_8080_cow_free(&child);
+  }
+  double elapsed = now_seconds() - start;
+  printf("cow fork+free:       %12.0f forks/s\n", FORK_BRANCHES / elapsed);
+
+  // Fork, run the branch and discard.
+  uint64_t private_pages = 0;
+  start = now_seconds();
+  for (int i = 0; i < FORK_BRANCHES; i++) {
+    adc_8080_cow_machine *child = adc_8080_cow_fork(parent);
+    child->userdata = (void *)(uintptr_t)(i & 0xFF);
+    run_cycles(&child->cpu, FORK_BRANCH_CYCLES);
+    private_pages += adc_8080_cow_private_pages(child);
+    bool error = child->error;
+    adc_8080_cow_free(&child);
+    if (error) {
+      fprintf(stderr, "Failed to copy a page of a fork!\n");
+      adc_8080_cow_free(&parent);
+      return EXIT_FAILURE;
+    }
+  }
+  elapsed = now_seconds() - start;
+  double pages_per_fork = (double)private_pages / FORK_BRANCHES;
+  printf("cow fork+run+free:   %12.0f forks/s, %.1f pages (%.0f bytes) "
+         "resident per fork\n",
+         FORK_BRANCHES / elapsed, pages_per_fork,
+         sizeof(adc_8080_cow_machine) +
+             pages_per_fork * (ADC_8080_COW_PAGE_SIZE + sizeof(int)));
+
+  // Baseline, allocate and copy the cpu and the full memory per branch.
+  adc_8080_cow_copy_memory(parent, s_memory);
+  static void *volatile sink;
+  start = now_seconds();
+  for (int i = 0; i < FORK_BRANCHES; i++) {
+    adc_8080_cpu *cpu = malloc(sizeof(adc_8080_cpu) + MEMORY_TOTAL);
+    if (!cpu)
+      return EXIT_FAILURE;
+    *cpu = parent->cpu;
+    memcpy(cpu + 1, s_memory, MEMORY_TOTAL);
+    sink = cpu;
+    free(sink);
+  }
+  elapsed = now_seconds() - start;
+  printf("memcpy copy:         %12.0f copies/s, %zu bytes resident per copy\n",
+         FORK_BRANCHES / elapsed, sizeof(adc_8080_cpu) + MEMORY_TOTAL);
+
+  adc_8080_cow_free(&parent);
+  return EXIT_SUCCESS;
+}
+
+// State file benchmark. Every instance is started from its own state and
+// runs for STATES_CYCLES, all instances are kept alive until the batch ends.
+#define STATES_BATCH 1000
+#define STATES_CYCLES 10000
+#define STATES_PATH "build/bench.states"
+
+static uint8_t handle_instance_read(void *userdata, uint16_t addr) {
+  return ((uint8_t *)userdata)[addr];
+}
+
+static void handle_instance_write(void *userdata, uint16_t addr,
+                                  uint8_t value) {
+  ((uint8_t *)userdata)[addr] = value;
+}
+
+static void init_instance(adc_8080_cpu *cpu, uint8_t *memory) {
+  cpu->userdata = memory;
+  cpu->read_byte = handle_instance_read;
+  cpu->write_byte = handle_instance_write;
+  cpu->read_device = handle_device_read;
+  cpu->write_device = handle_cow_device_write;
+}
+
+static int bench_states(void) {
+  if (!load_rom("roms/8080EXM.COM"))
+    return EXIT_FAILURE;
+
+  // Every state is a few thousand cycles further into the exerciser.
+  adc_8080_statefile_writer *writer =
+      adc_8080_statefile_create(STATES_PATH, STATES_BATCH);
+  if (!writer) {
+    fprintf(stderr, "Failed to create '%s'!\n", STATES_PATH);
+    return EXIT_FAILURE;
+  }
+  adc_8080_cpu cpu;
+  adc_8080_cpu_init(&cpu);
+  init_instance(&cpu, s_memory);
+  cpu.pc = 0x100;
+  for (int i = 0; i < STATES_BATCH; i++) {
+    run_cycles(&cpu, 5000);
+    adc_8080_statefile_add(writer, &cpu, s_memory);
+  }
+  if (!adc_8080_statefile_finish(&writer)) {
+    fprintf(stderr, "Failed to write '%s'!\n", STATES_PATH);
+    return EXIT_FAILURE;
+  }
+
+  static adc_8080_cpu cpus[STATES_BATCH];
+  static uint8_t *memories[STATES_BATCH];
+
+  // Map every state.
+  double start = now_seconds();
+  adc_8080_statefile *file = adc_8080_statefile_open(STATES_PATH);
+  if (!file)
+    return EXIT_FAILURE;
+  for (int i = 0; i < STATES_BATCH; i++) {
+    adc_8080_cpu_init(&cpus[i]);
+    memories[i] = adc_8080_statefile_map(file, i, &cpus[i]);
+    if (!memories[i])
+      return EXIT_FAILURE;
+    init_instance(&cpus[i], memories[i]);
+    run_cycles(&cpus[i], STATES_CYCLES);
+  }
+  for (int i = 0; i < STATES_BATCH; i++)
+    adc_8080_statefile_unmap(&memories[i]);
+  adc_8080_statefile_close(&file);
+  double elapsed = now_seconds() - start;
+  printf("mmap batch:  %8.2f ms for %d instances\n", elapsed * 1e3,
+         STATES_BATCH);
+
+  // Baseline, read every state and memory image into a fresh buffer. See
+  // adc_8080_statefile.h for the file layout.
+  start = now_seconds();
+  FILE *stream = fopen(STATES_PATH, "rb");
+  if (!stream)
+    return EXIT_FAILURE;
+  uint8_t header[16 + STATES_BATCH * 32];
+  if (fread(header, 1, sizeof(header), stream) != sizeof(header))
+    return EXIT_FAILURE;
+  size_t data_offset = header[12] | header[13] << 8 | header[14] << 16 |
+                       (size_t)header[15] << 24;
+  fseek(stream, (long)data_offset, SEEK_SET);
+  for (int i = 0; i < STATES_BATCH; i++) {
+    adc_8080_cpu_init(&cpus[i]);
+    adc_8080_cpu_load(&cpus[i], NULL, header + 16 + i * 32, 32);
+    memories[i] = malloc(MEMORY_TOTAL);
+    if (!memories[i] ||
+        fread(memories[i], 1, MEMORY_TOTAL, stream) != MEMORY_TOTAL)
+      return EXIT_FAILURE;
+    init_instance(&cpus[i], memories[i]);
+    run_cycles(&cpus[i], STATES_CYCLES);
+  }
+  for (int i = 0; i < STATES_BATCH; i++)
+    free(memories[i]);
+  fclose(stream);
+  elapsed = now_seconds() - start;
+  printf("fread batch: %8.2f ms for %d instances\n", elapsed * 1e3,
+         STATES_BATCH);
+
+  remove(STATES_PATH);
+  return EXIT_SUCCESS;
+}
+
+// Codec benchmark. Snapshots are captured every interval cycles of a rom and
+// every CODEC_KEYFRAME_INTERVAL snapshot is a keyframe, the others are encoded
+// against the previous keyframe.
+#define CODEC_SNAPSHOTS 64
+#define CODEC_KEYFRAME_INTERVAL 16
+#define CODEC_DECODE_REPEAT 50
+
+static uint8_t s_codec_images[CODEC_SNAPSHOTS][MEMORY_TOTAL];
+
+static const uint8_t *codec_keyframe(int snapshot) {
+  if (snapshot % CODEC_KEYFRAME_INTERVAL == 0)
+    return NULL;
+  return s_codec_images[snapshot - snapshot % CODEC_KEYFRAME_INTERVAL];
+}
+
+static int bench_codec_rom(const char *filename, uint64_t interval) {
+  if (!load_rom(filename))
+    return EXIT_FAILURE;
+
+  static adc_8080_cpu cpus[CODEC_SNAPSHOTS];
+  static uint8_t snapshots[CODEC_SNAPSHOTS][ADC_8080_CODEC_MAX_SIZE];
+  static size_t sizes[CODEC_SNAPSHOTS];
+
+  adc_8080_cpu cpu;
+  adc_8080_cpu_init(&cpu);
+  cpu.userdata = &cpu;
+  cpu.read_byte = handle_memory_read;
+  cpu.write_byte = handle_memory_write;
+  cpu.read_device = handle_device_read;
+  cpu.write_device = handle_device_write;
+  cpu.pc = 0x100;
+
+  int count = 0;
+  s_done = false;
+  while (count < CODEC_SNAPSHOTS && !s_done) {
+    memcpy(s_codec_images[count], s_memory, MEMORY_TOTAL);
+    cpus[count++] = cpu;
+    uint64_t end = cpu.cycle_count + interval;
+    while (cpu.cycle_count < end && !s_done)
+      adc_8080_cpu_step(&cpu);
+  }
+
+  size_t encoded = 0;
+  double start = now_seconds();
+  for (int i = 0; i < count; i++) {
+    sizes[i] = adc_8080_codec_encode(&cpus[i], s_codec_images[i], codec_keyframe(i),
+                                     snapshots[i], ADC_8080_CODEC_MAX_SIZE);
+    encoded += sizes[i];
+  }
+  double encode_elapsed = now_seconds() - start;
+
+  static uint8_t memory[MEMORY_TOTAL];
+  start = now_seconds();
+  for (int r = 0; r < CODEC_DECODE_REPEAT; r++) {
+    for (int i = 0; i < count; i++) {
+      adc_8080_codec_decode(&cpu, memory, codec_keyframe(i), snapshots[i],
+                            sizes[i]);
+    }
+  }
+  double decode_elapsed = now_seconds() - start;
+
+  bool match = true;
+  for (int i = 0; i < count; i++) {
+    adc_8080_codec_decode(&cpu, memory, codec_keyframe(i), snapshots[i], sizes[i]);
+    match = match && cpu.pc == cpus[i].pc &&
+            memcmp(memory, s_codec_images[i], MEMORY_TOTAL) == 0;
+  }
+
+  size_t raw = (size_t)count * (ADC_8080_CPU_STATE_SIZE + MEMORY_TOTAL);
+  printf("%-17s %2d snapshots %8zu -> %6zu bytes (%5.1fx) encode %7.1f MB/s "
+         "decode %5.2f GB/s%s\n",
+         filename, count, raw, encoded, (double)raw / encoded,
+         raw / encode_elapsed / 1e6,
+         raw * (double)CODEC_DECODE_REPEAT / decode_elapsed / 1e9,
+         match ? "" : " MISMATCH");
+  return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int bench_codec(void) {
+  int result = EXIT_SUCCESS;
+  if (bench_codec_rom("roms/TST8080.COM", 100) != EXIT_SUCCESS)
+    result = EXIT_FAILURE;
+  if (bench_codec_rom("roms/8080PRE.COM", 200) != EXIT_SUCCESS)
+    result = EXIT_FAILURE;
+  if (bench_codec_rom("roms/CPUTEST.COM", 4000000) != EXIT_SUCCESS)
+    result = EXIT_FAILURE;
+  if (bench_codec_rom("roms/8080EXM.COM", 10000000) != EXIT_SUCCESS)
+    result = EXIT_FAILURE;
+  return result;
+}
+
+// Trace benchmark.
+#define TRACE_RECORDS 1000000
+#define TRACE_PRINT_STEPS 200000
+#define TRACE_DUMP_RECORDS 8
+
+static int bench_trace(void) {
+  if (!load_rom("roms/8080EXM.COM"))
+    return EXIT_FAILURE;
+
+  static uint8_t rom_image[MEMORY_TOTAL];
+  memcpy(rom_image, s_memory, MEMORY_TOTAL);
+
+  adc_8080_cpu_trace_record *records =
+      malloc(TRACE_RECORDS * sizeof(adc_8080_cpu_trace_record));
+  if (!records)
+    return EXIT_FAILURE;
+
+  printf("untraced:    ");
+  bench_exm_section(rom_image, 1, NULL, NULL, NULL, NULL);
+
+  adc_8080_cpu_trace trace = {.records = records, .capacity = TRACE_RECORDS};
+  printf("traced:      ");
+  bench_exm_section(rom_image, 1, &trace, NULL, NULL, NULL);
+
+  // Baseline, text formatting of every step.
+  FILE *null = fopen("/dev/null", "w");
+  if (!null)
+    return EXIT_FAILURE;
+  memcpy(s_memory, rom_image, MEMORY_TOTAL);
+  select_exm_section(rom_image + EXM_TESTS_ADDR, 1);
+  adc_8080_cpu cpu;
+  adc_8080_cpu_init(&cpu);
+  cpu.userdata = &cpu;
+  cpu.read_byte = handle_memory_read;
+  cpu.write_byte = handle_memory_write;
+  cpu.read_device = handle_device_read;
+  cpu.write_device = handle_device_write;
+  cpu.pc = 0x100;
+  double start = now_seconds();
+  for (int i = 0; i < TRACE_PRINT_STEPS; i++) {
+    adc_8080_cpu_print(&cpu, null);
+    adc_8080_cpu_step(&cpu);
+  }
+  double elapsed = now_seconds() - start;
+  fclose(null);
+  printf("cpu_print:   %12llu cycles %8.3f s %8.2f MHz\n",
+         (unsigned long long)cpu.cycle_count, elapsed,
+         cpu.cycle_count / elapsed / 1e6);
+
+  printf("last %d of %llu records:\n", TRACE_DUMP_RECORDS,
+         (unsigned long long)trace.total);
+  char line[128];
+  size_t count = adc_8080_cpu_trace_count(&trace);
+  for (size_t i = count - TRACE_DUMP_RECORDS; i < count; i++) {
+    adc_8080_trace_format(adc_8080_cpu_trace_get(&trace, i), line,
+                          sizeof(line));
+    printf("%s\n", line);
+  }
+
+  free(records);
+  return EXIT_SUCCESS;
+}
+
+// Profile benchmark.
+#define PROFILE_TOP_STACKS 10
+
+static int bench_profile(void) {
+  if (!load_rom("roms/8080EXM.COM"))
+    return EXIT_FAILURE;
+
+  static uint8_t rom_image[MEMORY_TOTAL];
+  memcpy(rom_image, s_memory, MEMORY_TOTAL);
+
+  adc_8080_profiler *profiler = adc_8080_profiler_new();
+  if (!profiler)
+    return EXIT_FAILURE;
+  int symbols = adc_8080_profiler_load_symbols(profiler, "roms/8080EXM.PRN");
+  if (symbols < 0) {
+    fprintf(stderr, "Failed to load roms/8080EXM.PRN!\n");
+    adc_8080_profiler_free(&profiler);
+    return EXIT_FAILURE;
+  }
+
+  printf("unprofiled:  ");
+  bench_exm_section(rom_image, 1, NULL, NULL, NULL, NULL);
+  printf("profiled:    ");
+  bench_exm_section(rom_image, 1, NULL, profiler, NULL, NULL);
+
+  const char *path = "build/8080EXM.folded";
+  FILE *file = fopen(path, "w");
+  bool written = file && adc_8080_profiler_write_folded(profiler, file);
+  if (file && fclose(file) != 0)
+    written = false;
+  if (!written) {
+    fprintf(stderr, "Failed to write %s!\n", path);
+    adc_8080_profiler_free(&profiler);
+    return EXIT_FAILURE;
+  }
+
+  printf("%llu samples every %d cycles, %d symbols, written to %s\n",
+         (unsigned long long)adc_8080_profiler_samples(profiler),
+         PROFILE_INTERVAL, symbols, path);
+  printf("first %d stacks:\n", PROFILE_TOP_STACKS);
+  file = fopen(path, "r");
+  char line[512];
+  for (int i = 0;
+       file && i < PROFILE_TOP_STACKS && fgets(line, sizeof(line), file); i++)
+    printf("  %s", line);
+  if (file)
+    fclose(file);
+
+  adc_8080_profiler_free(&profiler);
+  return EXIT_SUCCESS;
+}
+
+// Breakpoint benchmark. The host baseline compares the pc against a list of
+// breakpoints after every step and calls a condition on a match, the usual
+// way of debugging a step loop.
+#define DEBUG_BREAKPOINTS 16
+#define DEBUG_CONDITION "hl == 0xFFFF && a == 0x42"
+
+static bool host_condition(const adc_8080_cpu *cpu) {
+  return ((cpu->rh << 8) | cpu->rl) == 0xFFFF && cpu->ra == 0x42;
+}
+
+static int bench_debug(void) {
+  if (!load_rom("roms/8080EXM.COM"))
+    return EXIT_FAILURE;
+
+  static uint8_t rom_image[MEMORY_TOTAL];
+  memcpy(rom_image, s_memory, MEMORY_TOTAL);
+
+  static adc_8080_cpu_debug debug;
+  uint8_t code[ADC_8080_CPU_COND_SIZE];
+  size_t size = adc_8080_cond_compile(DEBUG_CONDITION, code, sizeof(code),
+                                      NULL);
+  adc_8080_cpu_debug_init(&debug);
+  if (size == 0 ||
+      !adc_8080_cpu_debug_break_if(&debug, EXM_TLP_ADDR, code, size))
+    return EXIT_FAILURE;
+
+  // The test loop plus breakpoints that are never hit.
+  uint16_t breakpoints[DEBUG_BREAKPOINTS] = {EXM_TLP_ADDR};
+  for (int i = 1; i < DEBUG_BREAKPOINTS; i++) {
+    breakpoints[i] = (uint16_t)(0xF000 + i);
+    adc_8080_cpu_debug_break(&debug, breakpoints[i], true);
+  }
+
+  printf("step:        ");
+  bench_exm_section(rom_image, 1, NULL, NULL, NULL, NULL);
+  printf("run:         ");
+  bench_exm_section(rom_image, 1, NULL, NULL, &debug, NULL);
+
+  memcpy(s_memory, rom_image, MEMORY_TOTAL);
+  select_exm_section(rom_image + EXM_TESTS_ADDR, 1);
+  adc_8080_cpu cpu;
+  adc_8080_cpu_init(&cpu);
+  cpu.userdata = &cpu;
+  cpu.read_byte = handle_memory_read;
+  cpu.write_byte = handle_memory_write;
+  cpu.read_device = handle_device_read;
+  cpu.write_device = handle_device_write;
+  cpu.pc = 0x100;
+
+  s_done = false;
+  uint64_t cycles = 0, hits = 0;
+  double start = now_seconds();
+  while (!s_done) {
+    cycles += adc_8080_cpu_step(&cpu);
+    for (int i = 0; i < DEBUG_BREAKPOINTS; i++) {
+      if (cpu.pc == breakpoints[i] && host_condition(&cpu))
+        hits++;
+    }
+  }
+  double elapsed = now_seconds() - start;
+  printf("host:        section  1: %12llu cycles %8.3f s %8.2f MHz\n",
+         (unsigned long long)cycles, elapsed, cycles / elapsed / 1e6);
+  printf("'%s' evaluated %llu times at 0x%04X\n", DEBUG_CONDITION,
+         (unsigned long long)debug.conditions[0].hits, EXM_TLP_ADDR);
+
+  return hits == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Coverage benchmark.
+static int bench_coverage(void) {
+  if (!load_rom("roms/8080EXM.COM"))
+    return EXIT_FAILURE;
+
+  static uint8_t rom_image[MEMORY_TOTAL];
+  memcpy(rom_image, s_memory, MEMORY_TOTAL);
+
+  static adc_8080_cpu_coverage coverage;
+  adc_8080_coverage_clear(&coverage);
+
+  printf("uncovered:   ");
+  bench_exm_section(rom_image, 1, NULL, NULL, NULL, NULL);
+  printf("covered:     ");
+  bench_exm_section(rom_image, 1, NULL, NULL, NULL, &coverage);
+
+  const char *path = "build/8080EXM.coverage";
+  if (!adc_8080_coverage_save(&coverage, path)) {
+    fprintf(stderr, "Failed to write %s!\n", path);
+    return EXIT_FAILURE;
+  }
+
+  size_t opcodes, operands;
+  size_t total = adc_8080_coverage_count(&coverage, &opcodes, &operands);
+  FILE *file = fopen(path, "rb");
+  long size = -1;
+  if (file && fseek(file, 0, SEEK_END) == 0)
+    size = ftell(file);
+  if (file)
+    fclose(file);
+
+  printf("%zu addresses covered, %zu opcodes, %zu operands\n", total, opcodes,
+         operands);
+  printf("%ld bytes written to %s\n", size, path);
+  return EXIT_SUCCESS;
+}
+
+// Pc trace benchmark.
+#define PCTRACE_EXM_CYCLES 2000000000ull
+
+static void init_rom_cpu(adc_8080_cpu *cpu) {
+  adc_8080_cpu_init(cpu);
+  cpu->userdata = cpu;
+  cpu->read_byte = handle_memory_read;
+  cpu->write_byte = handle_memory_write;
+  cpu->read_device = handle_device_read;
+  cpu->write_device = handle_device_write;
+  cpu->pc = 0x100;
+}
+
+static int bench_pctrace_rom(const char *filename, uint64_t max_cycles) {
+  if (!load_rom(filename))
+    return EXIT_FAILURE;
+
+  static uint8_t rom_image[MEMORY_TOTAL];
+  memcpy(rom_image, s_memory, MEMORY_TOTAL);
+
+  adc_8080_cpu cpu;
+  init_rom_cpu(&cpu);
+  s_done = false;
+  double start = now_seconds();
+  while (!s_done && cpu.cycle_count < max_cycles)
+    adc_8080_cpu_step(&cpu);
+  double untraced = now_seconds() - start;
+
+  const char *path = "build/bench.pctrace";
+  FILE *file = fopen(path, "w+b");
+  adc_8080_pctrace_writer *writer =
+      file ? adc_8080_pctrace_writer_new(file) : NULL;
+  if (!writer) {
+    fprintf(stderr, "Failed to create %s!\n", path);
+    if (file)
+      fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  memcpy(s_memory, rom_image, MEMORY_TOTAL);
+  init_rom_cpu(&cpu);
+  s_done = false;
+  start = now_seconds();
+  adc_8080_pctrace_writer_attach(writer, &cpu);
+  while (!s_done && cpu.cycle_count < max_cycles)
+    adc_8080_cpu_step(&cpu);
+  bool match = adc_8080_pctrace_writer_detach(writer, &cpu);
+  double traced = now_seconds() - start;
+  uint64_t instructions = adc_8080_pctrace_writer_instructions(writer);
+  uint64_t size = adc_8080_pctrace_writer_size(writer);
+  adc_8080_pctrace_writer_free(&writer);
+
+  // Replay in lockstep with a new run, so code changed by the rom is read as
+  // it was executed.
+  memcpy(s_memory, rom_image, MEMORY_TOTAL);
+  init_rom_cpu(&cpu);
+  s_done = false;
+  rewind(file);
+  adc_8080_pctrace_reader *reader =
+      adc_8080_pctrace_reader_new(file, s_memory);
+  adc_8080_pctrace_event event;
+  uint64_t replayed = 0;
+  while (match && reader && adc_8080_pctrace_reader_next(reader, &event)) {
+    match = event.pc == cpu.pc && !event.interrupt;
+    adc_8080_cpu_step(&cpu);
+    replayed++;
+  }
+  match = match && reader && !adc_8080_pctrace_reader_error(reader) &&
+          replayed == instructions;
+  adc_8080_pctrace_reader_free(&reader);
+  fclose(file);
+  remove(path);
+
+  printf("%-17s %11llu instructions %10llu bytes %6.3f bytes/instruction "
+         "%7.2f -> %7.2f MHz%s\n",
+         filename, (unsigned long long)instructions, (unsigned long long)size,
+         (double)size / instructions, cpu.cycle_count / untraced / 1e6,
+         cpu.cycle_count / traced / 1e6, match ? "" : " MISMATCH");
+  return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int bench_pctrace(void) {
+  int result = EXIT_SUCCESS;
+  if (bench_pctrace_rom("roms/TST8080.COM", UINT64_MAX) != EXIT_SUCCESS)
+    result = EXIT_FAILURE;
+  if (bench_pctrace_rom("roms/8080PRE.COM", UINT64_MAX) != EXIT_SUCCESS)
+    result = EXIT_FAILURE;
+  if (bench_pctrace_rom("roms/CPUTEST.COM", UINT64_MAX) != EXIT_SUCCESS)
+    result = EXIT_FAILURE;
+  if (bench_pctrace_rom("roms/8080EXM.COM", PCTRACE_EXM_CYCLES) !=
+      EXIT_SUCCESS)
+    result = EXIT_FAILURE;
+  return result;
+}
+
+// Run statistics benchmark.
+#define STATS_INTERVAL 100000
+#define STATS_GUEST_HZ 2000000.0
+
+static int bench_stats(void) {
+  if (!load_rom("roms/8080EXM.COM"))
+    return EXIT_FAILURE;
+
+  static uint8_t rom_image[MEMORY_TOTAL];
+  memcpy(rom_image, s_memory, MEMORY_TOTAL);
+
+  printf("no stats:    ");
+  bench_exm_section(rom_image, 1, NULL, NULL, NULL, NULL);
+
+  memcpy(s_memory, rom_image, MEMORY_TOTAL);
+  select_exm_section(rom_image + EXM_TESTS_ADDR, 1);
+  adc_8080_cpu cpu;
+  init_rom_cpu(&cpu);
+  adc_8080_cpu_stats stats;
+  adc_8080_cpu_stats_attach(&cpu, &stats, STATS_INTERVAL, now_ns);
+
+  s_done = false;
+  double start = now_seconds();
+  while (!s_done)
+    adc_8080_cpu_step(&cpu);
+  double elapsed = now_seconds() - start;
+  printf("stats:       section  1: %12llu cycles %8.3f s %8.2f MHz\n",
+         (unsigned long long)cpu.cycle_count, elapsed,
+         cpu.cycle_count / elapsed / 1e6);
+
+  adc_8080_cpu_stats_summary summary;
+  adc_8080_cpu_stats_query(&cpu, STATS_GUEST_HZ, &summary);
+  adc_8080_cpu_stats_detach(&cpu);
+  printf("%llu instructions, %llu interrupts, %llu halted steps\n",
+         (unsigned long long)summary.instructions,
+         (unsigned long long)stats.interrupts,
+         (unsigned long long)stats.halted_steps);
+  printf("%.2f MHz %.2f MIPS, %.0f host ns per guest second at 2 MHz, "
+         "%.1fx real time\n",
+         summary.mhz, summary.mips, summary.host_ns_per_guest_second,
+         summary.realtime);
+  printf("host time: core %.1f%% memory %.1f%% device %.1f%% outside %.1f%% "
+         "(%llu steps timed)\n",
+         summary.core * 100, summary.memory * 100, summary.device * 100,
+         summary.outside * 100,
+         (unsigned long long)(stats.window_steps + stats.handler_steps));
+  return EXIT_SUCCESS;
+}
+
+// Guest fuzzing benchmark. The guest reads port 1 until it reads "FUZZ",
+// then an index byte and jumps through a table at FUZZ_TABLE_ADDR: 0 back to
+// the start, 1 to a loop that never reads again and anything else past the
+// end of the table to address 0, outside of the code.
+#define FUZZ_CODE_ADDR 0x0100
+#define FUZZ_TABLE_ADDR 0x0140
+#define FUZZ_STACK_ADDR 0x0200
+#define FUZZ_CYCLES 10000
+#define FUZZ_CASES 1000000
+#define FUZZ_PERSISTENT 100
+#define FUZZ_WORKERS 2
+// Cases between syncs with the other workers.
+#define FUZZ_SYNC_CASES 50000
+#define FUZZ_CORPUS_DIR "build/fuzz_corpus"
+
+static const uint8_t s_fuzz_code[] = {
+    // loop:
+    0xDB, 0x01, 0xFE, 'F', 0xC2, 0x00, 0x01, // in 1, cpi 'F', jnz loop
+    0xDB, 0x01, 0xFE, 'U', 0xC2, 0x00, 0x01, // in 1, cpi 'U', jnz loop
+    0xDB, 0x01, 0xFE, 'Z', 0xC2, 0x00, 0x01, // in 1, cpi 'Z', jnz loop
+    0xDB, 0x01, 0xFE, 'Z', 0xC2, 0x00, 0x01, // in 1, cpi 'Z', jnz loop
+    0xDB, 0x01,                              // in 1
+    0x87, 0x5F, 0x16, 0x00,                  // add a, mov e,a, mvi d,0
+    0x21, 0x40, 0x01, 0x19,                  // lxi h,table, dad d
+    0x5E, 0x23, 0x56, 0xEB, 0xE9,            // mov e,m, inx h, mov d,m,
+                                             // xchg, pchl
+    // spin:
+    0xC3, 0x2B, 0x01, // jmp spin
+};
+static const uint8_t s_fuzz_table[] = {0x00, 0x01, 0x2B, 0x01};
+
+static void fuzz_failure(void *userdata, enum adc_8080_fuzzer_outcome outcome,
+                         const uint8_t *input, size_t size) {
+  printf("  %s: %-8s", (const char *)userdata,
+         adc_8080_fuzzer_outcome_name(outcome));
+  for (size_t i = 0; i < size; i++)
+    printf(" %02X", input[i]);
+  printf("\n");
+}
+
+static void fuzz_config_init(adc_8080_fuzzer_config *config,
+                             const char *worker, uint32_t persistent) {
+  adc_8080_fuzzer_config_init(config);
+  config->cycles = FUZZ_CYCLES;
+  memset(config->ports, 0, sizeof(config->ports));
+  config->ports[0] = 1u << 1;
+  config->code_start = FUZZ_CODE_ADDR;
+  config->code_end = FUZZ_TABLE_ADDR - 1;
+  config->stack_start = FUZZ_CODE_ADDR;
+  config->stack_end = FUZZ_STACK_ADDR;
+  config->persistent = persistent;
+  config->max_input = 64;
+  config->worker = worker;
+  config->failure = fuzz_failure;
+  config->userdata = (void *)worker;
+}
+
+static void fuzz_report(const char *name, adc_8080_fuzzer *fuzzer,
+                        double elapsed) {
+  adc_8080_fuzzer_stats stats;
+  adc_8080_fuzzer_get_stats(fuzzer, &stats);
+  printf("%-12s %10.0f cases/s, %llu edges, %llu corpus (%llu imported), "
+         "%llu failures, %llu unstable\n",
+         name, stats.cases / elapsed, (unsigned long long)stats.edges,
+         (unsigned long long)stats.corpus, (unsigned long long)stats.imported,
+         (unsigned long long)stats.failures,
+         (unsigned long long)stats.unstable);
+  printf("  outcomes:");
+  for (int i = 0; i < ADC_8080_FUZZER_OUTCOMES; i++)
+    printf(" %s %llu", adc_8080_fuzzer_outcome_name(i),
+           (unsigned long long)stats.outcomes[i]);
+  printf("\n");
+}
+
+static int fuzz_in_process(const char *name, const adc_8080_cpu *cpu,
+                           uint32_t persistent) {
+  adc_8080_fuzzer_config config;
+  fuzz_config_init(&config, name, persistent);
+  adc_8080_fuzzer *fuzzer = adc_8080_fuzzer_new(&config, cpu, s_memory);
+  if (!fuzzer) {
+    fprintf(stderr, "Failed to create the fuzzer!\n");
+    return EXIT_FAILURE;
+  }
+
+  double start = now_seconds();
+  adc_8080_fuzzer_fuzz(fuzzer, FUZZ_CASES);
+  fuzz_report(name, fuzzer, now_seconds() - start);
+  adc_8080_fuzzer_free(&fuzzer);
+  return EXIT_SUCCESS;
+}
+
+static int fuzz_worker(const char *name, uint64_t seed,
+                       const adc_8080_cpu *cpu) {
+  adc_8080_fuzzer_config config;
+  fuzz_config_init(&config, name, 0);
+  config.seed = seed;
+  config.corpus_dir = FUZZ_CORPUS_DIR;
+  adc_8080_fuzzer *fuzzer = adc_8080_fuzzer_new(&config, cpu, s_memory);
+  if (!fuzzer) {
+    fprintf(stderr, "Failed to create the fuzzer!\n");
+    return EXIT_FAILURE;
+  }
+
+  double start = now_seconds();
+  for (int i = 0; i < FUZZ_CASES / FUZZ_SYNC_CASES; i++) {
+    adc_8080_fuzzer_fuzz(fuzzer, FUZZ_SYNC_CASES);
+    adc_8080_fuzzer_sync(fuzzer);
+  }
+  fuzz_report(name, fuzzer, now_seconds() - start);
+  adc_8080_fuzzer_free(&fuzzer);
+  return EXIT_SUCCESS;
+}
+
+// Remove the files of a directory, subdirectories are left as is.
+static void clear_dir(const char *path) {
+  DIR *dir = opendir(path);
+  if (!dir)
+    return;
+  struct dirent *entry;
+  char file[512];
+  while ((entry = readdir(dir))) {
+    int length = snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+    if (entry->d_name[0] != '.' && length > 0 && length < (int)sizeof(file))
+      remove(file);
+  }
+  closedir(dir);
+}
+
+static int bench_fuzz(void) {
+  memset(s_memory, 0, MEMORY_TOTAL);
+  memcpy(s_memory + FUZZ_CODE_ADDR, s_fuzz_code, sizeof(s_fuzz_code));
+  memcpy(s_memory + FUZZ_TABLE_ADDR, s_fuzz_table, sizeof(s_fuzz_table));
+  adc_8080_cpu cpu;
+  adc_8080_cpu_init(&cpu);
+  cpu.pc = FUZZ_CODE_ADDR;
+  cpu.sp = FUZZ_STACK_ADDR;
+
+  if (fuzz_in_process("restore", &cpu, 0) != EXIT_SUCCESS ||
+      fuzz_in_process("persistent", &cpu, FUZZ_PERSISTENT) != EXIT_SUCCESS)
+    return EXIT_FAILURE;
+
+  clear_dir(FUZZ_CORPUS_DIR "/crashes");
+  clear_dir(FUZZ_CORPUS_DIR);
+  fflush(stdout);
+  pid_t pids[FUZZ_WORKERS];
+  for (int i = 0; i < FUZZ_WORKERS; i++) {
+    pids[i] = fork();
+    if (pids[i] < 0) {
+      fprintf(stderr, "Failed to fork() worker %d!\n", i);
+      return EXIT_FAILURE;
+    }
+    if (pids[i] == 0) {
+      char name[16];
+      snprintf(name, sizeof(name), "worker%d", i);
+      int result = fuzz_worker(name, (uint64_t)i + 1, &cpu);
+      fflush(stdout);
+      _exit(result);
+    }
+  }
+
+  int result = EXIT_SUCCESS;
+  for (int i = 0; i < FUZZ_WORKERS; i++) {
+    int status;
+    if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != EXIT_SUCCESS)
+      result = EXIT_FAILURE;
+  }
+  return result;
+}
+
+// Benchmark suite. Every workload runs headless with its output discarded,
+// once to warm up and then for the timed trials. A trial runs the workload
+// reps times from a fresh copy of its memory and only the steps are timed.
+#define SUITE_TRIALS 5
+#define SUITE_MAX_TRIALS 100
+// Slowdown of the ns per instruction in percent flagged as a regression.
+#define SUITE_THRESHOLD 5.0
+#define SUITE_NAME_SIZE 32
+#define SUITE_LINE_SIZE 512
+
+// ALU kernel: 65536 iterations of arithmetic, logic and rotate instructions.
+static const uint8_t s_suite_alu_kernel[] = {
+    0x01, 0x00, 0x00,                   // lxi b,0
+    0x3E, 0x5A, 0x16, 0x33, 0x1E, 0xC3, // mvi a,5ah, mvi d,33h, mvi e,0c3h
+    // loop:
+    0x82, 0x8B, 0x92, 0x9B,             // add d, adc e, sub d, sbb e
+    0xA2, 0xB3, 0xAA, 0xBB,             // ana d, ora e, xra d, cmp e
+    0x27, 0x07, 0x1F,                   // daa, rlc, rar
+    0xC6, 0x11, 0xEE, 0x0F,             // adi 11h, xri 0fh
+    0x0B, 0x67, 0x78, 0xB1, 0x7C,       // dcx b, mov h,a, mov a,b, ora c,
+                                        // mov a,h
+    0xC2, 0x09, 0x01,                   // jnz loop
+    0xD3, 0x00,                         // out 0
+};
+
+// Memory kernel: 256 passes of loads, stores, read-modify-writes and stack
+// operations over a 256 byte block.
+static const uint8_t s_suite_memory_kernel[] = {
+    0x31, 0x00, 0xF0, // lxi sp,0f000h
+    0x0E, 0x00,       // mvi c,0
+    // outer:
+    0x21, 0x00, 0x20, // lxi h,2000h
+    0x11, 0x00, 0x30, // lxi d,3000h
+    0x06, 0x00,       // mvi b,0
+    // inner:
+    0x7E, 0x12, 0x23, 0x13, // mov a,m, stax d, inx h, inx d
+    0xE5, 0x1A, 0x77, 0xE1, // push h, ldax d, mov m,a, pop h
+    0x34, 0x05,             // inr m, dcr b
+    0xC2, 0x0D, 0x01,       // jnz inner
+    0x0D,                   // dcr c
+    0xC2, 0x05, 0x01,       // jnz outer
+    0xD3, 0x00,             // out 0
+};
+
+// Branch kernel: 65536 iterations of taken and not taken jumps, calls and
+// returns.
+static const uint8_t s_suite_branch_kernel[] = {
+    0x31, 0x00, 0xF0, // lxi sp,0f000h
+    0x01, 0x00, 0x00, // lxi b,0
+    // loop:
+    0x79, 0xE6, 0x01, // mov a,c, ani 1
+    0xCA, 0x0F, 0x01, // jz even
+    0xCD, 0x1D, 0x01, // call sub
+    // even:
+    0x79, 0xE6, 0x02, // mov a,c, ani 2
+    0xC4, 0x1D, 0x01, // cnz sub
+    0x0B, 0x78, 0xB1, // dcx b, mov a,b, ora c
+    0xC2, 0x06, 0x01, // jnz loop
+    0xD3, 0x00,       // out 0
+    // sub:
+    0x79, 0xE6, 0x04, // mov a,c, ani 4
+    0xC8, 0x3C, 0xC9, // rz, inr a, ret
+};
+
+typedef struct {
+  const char *name;
+  // Test rom to run, or NULL to run the kernel.
+  const char *rom;
+  // 8080EXM section to run, or -1 for the whole rom.
+  int section;
+  const uint8_t *kernel;
+  size_t kernel_size;
+  int reps;
+} suite_workload;
+
+static const suite_workload s_suite_workloads[] = {
+    {"TST8080", "roms/TST8080.COM", -1, NULL, 0, 20000},
+    {"CPUTEST", "roms/CPUTEST.COM", -1, NULL, 0, 1},
+    {"8080PRE", "roms/8080PRE.COM", -1, NULL, 0, 10000},
+    {"8080EXM aluop nn", "roms/8080EXM.COM", 1, NULL, 0, 1},
+    {"8080EXM inr,dcr a", "roms/8080EXM.COM", 4, NULL, 0, 1},
+    {"8080EXM mov", "roms/8080EXM.COM", 21, NULL, 0, 1},
+    {"alu kernel", NULL, -1, s_suite_alu_kernel, sizeof(s_suite_alu_kernel),
+     20},
+    {"memory kernel", NULL, -1, s_suite_memory_kernel,
+     sizeof(s_suite_memory_kernel), 20},
+    {"branch kernel", NULL, -1, s_suite_branch_kernel,
+     sizeof(s_suite_branch_kernel), 20},
+};
+
+#define SUITE_WORKLOADS                                                        \
+  (int)(sizeof(s_suite_workloads) / sizeof(s_suite_workloads[0]))
+
+typedef struct {
+  // Per trial.
+  uint64_t instructions;
+  uint64_t cycles;
+  // Median ns per instruction of the trials, and its spread.
+  double ns_per_instruction;
+  double stddev;
+  double cv;
+  // Ns per instruction of the fastest trial, which other load on the host
+  // disturbs the least, and of the fastest trial of the baseline, 0 if it
+  // has no such workload.
+  double min;
+  double baseline;
+  double change;
+  bool regression;
+} suite_result;
+
+typedef struct {
+  char name[SUITE_NAME_SIZE];
+  double min;
+} suite_baseline;
+
+static bool suite_load_image(const suite_workload *workload,
+                             uint8_t *image) {
+  if (workload->rom) {
+    if (!load_rom(workload->rom))
+      return false;
+    if (workload->section >= 0) {
+      static uint8_t rom_image[MEMORY_TOTAL];
+      memcpy(rom_image, s_memory, MEMORY_TOTAL);
+      select_exm_section(rom_image + EXM_TESTS_ADDR, workload->section);
+    }
+  } else {
+    memset(s_memory, 0, MEMORY_TOTAL);
+    memcpy(s_memory + 0x100, workload->kernel, workload->kernel_size);
+  }
+  memcpy(image, s_memory, MEMORY_TOTAL);
+  return true;
+}
+
+// Run a trial of a workload.
+//
+// Returns the host ns spent stepping.
+static uint64_t suite_trial(const suite_workload *workload,
+                            const uint8_t *image, uint64_t *instructions,
+                            uint64_t *cycles) {
+  uint64_t ns = 0;
+  *instructions = 0;
+  *cycles = 0;
+  for (int rep = 0; rep < workload->reps; rep++) {
+    memcpy(s_memory, image, MEMORY_TOTAL);
+    adc_8080_cpu cpu;
+    init_rom_cpu(&cpu);
+    s_done = false;
+    uint64_t steps = 0;
+    uint64_t start = now_ns();
+    while (!s_done) {
+      adc_8080_cpu_step(&cpu);
+      steps++;
+    }
+    ns += now_ns() - start;
+    *instructions += steps;
+    *cycles += cpu.cycle_count;
+  }
+  return ns;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Set the median, fastest trial and spread of the ns per instruction of the
+// trials, the samples are sorted.
+static void suite_summarize(double *samples, int trials,
+                            suite_result *result) {
+  double mean = 0, variance = 0;
+  for (int i = 0; i < trials; i++)
+    mean += samples[i] / trials;
+  for (int i = 0; i < trials; i++)
+    variance += (samples[i] - mean) * (samples[i] - mean);
+  variance = trials > 1 ? variance / (trials - 1) : 0;
+
+  qsort(samples, trials, sizeof(double), compare_doubles);
+  result->ns_per_instruction =
+      trials % 2 ? samples[trials / 2]
+                 : (samples[trials / 2 - 1] + samples[trials / 2]) / 2;
+  result->min = samples[0];
+  result->stddev = sqrt(variance);
+  result->cv = result->stddev / mean;
+}
+
+// Run the warmup and the timed trials of every workload. Trials are run in
+// rounds of every workload so a burst of other load on the host slows one
+// trial of each rather than every trial of one.
+static bool suite_run(int trials, suite_result *results) {
+  static uint8_t images[SUITE_WORKLOADS][MEMORY_TOTAL];
+  for (int i = 0; i < SUITE_WORKLOADS; i++) {
+    if (!suite_load_image(&s_suite_workloads[i], images[i]))
+      return false;
+  }
+
+  static double samples[SUITE_WORKLOADS][SUITE_MAX_TRIALS];
+  for (int round = -1; round < trials; round++) {
+    for (int i = 0; i < SUITE_WORKLOADS; i++) {
+      suite_result *r = &results[i];
+      uint64_t ns = suite_trial(&s_suite_workloads[i], images[i],
+                                &r->instructions, &r->cycles);
+      if (round >= 0)
+        samples[i][round] = (double)ns / (double)r->instructions;
+    }
+  }
+
+  for (int i = 0; i < SUITE_WORKLOADS; i++)
+    suite_summarize(samples[i], trials, &results[i]);
+  return true;
+}
+
+// Read the fastest trial of the workloads of a results file, one workload
+// per line as written by suite_write_json().
+//
+// Returns the number of workloads read, or -1 if the file can not be read.
+static int suite_read_baseline(const char *path, suite_baseline *baseline,
+                               int max) {
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return -1;
+
+  int count = 0;
+  char line[SUITE_LINE_SIZE];
+  while (count < max && fgets(line, sizeof(line), file)) {
+    const char *name = strstr(line, "\"name\": \"");
+    const char *min = strstr(line, "\"min\": ");
+    if (!name || !min)
+      continue;
+    name += strlen("\"name\": \"");
+    size_t length = strcspn(name, "\"");
+    if (length >= SUITE_NAME_SIZE)
+      continue;
+    memcpy(baseline[count].name, name, length);
+    baseline[count].name[length] = '\0';
+    baseline[count].min = strtod(min + strlen("\"min\": "), NULL);
+    if (baseline[count].min > 0)
+      count++;
+  }
+  fclose(file);
+  return count;
+}
+
+static void suite_write_json(FILE *file, const suite_result *results,
+                             int trials, double threshold) {
+  fprintf(file, "{\n");
+  fprintf(file, "  \"suite\": 1,\n");
+#ifdef ADC_8080_CPU_ALU_TABLES
+  fprintf(file, "  \"alu\": \"tables\",\n");
+#else
+  fprintf(file, "  \"alu\": \"arithmetic\",\n");
+#endif
+  fprintf(file, "  \"trials\": %d,\n", trials);
+  fprintf(file, "  \"threshold\": %.1f,\n", threshold);
+  fprintf(file, "  \"workloads\": [\n");
+  for (int i = 0; i < SUITE_WORKLOADS; i++) {
+    const suite_result *r = &results[i];
+    fprintf(file,
+            "    {\"name\": \"%s\", \"instructions\": %llu, "
+            "\"cycles\": %llu, \"ns_per_instruction\": %.4f, "
+            "\"mips\": %.2f, \"stddev\": %.4f, \"cv\": %.4f, "
+            "\"min\": %.4f",
+            s_suite_workloads[i].name, (unsigned long long)r->instructions,
+            (unsigned long long)r->cycles, r->ns_per_instruction,
+            1000.0 / r->ns_per_instruction, r->stddev, r->cv, r->min);
+    if (r->baseline > 0)
+      fprintf(file,
+              ", \"baseline\": %.4f, \"change\": %.2f, \"regression\": %s",
+              r->baseline, r->change, r->regression ? "true" : "false");
+    fprintf(file, "}%s\n", i + 1 < SUITE_WORKLOADS ? "," : "");
+  }
+  fprintf(file, "  ]\n");
+  fprintf(file, "}\n");
+}
+
+static int bench_suite(int argc, char *argv[]) {
+  const char *json_path = NULL;
+  const char *baseline_path = NULL;
+  double threshold = SUITE_THRESHOLD;
+  int trials = SUITE_TRIALS;
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--trials") == 0 && i + 1 < argc) {
+      trials = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "Invalid option '%s'!\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (trials < 1 || trials > SUITE_MAX_TRIALS) {
+    fprintf(stderr, "Trials must be 1 to %d!\n", SUITE_MAX_TRIALS);
+    return EXIT_FAILURE;
+  }
+
+  suite_baseline baseline[SUITE_WORKLOADS];
+  int baseline_count = 0;
+  if (baseline_path) {
+    baseline_count =
+        suite_read_baseline(baseline_path, baseline, SUITE_WORKLOADS);
+    if (baseline_count < 0) {
+      fprintf(stderr, "Failed to read the baseline '%s'!\n", baseline_path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  suite_result results[SUITE_WORKLOADS];
+  memset(results, 0, sizeof(results));
+  if (!suite_run(trials, results))
+    return EXIT_FAILURE;
+
+  int regressions = 0;
+  printf("%-24s %14s %10s %8s %8s %9s\n", "workload", "instructions",
+         "ns/instr", "MIPS", "cv", "change");
+  for (int i = 0; i < SUITE_WORKLOADS; i++) {
+    suite_result *r = &results[i];
+
+    for (int j = 0; j < baseline_count; j++) {
+      if (strcmp(baseline[j].name, s_suite_workloads[i].name) == 0) {
+        r->baseline = baseline[j].min;
+        r->change = (r->min / r->baseline - 1) * 100;
+        r->regression = r->change > threshold;
+        regressions += r->regression;
+      }
+    }
+
+    printf("%-24s %14llu %10.4f %8.2f %7.2f%%", s_suite_workloads[i].name,
+           (unsigned long long)r->instructions, r->ns_per_instruction,
+           1000.0 / r->ns_per_instruction, r->cv * 100);
+    if (r->baseline > 0)
+      printf(" %+8.2f%%%s", r->change, r->regression ? " REGRESSION" : "");
+    printf("\n");
+  }
+
+  if (json_path) {
+    FILE *file = fopen(json_path, "w");
+    if (!file) {
+      fprintf(stderr, "Failed to fopen() '%s'!\n", json_path);
+      return EXIT_FAILURE;
+    }
+    suite_write_json(file, results, trials, threshold);
+    if (fclose(file) != 0) {
+      fprintf(stderr, "Failed to write '%s'!\n", json_path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (regressions > 0) {
+    printf("%d workloads slower than the baseline by more than %.1f%%\n",
+           regressions, threshold);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// Rom benchmark, for the programs of 8080_rom_gen.c or any other .COM that
+// ends with a warm boot. Each rom is run like a workload of the suite.
+static int bench_rom(int argc, char *argv[]) {
+  if (argc == 0) {
+    fprintf(stderr, "Usage: 8080_cpu_bench rom <file.COM>...\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%-24s %14s %14s %10s %8s %8s\n", "rom", "instructions", "cycles",
+         "ns/instr", "MIPS", "cv");
+  for (int i = 0; i < argc; i++) {
+    suite_workload workload = {argv[i], argv[i], -1, NULL, 0, 1};
+    static uint8_t image[MEMORY_TOTAL];
+    if (!suite_load_image(&workload, image))
+      return EXIT_FAILURE;
+
+    suite_result result;
+    memset(&result, 0, sizeof(result));
+    double samples[SUITE_TRIALS];
+    for (int trial = -1; trial < SUITE_TRIALS; trial++) {
+      uint64_t ns = suite_trial(&workload, image, &result.instructions,
+                                &result.cycles);
+      if (trial >= 0)
+        samples[trial] = (double)ns / (double)result.instructions;
+    }
+    suite_summarize(samples, SUITE_TRIALS, &result);
+    printf("%-24s %14llu %14llu %10.4f %8.2f %7.2f%%\n", argv[i],
+           (unsigned long long)result.instructions,
+           (unsigned long long)result.cycles, result.ns_per_instruction,
+           1000.0 / result.ns_per_instruction, result.cv * 100);
+  }
+  return EXIT_SUCCESS;
+}
+
+// CP/M benchmark. The program's console is stdin and stdout, so the
+// results go to stderr. Time spent waiting for console input is counted.
+static int bench_cpm(int argc, char *argv[]) {
+  if (argc == 0) {
+    fprintf(stderr, "Usage: 8080_cpu_bench cpm <file.COM> [argument...]\n");
+    return EXIT_FAILURE;
+  }
+
+  memset(s_memory, 0, MEMORY_TOTAL);
+  FILE *file = fopen(argv[0], "rb");
+  if (!file) {
+    fprintf(stderr, "Failed to fopen() '%s'!\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  size_t size =
+      fread(s_memory + 0x100, 1, ADC_8080_BDOS_BASE - 0x100 - 2, file);
+  fclose(file);
+  if (size == 0) {
+    fprintf(stderr, "Failed to read '%s'!\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  char tail[128] = "";
+  for (int i = 1; i < argc; i++) {
+    size_t length = strlen(tail);
+    snprintf(tail + length, sizeof(tail) - length, "%s%s", i > 1 ? " " : "",
+             argv[i]);
+  }
+
+  adc_8080_bdos *bdos = adc_8080_bdos_new(".", stdin, stdout);
+  if (!bdos) {
+    fprintf(stderr, "Failed to create the BDOS!\n");
+    return EXIT_FAILURE;
+  }
+
+  adc_8080_cpu cpu;
+  adc_8080_cpu_init(&cpu);
+  cpu.read_byte = handle_memory_read;
+  cpu.write_byte = handle_memory_write;
+  cpu.read_device = handle_device_read;
+  cpu.write_device = handle_device_write;
+  adc_8080_bdos_setup(bdos, &cpu, tail);
+
+  double start = now_seconds();
+  while (!adc_8080_bdos_exited(bdos))
+    adc_8080_bdos_run(bdos, &cpu, CPM_RUN_CYCLES);
+  double elapsed = now_seconds() - start;
+  uint64_t calls = adc_8080_bdos_calls(bdos);
+  adc_8080_bdos_free(&bdos);
+
+  fprintf(stderr,
+          "\n%s: %llu cycles, %llu BDOS calls, %.3f s, %.2f MHz\n",
+          argv[0], (unsigned long long)cpu.cycle_count,
+          (unsigned long long)calls, elapsed,
+          cpu.cycle_count / elapsed / 1e6);
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc >= 2 && strcmp(argv[1], "fork") == 0)
+    return bench_fork();
+  if (argc >= 2 && strcmp(argv[1], "states") == 0)
+    return bench_states();
+  if (argc >= 2 && strcmp(argv[1], "codec") == 0)
+    return bench_codec();
+  if (argc >= 2 && strcmp(argv[1], "trace") == 0)
+    return bench_trace();
+  if (argc >= 2 && strcmp(argv[1], "profile") == 0)
+    return bench_profile();
+  if (argc >= 2 && strcmp(argv[1], "debug") == 0)
+    return bench_debug();
+  if (argc >= 2 && strcmp(argv[1], "coverage") == 0)
+    return bench_coverage();
+  if (argc >= 2 && strcmp(argv[1], "pctrace") == 0)
+    return bench_pctrace();
+  if (argc >= 2 && strcmp(argv[1], "stats") == 0)
+    return bench_stats();
+  if (argc >= 2 && strcmp(argv[1], "fuzz") == 0)
+    return bench_fuzz();
+  if (argc >= 2 && strcmp(argv[1], "suite") == 0)
+    return bench_suite(argc - 2, argv + 2);
+  if (argc >= 2 && strcmp(argv[1], "rom") == 0)
+    return bench_rom(argc - 2, argv + 2);
+  if (argc >= 2 && strcmp(argv[1], "cpm") == 0)
+    return bench_cpm(argc - 2, argv + 2);
+  if (argc >= 2 && strcmp(argv[1], "exm") == 0)
+    return bench_exm(argc - 2, argv + 2);
+
+  return bench_exm(argc - 1, argv + 1);
+}
@@ -0,0 +1,685 @@
+// Usage: 8080_cpu_fuzz [--seed S] [--cases N] [--steps N] [--jobs N]
+//                      [--case I]
+//
+// Differential fuzzing of the cpu execution engines against the reference,
+// adc_8080_cpu_step() with the arithmetic ALU. A case is a random cpu state,
+// random code bytes at the pc and random data bytes everywhere else, run for
+// a number of instructions with an optional interrupt. The state of every
+// engine is compared with the reference after every instruction, and the
+// first failing case is minimized and printed.
+//
+// --seed S  - Seed of the cases, 1 by default. Case I of a seed is always the
+//             same case.
+// --cases N - Number of cases, FUZZ_CASES by default.
+// --steps N - Instructions per case, FUZZ_STEPS by default, at most
+//             FUZZ_MAX_STEPS.
+// --jobs N  - Worker threads, the number of online processors by default.
+// --case I  - Print the instructions of case I and run it alone.
+//
+// Engines compared with the reference:
+// alu tables - adc_8080_cpu_step() built with ADC_8080_CPU_ALU_TABLES. It is
+//              linked next to the reference with its symbols prefixed by
+//              alu_, see the Makefile.
+// debug loop - adc_8080_cpu_run() with every breakpoint and watchpoint armed,
+//              one instruction per call.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "adc_8080_cpu.h"
+#include "adc_8080_dasm.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MEMORY_TOTAL 0x10000
+// Random code bytes at the pc of a case, the rest of memory is random data.
+#define FUZZ_CODE_SIZE 64
+#define FUZZ_CASES 1000000
+#define FUZZ_STEPS 32
+#define FUZZ_MAX_STEPS 4096
+// Passes of the minimizer, each keeps the simplifications that still fail.
+#define FUZZ_MINIMIZE_PASSES 8
+
+#define DIGEST_BASIS 0xCBF29CE484222325u
+#define DIGEST_PRIME 0x100000001B3u
+
+// The table driven ALU build of the cpu.
+void alu_adc_8080_cpu_init(adc_8080_cpu *cpu);
+int alu_adc_8080_cpu_step(adc_8080_cpu *cpu);
+void alu_adc_8080_cpu_interrupt(adc_8080_cpu *cpu, uint8_t opcode);
+
+enum { REG_A, REG_B, REG_C, REG_D, REG_E, REG_H, REG_L, NUM_REGS };
+enum { FLAG_S, FLAG_Z, FLAG_A, FLAG_P, FLAG_C, NUM_FLAGS };
+
+// A test case, generated from the seed and its index.
+typedef struct {
+  uint64_t index;
+  uint8_t regs[NUM_REGS];
+  bool flags[NUM_FLAGS];
+  uint16_t pc, sp;
+  bool inte;
+  // Instructions to run, stopping early once halted.
+  int steps;
+  // Step before which an interrupt is requested, -1 for none.
+  int interrupt_step;
+  uint8_t interrupt_opcode;
+  uint8_t code[FUZZ_CODE_SIZE];
+  // Seed of the memory outside of the code and of the device input, 0 for
+  // zeros.
+  uint64_t data_seed;
+} fuzz_case;
+
+// Fields of the state compared after every instruction.
+enum {
+  FIELD_A,
+  FIELD_B,
+  FIELD_C,
+  FIELD_D,
+  FIELD_E,
+  FIELD_H,
+  FIELD_L,
+  FIELD_PC,
+  FIELD_SP,
+  FIELD_CFS,
+  FIELD_CFZ,
+  FIELD_CFA,
+  FIELD_CFP,
+  FIELD_CFC,
+  FIELD_HALTED,
+  FIELD_INTE,
+  FIELD_INTERRUPT_PENDING,
+  FIELD_INTERRUPT_DELAY,
+  FIELD_CYCLES,
+  FIELD_CYCLE_COUNT,
+  // Digests of every memory write and device output so far, in order.
+  FIELD_WRITES,
+  FIELD_OUTPUTS,
+  NUM_FIELDS
+};
+
+static const char *s_field_names[NUM_FIELDS] = {
+    "a",   "b",   "c",   "d",      "e",
+    "h",   "l",   "pc",  "sp",     "cfs",
+    "cfz", "cfa", "cfp", "cfc",    "halted",
+    "inte", "interrupt_pending", "interrupt_delay", "cycles", "cycle_count",
+    "writes", "outputs"};
+
+typedef struct {
+  uint64_t fields[NUM_FIELDS];
+} fuzz_state;
+
+// A machine running one engine. The cpu comes first, the device handlers are
+// passed the cpu.
+typedef struct {
+  adc_8080_cpu cpu;
+  adc_8080_cpu_debug debug;
+  const fuzz_case *fcase;
+  // Bytes written by the case, valid where the stamp is the generation.
+  uint32_t generation;
+  uint32_t stamps[MEMORY_TOTAL];
+  uint8_t memory[MEMORY_TOTAL];
+  uint64_t writes, outputs;
+} fuzz_machine;
+
+typedef struct {
+  const char *name;
+  void (*init)(adc_8080_cpu *cpu);
+  int (*step)(fuzz_machine *machine);
+  void (*interrupt)(adc_8080_cpu *cpu, uint8_t opcode);
+} fuzz_engine;
+
+static int reference_step(fuzz_machine *machine) {
+  return adc_8080_cpu_step(&machine->cpu);
+}
+
+static int alu_step(fuzz_machine *machine) {
+  return alu_adc_8080_cpu_step(&machine->cpu);
+}
+
+// A budget of one cycle runs one instruction, the instruction at the pc on
+// entry is not checked against the breakpoints.
+static int debug_loop_step(fuzz_machine *machine) {
+  return (int)adc_8080_cpu_run(&machine->cpu, &machine->debug, 1, NULL);
+}
+
+static const fuzz_engine s_reference = {"reference", adc_8080_cpu_init,
+                                        reference_step,
+                                        adc_8080_cpu_interrupt};
+
+static const fuzz_engine s_candidates[] = {
+    {"alu tables", alu_adc_8080_cpu_init, alu_step,
+     alu_adc_8080_cpu_interrupt},
+    {"debug loop", adc_8080_cpu_init, debug_loop_step,
+     adc_8080_cpu_interrupt},
+};
+
+#define NUM_CANDIDATES (int)(sizeof(s_candidates) / sizeof(s_candidates[0]))
+
+// A worker thread runs every jobs-th case from its first.
+typedef struct {
+  pthread_t thread;
+  uint64_t first;
+  fuzz_machine *reference;
+  fuzz_machine *candidate;
+  uint64_t cases;
+  uint64_t instructions;
+  // The first failing case of the worker.
+  bool failed;
+  fuzz_case failure;
+  int engine;
+} fuzz_worker;
+
+static uint64_t s_seed = 1;
+static uint64_t s_cases = FUZZ_CASES;
+static int s_steps = FUZZ_STEPS;
+static int s_jobs;
+
+// Lowest failing case index of every worker so far, workers stop past it.
+static pthread_mutex_t s_failure_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t s_first_failure = UINT64_MAX;
+
+static inline uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15u);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+  return z ^ (z >> 31);
+}
+
+// Data bytes are a hash of the address so cases need no memory image.
+static inline uint8_t data_byte(uint64_t seed, uint32_t addr) {
+  if (seed == 0)
+    return 0;
+  uint64_t state = seed ^ ((uint64_t)addr << 32);
+  return (uint8_t)(splitmix64(&state) >> 56);
+}
+
+static inline uint64_t digest(uint64_t digest, uint32_t value) {
+  return (digest ^ value) * DIGEST_PRIME;
+}
+
+static void generate_case(uint64_t index, fuzz_case *fcase) {
+  uint64_t state = s_seed ^ (index * 0xD1B54A32D192ED03u);
+  uint64_t r = splitmix64(&state);
+
+  fcase->index = index;
+  for (int i = 0; i < NUM_REGS; i++)
+    fcase->regs[i] = (uint8_t)(r >> (i * 8));
+  r = splitmix64(&state);
+  fcase->pc = (uint16_t)r;
+  fcase->sp = (uint16_t)(r >> 16);
+  for (int i = 0; i < NUM_FLAGS; i++)
+    fcase->flags[i] = (r >> (32 + i)) & 1;
+  fcase->inte = (r >> 40) & 1;
+
+  // A quarter of the cases request an interrupt, half of them with an RST.
+  fcase->steps = s_steps;
+  fcase->interrupt_step = -1;
+  if (((r >> 41) & 3) == 0)
+    fcase->interrupt_step = (int)((r >> 48) % (uint64_t)s_steps);
+  fcase->interrupt_opcode = (uint8_t)(r >> 56);
+  if ((r >> 43) & 1)
+    fcase->interrupt_opcode = 0xC7 | (fcase->interrupt_opcode & 0x38);
+
+  for (int i = 0; i < FUZZ_CODE_SIZE; i += 8) {
+    r = splitmix64(&state);
+    for (int j = 0; j < 8; j++)
+      fcase->code[i + j] = (uint8_t)(r >> (j * 8));
+  }
+  fcase->data_seed = splitmix64(&state) | 1;
+}
+
+static uint8_t machine_peek(const fuzz_machine *machine, uint16_t addr) {
+  if (machine->stamps[addr] == machine->generation)
+    return machine->memory[addr];
+  uint16_t offset = (uint16_t)(addr - machine->fcase->pc);
+  if (offset < FUZZ_CODE_SIZE)
+    return machine->fcase->code[offset];
+  return data_byte(machine->fcase->data_seed, addr);
+}
+
+static uint8_t handle_memory_read(void *userdata, uint16_t addr) {
+  return machine_peek(userdata, addr);
+}
+
+static void handle_memory_write(void *userdata, uint16_t addr, uint8_t value) {
+  fuzz_machine *machine = userdata;
+  machine->stamps[addr] = machine->generation;
+  machine->memory[addr] = value;
+  machine->writes = digest(machine->writes, (uint32_t)addr << 8 | value);
+}
+
+static uint8_t handle_device_read(void *userdata, uint8_t device) {
+  const fuzz_machine *machine = userdata;
+  return data_byte(machine->fcase->data_seed, MEMORY_TOTAL + device);
+}
+
+static void handle_device_write(void *userdata, uint8_t device,
+                                uint8_t output) {
+  fuzz_machine *machine = userdata;
+  machine->outputs =
+      digest(machine->outputs, (uint32_t)device << 8 | output);
+}
+
+static fuzz_machine *machine_new(void) {
+  fuzz_machine *machine = calloc(1, sizeof(fuzz_machine));
+  if (!machine)
+    return NULL;
+
+  // Every check of the debug loop runs, and every access hits a watchpoint.
+  adc_8080_cpu_debug_init(&machine->debug);
+  for (uint32_t addr = 0; addr < MEMORY_TOTAL; addr++) {
+    adc_8080_cpu_debug_break(&machine->debug, (uint16_t)addr, true);
+    adc_8080_cpu_debug_watch(&machine->debug, (uint16_t)addr,
+                             ADC_8080_CPU_WATCH_READ |
+                                 ADC_8080_CPU_WATCH_WRITE,
+                             true);
+  }
+  return machine;
+}
+
+static void machine_start(fuzz_machine *machine, const fuzz_engine *engine,
+                          const fuzz_case *fcase) {
+  // Forget the bytes written by the previous case.
+  if (++machine->generation == 0) {
+    memset(machine->stamps, 0, sizeof(machine->stamps));
+    machine->generation = 1;
+  }
+  machine->fcase = fcase;
+  machine->writes = machine->outputs = DIGEST_BASIS;
+
+  adc_8080_cpu *cpu = &machine->cpu;
+  engine->init(cpu);
+  cpu->ra = fcase->regs[REG_A], cpu->rb = fcase->regs[REG_B],
+  cpu->rc = fcase->regs[REG_C], cpu->rd = fcase->regs[REG_D],
+  cpu->re = fcase->regs[REG_E], cpu->rh = fcase->regs[REG_H],
+  cpu->rl = fcase->regs[REG_L];
+  cpu->pc = fcase->pc;
+  cpu->sp = fcase->sp;
+  cpu->cfs = fcase->flags[FLAG_S], cpu->cfz = fcase->flags[FLAG_Z],
+  cpu->cfa = fcase->flags[FLAG_A], cpu->cfp = fcase->flags[FLAG_P],
+  cpu->cfc = fcase->flags[FLAG_C];
+  cpu->inte = fcase->inte;
+  cpu->userdata = machine;
+  cpu->read_byte = handle_memory_read;
+  cpu->write_byte = handle_memory_write;
+  cpu->read_device = handle_device_read;
+  cpu->write_device = handle_device_write;
+}
+
+static void capture_state(const fuzz_machine *machine, int cycles,
+                          fuzz_state *state) {
+  const adc_8080_cpu *cpu = &machine->cpu;
+  uint64_t *f = state->fields;
+  f[FIELD_A] = cpu->ra, f[FIELD_B] = cpu->rb, f[FIELD_C] = cpu->rc,
+  f[FIELD_D] = cpu->rd, f[FIELD_E] = cpu->re, f[FIELD_H] = cpu->rh,
+  f[FIELD_L] = cpu->rl;
+  f[FIELD_PC] = cpu->pc;
+  f[FIELD_SP] = cpu->sp;
+  f[FIELD_CFS] = cpu->cfs, f[FIELD_CFZ] = cpu->cfz, f[FIELD_CFA] = cpu->cfa,
+  f[FIELD_CFP] = cpu->cfp, f[FIELD_CFC] = cpu->cfc;
+  f[FIELD_HALTED] = cpu->halted;
+  f[FIELD_INTE] = cpu->inte;
+  f[FIELD_INTERRUPT_PENDING] = cpu->interrupt_pending;
+  f[FIELD_INTERRUPT_DELAY] = cpu->interrupt_delay;
+  f[FIELD_CYCLES] = (uint64_t)cycles;
+  f[FIELD_CYCLE_COUNT] = cpu->cycle_count;
+  f[FIELD_WRITES] = machine->writes;
+  f[FIELD_OUTPUTS] = machine->outputs;
+}
+
+static bool states_equal(const fuzz_state *a, const fuzz_state *b) {
+  for (int i = 0; i < NUM_FIELDS; i++) {
+    if (a->fields[i] != b->fields[i])
+      return false;
+  }
+  return true;
+}
+
+// Run the case on the reference and the candidate in lockstep.
+//
+// Returns the step after which the states first differ, -1 if they never do.
+static int run_case(fuzz_worker *worker, const fuzz_engine *candidate,
+                    const fuzz_case *fcase, fuzz_state *expected,
+                    fuzz_state *actual) {
+  fuzz_machine *reference = worker->reference;
+  fuzz_machine *machine = worker->candidate;
+  machine_start(reference, &s_reference, fcase);
+  machine_start(machine, candidate, fcase);
+
+  for (int step = 0; step < fcase->steps; step++) {
+    if (step == fcase->interrupt_step) {
+      s_reference.interrupt(&reference->cpu, fcase->interrupt_opcode);
+      candidate->interrupt(&machine->cpu, fcase->interrupt_opcode);
+    }
+    capture_state(reference, s_reference.step(reference), expected);
+    capture_state(machine, candidate->step(machine), actual);
+    worker->instructions++;
+    if (!states_equal(expected, actual))
+      return step;
+    // Both are halted, the steps left would not change anything.
+    if (reference->cpu.halted)
+      break;
+  }
+  return -1;
+}
+
+static bool case_fails(fuzz_worker *worker, const fuzz_engine *candidate,
+                       const fuzz_case *fcase) {
+  fuzz_state expected, actual;
+  return run_case(worker, candidate, fcase, &expected, &actual) >= 0;
+}
+
+// Replace the case with the simpler one if it still fails.
+static bool try_simpler(fuzz_worker *worker, const fuzz_engine *candidate,
+                        fuzz_case *fcase, const fuzz_case *simpler) {
+  if (!case_fails(worker, candidate, simpler))
+    return false;
+  *fcase = *simpler;
+  return true;
+}
+
+// Shorten the case to the failing instruction, then zero the data, the
+// interrupt, the code bytes and the registers one at a time while it still
+// fails. Zeroed code bytes are NOPs.
+static void minimize_case(fuzz_worker *worker, const fuzz_engine *candidate,
+                          fuzz_case *fcase) {
+  fuzz_state expected, actual;
+  for (int pass = 0; pass < FUZZ_MINIMIZE_PASSES; pass++) {
+    bool simplified = false;
+    fuzz_case simpler = *fcase;
+    simpler.steps =
+        run_case(worker, candidate, fcase, &expected, &actual) + 1;
+    simplified |= simpler.steps < fcase->steps;
+    fcase->steps = simpler.steps;
+
+    simpler.interrupt_step = -1;
+    if (fcase->interrupt_step >= 0)
+      simplified |= try_simpler(worker, candidate, fcase, &simpler);
+    simpler = *fcase;
+    simpler.data_seed = 0;
+    if (fcase->data_seed != 0)
+      simplified |= try_simpler(worker, candidate, fcase, &simpler);
+
+    for (int i = FUZZ_CODE_SIZE - 1; i >= 0; i--) {
+      simpler = *fcase;
+      simpler.code[i] = 0x00;
+      if (fcase->code[i] != 0x00)
+        simplified |= try_simpler(worker, candidate, fcase, &simpler);
+    }
+    for (int i = 0; i < NUM_REGS; i++) {
+      simpler = *fcase;
+      simpler.regs[i] = 0;
+      if (fcase->regs[i] != 0)
+        simplified |= try_simpler(worker, candidate, fcase, &simpler);
+    }
+    for (int i = 0; i < NUM_FLAGS; i++) {
+      simpler = *fcase;
+      simpler.flags[i] = false;
+      if (fcase->flags[i])
+        simplified |= try_simpler(worker, candidate, fcase, &simpler);
+    }
+    simpler = *fcase;
+    simpler.sp = 0;
+    if (fcase->sp != 0)
+      simplified |= try_simpler(worker, candidate, fcase, &simpler);
+    simpler = *fcase;
+    simpler.inte = false;
+    if (fcase->inte)
+      simplified |= try_simpler(worker, candidate, fcase, &simpler);
+
+    if (!simplified)
+      break;
+  }
+}
+
+static void print_case(const fuzz_case *fcase) {
+  printf("case %llu of seed %llu, %d steps\n",
+         (unsigned long long)fcase->index, (unsigned long long)s_seed,
+         fcase->steps);
+  printf("  a:%02X b:%02X c:%02X d:%02X e:%02X h:%02X l:%02X pc:%04X "
+         "sp:%04X\n",
+         fcase->regs[REG_A], fcase->regs[REG_B], fcase->regs[REG_C],
+         fcase->regs[REG_D], fcase->regs[REG_E], fcase->regs[REG_H],
+         fcase->regs[REG_L], fcase->pc, fcase->sp);
+  printf("  cfs:%d cfz:%d cfa:%d cfp:%d cfc:%d inte:%d data seed:%016llX\n",
+         fcase->flags[FLAG_S], fcase->flags[FLAG_Z], fcase->flags[FLAG_A],
+         fcase->flags[FLAG_P], fcase->flags[FLAG_C], fcase->inte,
+         (unsigned long long)fcase->data_seed);
+  if (fcase->interrupt_step >= 0)
+    printf("  interrupt %02X before step %d\n", fcase->interrupt_opcode,
+           fcase->interrupt_step);
+
+  int length = FUZZ_CODE_SIZE;
+  while (length > 0 && fcase->code[length - 1] == 0x00)
+    length--;
+  printf("  code:");
+  for (int i = 0; i < length; i++)
+    printf(" %02X", fcase->code[i]);
+  printf("\n");
+}
+
+// Print the instructions of the case as the reference runs them.
+static void print_instructions(fuzz_worker *worker, const fuzz_case *fcase) {
+  fuzz_machine *machine = worker->reference;
+  machine_start(machine, &s_reference, fcase);
+  for (int step = 0; step < fcase->steps && !machine->cpu.halted; step++) {
+    adc_8080_cpu *cpu = &machine->cpu;
+    if (step == fcase->interrupt_step)
+      s_reference.interrupt(cpu, fcase->interrupt_opcode);
+
+    uint8_t bytes[3];
+    for (int i = 0; i < 3; i++)
+      bytes[i] = machine_peek(machine, (uint16_t)(cpu->pc + i));
+    char text[32];
+    adc_8080_dasm_format(bytes, text, sizeof(text));
+    bool interrupt =
+        cpu->interrupt_pending && cpu->inte && !cpu->interrupt_delay;
+    if (interrupt)
+      printf("  %3d  interrupt %02X at %04X\n", step, cpu->interrupt_opcode,
+             cpu->pc);
+    else
+      printf("  %3d  %04X  %s\n", step, cpu->pc, text);
+    s_reference.step(machine);
+  }
+}
+
+static void print_diff(const fuzz_state *expected, const fuzz_state *actual,
+                       const char *name) {
+  printf("  %-18s %18s %18s\n", "field", s_reference.name, name);
+  for (int i = 0; i < NUM_FIELDS; i++) {
+    if (expected->fields[i] != actual->fields[i])
+      printf("  %-18s %18llX %18llX\n", s_field_names[i],
+             (unsigned long long)expected->fields[i],
+             (unsigned long long)actual->fields[i]);
+  }
+}
+
+static void *worker_run(void *arg) {
+  fuzz_worker *worker = arg;
+  fuzz_case fcase;
+
+  for (uint64_t index = worker->first; index < s_cases;
+       index += (uint64_t)s_jobs) {
+    pthread_mutex_lock(&s_failure_mutex);
+    bool past_failure = index > s_first_failure;
+    pthread_mutex_unlock(&s_failure_mutex);
+    if (past_failure)
+      break;
+
+    generate_case(index, &fcase);
+    worker->cases++;
+    for (int i = 0; i < NUM_CANDIDATES; i++) {
+      if (case_fails(worker, &s_candidates[i], &fcase)) {
+        worker->failed = true;
+        worker->failure = fcase;
+        worker->engine = i;
+        pthread_mutex_lock(&s_failure_mutex);
+        if (index < s_first_failure)
+          s_first_failure = index;
+        pthread_mutex_unlock(&s_failure_mutex);
+        return NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void worker_free(fuzz_worker *worker) {
+  free(worker->reference);
+  free(worker->candidate);
+}
+
+static bool worker_init(fuzz_worker *worker, uint64_t first) {
+  memset(worker, 0, sizeof(fuzz_worker));
+  worker->first = first;
+  worker->reference = machine_new();
+  worker->candidate = machine_new();
+  if (!worker->reference || !worker->candidate) {
+    worker_free(worker);
+    return false;
+  }
+  return true;
+}
+
+// Run a single case against every engine, printing its instructions.
+static int fuzz_one(uint64_t index) {
+  fuzz_worker worker;
+  if (!worker_init(&worker, index))
+    return EXIT_FAILURE;
+
+  fuzz_case fcase;
+  generate_case(index, &fcase);
+  print_case(&fcase);
+  print_instructions(&worker, &fcase);
+
+  int result = EXIT_SUCCESS;
+  for (int i = 0; i < NUM_CANDIDATES; i++) {
+    fuzz_state expected, actual;
+    int step = run_case(&worker, &s_candidates[i], &fcase, &expected,
+                        &actual);
+    if (step < 0) {
+      printf("%s: matches\n", s_candidates[i].name);
+      continue;
+    }
+    printf("%s: differs after step %d\n", s_candidates[i].name, step);
+    print_diff(&expected, &actual, s_candidates[i].name);
+    result = EXIT_FAILURE;
+  }
+  worker_free(&worker);
+  return result;
+}
+
+static int fuzz_all(void) {
+  fuzz_worker *workers = calloc((size_t)s_jobs, sizeof(fuzz_worker));
+  if (!workers)
+    return EXIT_FAILURE;
+
+  int started = 0;
+  double start = now_seconds();
+  for (; started < s_jobs; started++) {
+    if (!worker_init(&workers[started], (uint64_t)started))
+      break;
+    if (pthread_create(&workers[started].thread, NULL, worker_run,
+                       &workers[started]) != 0) {
+      worker_free(&workers[started]);
+      break;
+    }
+  }
+  for (int i = 0; i < started; i++)
+    pthread_join(workers[i].thread, NULL);
+  double elapsed = now_seconds() - start;
+
+  int result = started == s_jobs ? EXIT_SUCCESS : EXIT_FAILURE;
+  if (started < s_jobs)
+    fprintf(stderr, "Failed to start worker %d!\n", started);
+
+  uint64_t cases = 0, instructions = 0;
+  fuzz_worker *failed = NULL;
+  for (int i = 0; i < started; i++) {
+    cases += workers[i].cases;
+    instructions += workers[i].instructions;
+    if (workers[i].failed && workers[i].failure.index == s_first_failure)
+      failed = &workers[i];
+  }
+  printf("%llu cases, %llu instructions per engine in %.2f s, %.0f cases "
+         "per minute on %d threads\n",
+         (unsigned long long)cases,
+         (unsigned long long)(instructions / NUM_CANDIDATES), elapsed,
+         cases / elapsed * 60, started);
+
+  if (failed) {
+    const fuzz_engine *candidate = &s_candidates[failed->engine];
+    fuzz_case fcase = failed->failure;
+    minimize_case(failed, candidate, &fcase);
+
+    fuzz_state expected, actual;
+    int step = run_case(failed, candidate, &fcase, &expected, &actual);
+    printf("\n%s differs from the %s after step %d of the minimized ",
+           candidate->name, s_reference.name, step);
+    print_case(&fcase);
+    print_instructions(failed, &fcase);
+    print_diff(&expected, &actual, candidate->name);
+    printf("Run it again with --seed %llu --case %llu\n",
+           (unsigned long long)s_seed,
+           (unsigned long long)failed->failure.index);
+    result = EXIT_FAILURE;
+  } else if (result == EXIT_SUCCESS) {
+    printf("All engines match the %s\n", s_reference.name);
+  }
+
+  for (int i = 0; i < started; i++)
+    worker_free(&workers[i]);
+  free(workers);
+  return result;
+}
+
+static bool parse_u64(const char *text, uint64_t *value) {
+  char *end;
+  *value = strtoull(text, &end, 0);
+  return *text != '\0' && *end == '\0';
+}
+
+int main(int argc, char *argv[]) {
+  long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  s_jobs = processors > 0 ? (int)processors : 1;
+
+  bool one = false;
+  uint64_t index = 0;
+  for (int i = 1; i < argc; i++) {
+    uint64_t value;
+    bool valid = i + 1 < argc && parse_u64(argv[i + 1], &value);
+    if (valid && strcmp(argv[i], "--seed") == 0) {
+      s_seed = value;
+    } else if (valid && strcmp(argv[i], "--cases") == 0) {
+      s_cases = value;
+    } else if (valid && strcmp(argv[i], "--steps") == 0 && value > 0 &&
+               value <= FUZZ_MAX_STEPS) {
+      s_steps = (int)value;
+    } else if (valid && strcmp(argv[i], "--jobs") == 0 && value > 0 &&
+               value <= 1024) {
+      s_jobs = (int)value;
+    } else if (valid && strcmp(argv[i], "--case") == 0) {
+      one = true;
+      index = value;
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--seed S] [--cases N] [--steps N] [--jobs N] "
+              "[--case I]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+
+  return one ? fuzz_one(index) : fuzz_all();
+}
@@ -1,55 +1,460 @@
+// Usage: 8080_cpu_test [--resume] [--checkpoint-cycles N] [--jobs N]
+//
+// --resume              - Continue each run from its last checkpoint file,
+//                         if there is one. The output the run printed before
+//                         the checkpoint is kept in the file and printed
+//                         again.
+// --checkpoint-cycles N - Write a checkpoint of each run to build/<rom>.state,
+//                         or build/<rom>.<section>.state, every N cycles, 0
+//                         disables checkpoints. The file is removed once the
+//                         test passes.
+// --jobs N              - Runs at once, the number of online processors by
+//                         default. Every rom is a run, and each test section
+//                         of 8080EXM.COM is a run of its own. The output is
+//                         printed in rom order as the runs finish.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "adc_8080_codec.h"
+#include "adc_8080_cond.h"
+#include "adc_8080_coverage.h"
 #include "adc_8080_cpu.h"
+#include "adc_8080_history.h"
+#include "adc_8080_pctrace.h"
+#include "adc_8080_rewind.h"
+#include "adc_8080_statefile.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define MEMORY_TOTAL 0x10000
+// Steps between rewind checkpoints and the number of checkpoints kept.
+#define CHECKPOINT_STEPS 256
+#define CHECKPOINT_CAPACITY 16
+// Instructions stepped back over by the reverse execution check.
+#define HISTORY_STEPS 1024
+// Steps between the timed windows of the run statistics check, a window is
+// 1024 steps.
+#define STATS_INTERVAL 1500
+// Default cycles between checkpoint files, about a second of host time.
+#define DISK_CHECKPOINT_CYCLES 1000000000LU
+#define DISK_CHECKPOINT_DIR "build/"
+#define DISK_CHECKPOINT_SIZE                                                   \
+  (ADC_8080_CPU_STATE_SIZE + ADC_8080_CPU_STATE_MEMORY_SIZE)
+
+// Address of the zero terminated test descriptor list in 8080EXM.COM and of
+// the calls printing its banner and its closing message, see 'tests:',
+// 'start:' and 'done:' in roms/8080EXM.PRN.
+#define EXM_TESTS_ADDR 0x013A
+#define EXM_NUM_TESTS 25
+#define EXM_BANNER_CALL 0x011C
+#define EXM_DONE_CALL 0x0134
+
+typedef struct {
+  const char *filename;
+  uint64_t expected_cycles;
+  // Run each test section of 8080EXM.COM on its own, see patch_exm().
+  bool sections;
+} test_rom;
+
+// Checkpoint files are written by a background thread per run. Submitting
+// copies the state and the output of the run so far into the pending
+// buffers, a checkpoint still pending is replaced by the newer one. The file
+// holds the state followed by the output, it is written next to its final
+// path and renamed over it so an interrupted write never leaves a truncated
+// checkpoint.
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool running;
+  bool quit;
+  bool has_pending;
+  char path[256];
+  uint8_t pending[DISK_CHECKPOINT_SIZE];
+  uint8_t writing[DISK_CHECKPOINT_SIZE];
+  // Output buffers, grown as the output of the run grows.
+  char *pending_out;
+  size_t pending_out_size;
+  size_t pending_out_capacity;
+  char *writing_out;
+  size_t writing_out_size;
+  size_t writing_out_capacity;
+} checkpoint_writer;
+
+// A run of a rom, or of one test section of it, on its own cpu and memory so
+// that runs can go on in parallel. The cpu is the first member, the handlers
+// get the run as their userdata.
+typedef struct {
+  adc_8080_cpu cpu;
+  uint8_t memory[MEMORY_TOTAL];
+  const test_rom *rom;
+  // Test section, -1 runs the whole rom.
+  int section;
+  // Name in messages, and the prefix of the files of the run in build/.
+  char name[64];
+  char file_prefix[64];
+  char checkpoint_path[256];
+  adc_8080_cpu_hash hash;
+  bool complete;
+  bool quiet;
+  // Number of memory writes and the address of the last one.
+  uint64_t writes;
+  uint16_t last_write;
+  // What the run prints to stdout and stderr, printed in rom order by the
+  // main thread once the run is done.
+  FILE *out;
+  char *out_buf;
+  size_t out_size;
+  // Start of the output of the rom in out_buf, after the resume message.
+  size_t out_start;
+  FILE *err;
+  char *err_buf;
+  size_t err_size;
+  bool passed;
+  // Cycles of the run, checked against the rom once all of its runs are
+  // done.
+  uint64_t cycle_count;
+  // Set with s_runs.mutex held.
+  bool done;
+  checkpoint_writer writer;
+  // Buffers of the checks.
+  uint8_t expected[DISK_CHECKPOINT_SIZE];
+  uint8_t actual[DISK_CHECKPOINT_SIZE];
+  uint8_t scratch[MEMORY_TOTAL];
+  uint8_t keyframe[MEMORY_TOTAL];
+  uint8_t snapshot[ADC_8080_CODEC_MAX_SIZE];
+  adc_8080_cpu_debug debug;
+  adc_8080_cpu_coverage coverage;
+  adc_8080_cpu_coverage loaded;
+  adc_8080_rewind *rw;
+  uint64_t hashes[HISTORY_STEPS + 1];
+  uint16_t pcs[HISTORY_STEPS + 1];
+} test_run;
+
+// A hand assembled program run on its own cpu and flat memory, for what the
+// roms do not reach. The cpu is the first member, the handlers get the
+// program as their userdata.
+typedef struct {
+  adc_8080_cpu cpu;
+  uint8_t memory[MEMORY_TOTAL];
+  // Number of IN made, see handle_program_in().
+  int reads;
+} program;
+
+static void run_test(test_run *run);
+static bool check_save_load(test_run *run);
+static bool check_statefile(test_run *run);
+static bool check_resume(test_run *run);
+static bool check_codec(test_run *run);
+static bool check_rewind(test_run *run);
+static bool check_hash(test_run *run);
+static bool check_debug(test_run *run);
+static bool check_conditions(test_run *run);
+static bool check_coverage(test_run *run);
+static bool check_pctrace(test_run *run);
+static bool check_stats(test_run *run);
+static bool check_history(test_run *run);
+static bool check_iolog_program(void);
+static bool check_trace_program(void);
+static bool check_profile_program(void);
+static bool check_halt_program(void);
+#ifdef ADC_8080_CPU_OPCODE_STATS
+static bool check_opstats_program(void);
+#endif
+static bool checkpoint_writer_start(checkpoint_writer *writer,
+                                    const char *path);
+static void checkpoint_writer_submit(checkpoint_writer *writer,
+                                     const adc_8080_cpu *cpu,
+                                     const uint8_t *memory, const char *out,
+                                     size_t out_size);
+static void checkpoint_writer_stop(checkpoint_writer *writer);
+static bool write_checkpoint(const char *path, const uint8_t *state,
+                             const char *out, size_t out_size);
+static bool load_checkpoint(test_run *run, const char *path);
+static void *run_worker(void *arg);
+
+static const test_rom s_roms[] = {
+    {"roms/TST8080.COM", 4924LU, false},
+    {"roms/CPUTEST.COM", 255653383LU, false},
+    {"roms/8080PRE.COM", 7817LU, false},
+    {"roms/8080EXM.COM", 23803381171LU, true},
+};
+#define NUM_ROMS (int)(sizeof(s_roms) / sizeof(s_roms[0]))
+
+// Checks made in order once a run is complete, with the error printed when
+// one fails.
+typedef struct check {
+  bool (*check)(test_run *run);
+  const char *error;
+} check;
+
+static const check s_checks[] = {
+    {check_hash, "Incremental state hash does not match the memory!"},
+    {check_rewind, "Re-running from a rewind checkpoint diverged!"},
+    {check_debug, "Breakpoint or watchpoint did not stop as expected!"},
+    {check_conditions, "Conditional breakpoint did not stop as expected!"},
+    {check_coverage, "Code coverage is wrong or does not round trip!"},
+    {check_pctrace,
+     "Replaying the pc trace does not give the executed pcs!"},
+    {check_stats, "Run statistics do not match the steps made!"},
+    {check_history, "Stepping backwards diverged from the recorded states!"},
+    {check_save_load, "Save state does not round trip!"},
+    {check_codec, "Compressed snapshot does not round trip!"},
+    {check_statefile, "Memory mapped state file does not round trip!"},
+    {check_resume, "Resuming from a checkpoint file changed the output!"},
+};
+#define NUM_CHECKS (int)(sizeof(s_checks) / sizeof(s_checks[0]))
+
+// Programs run before the roms, with the error printed when one fails.
+typedef struct program_check {
+  bool (*check)(void);
+  const char *name;
+  const char *error;
+} program_check;
+
+static const program_check s_program_checks[] = {
+    {check_iolog_program, "IN and interrupt replay",
+     "Replaying IN and an interrupt requested by IN diverged!"},
+    {check_trace_program, "Trace triggers and wrap around",
+     "Trace records or triggers are wrong!"},
+    {check_profile_program, "Profile call stack",
+     "Profile call stack is wrong after a return!"},
+    {check_halt_program, "Run until halted",
+     "A run did not stop at a halt or wake from it on an interrupt!"},
+#ifdef ADC_8080_CPU_OPCODE_STATS
+    {check_opstats_program, "Opcode statistics",
+     "Opcode counts, cycles or taken branches are wrong!"},
+#endif
+};
+#define NUM_PROGRAM_CHECKS                                                     \
+  (int)(sizeof(s_program_checks) / sizeof(s_program_checks[0]))
 
-static void run_test(adc_8080_cpu *cpu, const char *filename,
-                     uint64_t expected_cycles);
+static bool s_resume;
+static uint64_t s_checkpoint_cycles = DISK_CHECKPOINT_CYCLES;
+static int s_jobs;
 
-static bool s_test_complete;
-static uint8_t *s_memory;
+// Runs are taken in order by the worker threads. The main thread waits on
+// the condition for each run to be done.
+static struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  test_run **runs;
+  int count;
+  int next;
+} s_runs = {.mutex = PTHREAD_MUTEX_INITIALIZER,
+            .cond = PTHREAD_COND_INITIALIZER};
 
 // Credit to superzazu for their 8080 cpu test setup which was used as a
 // reference. https://github.com/superzazu/8080/blob/master/i8080_tests.c
 // Test roms from: https://altairclone.com/downloads/cpu_tests/.
 // BDOS system call reference: https://www.seasip.info/Cpm/bdos.html
-int main() {
+int main(int argc, char *argv[]) {
+  long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  s_jobs = processors > 0 ? (int)processors : 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--resume") == 0) {
+      s_resume = true;
+    } else if (strcmp(argv[i], "--checkpoint-cycles") == 0 && i + 1 < argc) {
+      s_checkpoint_cycles = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc &&
+               atoi(argv[i + 1]) > 0) {
+      s_jobs = atoi(argv[++i]);
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--resume] [--checkpoint-cycles N] [--jobs N]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
   printf("########## 8080 CPU test started!\n");
 
-  s_memory = malloc(MEMORY_TOTAL);
-  if (!s_memory) {
-    fprintf(stderr, "Failed to malloc() memory!");
+  for (int i = 0; i < NUM_PROGRAM_CHECKS; i++) {
+    const program_check *check = &s_program_checks[i];
+    if (check->check())
+      printf("\n##### Test '%s' passed!\n", check->name);
+    else
+      fprintf(stderr, "\n\n##### Test '%s' failed!\nError: %s\n",
+              check->name, check->error);
+  }
+
+  // A run per rom, and for 8080EXM.COM a run per section and one with no
+  // section at all, see patch_exm().
+  for (int i = 0; i < NUM_ROMS; i++)
+    s_runs.count += s_roms[i].sections ? EXM_NUM_TESTS + 1 : 1;
+  s_runs.runs = calloc((size_t)s_runs.count, sizeof(test_run *));
+  if (!s_runs.runs) {
+    fprintf(stderr, "Failed to calloc() the runs!");
     return EXIT_FAILURE;
   }
 
-  adc_8080_cpu cpu;
-  run_test(&cpu, "roms/TST8080.COM", 4924LU);
-  run_test(&cpu, "roms/CPUTEST.COM", 255653383LU);
-  run_test(&cpu, "roms/8080PRE.COM", 7817LU);
-  run_test(&cpu, "roms/8080EXM.COM", 23803381171LU);
+  int index = 0;
+  for (int i = 0; i < NUM_ROMS; i++) {
+    int sections = s_roms[i].sections ? EXM_NUM_TESTS + 1 : 1;
+    for (int section = 0; section < sections; section++) {
+      test_run *run = calloc(1, sizeof(test_run));
+      if (!run) {
+        fprintf(stderr, "Failed to calloc() a run!");
+        return EXIT_FAILURE;
+      }
+      run->rom = &s_roms[i];
+      run->section = s_roms[i].sections ? section : -1;
+      run->out = open_memstream(&run->out_buf, &run->out_size);
+      run->err = open_memstream(&run->err_buf, &run->err_size);
+      if (!run->out || !run->err) {
+        fprintf(stderr, "Failed to open_memstream() the run output!");
+        return EXIT_FAILURE;
+      }
+      s_runs.runs[index++] = run;
+    }
+  }
 
-  printf("\n########## 8080 CPU test finished!\n");
+  int workers = s_jobs < s_runs.count ? s_jobs : s_runs.count;
+  pthread_t *threads = calloc((size_t)workers, sizeof(pthread_t));
+  int started = 0;
+  while (threads && started < workers &&
+         pthread_create(&threads[started], NULL, run_worker, NULL) == 0)
+    started++;
+  if (started == 0) {
+    fprintf(stderr, "Failed to start the test threads!");
+    return EXIT_FAILURE;
+  }
 
-  free(s_memory);
+  index = 0;
+  for (int i = 0; i < NUM_ROMS; i++) {
+    const test_rom *rom = &s_roms[i];
+    int sections = rom->sections ? EXM_NUM_TESTS + 1 : 1;
+    printf("\n##### Starting test '%s'\n\n", rom->filename);
+    fflush(stdout);
+
+    bool passed = true;
+    uint64_t cycle_count = 0;
+    for (int j = index; j < index + sections; j++) {
+      test_run *run = s_runs.runs[j];
+      pthread_mutex_lock(&s_runs.mutex);
+      while (!run->done)
+        pthread_cond_wait(&s_runs.cond, &s_runs.mutex);
+      pthread_mutex_unlock(&s_runs.mutex);
+
+      fwrite(run->out_buf, 1, run->out_size, stdout);
+      fflush(stdout);
+      fwrite(run->err_buf, 1, run->err_size, stderr);
+      passed = passed && run->passed;
+      // The runs of the sections repeat the setup and exit of the rom which
+      // the run with no section is made of, see patch_exm().
+      if (!rom->sections || run->section < EXM_NUM_TESTS)
+        cycle_count += run->cycle_count;
+      else
+        cycle_count -= (EXM_NUM_TESTS - 1) * run->cycle_count;
+    }
+
+    if (passed && cycle_count != rom->expected_cycles) {
+      fprintf(stderr,
+              "\n\n##### Test '%s' failed!\n"
+              "Error: Cycles consumed does not match expected! Expected: "
+              "%llu, actual: "
+              "%llu\n",
+              rom->filename, (unsigned long long)rom->expected_cycles,
+              (unsigned long long)cycle_count);
+      passed = false;
+    }
+
+    if (passed) {
+      for (int j = index; j < index + sections; j++)
+        remove(s_runs.runs[j]->checkpoint_path);
+      printf("\n\n##### Test '%s' passed!\n", rom->filename);
+    }
+    index += sections;
+  }
+
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+  for (int i = 0; i < s_runs.count; i++) {
+    free(s_runs.runs[i]->out_buf);
+    free(s_runs.runs[i]->err_buf);
+    free(s_runs.runs[i]);
+  }
+  free(s_runs.runs);
+
+  printf("\n########## 8080 CPU test finished!\n");
   return EXIT_SUCCESS;
 }
 
+static void *run_worker(void *arg) {
+  (void)arg;
+
+  for (;;) {
+    pthread_mutex_lock(&s_runs.mutex);
+    test_run *run =
+        s_runs.next < s_runs.count ? s_runs.runs[s_runs.next++] : NULL;
+    pthread_mutex_unlock(&s_runs.mutex);
+    if (!run)
+      break;
+
+    run_test(run);
+    fclose(run->out);
+    fclose(run->err);
+
+    pthread_mutex_lock(&s_runs.mutex);
+    run->done = true;
+    pthread_cond_broadcast(&s_runs.cond);
+    pthread_mutex_unlock(&s_runs.mutex);
+  }
+
+  return NULL;
+}
+
+// Patch the memory image of 8080EXM.COM to run only the given test section,
+// or no test for section EXM_NUM_TESTS. Only the first section prints the
+// banner and only the last one the closing message, so the output of the
+// sections in order is the output of the whole rom. The calls left out are
+// replaced with NOPs, which makes the setup and exit the same in every run:
+// the cycles of the whole rom are those of the sections less all but one
+// run of the setup and exit, the cycles of the run with no section.
+static void patch_exm(uint8_t *memory, int section) {
+  uint8_t *tests = memory + EXM_TESTS_ADDR;
+  if (section < EXM_NUM_TESTS)
+    memmove(tests, tests + section * 2, 2);
+  else
+    memset(tests, 0x00, 2);
+  memset(tests + 2, 0x00, 2);
+
+  if (section != 0)
+    memset(memory + EXM_BANNER_CALL, 0x00, 3);
+  if (section != EXM_NUM_TESTS - 1)
+    memset(memory + EXM_DONE_CALL, 0x00, 3);
+}
+
 static uint8_t handle_memory_read(void *userdata, uint16_t addr);
 static void handle_memory_write(void *userdata, uint16_t addr, uint8_t value);
 static uint8_t handle_device_read(void *userdata, uint8_t device);
 static void handle_device_write(void *userdata, uint8_t device, uint8_t output);
 
-static void run_test(adc_8080_cpu *cpu, const char *filename,
-                     uint64_t expected_cycles) {
-  printf("\n##### Starting test '%s'\n\n", filename);
-  s_test_complete = false;
+static void run_test(test_run *run) {
+  adc_8080_cpu *cpu = &run->cpu;
+  const char *filename = run->rom->filename;
+  const char *basename = strrchr(filename, '/');
+  basename = basename ? basename + 1 : filename;
+  if (run->section < 0) {
+    snprintf(run->name, sizeof(run->name), "%s", filename);
+    snprintf(run->file_prefix, sizeof(run->file_prefix), "%s", basename);
+  } else {
+    snprintf(run->name, sizeof(run->name), "%s section %d", filename,
+             run->section);
+    snprintf(run->file_prefix, sizeof(run->file_prefix), "%s.%d", basename,
+             run->section);
+  }
+  run->complete = false;
 
   // Init the cpu.
   adc_8080_cpu_init(cpu);
-  cpu->userdata = cpu;
+  cpu->userdata = run;
   cpu->read_byte = handle_memory_read;
   cpu->write_byte = handle_memory_write;
   cpu->read_device = handle_device_read;
@@ -58,90 +463,1132 @@ static void run_test(adc_8080_cpu *cpu, const char *filename,
   cpu->pc = 0x100;
 
   // Clear all the memory.
-  memset(s_memory, 0, MEMORY_TOTAL);
+  memset(run->memory, 0, MEMORY_TOTAL);
   // Inject 'OUT 0,A' at 0x0000 to signal the test is complete.
   // BDOS 'function 0 P_TERMCPM' system call.
-  s_memory[0x0000] = 0xD3;
-  s_memory[0x0001] = 0x00;
+  run->memory[0x0000] = 0xD3;
+  run->memory[0x0001] = 0x00;
   // Inject 'OUT 1,A' at 0x0005 to signal character output.
   // BDOS 'function 2 C_WRITE' and 'function 9 C_WRITESTR' system calls.
-  s_memory[0x0005] = 0xD3;
-  s_memory[0x0006] = 0x01;
-  s_memory[0x0007] = 0xC9; // RET
+  run->memory[0x0005] = 0xD3;
+  run->memory[0x0006] = 0x01;
+  run->memory[0x0007] = 0xC9; // RET
 
   // Open the rom file and read into memory.
   FILE *file = fopen(filename, "rb");
   if (!file) {
-    fprintf(stderr,
+    fprintf(run->err,
             "\n\n##### Test '%s' failed!\n"
             "Error: Failed to fopen() the rom file!\n",
-            filename);
+            run->name);
     return;
   }
   fseek(file, 0, SEEK_END);
   size_t size = ftell(file);
   rewind(file);
 
-  size_t bytes_read = fread(s_memory + 0x100, 1, size, file);
+  size_t bytes_read = fread(run->memory + 0x100, 1, size, file);
+  fclose(file);
   if (bytes_read != size) {
-    fprintf(stderr,
+    fprintf(run->err,
             "\n\n##### Test '%s' failed!\n"
             "Error: Failed to read the rom file into memory! Read %zu "
             "bytes, total is %zu bytes\n",
-            filename, bytes_read, size);
+            run->name, bytes_read, size);
     return;
   }
+  if (run->section >= 0)
+    patch_exm(run->memory, run->section);
+
+  // Checkpoint files are named after the rom and section, e.g.
+  // build/8080EXM.COM.2.state.
+  snprintf(run->checkpoint_path, sizeof(run->checkpoint_path), "%s%s.state",
+           DISK_CHECKPOINT_DIR, run->file_prefix);
+
+  if (s_resume)
+    load_checkpoint(run, run->checkpoint_path);
 
-  // Run the test.
-  uint64_t cycle_count = 0;
-  while (!s_test_complete)
-    cycle_count += adc_8080_cpu_step(cpu);
+  if (s_checkpoint_cycles > 0 &&
+      !checkpoint_writer_start(&run->writer, run->checkpoint_path)) {
+    fprintf(run->err,
+            "\n\n##### Test '%s' failed!\n"
+            "Error: Failed to start the checkpoint writer!\n",
+            run->name);
+    return;
+  }
 
-  int64_t diff = llabs(expected_cycles - cycle_count);
-  if (diff > 0) {
-    fprintf(stderr,
+  adc_8080_rewind *rw = adc_8080_rewind_new(CHECKPOINT_CAPACITY);
+  if (!rw) {
+    fprintf(run->err,
             "\n\n##### Test '%s' failed!\n"
-            "Error: Cycles consumed does not match expected! Expected: "
-            "%lld, actual: "
-            "%lld\n",
-            filename, expected_cycles, cycle_count);
+            "Error: Failed to create the rewind buffer!\n",
+            run->name);
+    checkpoint_writer_stop(&run->writer);
     return;
   }
 
-  printf("\n\n##### Test '%s' passed!\n", filename);
+  // Run the test, taking rewind checkpoints and checkpoint files along the
+  // way. The cycle count carries over from a resumed checkpoint and is
+  // checked against the rom once all of its runs are done.
+  uint64_t steps = 0;
+  uint64_t next_checkpoint = cpu->cycle_count + s_checkpoint_cycles;
+  adc_8080_rewind_push(rw, cpu, run->memory);
+  while (!run->complete) {
+    adc_8080_cpu_step(cpu);
+    if (++steps % CHECKPOINT_STEPS == 0)
+      adc_8080_rewind_push(rw, cpu, run->memory);
+    if (s_checkpoint_cycles > 0 && cpu->cycle_count >= next_checkpoint) {
+      fflush(run->out);
+      checkpoint_writer_submit(&run->writer, cpu, run->memory,
+                               run->out_buf + run->out_start,
+                               run->out_size - run->out_start);
+      next_checkpoint += s_checkpoint_cycles;
+    }
+  }
+  checkpoint_writer_stop(&run->writer);
+  run->cycle_count = cpu->cycle_count;
+
+  run->rw = rw;
+  bool passed = true;
+  for (int i = 0; passed && i < NUM_CHECKS; i++) {
+    passed = s_checks[i].check(run);
+    if (!passed)
+      fprintf(run->err, "\n\n##### Test '%s' failed!\nError: %s\n",
+              run->name, s_checks[i].error);
+  }
+  run->rw = NULL;
+  adc_8080_rewind_free(&rw);
+  run->passed = passed;
+}
+
+// Save the final cpu state and memory, load it into a fresh cpu and memory
+// image and check that both match.
+static bool check_save_load(test_run *run) {
+  adc_8080_cpu *cpu = &run->cpu;
+  uint8_t *state = run->expected;
+  uint8_t *memory = run->scratch;
+
+  size_t size =
+      adc_8080_cpu_save(cpu, run->memory, state, DISK_CHECKPOINT_SIZE);
+  if (size != DISK_CHECKPOINT_SIZE)
+    return false;
+  if (adc_8080_cpu_save(cpu, run->memory, state, DISK_CHECKPOINT_SIZE - 1) !=
+      0)
+    return false;
+
+  adc_8080_cpu loaded;
+  adc_8080_cpu_init(&loaded);
+  if (adc_8080_cpu_load(&loaded, memory, state, size) != size)
+    return false;
+
+  return loaded.ra == cpu->ra && loaded.rb == cpu->rb &&
+         loaded.rc == cpu->rc && loaded.rd == cpu->rd &&
+         loaded.re == cpu->re && loaded.rh == cpu->rh &&
+         loaded.rl == cpu->rl && loaded.pc == cpu->pc &&
+         loaded.sp == cpu->sp && loaded.cfs == cpu->cfs &&
+         loaded.cfz == cpu->cfz && loaded.cfa == cpu->cfa &&
+         loaded.cfp == cpu->cfp && loaded.cfc == cpu->cfc &&
+         loaded.halted == cpu->halted && loaded.inte == cpu->inte &&
+         loaded.interrupt_pending == cpu->interrupt_pending &&
+         loaded.interrupt_opcode == cpu->interrupt_opcode &&
+         loaded.interrupt_delay == cpu->interrupt_delay &&
+         memcmp(memory, run->memory, MEMORY_TOTAL) == 0;
+}
+
+// Encode the final state as a snapshot on its own and against a keyframe that
+// differs in a few places, and check that both decode to the same state.
+static bool check_codec(test_run *run) {
+  adc_8080_cpu *cpu = &run->cpu;
+  uint8_t *snapshot = run->snapshot;
+  uint8_t *keyframe = run->keyframe;
+  uint8_t *memory = run->scratch;
+
+  memcpy(keyframe, run->memory, MEMORY_TOTAL);
+  keyframe[0x0000] ^= 0x01;
+  memset(keyframe + 0x1000, 0xAA, 0x20);
+  keyframe[0xFFFF] ^= 0x80;
+
+  for (int i = 0; i < 2; i++) {
+    const uint8_t *key = i == 0 ? NULL : keyframe;
+    size_t size = adc_8080_codec_encode(cpu, run->memory, key, snapshot,
+                                        sizeof(run->snapshot));
+    if (size == 0 || adc_8080_codec_decode(cpu, memory, NULL, snapshot,
+                                           size) != (i == 0 ? size : 0))
+      return false;
+
+    adc_8080_cpu loaded;
+    adc_8080_cpu_init(&loaded);
+    if (adc_8080_codec_decode(&loaded, memory, key, snapshot, size) != size ||
+        adc_8080_codec_decode(&loaded, memory, key, snapshot, size - 1) != 0)
+      return false;
+    if (loaded.pc != cpu->pc || loaded.sp != cpu->sp ||
+        loaded.cycle_count != cpu->cycle_count ||
+        memcmp(memory, run->memory, MEMORY_TOTAL) != 0)
+      return false;
+  }
+
+  return true;
+}
+
+// Write the final state twice into a state file, map both states and check
+// that they match and that writes to one mapping are private to it.
+static bool check_statefile(test_run *run) {
+  adc_8080_cpu *cpu = &run->cpu;
+  char path[256];
+  snprintf(path, sizeof(path), "%s%s.check.states", DISK_CHECKPOINT_DIR,
+           run->file_prefix);
+
+  adc_8080_statefile_writer *writer = adc_8080_statefile_create(path, 2);
+  if (!writer)
+    return false;
+  bool written = adc_8080_statefile_add(writer, cpu, run->memory) &&
+                 adc_8080_statefile_add(writer, cpu, run->memory) &&
+                 !adc_8080_statefile_add(writer, cpu, run->memory);
+  if (!adc_8080_statefile_finish(&writer) || !written)
+    return false;
+
+  adc_8080_statefile *file = adc_8080_statefile_open(path);
+  if (!file)
+    return false;
+
+  adc_8080_cpu loaded;
+  adc_8080_cpu_init(&loaded);
+  uint8_t *first = adc_8080_statefile_map(file, 0, &loaded);
+  uint8_t *second = adc_8080_statefile_map(file, 1, NULL);
+  bool match = adc_8080_statefile_count(file) == 2 && first && second &&
+               !adc_8080_statefile_map(file, 2, NULL) &&
+               loaded.pc == cpu->pc && loaded.sp == cpu->sp &&
+               loaded.cycle_count == cpu->cycle_count &&
+               memcmp(first, run->memory, MEMORY_TOTAL) == 0 &&
+               memcmp(second, run->memory, MEMORY_TOTAL) == 0;
+  if (match) {
+    first[0x100] ^= 0xFF;
+    match = second[0x100] == run->memory[0x100];
+  }
+
+  adc_8080_statefile_unmap(&first);
+  adc_8080_statefile_unmap(&second);
+  adc_8080_statefile_close(&file);
+  remove(path);
+  return match;
+}
+
+// Write a checkpoint file of the oldest rewind checkpoint with the output
+// printed before it, resume from the file as --resume does and check that
+// the output of the resumed run is the output of the whole run.
+static bool check_resume(test_run *run) {
+  adc_8080_rewind *rw = run->rw;
+  adc_8080_cpu *cpu = &run->cpu;
+  char path[256];
+  snprintf(path, sizeof(path), "%s%s.check.state", DISK_CHECKPOINT_DIR,
+           run->file_prefix);
+
+  fflush(run->out);
+  FILE *out = run->out;
+  size_t out_start = run->out_start;
+  const char *whole = run->out_buf + out_start;
+  size_t whole_size = run->out_size - out_start;
+  char *buf = NULL;
+  size_t size = 0;
+
+  // The output of a re-run from the checkpoint ends the whole output.
+  run->out = open_memstream(&buf, &size);
+  bool match = run->out && adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+  if (match) {
+    adc_8080_cpu_save(cpu, run->memory, run->expected, DISK_CHECKPOINT_SIZE);
+    run->complete = false;
+    while (!run->complete)
+      adc_8080_cpu_step(cpu);
+    fflush(run->out);
+    match = size <= whole_size &&
+            memcmp(whole + whole_size - size, buf, size) == 0 &&
+            write_checkpoint(path, run->expected, whole, whole_size - size);
+  }
+  if (run->out)
+    fclose(run->out);
+  free(buf);
+  buf = NULL;
+
+  run->out = match ? open_memstream(&buf, &size) : NULL;
+  if (run->out) {
+    match = load_checkpoint(run, path);
+    run->complete = false;
+    while (match && !run->complete)
+      adc_8080_cpu_step(cpu);
+    fflush(run->out);
+    match = match && size - run->out_start == whole_size &&
+            memcmp(buf + run->out_start, whole, whole_size) == 0;
+    fclose(run->out);
+  }
+  free(buf);
+
+  run->out = out;
+  run->out_start = out_start;
+  remove(path);
+  return match;
+}
+
+// Restore the oldest checkpoint still in the rewind buffer, run to the end
+// of the test again and check that the final state and memory match.
+static bool check_rewind(test_run *run) {
+  adc_8080_rewind *rw = run->rw;
+  adc_8080_cpu *cpu = &run->cpu;
+  uint8_t *expected = run->expected;
+  uint8_t *actual = run->actual;
+
+  uint64_t expected_hash = adc_8080_cpu_hash_state(cpu);
+  adc_8080_cpu_save(cpu, run->memory, expected, DISK_CHECKPOINT_SIZE);
+  if (!adc_8080_rewind_restore(rw, 0, cpu, run->memory))
+    return false;
+
+  run->quiet = true;
+  run->complete = false;
+  while (!run->complete)
+    adc_8080_cpu_step(cpu);
+  run->quiet = false;
+
+  adc_8080_cpu_save(cpu, run->memory, actual, DISK_CHECKPOINT_SIZE);
+  return memcmp(expected, actual, DISK_CHECKPOINT_SIZE) == 0 &&
+         adc_8080_cpu_hash_state(cpu) == expected_hash;
+}
+
+// Re-run from the oldest rewind checkpoint with an incremental hash of the
+// memory attached, the run itself has no hooks attached. Then check the hash
+// against one computed from scratch.
+static bool check_hash(test_run *run) {
+  adc_8080_rewind *rw = run->rw;
+  adc_8080_cpu *cpu = &run->cpu;
+  adc_8080_cpu_hash fresh;
+
+  if (!adc_8080_rewind_restore(rw, 0, cpu, run->memory))
+    return false;
+
+  adc_8080_cpu_hash_attach(cpu, &run->hash);
+  run->quiet = true;
+  run->complete = false;
+  while (!run->complete)
+    adc_8080_cpu_step(cpu);
+  run->quiet = false;
+
+  uint64_t state = adc_8080_cpu_hash_state(cpu);
+  adc_8080_cpu_hash_attach(cpu, &fresh);
+  bool match = adc_8080_cpu_hash_diff(&run->hash, &fresh) == -1 &&
+               adc_8080_cpu_hash_state(cpu) == state;
+  adc_8080_cpu_hash_detach(cpu);
+  return match;
+}
+
+// Re-run from the oldest rewind checkpoint with adc_8080_cpu_run(). A write
+// watchpoint must stop at the first write found by stepping, a breakpoint at
+// 0x0000 right before the 'OUT 0,A' that completes the test. Resuming from
+// the breakpoint must reach the same final state as stepping.
+static bool check_debug(test_run *run) {
+  adc_8080_rewind *rw = run->rw;
+  adc_8080_cpu *cpu = &run->cpu;
+  uint8_t *expected = run->expected;
+  uint8_t *actual = run->actual;
+  adc_8080_cpu_debug *debug = &run->debug;
+  adc_8080_cpu_save(cpu, run->memory, expected, DISK_CHECKPOINT_SIZE);
+  // Bounds the runs in case a stop is missed.
+  uint64_t end_cycle = cpu->cycle_count;
+
+  run->quiet = true;
+  run->complete = false;
+  bool match = adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+
+  // The first write, by stepping.
+  uint64_t writes = run->writes;
+  uint16_t write_pc = cpu->pc;
+  while (match && run->writes == writes && !run->complete) {
+    write_pc = cpu->pc;
+    adc_8080_cpu_step(cpu);
+  }
+  uint64_t write_cycle = cpu->cycle_count;
+  uint16_t write_addr = run->last_write;
+
+  if (match && run->writes != writes) {
+    adc_8080_cpu_stop stop;
+    adc_8080_cpu_debug_init(debug);
+    adc_8080_cpu_debug_watch(debug, write_addr, ADC_8080_CPU_WATCH_WRITE,
+                             true);
+    run->complete = false;
+    match = adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+    adc_8080_cpu_run(cpu, debug, end_cycle - cpu->cycle_count, &stop);
+    match = match && stop.reason == ADC_8080_CPU_STOP_WATCH_WRITE &&
+            stop.addr == write_addr && stop.pc == write_pc &&
+            stop.value == run->memory[write_addr] &&
+            cpu->cycle_count == write_cycle;
+  }
+
+  if (match) {
+    adc_8080_cpu_stop stop;
+    adc_8080_cpu_debug_init(debug);
+    adc_8080_cpu_debug_break(debug, 0x0000, true);
+    run->complete = false;
+    match = adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+    adc_8080_cpu_run(cpu, debug, end_cycle - cpu->cycle_count, &stop);
+    match = match && stop.reason == ADC_8080_CPU_STOP_BREAKPOINT &&
+            stop.addr == 0x0000 && cpu->pc == 0x0000 && !run->complete;
+
+    // Resumes past the breakpoint, OUT 0,A completes the test.
+    adc_8080_cpu_run(cpu, debug, 1, &stop);
+    match = match && stop.reason == ADC_8080_CPU_STOP_NONE && run->complete;
+  }
+  run->quiet = false;
+
+  adc_8080_cpu_save(cpu, run->memory, actual, DISK_CHECKPOINT_SIZE);
+  return match && memcmp(expected, actual, DISK_CHECKPOINT_SIZE) == 0;
+}
+
+// Re-run from the oldest rewind checkpoint with conditional breakpoints at
+// 0x0000, where the test completes. A false condition must not stop, a true
+// one must stop on its first hit.
+static bool check_conditions(test_run *run) {
+  adc_8080_rewind *rw = run->rw;
+  adc_8080_cpu *cpu = &run->cpu;
+  adc_8080_cpu_debug *debug = &run->debug;
+  uint8_t never[ADC_8080_CPU_COND_SIZE];
+  uint8_t first_hit[ADC_8080_CPU_COND_SIZE];
+  uint8_t invalid[ADC_8080_CPU_COND_SIZE];
+  size_t never_size =
+      adc_8080_cond_compile("a == a + 1 || hits > 1", never, sizeof(never),
+                            NULL);
+  size_t first_hit_size = adc_8080_cond_compile(
+      "pc == 0 && hits == 1 && cycles > 0 && mem[0] == 0xD3 && "
+      "word[0x0000] == 0x00D3 && !(cfz && !cfz)",
+      first_hit, sizeof(first_hit), NULL);
+  if (never_size == 0 || first_hit_size == 0 ||
+      adc_8080_cond_compile("hl >", invalid, sizeof(invalid), NULL) != 0)
+    return false;
+
+  // Bounds the runs in case a stop is missed, the test ends at end_cycle and
+  // runs on over NOPs after that.
+  uint64_t end_cycle = cpu->cycle_count;
+  run->quiet = true;
+  adc_8080_cpu_stop stop;
+
+  // 'OUT 0,A' executes, the run stops at the NOP that follows it.
+  adc_8080_cpu_debug_init(debug);
+  bool match = adc_8080_cpu_debug_break_if(debug, 0x0000, never, never_size);
+  adc_8080_cpu_debug_break(debug, 0x0002, true);
+  run->complete = false;
+  match = match && adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+  adc_8080_cpu_run(cpu, debug, end_cycle - cpu->cycle_count + 100, &stop);
+  match = match && stop.reason == ADC_8080_CPU_STOP_BREAKPOINT &&
+          stop.addr == 0x0002 && run->complete &&
+          debug->conditions[0].hits == 1;
+
+  adc_8080_cpu_debug_init(debug);
+  match = match &&
+          adc_8080_cpu_debug_break_if(debug, 0x0000, first_hit,
+                                      first_hit_size);
+  run->complete = false;
+  match = match && adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+  adc_8080_cpu_run(cpu, debug, end_cycle - cpu->cycle_count + 100, &stop);
+  match = match && stop.reason == ADC_8080_CPU_STOP_BREAKPOINT &&
+          stop.addr == 0x0000 && !run->complete;
+  run->quiet = false;
+
+  return match;
+}
+
+// Re-run from the oldest rewind checkpoint with coverage attached. The
+// 'OUT 0,A' at 0x0000 must be covered as an opcode and its port operand, and
+// the coverage must round trip through a file and merge with itself.
+static bool check_coverage(test_run *run) {
+  adc_8080_rewind *rw = run->rw;
+  adc_8080_cpu *cpu = &run->cpu;
+  adc_8080_cpu_coverage *coverage = &run->coverage;
+  adc_8080_cpu_coverage *loaded = &run->loaded;
+  char path[256];
+  snprintf(path, sizeof(path), "%s%s.check.coverage", DISK_CHECKPOINT_DIR,
+           run->file_prefix);
+
+  adc_8080_coverage_clear(coverage);
+  run->quiet = true;
+  run->complete = false;
+  bool match = adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+  adc_8080_cpu_coverage_attach(cpu, coverage);
+  while (match && !run->complete)
+    adc_8080_cpu_step(cpu);
+  adc_8080_cpu_coverage_detach(cpu);
+  run->quiet = false;
+
+  size_t opcodes, operands;
+  adc_8080_coverage_count(coverage, &opcodes, &operands);
+  match = match && (coverage->opcodes[0] & 0x3) == 0x1 &&
+          (coverage->operands[0] & 0x3) == 0x2 && opcodes > 0 && operands > 0;
+
+  adc_8080_coverage_clear(loaded);
+  match = match && adc_8080_coverage_save(coverage, path) &&
+          adc_8080_coverage_load(loaded, path);
+  adc_8080_coverage_merge(loaded, coverage);
+  remove(path);
+  return match && memcmp(loaded, coverage, sizeof(*coverage)) == 0;
+}
+
+// Re-run from the oldest rewind checkpoint with a pc trace attached, then
+// replay the trace in lockstep with another re-run. Code the roms change is
+// read from memory as it was executed.
+static bool check_pctrace(test_run *run) {
+  adc_8080_rewind *rw = run->rw;
+  adc_8080_cpu *cpu = &run->cpu;
+  char path[256];
+  snprintf(path, sizeof(path), "%s%s.check.pctrace", DISK_CHECKPOINT_DIR,
+           run->file_prefix);
+  FILE *file = fopen(path, "w+b");
+  adc_8080_pctrace_writer *writer =
+      file ? adc_8080_pctrace_writer_new(file) : NULL;
+  if (!writer) {
+    if (file)
+      fclose(file);
+    return false;
+  }
+
+  run->quiet = true;
+  run->complete = false;
+  bool match = adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+  adc_8080_pctrace_writer_attach(writer, cpu);
+  while (match && !run->complete)
+    adc_8080_cpu_step(cpu);
+  match = adc_8080_pctrace_writer_detach(writer, cpu) && match;
+  uint64_t instructions = adc_8080_pctrace_writer_instructions(writer);
+  adc_8080_pctrace_writer_free(&writer);
+
+  run->complete = false;
+  match = match && adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+  rewind(file);
+  adc_8080_pctrace_reader *reader =
+      adc_8080_pctrace_reader_new(file, run->memory);
+  adc_8080_pctrace_event event;
+  uint64_t replayed = 0;
+  while (match && reader && adc_8080_pctrace_reader_next(reader, &event)) {
+    match = event.pc == cpu->pc && !event.interrupt;
+    adc_8080_cpu_step(cpu);
+    replayed++;
+  }
+  run->quiet = false;
+
+  match = match && reader && !adc_8080_pctrace_reader_error(reader) &&
+          replayed == instructions && run->complete;
+  adc_8080_pctrace_reader_free(&reader);
+  fclose(file);
+  remove(path);
+  return match;
+}
+
+// Host clock of the run statistics check, every call takes 10 ns. The clock
+// is shared, runs take turns at the check.
+static uint64_t s_stats_ns;
+static pthread_mutex_t s_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t stats_clock(void) { return s_stats_ns += 10; }
+
+// Re-run from the oldest rewind checkpoint with run statistics attached. The
+// roms neither halt nor take interrupts, so every step is an instruction.
+static bool check_stats(test_run *run) {
+  adc_8080_rewind *rw = run->rw;
+  adc_8080_cpu *cpu = &run->cpu;
+  adc_8080_cpu_stats stats;
+  adc_8080_cpu_stats_summary summary;
+
+  pthread_mutex_lock(&s_stats_mutex);
+  run->quiet = true;
+  run->complete = false;
+  bool match = adc_8080_rewind_restore(rw, 0, cpu, run->memory);
+  uint64_t start_cycle = cpu->cycle_count;
+  uint64_t steps = 0;
+  adc_8080_cpu_stats_attach(cpu, &stats, STATS_INTERVAL, stats_clock);
+  while (match && !run->complete) {
+    adc_8080_cpu_step(cpu);
+    steps++;
+  }
+  adc_8080_cpu_stats_query(cpu, 2000000.0, &summary);
+  adc_8080_cpu_stats_detach(cpu);
+  run->quiet = false;
+
+  double seconds = (s_stats_ns - stats.start_ns) / 1e9;
+  pthread_mutex_unlock(&s_stats_mutex);
+  double cycles = summary.mhz * 1e6 * seconds;
+  double total = summary.core + summary.memory + summary.device +
+                 summary.outside;
+  // The shortest roms end before the first timed window.
+  bool timed = steps < 2 * STATS_INTERVAL || stats.window_steps > 0;
+  return match && summary.instructions == steps && stats.interrupts == 0 &&
+         stats.halted_steps == 0 && timed &&
+         cycles > (cpu->cycle_count - start_cycle) * 0.999 &&
+         cycles < (cpu->cycle_count - start_cycle) * 1.001 &&
+         summary.core >= 0 && summary.memory >= 0 && summary.device >= 0 &&
+         summary.outside >= 0 && total > 0.999 && total < 1.001;
 }
 
 static uint8_t handle_memory_read(void *userdata, uint16_t addr) {
-  return s_memory[addr];
+  return ((test_run *)userdata)->memory[addr];
 }
 
 static void handle_memory_write(void *userdata, uint16_t addr, uint8_t value) {
-  s_memory[addr] = value;
+  test_run *run = (test_run *)userdata;
+  run->memory[addr] = value;
+  run->writes++;
+  run->last_write = addr;
 }
 
 static uint8_t handle_device_read(void *userdata, uint8_t device) { return 0; }
 
 static void handle_device_write(void *userdata, uint8_t device,
                                 uint8_t output) {
-  adc_8080_cpu *cpu = (adc_8080_cpu *)userdata;
+  test_run *run = (test_run *)userdata;
+  adc_8080_cpu *cpu = &run->cpu;
 
   if (device == 0) {
-    s_test_complete = true;
+    run->complete = true;
     return;
   }
 
-  if (device == 1) {
+  if (device == 1 && !run->quiet) {
     uint8_t operation = cpu->rc;
     if (operation == 2) {
-      printf("%c", cpu->re);
+      fputc(cpu->re, run->out);
     } else if (operation == 9) {
       // Print chars starting from address DE until
       // terminating '$' char.
       uint16_t addr = (cpu->rd << 8) | cpu->re;
       while (cpu->read_byte(userdata, addr) != '$') {
-        printf("%c", cpu->read_byte(userdata, addr++));
+        fputc(cpu->read_byte(userdata, addr++), run->out);
       }
     }
-    fflush(stdout);
   }
 }
+
+// Step forward from the oldest rewind checkpoint recording the state hash at
+// every instruction, then step all the way back and check every state again.
+static bool check_history(test_run *run) {
+  adc_8080_rewind *rw = run->rw;
+  adc_8080_cpu *cpu = &run->cpu;
+  uint64_t *hashes = run->hashes;
+  uint16_t *pcs = run->pcs;
+
+  if (!adc_8080_rewind_restore(rw, 0, cpu, run->memory))
+    return false;
+
+  // The compared state hashes include the memory.
+  adc_8080_cpu_hash_attach(cpu, &run->hash);
+  adc_8080_history *history = adc_8080_history_new(cpu, run->memory, 64, 32);
+  if (!history) {
+    adc_8080_cpu_hash_detach(cpu);
+    return false;
+  }
+
+  run->quiet = true;
+  run->complete = false;
+  uint64_t steps = 0;
+  while (steps < HISTORY_STEPS && !run->complete) {
+    hashes[steps] = adc_8080_cpu_hash_state(cpu);
+    pcs[steps++] = cpu->pc;
+    adc_8080_history_step(history);
+  }
+  hashes[steps] = adc_8080_cpu_hash_state(cpu);
+
+  bool match = !adc_8080_history_error(history);
+  for (uint64_t i = steps; match && i > 0; i--)
+    match = adc_8080_history_step_back(history) &&
+            adc_8080_history_position(history) == i - 1 &&
+            adc_8080_cpu_hash_state(cpu) == hashes[i - 1];
+
+  // Forward again to the end, then back to the last visit of a midway pc.
+  uint64_t target = steps / 2;
+  match = match && adc_8080_history_seek(history, steps) &&
+          adc_8080_cpu_hash_state(cpu) == hashes[steps];
+  match = match && adc_8080_history_run_back_to(history, pcs[target]);
+  uint64_t found = adc_8080_history_position(history);
+  match = match && found >= target && pcs[found] == pcs[target] &&
+          adc_8080_cpu_hash_state(cpu) == hashes[found];
+  match = match && !adc_8080_history_error(history);
+  run->quiet = false;
+
+  adc_8080_history_free(&history);
+  adc_8080_cpu_hash_detach(cpu);
+  return match;
+}
+
+static bool write_checkpoint(const char *path, const uint8_t *state,
+                             const char *out, size_t out_size) {
+  char tmp_path[sizeof(((checkpoint_writer *)NULL)->path) + 4];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+  FILE *file = fopen(tmp_path, "wb");
+  if (!file) {
+    fprintf(stderr, "Failed to fopen() '%s'!\n", tmp_path);
+    return false;
+  }
+  bool written =
+      fwrite(state, 1, DISK_CHECKPOINT_SIZE, file) == DISK_CHECKPOINT_SIZE &&
+      fwrite(out, 1, out_size, file) == out_size;
+  if (fclose(file) != 0 || !written || rename(tmp_path, path) != 0) {
+    fprintf(stderr, "Failed to write the checkpoint '%s'!\n", path);
+    remove(tmp_path);
+    return false;
+  }
+  return true;
+}
+
+static void *checkpoint_writer_run(void *arg) {
+  checkpoint_writer *writer = (checkpoint_writer *)arg;
+
+  pthread_mutex_lock(&writer->mutex);
+  for (;;) {
+    while (!writer->has_pending && !writer->quit)
+      pthread_cond_wait(&writer->cond, &writer->mutex);
+    if (!writer->has_pending)
+      break;
+
+    memcpy(writer->writing, writer->pending, DISK_CHECKPOINT_SIZE);
+    // Swap the output buffers, the pending one is refilled on submit.
+    char *out = writer->writing_out;
+    size_t capacity = writer->writing_out_capacity;
+    writer->writing_out = writer->pending_out;
+    writer->writing_out_size = writer->pending_out_size;
+    writer->writing_out_capacity = writer->pending_out_capacity;
+    writer->pending_out = out;
+    writer->pending_out_size = 0;
+    writer->pending_out_capacity = capacity;
+    writer->has_pending = false;
+    pthread_mutex_unlock(&writer->mutex);
+    write_checkpoint(writer->path, writer->writing, writer->writing_out,
+                     writer->writing_out_size);
+    pthread_mutex_lock(&writer->mutex);
+  }
+  pthread_mutex_unlock(&writer->mutex);
+
+  return NULL;
+}
+
+static bool checkpoint_writer_start(checkpoint_writer *writer,
+                                    const char *path) {
+  snprintf(writer->path, sizeof(writer->path), "%s", path);
+  writer->quit = false;
+  writer->has_pending = false;
+  writer->pending_out = writer->writing_out = NULL;
+  writer->pending_out_capacity = writer->writing_out_capacity = 0;
+  if (pthread_mutex_init(&writer->mutex, NULL) != 0)
+    return false;
+  if (pthread_cond_init(&writer->cond, NULL) != 0) {
+    pthread_mutex_destroy(&writer->mutex);
+    return false;
+  }
+  writer->running = pthread_create(&writer->thread, NULL,
+                                   checkpoint_writer_run, writer) == 0;
+  if (!writer->running) {
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+  }
+  return writer->running;
+}
+
+// The checkpoint is dropped if its output buffer cannot grow, the previous one
+// stays pending.
+static void checkpoint_writer_submit(checkpoint_writer *writer,
+                                     const adc_8080_cpu *cpu,
+                                     const uint8_t *memory, const char *out,
+                                     size_t out_size) {
+  pthread_mutex_lock(&writer->mutex);
+  if (out_size > writer->pending_out_capacity) {
+    char *grown = realloc(writer->pending_out, out_size);
+    if (!grown) {
+      pthread_mutex_unlock(&writer->mutex);
+      return;
+    }
+    writer->pending_out = grown;
+    writer->pending_out_capacity = out_size;
+  }
+  adc_8080_cpu_save(cpu, memory, writer->pending, DISK_CHECKPOINT_SIZE);
+  if (out_size > 0)
+    memcpy(writer->pending_out, out, out_size);
+  writer->pending_out_size = out_size;
+  writer->has_pending = true;
+  pthread_cond_signal(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+}
+
+// Write out the pending checkpoint, if any, and stop the thread.
+static void checkpoint_writer_stop(checkpoint_writer *writer) {
+  if (!writer->running)
+    return;
+
+  pthread_mutex_lock(&writer->mutex);
+  writer->quit = true;
+  pthread_cond_signal(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+  pthread_join(writer->thread, NULL);
+  pthread_cond_destroy(&writer->cond);
+  pthread_mutex_destroy(&writer->mutex);
+  free(writer->pending_out);
+  free(writer->writing_out);
+  writer->running = false;
+}
+
+// Restore the cpu and memory from a checkpoint file, then print the resume
+// message and the output the run printed before the checkpoint. The output
+// of the rom starts after the message.
+static bool load_checkpoint(test_run *run, const char *path) {
+  uint8_t *state = run->actual;
+
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+  size_t size = fread(state, 1, DISK_CHECKPOINT_SIZE, file);
+  if (size == 0 ||
+      adc_8080_cpu_load(&run->cpu, run->memory, state, size) != size) {
+    fclose(file);
+    return false;
+  }
+
+  fprintf(run->out, "##### Resuming test '%s' at cycle %llu\n\n", run->name,
+          (unsigned long long)run->cpu.cycle_count);
+  run->out_start = (size_t)ftell(run->out);
+  while ((size = fread(run->scratch, 1, MEMORY_TOTAL, file)) > 0)
+    fwrite(run->scratch, 1, size, run->out);
+  fclose(file);
+  return true;
+}
+
+static uint8_t handle_program_read(void *userdata, uint16_t addr) {
+  return ((program *)userdata)->memory[addr];
+}
+
+static void handle_program_write(void *userdata, uint16_t addr,
+                                 uint8_t value) {
+  ((program *)userdata)->memory[addr] = value;
+}
+
+// Every IN reads a new value, and every fifth requests an RST 7.
+static uint8_t handle_program_in(void *userdata, uint8_t device) {
+  program *prog = (program *)userdata;
+  prog->reads++;
+  if (prog->reads % 5 == 0)
+    adc_8080_cpu_interrupt(&prog->cpu, 0xFF);
+  return (uint8_t)(prog->reads * 37 + device);
+}
+
+// Load the code at 0x0000 and reset the cpu to run it.
+static void program_load(program *prog, const uint8_t *code, size_t size) {
+  // The cpu too, adc_8080_cpu_init() keeps inte.
+  memset(prog, 0, sizeof(*prog));
+  memcpy(prog->memory, code, size);
+
+  adc_8080_cpu *cpu = &prog->cpu;
+  adc_8080_cpu_init(cpu);
+  cpu->userdata = prog;
+  cpu->read_byte = handle_program_read;
+  cpu->write_byte = handle_program_write;
+  cpu->read_device = handle_program_in;
+}
+
+#define IOLOG_PROGRAM_STEPS 400
+
+// Record a loop adding IN values whose handler requests interrupts, then
+// replay it without the handler and check every state again. A replayed
+// interrupt taken an instruction early or late changes the sum.
+static bool check_iolog_program(void) {
+  static const uint8_t code[] = {
+      [0x0000] = 0x31, 0x00, 0x01, // LXI SP,0100h
+      0xFB,                        // EI
+      0xDB, 0x10,                  // loop: IN 10h
+      0x81,                        // ADD C
+      0x4F,                        // MOV C,A
+      0xC3, 0x04, 0x00,            // JMP loop
+      [0x0038] = 0x1C,             // INR E
+      0xFB,                        // EI
+      0xC9,                        // RET
+  };
+  uint64_t hashes[IOLOG_PROGRAM_STEPS + 1];
+  uint64_t cycles[IOLOG_PROGRAM_STEPS + 1];
+
+  program *prog = calloc(1, sizeof(program));
+  if (!prog)
+    return false;
+  adc_8080_cpu *cpu = &prog->cpu;
+
+  adc_8080_cpu_iolog log;
+  program_load(prog, code, sizeof(code));
+  adc_8080_cpu_record(cpu, &log);
+  for (int i = 0; i < IOLOG_PROGRAM_STEPS; i++) {
+    hashes[i] = adc_8080_cpu_hash_state(cpu);
+    cycles[i] = cpu->cycle_count;
+    adc_8080_cpu_step(cpu);
+  }
+  hashes[IOLOG_PROGRAM_STEPS] = adc_8080_cpu_hash_state(cpu);
+  cycles[IOLOG_PROGRAM_STEPS] = cpu->cycle_count;
+  adc_8080_cpu_iolog_stop(cpu);
+  bool match = !log.error && cpu->re > 0;
+
+  adc_8080_cpu_iolog replay;
+  program_load(prog, code, sizeof(code));
+  cpu->read_device = NULL;
+  adc_8080_cpu_replay(cpu, &replay, log.data, log.size);
+  for (int i = 0; match && i < IOLOG_PROGRAM_STEPS; i++) {
+    match = adc_8080_cpu_hash_state(cpu) == hashes[i] &&
+            cpu->cycle_count == cycles[i];
+    adc_8080_cpu_step(cpu);
+  }
+  match = match && !replay.error &&
+          adc_8080_cpu_hash_state(cpu) == hashes[IOLOG_PROGRAM_STEPS] &&
+          cpu->cycle_count == cycles[IOLOG_PROGRAM_STEPS];
+  adc_8080_cpu_iolog_stop(cpu);
+
+  adc_8080_cpu_iolog_free(&log);
+  free(prog);
+  return match;
+}
+
+#define TRACE_PROGRAM_CAPACITY 4
+
+// Trace a loop from its second instruction until a cycle count into a ring
+// buffer that wraps around, then check the newest records.
+static bool check_trace_program(void) {
+  static const uint8_t code[] = {
+      0x3E, 0x00,       // MVI A,00h
+      0x3C,             // loop: INR A
+      0x06, 0x55,       // MVI B,55h
+      0xC3, 0x02, 0x00, // JMP loop
+  };
+  // The instructions from the MVI B at cycle 12 to the first at or after
+  // cycle 70 are recorded, the buffer keeps the last of them.
+  static const adc_8080_cpu_trace_record expected[] = {
+      {.cycle = 51, .pc = 0x0002, .bytes = {0x3C}, .a = 2, .b = 0x55},
+      {.cycle = 56, .pc = 0x0003, .bytes = {0x06, 0x55}, .a = 3, .b = 0x55},
+      {.cycle = 63, .pc = 0x0005, .bytes = {0xC3, 0x02}, .a = 3, .b = 0x55},
+      {.cycle = 73, .pc = 0x0002, .bytes = {0x3C}, .a = 3, .b = 0x55},
+  };
+  adc_8080_cpu_trace_record records[TRACE_PROGRAM_CAPACITY];
+
+  program *prog = calloc(1, sizeof(program));
+  if (!prog)
+    return false;
+  adc_8080_cpu *cpu = &prog->cpu;
+
+  adc_8080_cpu_trace trace;
+  program_load(prog, code, sizeof(code));
+  adc_8080_cpu_trace_attach(cpu, &trace, records, TRACE_PROGRAM_CAPACITY);
+  adc_8080_cpu_trace_start_on(&trace, ADC_8080_CPU_TRACE_TRIGGER_PC, 0x0003);
+  adc_8080_cpu_trace_stop_on(&trace, ADC_8080_CPU_TRACE_TRIGGER_CYCLE, 70);
+  while (cpu->cycle_count < 200)
+    adc_8080_cpu_step(cpu);
+  adc_8080_cpu_trace_detach(cpu);
+
+  bool match = !trace.active && trace.total == 9 &&
+               adc_8080_cpu_trace_count(&trace) == TRACE_PROGRAM_CAPACITY;
+  for (size_t i = 0; match && i < TRACE_PROGRAM_CAPACITY; i++) {
+    const adc_8080_cpu_trace_record *record = adc_8080_cpu_trace_get(&trace, i);
+    match = record->cycle == expected[i].cycle &&
+            record->pc == expected[i].pc && record->sp == 0 &&
+            memcmp(record->bytes, expected[i].bytes, 3) == 0 &&
+            record->a == expected[i].a && record->b == expected[i].b &&
+            record->flags == 0;
+  }
+
+  free(prog);
+  return match;
+}
+
+// The call stack sampled at each pc of a program, by the pc before which it
+// was sampled.
+typedef struct {
+  int depth[0x100];
+  uint16_t frames[0x100][ADC_8080_CPU_PROFILE_DEPTH];
+} profile_samples;
+
+static void handle_profile_sample(void *userdata, uint16_t pc,
+                                  const adc_8080_cpu_frame *frames,
+                                  int depth) {
+  profile_samples *samples = (profile_samples *)userdata;
+  if (pc >= 0x100)
+    return;
+  samples->depth[pc] = depth;
+  for (int i = 0; i < depth; i++)
+    samples->frames[pc][i] = frames[i].target;
+}
+
+// Sample the call stack at every step of functions returning with RET,
+// POP then PCHL, XTHL then RET and SPHL, on a stack set up at 0x0000 that
+// wraps around. Then check that a call made after popping the return address
+// replaces the frame left behind.
+static bool check_profile_program(void) {
+  static const uint8_t code[] = {
+      [0x0000] = 0x31, 0x00, 0x00, // LXI SP,0000h
+      0xCD, 0x20, 0x00,            // CALL ret
+      0x00,                        // NOP
+      0xCD, 0x30, 0x00,            // CALL pchl
+      0x00,                        // NOP
+      0xCD, 0x40, 0x00,            // CALL xthl
+      0x76,                        // HLT
+      0x76,                        // HLT
+      [0x0010] = 0x00,             // NOP
+      0xCD, 0x50, 0x00,            // CALL sphl
+      0x76,                        // HLT
+      0x00,                        // NOP
+      0x76,                        // HLT
+      [0x0020] = 0x00,             // ret: NOP
+      0xC9,                        // RET
+      [0x0030] = 0xE1,             // pchl: POP H
+      0xE9,                        // PCHL
+      [0x0040] = 0x21, 0x10, 0x00, // xthl: LXI H,0010h
+      0xE3,                        // XTHL
+      0xC9,                        // RET
+      [0x0050] = 0xCD, 0x60, 0x00, // sphl: CALL nested
+      [0x0060] = 0x00,             // nested: NOP
+      0x21, 0x00, 0x00,            // LXI H,0000h
+      0xF9,                        // SPHL
+      0xC3, 0x15, 0x00,            // JMP 0015h
+  };
+  // Depth and frame targets sampled before the instruction at pc.
+  static const struct {
+    uint16_t pc;
+    int depth;
+    uint16_t frames[2];
+  } expected[] = {
+      {0x0020, 1, {0x0020}},         {0x0006, 0, {0}},
+      {0x0031, 0, {0}},              {0x000A, 0, {0}},
+      {0x0044, 1, {0x0040}},         {0x0010, 0, {0}},
+      {0x0060, 2, {0x0050, 0x0060}}, {0x0015, 0, {0}},
+  };
+  static const uint8_t pop_call[] = {
+      [0x0000] = 0x31, 0x00, 0x01, // LXI SP,0100h
+      0xCD, 0x10, 0x00,            // CALL popped
+      [0x0010] = 0xE1,             // popped: POP H
+      0xCD, 0x20, 0x00,            // CALL called
+      [0x0020] = 0x76,             // called: HLT
+  };
+
+  program *prog = calloc(1, sizeof(program));
+  profile_samples *samples = calloc(1, sizeof(profile_samples));
+  if (!prog || !samples) {
+    free(prog);
+    free(samples);
+    return false;
+  }
+  adc_8080_cpu *cpu = &prog->cpu;
+  for (int i = 0; i < 0x100; i++)
+    samples->depth[i] = -1;
+
+  adc_8080_cpu_profile profile;
+  program_load(prog, code, sizeof(code));
+  adc_8080_cpu_profile_attach(cpu, &profile, 1, handle_profile_sample,
+                              samples);
+  while (!cpu->halted)
+    adc_8080_cpu_step(cpu);
+  adc_8080_cpu_profile_detach(cpu);
+
+  bool match = cpu->pc == 0x0017;
+  for (size_t i = 0; match && i < sizeof(expected) / sizeof(expected[0]);
+       i++) {
+    uint16_t pc = expected[i].pc;
+    match = samples->depth[pc] == expected[i].depth;
+    for (int j = 0; match && j < expected[i].depth; j++)
+      match = samples->frames[pc][j] == expected[i].frames[j];
+  }
+
+  // Too short to be sampled, frames are only dropped by the calls.
+  program_load(prog, pop_call, sizeof(pop_call));
+  adc_8080_cpu_profile_attach(cpu, &profile, 1000, handle_profile_sample,
+                              samples);
+  while (!cpu->halted)
+    adc_8080_cpu_step(cpu);
+  adc_8080_cpu_profile_detach(cpu);
+  match = match && profile.depth == 1 && profile.frames[0].target == 0x0020 &&
+          profile.frames[0].sp == 0x00FE;
+
+  free(samples);
+  free(prog);
+  return match;
+}
+
+// Run a program halting with interrupts enabled, with and without armed
+// breakpoints. A run stops at the halt and only wakes from it once an
+// interrupt is requested.
+static bool check_halt_program(void) {
+  static const uint8_t code[] = {
+      [0x0000] = 0xFB, // EI
+      0x76,            // HLT
+      [0x0008] = 0x76, // HLT
+  };
+
+  program *prog = calloc(1, sizeof(program));
+  if (!prog)
+    return false;
+  adc_8080_cpu *cpu = &prog->cpu;
+
+  adc_8080_cpu_stop stop;
+  program_load(prog, code, sizeof(code));
+  bool match = adc_8080_cpu_run(cpu, NULL, 100, &stop) == 11 &&
+               stop.reason == ADC_8080_CPU_STOP_HALT && stop.pc == 0x0002;
+  match = match && adc_8080_cpu_run(cpu, NULL, 100, &stop) == 0 &&
+          stop.reason == ADC_8080_CPU_STOP_HALT;
+
+  // RST 1, then the HLT it jumps to.
+  adc_8080_cpu_debug debug;
+  adc_8080_cpu_debug_init(&debug);
+  adc_8080_cpu_debug_break(&debug, 0x0040, true);
+  adc_8080_cpu_interrupt(cpu, 0xCF);
+  match = match && adc_8080_cpu_run(cpu, &debug, 100, &stop) == 18 &&
+          stop.reason == ADC_8080_CPU_STOP_HALT && stop.pc == 0x0009;
+  match = match && adc_8080_cpu_run(cpu, &debug, 100, &stop) == 0 &&
+          stop.reason == ADC_8080_CPU_STOP_HALT;
+
+  free(prog);
+  return match;
+}
+
+#ifdef ADC_8080_CPU_OPCODE_STATS
+// Count a loop of conditional calls, returns and jumps taken and not taken,
+// then halted steps which are not counted.
+static bool check_opstats_program(void) {
+  static const uint8_t code[] = {
+      [0x0000] = 0x31, 0x00, 0x01, // LXI SP,0100h
+      0x06, 0x03,                  // MVI B,03h
+      0x05,                        // loop: DCR B
+      0xC4, 0x20, 0x00,            // CNZ sub
+      0xC2, 0x05, 0x00,            // JNZ loop
+      0x76,                        // HLT
+      [0x0020] = 0xC8,             // sub: RZ
+      0xC9,                        // RET
+  };
+  // The loop runs with B at 2, 1 and 0, calling sub on the first two.
+  static const struct {
+    uint8_t opcode;
+    uint64_t count, cycles, taken, not_taken;
+  } expected[] = {
+      {0x31, 1, 10, 0, 0}, {0x06, 1, 7, 0, 0},  {0x05, 3, 15, 0, 0},
+      {0xC4, 3, 45, 2, 1}, {0xC8, 2, 10, 0, 2}, {0xC9, 2, 20, 0, 0},
+      {0xC2, 3, 30, 2, 1}, {0x76, 1, 7, 0, 0},
+  };
+
+  program *prog = calloc(1, sizeof(program));
+  if (!prog)
+    return false;
+  adc_8080_cpu *cpu = &prog->cpu;
+
+  program_load(prog, code, sizeof(code));
+  while (!cpu->halted)
+    adc_8080_cpu_step(cpu);
+  for (int i = 0; i < 4; i++)
+    adc_8080_cpu_step(cpu);
+
+  const adc_8080_cpu_opstats *stats = &cpu->opstats;
+  uint64_t total = 0;
+  for (int i = 0; i < 256; i++)
+    total += stats->count[i];
+  bool match = cpu->halted && cpu->cycle_count == 144 && total == 16;
+  for (size_t i = 0; match && i < sizeof(expected) / sizeof(expected[0]);
+       i++) {
+    uint8_t opcode = expected[i].opcode;
+    match = stats->count[opcode] == expected[i].count &&
+            stats->cycles[opcode] == expected[i].cycles &&
+            stats->taken[opcode] == expected[i].taken &&
+            stats->not_taken[opcode] == expected[i].not_taken;
+  }
+
+  free(prog);
+  return match;
+}
+#endif
@@ -0,0 +1,449 @@
+// Generates synthetic 8080 programs to benchmark the cpu with a chosen
+// workload shape: the opcode mix, branch density, working set size, call
+// depth, I/O frequency and self-modifying code rate.
+//
+// The output is a .COM image loaded at 0x0100 like the test roms. It runs a
+// loop body of generated instructions a number of times and then jumps to
+// 0x0000, the BDOS warm boot the test harnesses treat as the end of a rom:
+//
+//   0x0100       setup, then the loop: advance the memory pointer through
+//                the working set, run the body and count down the iterations
+//   ...          with a call depth, one subroutine per level, each running
+//                its part of the body and calling the next level
+//   DATA_ADDR    the working set, read and written through HL and by address
+//   VARS_ADDR    the iteration counter and the memory pointer
+//   STACK_ADDR   the top of the stack
+//
+// Body instructions write A, B, C, D, E, the flags, memory and the stack. HL
+// is only moved by INX H, at most MAX_LENGTH past the working set per pass,
+// and by XTHL, which comes in pairs that restore it, so HL keeps pointing
+// into or just past the working set. Branches are forward conditional
+// jumps over the next 1 to 3 instructions, taken depending on the flags. I/O
+// is IN and OUT on port IO_PORT, which the harnesses ignore. Self-modifying
+// code is a STA into the operand of the ADI that follows it.
+//
+// Usage: 8080_rom_gen [options] <output .COM>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOAD_ADDR 0x0100
+#define DATA_ADDR 0x4000
+#define MAX_WORKING_SET 0x8000
+#define VARS_ADDR 0xE000
+#define COUNTER_ADDR VARS_ADDR
+#define POINTER_ADDR (VARS_ADDR + 2)
+#define STACK_ADDR 0xF000
+#define IO_PORT 0x10
+// Step of the memory pointer per iteration, odd so it visits every address of
+// the working set.
+#define POINTER_STRIDE 0x0107
+// Most body instructions, INX H may move HL this far past the working set.
+#define MAX_LENGTH 0x1000
+#define MAX_CALL_DEPTH 64
+// Longest unit of instructions, a branch over 3 self-modifying pairs.
+#define MAX_UNIT_BYTES 20
+
+enum unit_class {
+  UNIT_ALU,
+  UNIT_MOVE,
+  UNIT_MEMORY,
+  UNIT_STACK,
+  UNIT_BRANCH,
+  UNIT_IO,
+  UNIT_SMC,
+  UNIT_CLASSES
+};
+
+static const char *s_class_names[UNIT_CLASSES] = {
+    "alu", "move", "memory", "stack", "branch", "io", "smc"};
+
+typedef struct {
+  uint64_t seed;
+  uint64_t length;
+  uint64_t iterations;
+  // Relative weights of the plain instruction classes.
+  uint64_t weights[UNIT_STACK + 1];
+  // Percent of the body instructions that are branches, I/O and
+  // self-modifying code.
+  uint64_t branch;
+  uint64_t io;
+  uint64_t smc;
+  uint64_t working_set;
+  uint64_t call_depth;
+} gen_config;
+
+static gen_config s_config = {
+    .seed = 1,
+    .length = 256,
+    .iterations = 10000,
+    .weights = {4, 3, 2, 1},
+    .branch = 10,
+    .io = 0,
+    .smc = 0,
+    .working_set = 0x1000,
+    .call_depth = 0,
+};
+
+// Registers the body may write: B, C, D, E and A.
+static const uint8_t s_registers[] = {0, 1, 2, 3, 7};
+
+static uint8_t s_image[DATA_ADDR - LOAD_ADDR];
+static uint16_t s_addr = LOAD_ADDR;
+static uint64_t s_rng;
+static uint64_t s_counts[UNIT_CLASSES];
+static uint64_t s_instructions;
+
+static uint64_t next_random(void) {
+  uint64_t z = (s_rng += 0x9E3779B97F4A7C15u);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+  return z ^ (z >> 31);
+}
+
+static uint32_t random_below(uint32_t n) {
+  return (uint32_t)(next_random() % n);
+}
+
+static uint8_t random_register(void) {
+  return s_registers[random_below(sizeof(s_registers))];
+}
+
+static void emit(uint8_t byte) { s_image[s_addr++ - LOAD_ADDR] = byte; }
+
+static void emit_word(uint8_t op, uint16_t word) {
+  emit(op);
+  emit((uint8_t)word);
+  emit((uint8_t)(word >> 8));
+}
+
+static void emit_alu(void) {
+  switch (random_below(6)) {
+  case 0:
+  case 1:
+    // ADD to CMP with a register.
+    emit(0x80 | random_below(8) << 3 | random_register());
+    break;
+  case 2:
+    // ADI to CPI.
+    emit(0xC6 | random_below(8) << 3);
+    emit((uint8_t)next_random());
+    break;
+  case 3:
+    // INR or DCR of a register.
+    emit(0x04 | random_register() << 3 | random_below(2));
+    break;
+  case 4:
+    // RLC, RRC, RAL, RAR, DAA, CMA, STC or CMC.
+    emit(0x07 | random_below(8) << 3);
+    break;
+  default:
+    // INX or DCX of BC or DE.
+    emit(0x03 | random_below(2) << 4 | random_below(2) << 3);
+    break;
+  }
+}
+
+static void emit_move(void) {
+  if (random_below(4) == 0) {
+    emit(0x06 | random_register() << 3);
+    emit((uint8_t)next_random());
+  } else {
+    emit(0x40 | random_register() << 3 | random_register());
+  }
+}
+
+static void emit_memory(void) {
+  switch (random_below(7)) {
+  case 0:
+    emit(0x46 | random_register() << 3);
+    break;
+  case 1:
+    emit(0x70 | random_register());
+    break;
+  case 2:
+    // ADD M to CMP M.
+    emit(0x86 | random_below(8) << 3);
+    break;
+  case 3:
+    // INR M or DCR M.
+    emit(0x34 | random_below(2));
+    break;
+  case 4:
+    emit(0x36);
+    emit((uint8_t)next_random());
+    break;
+  case 5:
+    // LDA or STA of an address in the working set.
+    emit_word(random_below(2) ? 0x3A : 0x32,
+              (uint16_t)(DATA_ADDR + random_below(s_config.working_set)));
+    break;
+  default:
+    emit(0x23); // INX H
+    break;
+  }
+}
+
+// Emit a balanced pair, so it counts as two instructions.
+static void emit_stack(void) {
+  static const uint8_t pairs[] = {0x00, 0x10, 0x30}; // BC, DE, PSW
+  if (random_below(4) == 0) {
+    emit(0xE3); // XTHL, twice
+    emit(0xE3);
+  } else {
+    emit(0xC5 | pairs[random_below(sizeof(pairs))]);
+    emit(0xC1 | pairs[random_below(sizeof(pairs))]);
+  }
+}
+
+static enum unit_class choose_class(bool branches) {
+  uint32_t r = random_below(100);
+  if (r < s_config.branch)
+    return branches ? UNIT_BRANCH : UNIT_ALU;
+  r -= (uint32_t)s_config.branch;
+  if (r < s_config.io)
+    return UNIT_IO;
+  r -= (uint32_t)s_config.io;
+  if (r < s_config.smc)
+    return UNIT_SMC;
+
+  uint64_t total = 0;
+  for (int i = 0; i <= UNIT_STACK; i++)
+    total += s_config.weights[i];
+  uint64_t w = next_random() % total;
+  for (int i = 0; i < UNIT_STACK; i++) {
+    if (w < s_config.weights[i])
+      return (enum unit_class)i;
+    w -= s_config.weights[i];
+  }
+  return UNIT_STACK;
+}
+
+static void emit_unit(bool branches) {
+  enum unit_class unit = choose_class(branches);
+  s_counts[unit]++;
+  s_instructions++;
+
+  switch (unit) {
+  case UNIT_ALU:
+    emit_alu();
+    break;
+  case UNIT_MOVE:
+    emit_move();
+    break;
+  case UNIT_MEMORY:
+    emit_memory();
+    break;
+  case UNIT_STACK:
+    emit_stack();
+    s_instructions++;
+    break;
+  case UNIT_BRANCH: {
+    // Jcc over the next 1 to 3 units.
+    uint16_t jump = s_addr;
+    emit_word(0xC2 | random_below(8) << 3, 0);
+    int skipped = 1 + (int)random_below(3);
+    for (int i = 0; i < skipped; i++)
+      emit_unit(false);
+    s_image[jump + 1 - LOAD_ADDR] = (uint8_t)s_addr;
+    s_image[jump + 2 - LOAD_ADDR] = (uint8_t)(s_addr >> 8);
+    break;
+  }
+  case UNIT_IO:
+    emit(random_below(2) ? 0xDB : 0xD3);
+    emit(IO_PORT);
+    break;
+  case UNIT_SMC:
+    // STA into the operand of the next instruction, an ADI.
+    emit_word(0x32, (uint16_t)(s_addr + 4));
+    emit(0xC6);
+    emit((uint8_t)next_random());
+    s_instructions++;
+    break;
+  default:
+    break;
+  }
+}
+
+// Emit body instructions up to the given total.
+//
+// Returns false if the program no longer fits below the working set.
+static bool emit_body(uint64_t total) {
+  while (s_instructions < total) {
+    if (s_addr + MAX_UNIT_BYTES > DATA_ADDR)
+      return false;
+    emit_unit(true);
+  }
+  return true;
+}
+
+static bool generate(void) {
+  s_rng = s_config.seed;
+
+  emit_word(0x31, STACK_ADDR);                     // lxi sp,STACK_ADDR
+  emit_word(0x21, (uint16_t)s_config.iterations);  // lxi h,iterations
+  emit_word(0x22, COUNTER_ADDR);                   // shld counter
+  emit_word(0x21, DATA_ADDR);                      // lxi h,DATA_ADDR
+  emit_word(0x22, POINTER_ADDR);                   // shld pointer
+
+  uint16_t loop = s_addr;
+  emit_word(0x2A, POINTER_ADDR);                   // lhld pointer
+  emit_word(0x11, POINTER_STRIDE);                 // lxi d,POINTER_STRIDE
+  emit(0x19);                                      // dad d
+  emit(0x7C);                                      // mov a,h
+  emit(0xE6);                                      // ani mask
+  emit((uint8_t)((s_config.working_set - 1) >> 8));
+  emit(0xC6);                                      // adi DATA_ADDR >> 8
+  emit(DATA_ADDR >> 8);
+  emit(0x67);                                      // mov h,a
+  emit_word(0x22, POINTER_ADDR);                   // shld pointer
+
+  uint16_t call = s_addr;
+  if (s_config.call_depth == 0) {
+    if (!emit_body(s_config.length))
+      return false;
+  } else {
+    emit_word(0xCD, 0);                            // call level 1
+  }
+
+  emit_word(0x2A, COUNTER_ADDR);                   // lhld counter
+  emit(0x2B);                                      // dcx h
+  emit_word(0x22, COUNTER_ADDR);                   // shld counter
+  emit(0x7C);                                      // mov a,h
+  emit(0xB5);                                      // ora l
+  emit_word(0xC2, loop);                           // jnz loop
+  emit_word(0xC3, 0x0000);                         // jmp 0
+
+  if (s_config.call_depth > 0) {
+    s_image[call + 1 - LOAD_ADDR] = (uint8_t)s_addr;
+    s_image[call + 2 - LOAD_ADDR] = (uint8_t)(s_addr >> 8);
+  }
+  for (uint64_t level = 1; level <= s_config.call_depth; level++) {
+    if (!emit_body(s_config.length * level / s_config.call_depth))
+      return false;
+    if (level < s_config.call_depth)
+      emit_word(0xCD, (uint16_t)(s_addr + 4));     // call next level
+    emit(0xC9);                                    // ret
+  }
+  return true;
+}
+
+static bool parse_u64(const char *text, uint64_t *value) {
+  char *end;
+  *value = strtoull(text, &end, 0);
+  return *text != '\0' && *end == '\0';
+}
+
+static bool is_power_of_two(uint64_t v) { return v && !(v & (v - 1)); }
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [--seed S] [--length N] [--iterations N] [--alu W] "
+          "[--move W] [--memory W] [--stack W] [--branch P] [--io P] "
+          "[--smc P] [--working-set BYTES] [--call-depth N] "
+          "<output .COM>\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  static const char *weight_options[] = {"--alu", "--move", "--memory",
+                                         "--stack"};
+  const char *output = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (i == argc - 1 && argv[i][0] != '-') {
+      output = argv[i];
+      break;
+    }
+
+    uint64_t value;
+    if (i + 1 >= argc || !parse_u64(argv[i + 1], &value)) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    bool valid = true;
+    if (strcmp(argv[i], "--seed") == 0) {
+      s_config.seed = value;
+    } else if (strcmp(argv[i], "--length") == 0) {
+      s_config.length = value;
+    } else if (strcmp(argv[i], "--iterations") == 0) {
+      s_config.iterations = value;
+    } else if (strcmp(argv[i], "--branch") == 0) {
+      s_config.branch = value;
+    } else if (strcmp(argv[i], "--io") == 0) {
+      s_config.io = value;
+    } else if (strcmp(argv[i], "--smc") == 0) {
+      s_config.smc = value;
+    } else if (strcmp(argv[i], "--working-set") == 0) {
+      s_config.working_set = value;
+    } else if (strcmp(argv[i], "--call-depth") == 0) {
+      s_config.call_depth = value;
+    } else {
+      valid = false;
+      for (int w = 0; w <= UNIT_STACK; w++) {
+        if (strcmp(argv[i], weight_options[w]) == 0) {
+          s_config.weights[w] = value;
+          valid = true;
+        }
+      }
+    }
+    if (!valid) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+  if (!output) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t weights = 0;
+  for (int w = 0; w <= UNIT_STACK; w++)
+    weights += s_config.weights[w];
+  const char *error = NULL;
+  if (s_config.length == 0 || s_config.length > MAX_LENGTH)
+    error = "The length must be 1 to 4096 instructions";
+  else if (s_config.iterations == 0 || s_config.iterations > 0xFFFF)
+    error = "The iterations must be 1 to 65535";
+  else if (s_config.branch + s_config.io + s_config.smc > 100)
+    error = "Branch, I/O and self-modifying code percents exceed 100";
+  else if (weights == 0)
+    error = "At least one class weight must be positive";
+  else if (s_config.working_set < 0x100 ||
+           s_config.working_set > MAX_WORKING_SET ||
+           !is_power_of_two(s_config.working_set))
+    error = "The working set must be a power of two from 256 to 32768";
+  else if (s_config.call_depth > MAX_CALL_DEPTH)
+    error = "The call depth must be 0 to 64";
+  if (error) {
+    fprintf(stderr, "%s!\n", error);
+    return EXIT_FAILURE;
+  }
+
+  if (!generate()) {
+    fprintf(stderr, "The program does not fit below 0x%04X!\n", DATA_ADDR);
+    return EXIT_FAILURE;
+  }
+
+  FILE *file = fopen(output, "wb");
+  if (!file) {
+    fprintf(stderr, "Failed to fopen() '%s'!\n", output);
+    return EXIT_FAILURE;
+  }
+  size_t size = s_addr - LOAD_ADDR;
+  bool written = fwrite(s_image, 1, size, file) == size;
+  if (fclose(file) != 0 || !written) {
+    fprintf(stderr, "Failed to write '%s'!\n", output);
+    return EXIT_FAILURE;
+  }
+
+  printf("%s: %zu bytes, %llu body instructions:", output, size,
+         (unsigned long long)s_instructions);
+  for (int i = 0; i < UNIT_CLASSES; i++)
+    printf(" %s %llu", s_class_names[i], (unsigned long long)s_counts[i]);
+  printf("\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,807 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "adc_8080_bdos.h"
+
+#include <assert.h> // For assert
+#include <ctype.h> // For toupper
+#include <dirent.h> // For opendir, readdir, closedir
+#include <stdio.h> // For FILE, fopen, fread, fwrite, fseek, snprintf
+#include <stdlib.h> // For calloc, free
+#include <string.h> // For memcmp, memcpy, memset, strchr, strlen, strrchr
+#include <sys/stat.h> // For stat
+
+#define PATH_SIZE 4096
+#define CONSOLE_SIZE 4096
+// Files of the program kept open between calls, the oldest is closed to
+// open another.
+#define OPEN_FILES 8
+#define RECORD_SIZE 128
+#define EXTENT_RECORDS 128
+#define DEFAULT_DMA 0x0080
+#define DEFAULT_FCB1 0x005C
+#define DEFAULT_FCB2 0x006C
+#define COMMAND_TAIL 0x0080
+#define PROGRAM_START 0x0100
+#define WARM_BOOT (ADC_8080_BDOS_BIOS + 3)
+#define OPCODE_JMP 0xC3
+#define RET_CYCLES 10
+// ^Z, pads the last record of a file and reads at the end of the console.
+#define EOF_CHAR 0x1A
+// Fills the unused entries of a directory record.
+#define EMPTY_ENTRY 0xE5
+
+// FCB layout: drive, 8.3 blank padded name, extent, S1, S2, record count,
+// allocation map, current record and random record. Programs may give only
+// FCB_SIZE bytes when they do not use random access.
+#define FCB_NAME 1
+#define FCB_EX 12
+#define FCB_S2 14
+#define FCB_RC 15
+#define FCB_NEW_NAME 17
+#define FCB_CR 32
+#define FCB_R0 33
+#define FCB_SIZE 33
+#define FCB_RANDOM_SIZE 36
+#define NAME_SIZE 11
+#define DIR_ENTRY_SIZE 32
+
+enum {
+  P_TERMCPM = 0,
+  C_READ = 1,
+  C_WRITE = 2,
+  C_RAWIO = 6,
+  C_WRITESTR = 9,
+  C_READSTR = 10,
+  C_STAT = 11,
+  S_BDOSVER = 12,
+  DRV_ALLRESET = 13,
+  DRV_SET = 14,
+  F_OPEN = 15,
+  F_CLOSE = 16,
+  F_SFIRST = 17,
+  F_SNEXT = 18,
+  F_DELETE = 19,
+  F_READ = 20,
+  F_WRITE = 21,
+  F_MAKE = 22,
+  F_RENAME = 23,
+  DRV_LOGINVEC = 24,
+  DRV_GET = 25,
+  F_DMAOFF = 26,
+  F_USERNUM = 32,
+  F_READRAND = 33,
+  F_WRITERAND = 34,
+  F_SIZE = 35,
+  F_RANDREC = 36
+};
+
+typedef struct {
+  // Upper case FCB name of the file, FILE is NULL for a free slot.
+  uint8_t name[NAME_SIZE];
+  FILE *file;
+} open_file;
+
+struct adc_8080_bdos {
+  const char *dir;
+  FILE *in;
+  FILE *out;
+  bool exited;
+  uint64_t calls;
+  uint16_t dma;
+  uint8_t drive;
+  uint8_t user;
+  // Directory read by F_SFIRST and F_SNEXT, and the name searched for.
+  DIR *search;
+  uint8_t search_name[NAME_SIZE];
+  open_file files[OPEN_FILES];
+  int next_file;
+  size_t console_size;
+  uint8_t console[CONSOLE_SIZE];
+};
+
+static inline uint8_t peek(adc_8080_cpu *cpu, uint16_t addr) {
+  return cpu->read_byte(cpu->userdata, addr);
+}
+
+static inline void poke(adc_8080_cpu *cpu, uint16_t addr, uint8_t val) {
+  cpu->write_byte(cpu->userdata, addr, val);
+  adc_8080_cpu_mark_dirty(cpu, addr);
+}
+
+// Console
+
+static void console_put(adc_8080_bdos *bdos, uint8_t c) {
+  if (!bdos->out)
+    return;
+  if (bdos->console_size == CONSOLE_SIZE)
+    adc_8080_bdos_flush(bdos);
+  bdos->console[bdos->console_size++] = c;
+}
+
+static uint8_t console_get(adc_8080_bdos *bdos) {
+  adc_8080_bdos_flush(bdos);
+  int c = bdos->in ? fgetc(bdos->in) : EOF;
+  if (c == EOF)
+    return EOF_CHAR;
+  return c == '\n' ? '\r' : (uint8_t)c;
+}
+
+// Read a line into the buffer at addr, its first byte is the most characters
+// it takes. The count is stored in the second byte.
+static void console_read_line(adc_8080_bdos *bdos, adc_8080_cpu *cpu,
+                              uint16_t addr) {
+  uint8_t max = peek(cpu, addr);
+  uint8_t count = 0;
+  for (;;) {
+    uint8_t c = console_get(bdos);
+    if (c == '\r' || c == EOF_CHAR)
+      break;
+    if (count < max)
+      poke(cpu, addr + 2 + count++, c);
+  }
+  poke(cpu, addr + 1, count);
+}
+
+// File names
+
+static bool valid_name_char(char c) {
+  return c > ' ' && c < 0x7F && !strchr("<>.,;:=?*[]", c);
+}
+
+// Convert a host file name to an upper case FCB name.
+//
+// Returns false if it does not fit in 8.3 characters.
+static bool host_to_name(const char *host, uint8_t *name) {
+  const char *dot = strrchr(host, '.');
+  size_t base = dot ? (size_t)(dot - host) : strlen(host);
+  size_t ext = dot ? strlen(dot + 1) : 0;
+  if (base == 0 || base > 8 || ext > 3)
+    return false;
+
+  memset(name, ' ', NAME_SIZE);
+  for (size_t i = 0; i < base; i++) {
+    if (!valid_name_char(host[i]))
+      return false;
+    name[i] = toupper((unsigned char)host[i]);
+  }
+  for (size_t i = 0; i < ext; i++) {
+    if (!valid_name_char(dot[1 + i]))
+      return false;
+    name[8 + i] = toupper((unsigned char)dot[1 + i]);
+  }
+  return true;
+}
+
+// Copy an FCB name without its attribute bits, in upper case.
+static void fcb_name(const uint8_t *src, uint8_t *name) {
+  for (int i = 0; i < NAME_SIZE; i++)
+    name[i] = toupper(src[i] & 0x7F);
+}
+
+static bool name_matches(const uint8_t *pattern, const uint8_t *name) {
+  for (int i = 0; i < NAME_SIZE; i++)
+    if (pattern[i] != '?' && pattern[i] != name[i])
+      return false;
+  return true;
+}
+
+// Host path of a file made by the program, e.g. dir/HELLO.HEX.
+static void name_to_path(const adc_8080_bdos *bdos, const uint8_t *name,
+                         char *path) {
+  int base = 8, ext = 3;
+  while (base > 0 && name[base - 1] == ' ')
+    base--;
+  while (ext > 0 && name[8 + ext - 1] == ' ')
+    ext--;
+  snprintf(path, PATH_SIZE, "%s/%.*s%s%.*s", bdos->dir, base,
+           (const char *)name, ext > 0 ? "." : "", ext,
+           (const char *)name + 8);
+}
+
+// Find the next host file matching the pattern in an open directory.
+//
+// Returns false once there are no more.
+static bool next_match(const adc_8080_bdos *bdos, DIR *dir,
+                       const uint8_t *pattern, uint8_t *name, char *path) {
+  struct dirent *entry;
+  struct stat st;
+  while ((entry = readdir(dir))) {
+    if (!host_to_name(entry->d_name, name) || !name_matches(pattern, name))
+      continue;
+    snprintf(path, PATH_SIZE, "%s/%s", bdos->dir, entry->d_name);
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+      return true;
+  }
+  return false;
+}
+
+static bool find_file(const adc_8080_bdos *bdos, const uint8_t *pattern,
+                      char *path) {
+  DIR *dir = opendir(bdos->dir);
+  if (!dir)
+    return false;
+  uint8_t name[NAME_SIZE];
+  bool found = next_match(bdos, dir, pattern, name, path);
+  closedir(dir);
+  return found;
+}
+
+// Open files
+
+static open_file *cached_file(adc_8080_bdos *bdos, const uint8_t *name) {
+  for (int i = 0; i < OPEN_FILES; i++) {
+    open_file *file = &bdos->files[i];
+    if (file->file && memcmp(file->name, name, NAME_SIZE) == 0)
+      return file;
+  }
+  return NULL;
+}
+
+static bool close_file(adc_8080_bdos *bdos, const uint8_t *name) {
+  open_file *file = cached_file(bdos, name);
+  if (!file)
+    return false;
+  fclose(file->file);
+  file->file = NULL;
+  return true;
+}
+
+// Returns the open file of the name, opening it if it is not open yet. Make
+// creates the file, or truncates it.
+//
+// Returns NULL if there is no such file or it can not be opened.
+static open_file *get_file(adc_8080_bdos *bdos, const uint8_t *name,
+                           bool make) {
+  open_file *file = cached_file(bdos, name);
+  if (file && !make)
+    return file;
+  if (file)
+    close_file(bdos, name);
+
+  char path[PATH_SIZE];
+  FILE *host = NULL;
+  if (find_file(bdos, name, path)) {
+    host = fopen(path, make ? "w+b" : "r+b");
+    if (!host && !make)
+      host = fopen(path, "rb");
+  } else if (make) {
+    name_to_path(bdos, name, path);
+    host = fopen(path, "w+b");
+  }
+  if (!host)
+    return NULL;
+
+  file = NULL;
+  for (int i = 0; i < OPEN_FILES && !file; i++)
+    if (!bdos->files[i].file)
+      file = &bdos->files[i];
+  if (!file) {
+    file = &bdos->files[bdos->next_file];
+    bdos->next_file = (bdos->next_file + 1) % OPEN_FILES;
+    fclose(file->file);
+  }
+  memcpy(file->name, name, NAME_SIZE);
+  file->file = host;
+  return file;
+}
+
+static uint32_t file_records(FILE *file) {
+  if (fseek(file, 0, SEEK_END) != 0)
+    return 0;
+  long size = ftell(file);
+  return size > 0 ? (uint32_t)((size + RECORD_SIZE - 1) / RECORD_SIZE) : 0;
+}
+
+// Returns 0, or 1 at the end of the file.
+static uint8_t read_record(adc_8080_bdos *bdos, adc_8080_cpu *cpu,
+                           FILE *file, uint32_t record) {
+  uint8_t data[RECORD_SIZE];
+  if (fseek(file, (long)record * RECORD_SIZE, SEEK_SET) != 0)
+    return 1;
+  size_t size = fread(data, 1, RECORD_SIZE, file);
+  if (size == 0)
+    return 1;
+  memset(data + size, EOF_CHAR, RECORD_SIZE - size);
+  for (int i = 0; i < RECORD_SIZE; i++)
+    poke(cpu, bdos->dma + i, data[i]);
+  return 0;
+}
+
+// Returns 0, or 2 when the disk is full.
+static uint8_t write_record(adc_8080_bdos *bdos, adc_8080_cpu *cpu,
+                            FILE *file, uint32_t record) {
+  uint8_t data[RECORD_SIZE];
+  for (int i = 0; i < RECORD_SIZE; i++)
+    data[i] = peek(cpu, bdos->dma + i);
+  if (fseek(file, (long)record * RECORD_SIZE, SEEK_SET) != 0 ||
+      fwrite(data, 1, RECORD_SIZE, file) != RECORD_SIZE)
+    return 2;
+  return 0;
+}
+
+// FCBs
+
+static void load_fcb(adc_8080_cpu *cpu, uint16_t addr, uint8_t *fcb,
+                     int size) {
+  for (int i = 0; i < size; i++)
+    fcb[i] = peek(cpu, addr + i);
+}
+
+// Store the position fields of the FCB, from the extent on.
+static void store_fcb(adc_8080_cpu *cpu, uint16_t addr, const uint8_t *fcb,
+                      int size) {
+  for (int i = FCB_EX; i < size; i++)
+    poke(cpu, addr + i, fcb[i]);
+}
+
+// Sequential record of the extent, S2 and current record fields.
+static uint32_t fcb_record(const uint8_t *fcb) {
+  return (uint32_t)(fcb[FCB_S2] & 0x3F) * 32 * EXTENT_RECORDS +
+         (uint32_t)(fcb[FCB_EX] & 0x1F) * EXTENT_RECORDS +
+         (fcb[FCB_CR] & 0x7F);
+}
+
+// Set the record count of the current extent of a file of the given number
+// of records.
+static void fcb_set_rc(uint8_t *fcb, uint32_t records) {
+  uint32_t start = fcb_record(fcb) / EXTENT_RECORDS * EXTENT_RECORDS;
+  uint32_t rc = records > start ? records - start : 0;
+  fcb[FCB_RC] = rc < EXTENT_RECORDS ? rc : EXTENT_RECORDS;
+}
+
+static void fcb_set_record(uint8_t *fcb, uint32_t record, uint32_t records) {
+  fcb[FCB_CR] = record % EXTENT_RECORDS;
+  fcb[FCB_EX] = (record / EXTENT_RECORDS) % 32;
+  fcb[FCB_S2] = (record / (32 * EXTENT_RECORDS)) & 0x3F;
+  fcb_set_rc(fcb, records);
+}
+
+static uint32_t fcb_random_record(const uint8_t *fcb) {
+  return fcb[FCB_R0] | (uint32_t)fcb[FCB_R0 + 1] << 8 |
+         (uint32_t)fcb[FCB_R0 + 2] << 16;
+}
+
+static void fcb_set_random_record(uint8_t *fcb, uint32_t record) {
+  fcb[FCB_R0] = record & 0xFF;
+  fcb[FCB_R0 + 1] = (record >> 8) & 0xFF;
+  fcb[FCB_R0 + 2] = (record >> 16) & 0xFF;
+}
+
+// Parse a file name of the command tail such as "B:HELLO.*" into an FCB.
+static const char *parse_fcb(const char *s, uint8_t *fcb) {
+  memset(fcb, 0, 16);
+  memset(fcb + FCB_NAME, ' ', NAME_SIZE);
+  while (*s == ' ')
+    s++;
+  if (s[0] && s[1] == ':') {
+    fcb[0] = toupper((unsigned char)s[0]) - 'A' + 1;
+    s += 2;
+  }
+
+  int fields[2] = {8, 3};
+  uint8_t *out = fcb + FCB_NAME;
+  for (int field = 0; field < 2; field++) {
+    for (int i = 0; *s && *s != ' ' && *s != '.'; s++) {
+      if (*s == '*') {
+        while (i < fields[field])
+          out[i++] = '?';
+      } else if (i < fields[field]) {
+        out[i++] = toupper((unsigned char)*s);
+      }
+    }
+    if (*s == '.')
+      s++;
+    out += fields[field];
+  }
+  return s;
+}
+
+// Functions
+
+static void set_result(adc_8080_cpu *cpu, uint16_t value) {
+  cpu->ra = cpu->rl = value & 0xFF;
+  cpu->rb = cpu->rh = value >> 8;
+}
+
+static void warm_boot(adc_8080_bdos *bdos) {
+  bdos->exited = true;
+  adc_8080_bdos_flush(bdos);
+}
+
+static void close_search(adc_8080_bdos *bdos) {
+  if (bdos->search)
+    closedir(bdos->search);
+  bdos->search = NULL;
+}
+
+// Write the directory entry of the next match to the DMA buffer.
+//
+// Returns the directory code 0, or 0xFF once there are no more.
+static uint8_t search_next(adc_8080_bdos *bdos, adc_8080_cpu *cpu) {
+  uint8_t name[NAME_SIZE];
+  char path[PATH_SIZE];
+  struct stat st;
+  if (!bdos->search ||
+      !next_match(bdos, bdos->search, bdos->search_name, name, path) ||
+      stat(path, &st) != 0) {
+    close_search(bdos);
+    return 0xFF;
+  }
+
+  // A single entry for the whole file, with the position of its last record.
+  uint8_t entry[FCB_SIZE];
+  memset(entry, 0, sizeof(entry));
+  entry[0] = bdos->user;
+  memcpy(entry + FCB_NAME, name, NAME_SIZE);
+  uint32_t records = (uint32_t)((st.st_size + RECORD_SIZE - 1) / RECORD_SIZE);
+  fcb_set_record(entry, records > 0 ? records - 1 : 0, records);
+  entry[FCB_CR] = 0;
+
+  for (int i = 0; i < RECORD_SIZE; i++)
+    poke(cpu, bdos->dma + i, i < DIR_ENTRY_SIZE ? entry[i] : EMPTY_ENTRY);
+  return 0;
+}
+
+static uint8_t search_first(adc_8080_bdos *bdos, adc_8080_cpu *cpu,
+                            const uint8_t *fcb) {
+  close_search(bdos);
+  if (fcb[0] == '?')
+    memset(bdos->search_name, '?', NAME_SIZE);
+  else
+    fcb_name(fcb + FCB_NAME, bdos->search_name);
+  bdos->search = opendir(bdos->dir);
+  return search_next(bdos, cpu);
+}
+
+static uint8_t delete_files(adc_8080_bdos *bdos, const uint8_t *pattern) {
+  DIR *dir = opendir(bdos->dir);
+  if (!dir)
+    return 0xFF;
+  uint8_t name[NAME_SIZE];
+  char path[PATH_SIZE];
+  uint8_t result = 0xFF;
+  while (next_match(bdos, dir, pattern, name, path)) {
+    close_file(bdos, name);
+    if (remove(path) == 0)
+      result = 0;
+  }
+  closedir(dir);
+  return result;
+}
+
+static uint8_t rename_file(adc_8080_bdos *bdos, const uint8_t *fcb) {
+  uint8_t from[NAME_SIZE], to[NAME_SIZE];
+  char from_path[PATH_SIZE], to_path[PATH_SIZE];
+  fcb_name(fcb + FCB_NAME, from);
+  fcb_name(fcb + FCB_NEW_NAME, to);
+  if (!find_file(bdos, from, from_path))
+    return 0xFF;
+  name_to_path(bdos, to, to_path);
+  close_file(bdos, from);
+  close_file(bdos, to);
+  return rename(from_path, to_path) == 0 ? 0 : 0xFF;
+}
+
+// Sequential and random reads and writes, and the file size.
+static uint8_t file_access(adc_8080_bdos *bdos, adc_8080_cpu *cpu,
+                           uint8_t function, uint16_t addr) {
+  bool random = function >= F_READRAND;
+  int size = random ? FCB_RANDOM_SIZE : FCB_SIZE;
+  uint8_t fcb[FCB_RANDOM_SIZE];
+  uint8_t name[NAME_SIZE];
+  load_fcb(cpu, addr, fcb, size);
+  fcb_name(fcb + FCB_NAME, name);
+
+  open_file *file = get_file(bdos, name, false);
+  if (!file)
+    return 0xFF;
+
+  uint32_t record = random ? fcb_random_record(fcb) : fcb_record(fcb);
+  uint8_t result = 0;
+  switch (function) {
+  case F_READ:
+    result = read_record(bdos, cpu, file->file, record);
+    record += result == 0;
+    break;
+  case F_WRITE:
+    result = write_record(bdos, cpu, file->file, record);
+    record += result == 0;
+    break;
+  case F_READRAND:
+  case F_WRITERAND:
+    // Records past the 8 MB of a CP/M 2.2 file.
+    if (record > 0xFFFF)
+      return 6;
+    result = function == F_READRAND
+                 ? read_record(bdos, cpu, file->file, record)
+                 : write_record(bdos, cpu, file->file, record);
+    break;
+  case F_SIZE:
+    fcb_set_random_record(fcb, file_records(file->file));
+    store_fcb(cpu, addr, fcb, size);
+    return 0;
+  }
+
+  // The next sequential access continues from the record.
+  fcb_set_record(fcb, record, file_records(file->file));
+  store_fcb(cpu, addr, fcb, size);
+  return result;
+}
+
+// Public api implementation
+
+adc_8080_bdos *adc_8080_bdos_new(const char *dir, FILE *in, FILE *out) {
+  assert(dir);
+
+  adc_8080_bdos *bdos = calloc(1, sizeof(adc_8080_bdos));
+  if (!bdos)
+    return NULL;
+
+  bdos->dir = dir;
+  bdos->in = in;
+  bdos->out = out;
+  bdos->dma = DEFAULT_DMA;
+  return bdos;
+}
+
+void adc_8080_bdos_free(adc_8080_bdos **bdos) {
+  assert(bdos);
+
+  if (!*bdos)
+    return;
+
+  adc_8080_bdos_flush(*bdos);
+  close_search(*bdos);
+  for (int i = 0; i < OPEN_FILES; i++)
+    if ((*bdos)->files[i].file)
+      fclose((*bdos)->files[i].file);
+  free(*bdos);
+  *bdos = NULL;
+}
+
+void adc_8080_bdos_setup(adc_8080_bdos *bdos, adc_8080_cpu *cpu,
+                         const char *tail) {
+  assert(bdos);
+  assert(cpu);
+
+  close_search(bdos);
+  for (int i = 0; i < OPEN_FILES; i++) {
+    if (bdos->files[i].file)
+      fclose(bdos->files[i].file);
+    bdos->files[i].file = NULL;
+  }
+  bdos->exited = false;
+  bdos->calls = 0;
+  bdos->dma = DEFAULT_DMA;
+  bdos->drive = 0;
+  bdos->user = 0;
+
+  // Warm boot jump, IOBYTE, current drive and the BDOS entry jump.
+  const uint8_t zero_page[8] = {OPCODE_JMP,
+                                WARM_BOOT & 0xFF,
+                                WARM_BOOT >> 8,
+                                0x00,
+                                0x00,
+                                OPCODE_JMP,
+                                ADC_8080_BDOS_BASE & 0xFF,
+                                ADC_8080_BDOS_BASE >> 8};
+  for (int i = 0; i < 8; i++)
+    poke(cpu, i, zero_page[i]);
+
+  // The CCP parses the first two words into the default FCBs, the second
+  // lies over the allocation map of the first.
+  uint8_t fcb1[16], fcb2[16];
+  const char *s = tail ? tail : "";
+  s = parse_fcb(s, fcb1);
+  parse_fcb(s, fcb2);
+  for (int i = 0; i < 16; i++) {
+    poke(cpu, DEFAULT_FCB1 + i, fcb1[i]);
+    poke(cpu, DEFAULT_FCB2 + i, fcb2[i]);
+  }
+  for (int i = DEFAULT_FCB2 + 16; i < COMMAND_TAIL; i++)
+    poke(cpu, i, 0x00);
+
+  // Upper case command tail with its leading blank, e.g. " HELLO.ASM".
+  size_t length = tail && tail[0] ? strlen(tail) + 1 : 0;
+  if (length > RECORD_SIZE - 2)
+    length = RECORD_SIZE - 2;
+  poke(cpu, COMMAND_TAIL, length);
+  for (size_t i = 0; i < length; i++)
+    poke(cpu, COMMAND_TAIL + 1 + i,
+         i == 0 ? ' ' : toupper((unsigned char)tail[i - 1]));
+  poke(cpu, COMMAND_TAIL + 1 + length, 0x00);
+
+  // Returning from the program warm boots.
+  cpu->pc = PROGRAM_START;
+  cpu->sp = ADC_8080_BDOS_BASE - 2;
+  poke(cpu, cpu->sp, 0x00);
+  poke(cpu, cpu->sp + 1, 0x00);
+}
+
+uint64_t adc_8080_bdos_run(adc_8080_bdos *bdos, adc_8080_cpu *cpu,
+                           uint64_t cycles) {
+  assert(bdos);
+  assert(cpu);
+
+  // The pc is checked between plain steps instead of arming breakpoints, so
+  // the program does not run in the debug loop of adc_8080_cpu_run().
+  uint64_t consumed = 0;
+  while (consumed < cycles && !bdos->exited) {
+    // An interrupt about to be taken or a halt do not execute the pc.
+    bool interrupt = cpu->interrupt_pending && cpu->inte;
+    if (cpu->halted && !interrupt)
+      break;
+    if (interrupt || cpu->halted)
+      consumed += adc_8080_cpu_step(cpu);
+    else if (cpu->pc == 0x0000 || cpu->pc == WARM_BOOT)
+      warm_boot(bdos);
+    else if (cpu->pc == ADC_8080_BDOS_ENTRY || cpu->pc == ADC_8080_BDOS_BASE)
+      consumed += adc_8080_bdos_call(bdos, cpu);
+    else
+      consumed += adc_8080_cpu_step(cpu);
+  }
+  return consumed;
+}
+
+int adc_8080_bdos_call(adc_8080_bdos *bdos, adc_8080_cpu *cpu) {
+  assert(bdos);
+  assert(cpu);
+
+  bdos->calls++;
+  uint8_t function = cpu->rc;
+  uint16_t de = (cpu->rd << 8) | cpu->re;
+  uint8_t fcb[FCB_RANDOM_SIZE];
+  uint8_t name[NAME_SIZE];
+  open_file *file;
+  uint16_t result = 0;
+
+  switch (function) {
+  case P_TERMCPM:
+    warm_boot(bdos);
+    return 0;
+  case C_READ:
+    result = console_get(bdos);
+    break;
+  case C_WRITE:
+    console_put(bdos, cpu->re);
+    break;
+  case C_RAWIO:
+    // 0xFF reads a character, 0xFE reads the status, others are written.
+    if (cpu->re == 0xFF)
+      result = console_get(bdos);
+    else if (cpu->re != 0xFE)
+      console_put(bdos, cpu->re);
+    break;
+  case C_WRITESTR:
+    // Stop after the whole memory if it holds no '$'.
+    for (uint32_t i = 0; i < 0x10000; i++) {
+      uint8_t c = peek(cpu, (uint16_t)(de + i));
+      if (c == '$')
+        break;
+      console_put(bdos, c);
+    }
+    break;
+  case C_READSTR:
+    console_read_line(bdos, cpu, de);
+    break;
+  case C_STAT:
+    // Nothing is ever pending, input is only read when asked for.
+    break;
+  case S_BDOSVER:
+    result = 0x0022;
+    break;
+  case DRV_ALLRESET:
+    bdos->dma = DEFAULT_DMA;
+    bdos->drive = 0;
+    break;
+  case DRV_SET:
+    bdos->drive = cpu->re & 0x0F;
+    break;
+  case F_OPEN:
+    load_fcb(cpu, de, fcb, FCB_SIZE);
+    fcb_name(fcb + FCB_NAME, name);
+    file = get_file(bdos, name, false);
+    if (!file) {
+      result = 0xFF;
+      break;
+    }
+    fcb[FCB_S2] = 0;
+    fcb_set_rc(fcb, file_records(file->file));
+    store_fcb(cpu, de, fcb, FCB_SIZE);
+    break;
+  case F_CLOSE:
+    load_fcb(cpu, de, fcb, FCB_SIZE);
+    fcb_name(fcb + FCB_NAME, name);
+    if (!close_file(bdos, name)) {
+      char path[PATH_SIZE];
+      result = find_file(bdos, name, path) ? 0 : 0xFF;
+    }
+    break;
+  case F_SFIRST:
+    load_fcb(cpu, de, fcb, FCB_SIZE);
+    result = search_first(bdos, cpu, fcb);
+    break;
+  case F_SNEXT:
+    result = search_next(bdos, cpu);
+    break;
+  case F_DELETE:
+    load_fcb(cpu, de, fcb, FCB_SIZE);
+    fcb_name(fcb + FCB_NAME, name);
+    result = delete_files(bdos, name);
+    break;
+  case F_READ:
+  case F_WRITE:
+  case F_READRAND:
+  case F_WRITERAND:
+  case F_SIZE:
+    result = file_access(bdos, cpu, function, de);
+    break;
+  case F_MAKE:
+    load_fcb(cpu, de, fcb, FCB_SIZE);
+    fcb_name(fcb + FCB_NAME, name);
+    if (!get_file(bdos, name, true)) {
+      result = 0xFF;
+      break;
+    }
+    fcb[FCB_S2] = 0;
+    fcb[FCB_RC] = 0;
+    store_fcb(cpu, de, fcb, FCB_SIZE);
+    break;
+  case F_RENAME:
+    load_fcb(cpu, de, fcb, FCB_SIZE);
+    result = rename_file(bdos, fcb);
+    break;
+  case DRV_LOGINVEC:
+    result = 1u << bdos->drive;
+    break;
+  case DRV_GET:
+    result = bdos->drive;
+    break;
+  case F_DMAOFF:
+    bdos->dma = de;
+    break;
+  case F_USERNUM:
+    if (cpu->re == 0xFF)
+      result = bdos->user;
+    else
+      bdos->user = cpu->re & 0x0F;
+    break;
+  case F_RANDREC:
+    load_fcb(cpu, de, fcb, FCB_RANDOM_SIZE);
+    fcb_set_random_record(fcb, fcb_record(fcb));
+    store_fcb(cpu, de, fcb, FCB_RANDOM_SIZE);
+    break;
+  default:
+    result = 0xFF;
+    break;
+  }
+  set_result(cpu, result);
+
+  // Return to the caller.
+  cpu->pc = peek(cpu, cpu->sp) | (peek(cpu, cpu->sp + 1) << 8);
+  cpu->sp += 2;
+  cpu->cycle_count += RET_CYCLES;
+  return RET_CYCLES;
+}
+
+bool adc_8080_bdos_exited(const adc_8080_bdos *bdos) {
+  assert(bdos);
+
+  return bdos->exited;
+}
+
+uint64_t adc_8080_bdos_calls(const adc_8080_bdos *bdos) {
+  assert(bdos);
+
+  return bdos->calls;
+}
+
+void adc_8080_bdos_flush(adc_8080_bdos *bdos) {
+  assert(bdos);
+
+  if (!bdos->out || bdos->console_size == 0)
+    return;
+  fwrite(bdos->console, 1, bdos->console_size, bdos->out);
+  fflush(bdos->out);
+  bdos->console_size = 0;
+}
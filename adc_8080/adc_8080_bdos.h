@@ -0,0 +1,105 @@
+// adc_8080_bdos CP/M 2.2 BDOS high level emulation for adc_8080_cpu by
+// Anthony Del Ciotto. Runs transient programs (.COM files loaded at 0x0100)
+// with the BDOS functions implemented on the host instead of by guest code:
+// the console, string output and line input, and sequential and random access
+// to files through FCBs, backed by the files of a host directory.
+//
+// Calls to the BDOS entry at 0x0005 and jumps to the warm boot at 0x0000 are
+// trapped by adc_8080_bdos_run(), which checks the pc between calls to
+// adc_8080_cpu_step() instead of arming breakpoints. A trapped call runs the
+// function, sets the results in A and L, and B and H, then returns to the
+// caller as a RET would, taking its 10 cycles. C_WRITESTR writes at most 64 KiB
+// if the memory holds no '$'.
+//
+// Console output is buffered and written to the host stream in bulk, when the
+// buffer fills up, before console input is read and once the program exits.
+// Console input is read from the host stream without echo, a new line reads
+// as a carriage return and the end of the stream as ^Z.
+//
+// Every drive maps to the host directory. FCB names match host file names of
+// up to 8 characters and an extension of up to 3 in any case, files made by
+// the program are named in upper case. Memory is read and written through the
+// read_byte and write_byte handlers of the cpu, and written pages are marked
+// dirty, see adc_8080_cpu_mark_dirty(). An attached memory hash is not
+// updated by BDOS writes.
+//
+// Supported functions: 0 P_TERMCPM, 1 C_READ, 2 C_WRITE, 6 C_RAWIO,
+// 9 C_WRITESTR, 10 C_READSTR, 11 C_STAT, 12 S_BDOSVER, 13 DRV_ALLRESET,
+// 14 DRV_SET, 15 F_OPEN, 16 F_CLOSE, 17 F_SFIRST, 18 F_SNEXT, 19 F_DELETE,
+// 20 F_READ, 21 F_WRITE, 22 F_MAKE, 23 F_RENAME, 24 DRV_LOGINVEC,
+// 25 DRV_GET, 26 F_DMAOFF, 32 F_USERNUM, 33 F_READRAND, 34 F_WRITERAND,
+// 35 F_SIZE and 36 F_RANDREC. Other functions return 0xFF.
+
+#ifndef _ADC_8080_BDOS_H_
+#define _ADC_8080_BDOS_H_
+
+#include "adc_8080_cpu.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The BDOS entry called by programs, and the address it jumps to. The word at
+// 0x0006 is the top of the memory available to programs.
+#define ADC_8080_BDOS_ENTRY 0x0005
+#define ADC_8080_BDOS_BASE 0xFE00
+// Address of the BIOS jump table, the word at 0x0001 is its warm boot entry.
+#define ADC_8080_BDOS_BIOS 0xFF00
+
+typedef struct adc_8080_bdos adc_8080_bdos;
+
+// adc_8080_bdos_new() - Create a BDOS backed by the files of a directory.
+//
+// dir - Directory of the files of every drive, kept by pointer.
+// in  - Console input, may be NULL to read as ^Z.
+// out - Console output, may be NULL to discard it.
+//
+// Returns NULL on allocation failure.
+adc_8080_bdos *adc_8080_bdos_new(const char *dir, FILE *in, FILE *out);
+
+// adc_8080_bdos_free() - Write out the console output and close the files of
+// the program, then free the BDOS resources.
+void adc_8080_bdos_free(adc_8080_bdos **bdos);
+
+// adc_8080_bdos_setup() - Prepare the cpu and the zero page to start the
+// program at 0x0100 as the CCP would: the warm boot and BDOS entry jumps,
+// the default FCBs at 0x005C and 0x006C from the first two words of the
+// command tail, the command tail at 0x0080, the DMA address 0x0080 and a
+// return address of 0x0000 on the stack below ADC_8080_BDOS_BASE.
+//
+// tail - Arguments of the program, e.g. "HELLO.ASM", may be NULL.
+void adc_8080_bdos_setup(adc_8080_bdos *bdos, adc_8080_cpu *cpu,
+                         const char *tail);
+
+// adc_8080_bdos_run() - Run the program until at least the given number of
+// cycles were consumed, it exits or it halts with no interrupt pending.
+//
+// Returns the number of cycles consumed.
+uint64_t adc_8080_bdos_run(adc_8080_bdos *bdos, adc_8080_cpu *cpu,
+                           uint64_t cycles);
+
+// adc_8080_bdos_call() - Run the BDOS function in C with the parameter in E
+// or DE and return to the caller, for hosts trapping the BDOS entry
+// themselves. Function 0 exits instead of returning.
+//
+// Returns the number of cycles consumed.
+int adc_8080_bdos_call(adc_8080_bdos *bdos, adc_8080_cpu *cpu);
+
+// adc_8080_bdos_exited() - Returns true once the program called function 0
+// or jumped to the warm boot.
+bool adc_8080_bdos_exited(const adc_8080_bdos *bdos);
+
+// adc_8080_bdos_calls() - Returns the number of BDOS calls since the last
+// adc_8080_bdos_setup().
+uint64_t adc_8080_bdos_calls(const adc_8080_bdos *bdos);
+
+// adc_8080_bdos_flush() - Write the buffered console output to the host.
+void adc_8080_bdos_flush(adc_8080_bdos *bdos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_BDOS_H_
@@ -0,0 +1,187 @@
+#include "adc_8080_codec.h"
+
+#include <assert.h> // For assert
+#include <string.h> // For memcpy, memset
+
+#define MEMORY_TOTAL 0x10000
+
+#define RUN_SAME 0
+#define RUN_LITERAL 1
+#define RUN_FILL 2
+
+// Shortest runs worth breaking a literal for. Each run costs a varint.
+#define MIN_SAME_RUN 4
+#define MIN_FILL_RUN 8
+
+#define CODEC_FLAG_KEYFRAME (1 << 0)
+
+typedef struct {
+  uint8_t *buf;
+  size_t size;
+  size_t pos;
+  bool overflow;
+} writer;
+
+static inline void put_run(writer *w, int kind, size_t length) {
+  // A varint of at most 3 bytes for 64 KiB runs.
+  if (w->pos + 3 > w->size) {
+    w->overflow = true;
+    return;
+  }
+
+  size_t v = (length - 1) << 2 | kind;
+  while (v >= 0x80) {
+    w->buf[w->pos++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  w->buf[w->pos++] = (uint8_t)v;
+}
+
+static inline void put_bytes(writer *w, const uint8_t *bytes, size_t n) {
+  if (w->pos + n > w->size) {
+    w->overflow = true;
+    return;
+  }
+
+  memcpy(w->buf + w->pos, bytes, n);
+  w->pos += n;
+}
+
+// Length of the run of equal bytes at delta[pos], up to end.
+static inline size_t run_length(const uint8_t *delta, size_t pos,
+                                size_t end) {
+  size_t i = pos + 1;
+  while (i < end && delta[i] == delta[pos])
+    i++;
+  return i - pos;
+}
+
+static void encode_delta(writer *w, const uint8_t *delta) {
+  size_t literal = 0; // Start of the pending literal run.
+  size_t pos = 0;
+
+  while (pos < MEMORY_TOTAL) {
+    size_t length = run_length(delta, pos, MEMORY_TOTAL);
+    bool same = delta[pos] == 0 && length >= MIN_SAME_RUN;
+    bool fill = delta[pos] != 0 && length >= MIN_FILL_RUN;
+    if (!same && !fill) {
+      pos += length;
+      continue;
+    }
+
+    if (pos > literal) {
+      put_run(w, RUN_LITERAL, pos - literal);
+      put_bytes(w, delta + literal, pos - literal);
+    }
+    put_run(w, same ? RUN_SAME : RUN_FILL, length);
+    if (fill)
+      put_bytes(w, delta + pos, 1);
+
+    pos += length;
+    literal = pos;
+  }
+
+  if (pos > literal) {
+    put_run(w, RUN_LITERAL, pos - literal);
+    put_bytes(w, delta + literal, pos - literal);
+  }
+}
+
+// Public api implementation
+
+size_t adc_8080_codec_encode(const adc_8080_cpu *cpu, const uint8_t *memory,
+                             const uint8_t *keyframe, uint8_t *buf,
+                             size_t size) {
+  assert(cpu);
+  assert(memory);
+  assert(buf);
+
+  if (size < ADC_8080_CPU_STATE_SIZE + 1)
+    return 0;
+
+  adc_8080_cpu_save(cpu, NULL, buf, size);
+  buf[ADC_8080_CPU_STATE_SIZE] = keyframe ? CODEC_FLAG_KEYFRAME : 0;
+
+  const uint8_t *delta = memory;
+  uint8_t xored[MEMORY_TOTAL];
+  if (keyframe) {
+    for (size_t i = 0; i < MEMORY_TOTAL; i++)
+      xored[i] = memory[i] ^ keyframe[i];
+    delta = xored;
+  }
+
+  writer w = {buf, size, ADC_8080_CPU_STATE_SIZE + 1, false};
+  encode_delta(&w, delta);
+  return w.overflow ? 0 : w.pos;
+}
+
+size_t adc_8080_codec_decode(adc_8080_cpu *cpu, uint8_t *memory,
+                             const uint8_t *keyframe, const uint8_t *buf,
+                             size_t size) {
+  assert(cpu);
+  assert(memory);
+  assert(buf);
+
+  if (size < ADC_8080_CPU_STATE_SIZE + 1)
+    return 0;
+
+  bool delta = buf[ADC_8080_CPU_STATE_SIZE] & CODEC_FLAG_KEYFRAME;
+  if (delta && !keyframe)
+    return 0;
+  if (adc_8080_cpu_load(cpu, NULL, buf, ADC_8080_CPU_STATE_SIZE) == 0)
+    return 0;
+
+  size_t pos = ADC_8080_CPU_STATE_SIZE + 1;
+  size_t addr = 0;
+  while (addr < MEMORY_TOTAL) {
+    size_t v = 0;
+    for (int shift = 0;; shift += 7) {
+      if (pos == size || shift > 14)
+        return 0;
+      uint8_t b = buf[pos++];
+      v |= (size_t)(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        break;
+    }
+
+    size_t length = (v >> 2) + 1;
+    int kind = v & 3;
+    if (length > MEMORY_TOTAL - addr)
+      return 0;
+
+    uint8_t *dst = memory + addr;
+    const uint8_t *key = delta ? keyframe + addr : NULL;
+    if (kind == RUN_SAME) {
+      if (delta)
+        memcpy(dst, key, length);
+      else
+        memset(dst, 0, length);
+    } else if (kind == RUN_LITERAL) {
+      if (size - pos < length)
+        return 0;
+      if (delta) {
+        for (size_t i = 0; i < length; i++)
+          dst[i] = key[i] ^ buf[pos + i];
+      } else {
+        memcpy(dst, buf + pos, length);
+      }
+      pos += length;
+    } else if (kind == RUN_FILL) {
+      if (pos == size)
+        return 0;
+      uint8_t fill = buf[pos++];
+      if (delta) {
+        for (size_t i = 0; i < length; i++)
+          dst[i] = key[i] ^ fill;
+      } else {
+        memset(dst, fill, length);
+      }
+    } else {
+      return 0;
+    }
+
+    addr += length;
+  }
+
+  return pos;
+}
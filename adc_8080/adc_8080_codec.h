@@ -0,0 +1,62 @@
+// adc_8080_codec Snapshot compression for adc_8080_cpu by Anthony Del Ciotto.
+// Encodes a cpu state plus its 64 KiB memory image into a compact snapshot
+// for long-lived checkpoint storage.
+//
+// The memory image is XORed against an optional keyframe, normally the
+// previous full snapshot, so unchanged bytes become zero. The delta is then
+// stored as a stream of runs, each a varint of (length - 1) << 2 | kind:
+//
+//   same    - length bytes equal to the keyframe (a zero delta), no payload
+//   literal - length delta bytes follow
+//   fill    - one delta byte follows, repeated length times
+//
+// Snapshots are a save state blob without memory, a flags byte and the run
+// stream. Decoding is a sequence of memcpy(), XOR and memset() calls over
+// runs, fast enough to restore snapshots at memory bandwidth.
+
+#ifndef _ADC_8080_CODEC_H_
+#define _ADC_8080_CODEC_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size in bytes of the largest possible snapshot.
+#define ADC_8080_CODEC_MAX_SIZE                                                \
+  (ADC_8080_CPU_STATE_SIZE + 1 + ADC_8080_CPU_STATE_MEMORY_SIZE + 64)
+
+// adc_8080_codec_encode() - Encode a snapshot of the cpu and memory.
+//
+// memory   - The 64 KiB memory of the cpu.
+// keyframe - Optional 64 KiB memory image to encode the memory against, may
+//            be NULL. The same keyframe must be given to decode the snapshot.
+// buf      - Destination buffer provided by the caller.
+// size     - Size of the buffer in bytes, ADC_8080_CODEC_MAX_SIZE always fits.
+//
+// Returns the number of bytes written.
+// Returns 0 if the buffer is too small.
+size_t adc_8080_codec_encode(const adc_8080_cpu *cpu, const uint8_t *memory,
+                             const uint8_t *keyframe, uint8_t *buf,
+                             size_t size);
+
+// adc_8080_codec_decode() - Restore the cpu and memory from a snapshot.
+// Host function handlers and userdata are left as is.
+//
+// memory   - 64 KiB destination for the memory image. Must not overlap the
+//            keyframe.
+// keyframe - The keyframe the snapshot was encoded against, or NULL.
+//
+// Returns the number of bytes consumed from the buffer.
+// Returns 0 if the snapshot is truncated, invalid or needs a keyframe that
+// was not given. The cpu and memory may be partially written.
+size_t adc_8080_codec_decode(adc_8080_cpu *cpu, uint8_t *memory,
+                             const uint8_t *keyframe, const uint8_t *buf,
+                             size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_CODEC_H_
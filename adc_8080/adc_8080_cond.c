@@ -0,0 +1,320 @@
+#include "adc_8080_cond.h"
+
+#include <assert.h> // For assert
+#include <ctype.h> // For isalpha, isalnum, isdigit, isspace, tolower
+#include <string.h> // For strchr, strlen, strncmp
+
+#define MAX_NESTING 32
+
+// Recursive descent compiler, one function per precedence level.
+typedef struct {
+  const char *text;
+  size_t pos;
+  uint8_t *code;
+  size_t size;
+  size_t length;
+  // Values the program stacks at this point and the most it ever stacks.
+  int depth, max_depth;
+  int nesting;
+  bool error;
+} compiler;
+
+typedef struct {
+  const char *name;
+  uint8_t reg;
+} reg_name;
+
+static const reg_name s_reg_names[] = {
+    {"a", ADC_8080_CPU_COND_REG_A},     {"b", ADC_8080_CPU_COND_REG_B},
+    {"c", ADC_8080_CPU_COND_REG_C},     {"d", ADC_8080_CPU_COND_REG_D},
+    {"e", ADC_8080_CPU_COND_REG_E},     {"h", ADC_8080_CPU_COND_REG_H},
+    {"l", ADC_8080_CPU_COND_REG_L},     {"bc", ADC_8080_CPU_COND_REG_BC},
+    {"de", ADC_8080_CPU_COND_REG_DE},   {"hl", ADC_8080_CPU_COND_REG_HL},
+    {"sp", ADC_8080_CPU_COND_REG_SP},   {"pc", ADC_8080_CPU_COND_REG_PC},
+    {"psw", ADC_8080_CPU_COND_REG_PSW}, {"cfs", ADC_8080_CPU_COND_REG_CFS},
+    {"cfz", ADC_8080_CPU_COND_REG_CFZ}, {"cfa", ADC_8080_CPU_COND_REG_CFA},
+    {"cfp", ADC_8080_CPU_COND_REG_CFP}, {"cfc", ADC_8080_CPU_COND_REG_CFC},
+};
+
+static void expr_or(compiler *c);
+
+static void fail(compiler *c) { c->error = true; }
+
+static void skip_space(compiler *c) {
+  while (isspace((unsigned char)c->text[c->pos]))
+    c->pos++;
+}
+
+// Consume the token if it is next. Operators are not split, '<' does not
+// match the start of '<='.
+static bool accept(compiler *c, const char *token) {
+  skip_space(c);
+  size_t n = strlen(token);
+  if (strncmp(c->text + c->pos, token, n) != 0)
+    return false;
+  char next = c->text[c->pos + n];
+  if (n == 1 && ((next == '=' && strchr("<>=!", token[0])) ||
+                 (next == token[0] && strchr("&|", token[0]))))
+    return false;
+
+  c->pos += n;
+  return true;
+}
+
+static void emit(compiler *c, uint8_t byte) {
+  if (c->length == c->size) {
+    fail(c);
+    return;
+  }
+  c->code[c->length++] = byte;
+}
+
+static void emit_op(compiler *c, uint8_t op, int stack_effect) {
+  emit(c, op);
+  c->depth += stack_effect;
+  if (c->depth > c->max_depth)
+    c->max_depth = c->depth;
+}
+
+static void emit_const(compiler *c, uint64_t value) {
+  if (value <= 0xFF) {
+    emit_op(c, ADC_8080_CPU_COND_CONST8, 1);
+    emit(c, (uint8_t)value);
+  } else if (value <= 0xFFFF) {
+    emit_op(c, ADC_8080_CPU_COND_CONST16, 1);
+    emit(c, value & 0xFF);
+    emit(c, value >> 8);
+  } else {
+    emit_op(c, ADC_8080_CPU_COND_CONST64, 1);
+    for (int i = 0; i < 8; i++)
+      emit(c, (value >> (i * 8)) & 0xFF);
+  }
+}
+
+static bool name_is(const char *name, size_t n, const char *keyword) {
+  if (strlen(keyword) != n)
+    return false;
+  for (size_t i = 0; i < n; i++) {
+    if (tolower((unsigned char)name[i]) != keyword[i])
+      return false;
+  }
+  return true;
+}
+
+static void number(compiler *c) {
+  const char *p = c->text + c->pos;
+  uint64_t value = 0;
+  size_t n = 0;
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    n = 2;
+    if (!isxdigit((unsigned char)p[n])) {
+      fail(c);
+      return;
+    }
+    while (isxdigit((unsigned char)p[n])) {
+      int digit = isdigit((unsigned char)p[n])
+                      ? p[n] - '0'
+                      : tolower((unsigned char)p[n]) - 'a' + 10;
+      value = value << 4 | digit;
+      n++;
+    }
+  } else {
+    while (isdigit((unsigned char)p[n]))
+      value = value * 10 + (p[n++] - '0');
+  }
+  if (isalnum((unsigned char)p[n]) || p[n] == '_') {
+    fail(c);
+    return;
+  }
+
+  c->pos += n;
+  emit_const(c, value);
+}
+
+// Memory access, the address expression in brackets.
+static void memory(compiler *c, uint8_t op) {
+  if (!accept(c, "[")) {
+    fail(c);
+    return;
+  }
+  expr_or(c);
+  if (!accept(c, "]")) {
+    fail(c);
+    return;
+  }
+  emit_op(c, op, 0);
+}
+
+static void primary(compiler *c) {
+  skip_space(c);
+  const char *p = c->text + c->pos;
+  if (isdigit((unsigned char)*p)) {
+    number(c);
+    return;
+  }
+
+  if (accept(c, "(")) {
+    expr_or(c);
+    if (!accept(c, ")"))
+      fail(c);
+    return;
+  }
+
+  size_t n = 0;
+  while (isalnum((unsigned char)p[n]) || p[n] == '_')
+    n++;
+  if (n == 0 || !isalpha((unsigned char)p[0])) {
+    fail(c);
+    return;
+  }
+  c->pos += n;
+
+  if (name_is(p, n, "mem") || name_is(p, n, "memory")) {
+    memory(c, ADC_8080_CPU_COND_MEM8);
+    return;
+  }
+  if (name_is(p, n, "word")) {
+    memory(c, ADC_8080_CPU_COND_MEM16);
+    return;
+  }
+  if (name_is(p, n, "cycles")) {
+    emit_op(c, ADC_8080_CPU_COND_CYCLES, 1);
+    return;
+  }
+  if (name_is(p, n, "hits")) {
+    emit_op(c, ADC_8080_CPU_COND_HITS, 1);
+    return;
+  }
+  for (size_t i = 0; i < sizeof(s_reg_names) / sizeof(s_reg_names[0]); i++) {
+    if (name_is(p, n, s_reg_names[i].name)) {
+      emit_op(c, ADC_8080_CPU_COND_REG, 1);
+      emit(c, s_reg_names[i].reg);
+      return;
+    }
+  }
+
+  c->pos -= n;
+  fail(c);
+}
+
+static void unary(compiler *c) {
+  if (++c->nesting > MAX_NESTING) {
+    fail(c);
+    return;
+  }
+
+  if (accept(c, "!")) {
+    unary(c);
+    emit_op(c, ADC_8080_CPU_COND_NOT, 0);
+  } else if (accept(c, "~")) {
+    unary(c);
+    emit_op(c, ADC_8080_CPU_COND_INV, 0);
+  } else {
+    primary(c);
+  }
+  c->nesting--;
+}
+
+static void sum(compiler *c) {
+  unary(c);
+  while (!c->error) {
+    uint8_t op;
+    if (accept(c, "+"))
+      op = ADC_8080_CPU_COND_ADD;
+    else if (accept(c, "-"))
+      op = ADC_8080_CPU_COND_SUB;
+    else
+      break;
+    unary(c);
+    emit_op(c, op, -1);
+  }
+}
+
+static void bit_and(compiler *c) {
+  sum(c);
+  while (!c->error && accept(c, "&")) {
+    sum(c);
+    emit_op(c, ADC_8080_CPU_COND_AND, -1);
+  }
+}
+
+static void bit_xor(compiler *c) {
+  bit_and(c);
+  while (!c->error && accept(c, "^")) {
+    bit_and(c);
+    emit_op(c, ADC_8080_CPU_COND_XOR, -1);
+  }
+}
+
+static void bit_or(compiler *c) {
+  bit_xor(c);
+  while (!c->error && accept(c, "|")) {
+    bit_xor(c);
+    emit_op(c, ADC_8080_CPU_COND_OR, -1);
+  }
+}
+
+static void compare(compiler *c) {
+  static const struct {
+    const char *token;
+    uint8_t op;
+  } s_compares[] = {
+      {"==", ADC_8080_CPU_COND_EQ}, {"!=", ADC_8080_CPU_COND_NE},
+      {"<=", ADC_8080_CPU_COND_LE}, {">=", ADC_8080_CPU_COND_GE},
+      {"<", ADC_8080_CPU_COND_LT},  {">", ADC_8080_CPU_COND_GT},
+  };
+
+  bit_or(c);
+  for (size_t i = 0;
+       !c->error && i < sizeof(s_compares) / sizeof(s_compares[0]); i++) {
+    if (accept(c, s_compares[i].token)) {
+      bit_or(c);
+      emit_op(c, s_compares[i].op, -1);
+      break;
+    }
+  }
+}
+
+static void expr_and(compiler *c) {
+  compare(c);
+  while (!c->error && accept(c, "&&")) {
+    compare(c);
+    emit_op(c, ADC_8080_CPU_COND_LAND, -1);
+  }
+}
+
+static void expr_or(compiler *c) {
+  // Bound the recursion of nested brackets and unary operators.
+  if (++c->nesting > MAX_NESTING) {
+    fail(c);
+    return;
+  }
+
+  expr_and(c);
+  while (!c->error && accept(c, "||")) {
+    expr_and(c);
+    emit_op(c, ADC_8080_CPU_COND_LOR, -1);
+  }
+  c->nesting--;
+}
+
+// Public api implementation
+
+size_t adc_8080_cond_compile(const char *text, uint8_t *code, size_t size,
+                             size_t *error_pos) {
+  assert(text);
+  assert(code);
+
+  compiler c = {text, 0, code, size, 0, 0, 0, 0, false};
+  expr_or(&c);
+  skip_space(&c);
+  if (!c.error && text[c.pos] != '\0')
+    fail(&c);
+  emit(&c, ADC_8080_CPU_COND_END);
+
+  if (error_pos)
+    *error_pos = c.pos;
+  if (c.error || c.max_depth > ADC_8080_CPU_COND_STACK)
+    return 0;
+  return c.length;
+}
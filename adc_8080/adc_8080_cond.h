@@ -0,0 +1,47 @@
+// adc_8080_cond Breakpoint condition compiler for adc_8080_cpu by Anthony Del
+// Ciotto. Compiles C-like expressions into the bytecode evaluated by
+// conditional breakpoints, see adc_8080_cpu_debug_break_if():
+//
+//   hl > 0x2400 && mem[0x20C0] == 3
+//   hits == 100 || (cfz && word[sp] == 0x0123)
+//
+// Values are 64-bit unsigned. The operands are:
+//
+//   a b c d e h l bc de hl sp pc psw  registers
+//   cfs cfz cfa cfp cfc                flags, 0 or 1
+//   cycles                             total cycle count
+//   hits                               hits of the breakpoint, from 1
+//   mem[expr] (or memory[expr])        byte at an address
+//   word[expr]                         little-endian word at an address
+//   123, 0x7B                          decimal and hex constants
+//
+// The operators are, from the highest precedence: ! ~, + -, &, ^, |,
+// == != < <= > >=, && and ||. Names are case insensitive.
+
+#ifndef _ADC_8080_COND_H_
+#define _ADC_8080_COND_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// adc_8080_cond_compile() - Compile a condition expression.
+//
+// text      - The zero terminated expression.
+// code      - Destination buffer for the bytecode, ADC_8080_CPU_COND_SIZE
+//             bytes always fit a condition the cpu accepts.
+// size      - Size of the buffer in bytes.
+// error_pos - Set to the offset in text of a syntax error, may be NULL.
+//
+// Returns the size of the bytecode.
+// Returns 0 on a syntax error, or if the bytecode or its stack does not fit.
+size_t adc_8080_cond_compile(const char *text, uint8_t *code, size_t size,
+                             size_t *error_pos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_COND_H_
@@ -0,0 +1,175 @@
+#include "adc_8080_coverage.h"
+
+#include <assert.h> // For assert
+#include <string.h> // For memcmp, memset
+
+#define MAP_WORDS 2048
+#define MAP_BITS 0x10000
+#define COVERAGE_VERSION 1
+
+static const uint8_t s_coverage_magic[4] = {'A', '8', '0', 'C'};
+
+static inline bool map_test(const uint32_t *map, uint32_t addr) {
+  return map[addr >> 5] & (1u << (addr & 31));
+}
+
+static inline int popcount(uint32_t v) {
+  int n = 0;
+  while (v) {
+    v &= v - 1;
+    n++;
+  }
+  return n;
+}
+
+static bool put_varint(FILE *file, uint32_t v) {
+  while (v >= 0x80) {
+    if (fputc((v & 0x7F) | 0x80, file) == EOF)
+      return false;
+    v >>= 7;
+  }
+  return fputc(v, file) != EOF;
+}
+
+static bool get_varint(FILE *file, uint32_t *v) {
+  *v = 0;
+  for (int shift = 0; shift <= 14; shift += 7) {
+    int b = fgetc(file);
+    if (b == EOF)
+      return false;
+    *v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+// Length of the run of set bits at addr.
+static uint32_t run_length(const uint32_t *map, uint32_t addr) {
+  uint32_t end = addr;
+  while (end < MAP_BITS && map_test(map, end))
+    end++;
+  return end - addr;
+}
+
+static bool save_map(FILE *file, const uint32_t *map) {
+  uint32_t runs = 0;
+  for (uint32_t addr = 0; addr < MAP_BITS; addr++) {
+    if (map_test(map, addr)) {
+      addr += run_length(map, addr);
+      runs++;
+    }
+  }
+  if (!put_varint(file, runs))
+    return false;
+
+  uint32_t end = 0;
+  for (uint32_t addr = 0; addr < MAP_BITS; addr++) {
+    if (!map_test(map, addr))
+      continue;
+
+    uint32_t length = run_length(map, addr);
+    if (!put_varint(file, addr - end) || !put_varint(file, length - 1))
+      return false;
+    addr += length;
+    end = addr;
+  }
+  return true;
+}
+
+static bool load_map(FILE *file, uint32_t *map) {
+  uint32_t runs;
+  if (!get_varint(file, &runs))
+    return false;
+
+  uint32_t end = 0;
+  for (uint32_t i = 0; i < runs; i++) {
+    uint32_t gap, length;
+    if (!get_varint(file, &gap) || !get_varint(file, &length))
+      return false;
+    uint32_t addr = end + gap;
+    length++;
+    if (addr >= MAP_BITS || length > MAP_BITS - addr)
+      return false;
+
+    for (uint32_t a = addr; a < addr + length; a++)
+      map[a >> 5] |= 1u << (a & 31);
+    end = addr + length;
+  }
+  return true;
+}
+
+// Public api implementation
+
+void adc_8080_coverage_clear(adc_8080_cpu_coverage *coverage) {
+  assert(coverage);
+
+  memset(coverage, 0, sizeof(adc_8080_cpu_coverage));
+}
+
+void adc_8080_coverage_merge(adc_8080_cpu_coverage *dst,
+                             const adc_8080_cpu_coverage *src) {
+  assert(dst);
+  assert(src);
+
+  for (int i = 0; i < MAP_WORDS; i++) {
+    dst->opcodes[i] |= src->opcodes[i];
+    dst->operands[i] |= src->operands[i];
+  }
+}
+
+size_t adc_8080_coverage_count(const adc_8080_cpu_coverage *coverage,
+                               size_t *opcodes, size_t *operands) {
+  assert(coverage);
+
+  size_t num_opcodes = 0, num_operands = 0, total = 0;
+  for (int i = 0; i < MAP_WORDS; i++) {
+    num_opcodes += popcount(coverage->opcodes[i]);
+    num_operands += popcount(coverage->operands[i]);
+    total += popcount(coverage->opcodes[i] | coverage->operands[i]);
+  }
+
+  if (opcodes)
+    *opcodes = num_opcodes;
+  if (operands)
+    *operands = num_operands;
+  return total;
+}
+
+bool adc_8080_coverage_save(const adc_8080_cpu_coverage *coverage,
+                            const char *path) {
+  assert(coverage);
+  assert(path);
+
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+
+  bool ok = fwrite(s_coverage_magic, 1, sizeof(s_coverage_magic), file) ==
+                sizeof(s_coverage_magic) &&
+            fputc(COVERAGE_VERSION, file) != EOF &&
+            save_map(file, coverage->opcodes) &&
+            save_map(file, coverage->operands);
+  if (fclose(file) != 0)
+    ok = false;
+  return ok;
+}
+
+bool adc_8080_coverage_load(adc_8080_cpu_coverage *coverage,
+                            const char *path) {
+  assert(coverage);
+  assert(path);
+
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  uint8_t header[5];
+  bool ok = fread(header, 1, sizeof(header), file) == sizeof(header) &&
+            memcmp(header, s_coverage_magic, sizeof(s_coverage_magic)) == 0 &&
+            header[4] == COVERAGE_VERSION &&
+            load_map(file, coverage->opcodes) &&
+            load_map(file, coverage->operands);
+  fclose(file);
+  return ok;
+}
@@ -0,0 +1,58 @@
+// adc_8080_coverage Executed code coverage files for adc_8080_cpu by Anthony
+// Del Ciotto. Combines and stores the coverage maps kept by the cpu, see
+// adc_8080_cpu_coverage_attach().
+//
+// Coverage files store each map as runs of covered addresses:
+//
+//   offset 0  magic "A80C" and a version byte
+//   offset 5  the opcode map, then the operand map, each a varint count of
+//             runs followed by a varint gap from the end of the previous run
+//             and a varint length - 1 per run
+//
+// Code is mostly contiguous, a few hundred bytes cover a typical program.
+
+#ifndef _ADC_8080_COVERAGE_H_
+#define _ADC_8080_COVERAGE_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// adc_8080_coverage_clear() - Clear every bit of the coverage.
+void adc_8080_coverage_clear(adc_8080_cpu_coverage *coverage);
+
+// adc_8080_coverage_merge() - Add the bits of src to dst, for example to
+// combine the coverage of parallel runs.
+void adc_8080_coverage_merge(adc_8080_cpu_coverage *dst,
+                             const adc_8080_cpu_coverage *src);
+
+// adc_8080_coverage_count() - Count the covered addresses.
+//
+// opcodes  - Set to the number of opcode bits, may be NULL.
+// operands - Set to the number of operand bits, may be NULL.
+//
+// Returns the number of addresses fetched as an opcode or an operand.
+size_t adc_8080_coverage_count(const adc_8080_cpu_coverage *coverage,
+                               size_t *opcodes, size_t *operands);
+
+// adc_8080_coverage_save() - Write the coverage to a file.
+//
+// Returns false if the file can not be written.
+bool adc_8080_coverage_save(const adc_8080_cpu_coverage *coverage,
+                            const char *path);
+
+// adc_8080_coverage_load() - Merge a coverage file into the coverage. Clear
+// it first to load the file alone.
+//
+// Returns false if the file can not be read or is invalid. Runs before the
+// error may have been merged.
+bool adc_8080_coverage_load(adc_8080_cpu_coverage *coverage,
+                            const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_COVERAGE_H_
@@ -0,0 +1,164 @@
+#include "adc_8080_cow.h"
+
+#include <assert.h> // For assert
+#include <stdlib.h> // For malloc, free
+#include <string.h> // For memcpy, memset
+
+struct adc_8080_cow_page {
+  int refs;
+  uint8_t data[ADC_8080_COW_PAGE_SIZE];
+};
+
+static inline adc_8080_cow_page *page_new(const uint8_t *data) {
+  adc_8080_cow_page *page = malloc(sizeof(adc_8080_cow_page));
+  if (!page)
+    return NULL;
+
+  page->refs = 1;
+  if (data)
+    memcpy(page->data, data, ADC_8080_COW_PAGE_SIZE);
+  else
+    memset(page->data, 0, ADC_8080_COW_PAGE_SIZE);
+  return page;
+}
+
+static inline void page_release(adc_8080_cow_page *page) {
+  if (page && --page->refs == 0)
+    free(page);
+}
+
+static inline bool page_is_zero(const uint8_t *data) {
+  for (int i = 0; i < ADC_8080_COW_PAGE_SIZE; i++)
+    if (data[i] != 0)
+      return false;
+  return true;
+}
+
+// Memory handlers installed into the cpu.
+
+static uint8_t handle_memory_read(void *userdata, uint16_t addr) {
+  return adc_8080_cow_read(userdata, addr);
+}
+
+static void handle_memory_write(void *userdata, uint16_t addr, uint8_t val) {
+  adc_8080_cow_machine *machine = userdata;
+  if (!adc_8080_cow_write(machine, addr, val))
+    machine->error = true;
+}
+
+// Public api implementation
+
+adc_8080_cow_machine *adc_8080_cow_new(const uint8_t *memory) {
+  adc_8080_cow_machine *machine = malloc(sizeof(adc_8080_cow_machine));
+  if (!machine)
+    return NULL;
+
+  memset(machine->pages, 0, sizeof(machine->pages));
+
+  adc_8080_cow_page *zero_page = NULL;
+  for (int i = 0; i < ADC_8080_COW_NUM_PAGES; i++) {
+    const uint8_t *data = memory ? memory + i * ADC_8080_COW_PAGE_SIZE : NULL;
+
+    if (!data || page_is_zero(data)) {
+      if (!zero_page) {
+        zero_page = page_new(NULL);
+        if (!zero_page)
+          goto error;
+      } else {
+        zero_page->refs++;
+      }
+      machine->pages[i] = zero_page;
+      continue;
+    }
+
+    machine->pages[i] = page_new(data);
+    if (!machine->pages[i])
+      goto error;
+  }
+
+  adc_8080_cpu_init(&machine->cpu);
+  machine->cpu.userdata = machine;
+  machine->cpu.read_byte = handle_memory_read;
+  machine->cpu.write_byte = handle_memory_write;
+  machine->userdata = NULL;
+  machine->error = false;
+  return machine;
+
+error:
+  adc_8080_cow_free(&machine);
+  return NULL;
+}
+
+adc_8080_cow_machine *adc_8080_cow_fork(const adc_8080_cow_machine *parent) {
+  assert(parent);
+
+  adc_8080_cow_machine *machine = malloc(sizeof(adc_8080_cow_machine));
+  if (!machine)
+    return NULL;
+
+  memcpy(machine, parent, sizeof(adc_8080_cow_machine));
+  machine->cpu.userdata = machine;
+  // The hooks keep the state of the parent, the fork starts with none
+  // attached.
+  adc_8080_cpu_detach_all(&machine->cpu);
+  for (int i = 0; i < ADC_8080_COW_NUM_PAGES; i++)
+    machine->pages[i]->refs++;
+
+  return machine;
+}
+
+void adc_8080_cow_free(adc_8080_cow_machine **machine) {
+  if (machine && *machine) {
+    for (int i = 0; i < ADC_8080_COW_NUM_PAGES; i++)
+      page_release((*machine)->pages[i]);
+
+    free(*machine);
+    *machine = NULL;
+  }
+}
+
+uint8_t adc_8080_cow_read(const adc_8080_cow_machine *machine, uint16_t addr) {
+  return machine->pages[addr >> 8]->data[addr & 0xFF];
+}
+
+bool adc_8080_cow_write(adc_8080_cow_machine *machine, uint16_t addr,
+                        uint8_t val) {
+  adc_8080_cow_page *page = machine->pages[addr >> 8];
+
+  if (page->refs > 1) {
+    // Nothing to copy if the page would not change.
+    if (page->data[addr & 0xFF] == val)
+      return true;
+
+    adc_8080_cow_page *copy = page_new(page->data);
+    if (!copy)
+      return false;
+
+    page->refs--;
+    machine->pages[addr >> 8] = copy;
+    page = copy;
+  }
+
+  page->data[addr & 0xFF] = val;
+  return true;
+}
+
+void adc_8080_cow_copy_memory(const adc_8080_cow_machine *machine,
+                              uint8_t *dst) {
+  assert(machine);
+  assert(dst);
+
+  for (int i = 0; i < ADC_8080_COW_NUM_PAGES; i++)
+    memcpy(dst + i * ADC_8080_COW_PAGE_SIZE, machine->pages[i]->data,
+           ADC_8080_COW_PAGE_SIZE);
+}
+
+int adc_8080_cow_private_pages(const adc_8080_cow_machine *machine) {
+  assert(machine);
+
+  int count = 0;
+  for (int i = 0; i < ADC_8080_COW_NUM_PAGES; i++)
+    if (machine->pages[i]->refs == 1)
+      count++;
+  return count;
+}
@@ -0,0 +1,86 @@
+// adc_8080_cow Copy-on-write machine for adc_8080_cpu by Anthony Del Ciotto.
+// A cpu plus 64 KiB of memory made of 256-byte pages that are shared between
+// a machine and its forks. A page is only copied the first time a machine
+// writes to it, so forking costs a copy of the cpu and the page table
+// regardless of how much memory the guest uses.
+//
+// Page reference counts are not atomic. A machine and all of its forks must be
+// used from a single thread.
+
+#ifndef _ADC_8080_COW_H_
+#define _ADC_8080_COW_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADC_8080_COW_PAGE_SIZE 0x100
+#define ADC_8080_COW_NUM_PAGES 0x100
+
+typedef struct adc_8080_cow_page adc_8080_cow_page;
+
+typedef struct {
+  // The cpu must stay the first member. Device handlers receive the cpu
+  // pointer, which can be cast back to the machine.
+  adc_8080_cpu cpu;
+
+  // Custom user data for the host.
+  void *userdata;
+
+  // Set when a write made by the cpu was lost because copying a shared page
+  // failed. The host checks it after running the machine, forks inherit it.
+  bool error;
+
+  adc_8080_cow_page *pages[ADC_8080_COW_NUM_PAGES];
+} adc_8080_cow_machine;
+
+// adc_8080_cow_new() - Create a new machine.
+//
+// memory - Optional 64 KiB memory image to initialize the memory from, may be
+//          NULL for zeroed memory. All zero pages are shared.
+//
+// The cpu is initialized and its memory handlers are installed. The host must
+// set the device handlers.
+//
+// Returns NULL on allocation failure.
+adc_8080_cow_machine *adc_8080_cow_new(const uint8_t *memory);
+
+// adc_8080_cow_fork() - Create a copy of a machine that shares all of its
+// memory pages with the parent. Pages are copied on the first write by either
+// machine. The cpu, including its handlers, and userdata are copied as is,
+// but the fork has none of the optional hooks of the parent attached (hash,
+// coverage, input log, traces, stats and profile). Attach its own if needed.
+//
+// Returns NULL on allocation failure.
+adc_8080_cow_machine *adc_8080_cow_fork(const adc_8080_cow_machine *parent);
+
+// adc_8080_cow_free() - Free the machine, releasing its references to shared
+// pages. Discarding a fork only frees the pages it has written.
+void adc_8080_cow_free(adc_8080_cow_machine **machine);
+
+// adc_8080_cow_read() - Read a byte from the machine memory.
+uint8_t adc_8080_cow_read(const adc_8080_cow_machine *machine, uint16_t addr);
+
+// adc_8080_cow_write() - Write a byte to the machine memory, copying the page
+// if it is shared.
+//
+// Returns false if copying the page failed, the memory is left unchanged. The
+// error of the machine is only set for failed writes made by the cpu.
+bool adc_8080_cow_write(adc_8080_cow_machine *machine, uint16_t addr,
+                        uint8_t val);
+
+// adc_8080_cow_copy_memory() - Copy the full 64 KiB memory into dst.
+void adc_8080_cow_copy_memory(const adc_8080_cow_machine *machine,
+                              uint8_t *dst);
+
+// adc_8080_cow_private_pages() - Returns the number of pages referenced only
+// by this machine.
+int adc_8080_cow_private_pages(const adc_8080_cow_machine *machine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_COW_H_
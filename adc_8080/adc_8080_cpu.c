@@ -26,6 +26,34 @@
 
 #include <assert.h>   // For assert
 #include <inttypes.h> // For PRIu8, PRIu16, etc
+#include <stdlib.h>   // For realloc, free
+#include <string.h>   // For memcpy, memset
+
+#ifdef ADC_8080_CPU_ALU_TABLES
+// Precomputed ALU result and flag tables generated by 8080_alu_gen.c.
+#include "adc_8080_cpu_alu.h"
+#endif
+
+// exec_next() is inlined into one executor per mode so that the checks of
+// the mode fold away.
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+enum exec_mode {
+  // adc_8080_cpu_step() with no hooks attached, see adc_8080_cpu.hooks.
+  EXEC_PLAIN,
+  // adc_8080_cpu_step() checking the attached hooks.
+  EXEC_HOOKS,
+  // As EXEC_HOOKS while a statistics window times every handler call, see
+  // adc_8080_cpu_stats.timing.
+  EXEC_TIMED,
+  // run_debug(), as EXEC_HOOKS and reads and writes are checked against the
+  // watchpoints.
+  EXEC_DEBUG
+};
 
 // LUTs
 
@@ -49,6 +77,27 @@ static int s_cycles_lut[256] = {
 /*Ex*/   5,  10, 10, 18, 11, 11, 7,  11, 5,  5,  10, 4,  11, 17, 7, 11,
 /*Fx*/   5,  10, 10, 4,  11, 11, 7,  11, 5,  5,  10, 4,  11, 17, 7, 11
 };
+
+// Instruction sizes in bytes, the opcode included.
+static const uint8_t s_size_lut[256] = {
+//	 x0  x1  x2  x3  x4  x5  x6  x7  x8  x9  xA  xB  xC  xD  xE  xF
+/*x0*/   1,  3,  1,  1,  1,  1,  2,  1,  1,  1,  1,  1,  1,  1,  2,  1,
+/*1x*/   1,  3,  1,  1,  1,  1,  2,  1,  1,  1,  1,  1,  1,  1,  2,  1,
+/*2x*/   1,  3,  3,  1,  1,  1,  2,  1,  1,  1,  3,  1,  1,  1,  2,  1,
+/*3x*/   1,  3,  3,  1,  1,  1,  2,  1,  1,  1,  3,  1,  1,  1,  2,  1,
+/*4x*/   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/*5x*/   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/*6x*/   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/*7x*/   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/*8x*/   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/*9x*/   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/*Ax*/   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/*Bx*/   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/*Cx*/   1,  1,  3,  3,  3,  1,  2,  1,  1,  1,  3,  3,  3,  3,  2,  1,
+/*Dx*/   1,  1,  3,  2,  3,  1,  2,  1,  1,  1,  3,  2,  3,  3,  2,  1,
+/*Ex*/   1,  1,  3,  1,  3,  1,  2,  1,  1,  1,  3,  1,  3,  3,  2,  1,
+/*Fx*/   1,  1,  3,  1,  3,  1,  2,  1,  1,  1,  3,  1,  3,  3,  2,  1
+};
 // clang-format on
 
 static bool s_parity_lut[256];
@@ -64,37 +113,566 @@ static inline void bytes_from_word(uint8_t *high, uint8_t *low, uint16_t w) {
   *low = w & 0xFF;
 }
 
-static inline uint8_t read_byte(adc_8080_cpu *cpu, uint16_t addr) {
-  return cpu->read_byte(cpu->userdata, addr);
+// The PSW layout is S Z 0 AC 0 P 1 CY.
+static inline uint8_t get_cf_psw(const adc_8080_cpu *cpu) {
+  uint8_t psw = 0;
+  psw |= cpu->cfs << 7;
+  psw |= cpu->cfz << 6;
+  psw |= cpu->cfa << 4;
+  psw |= cpu->cfp << 2;
+  psw |= 1 << 1;
+  psw |= cpu->cfc << 0;
+  return psw;
+}
+
+static inline void set_cf_psw(adc_8080_cpu *cpu, uint8_t psw) {
+  cpu->cfs = (psw >> 7) & 1;
+  cpu->cfz = (psw >> 6) & 1;
+  cpu->cfa = (psw >> 4) & 1;
+  cpu->cfp = (psw >> 2) & 1;
+  cpu->cfc = (psw >> 0) & 1;
+}
+
+#ifdef ADC_8080_CPU_HEATMAP
+static inline void heatmap_count(adc_8080_cpu *cpu, uint16_t addr,
+                                 int access) {
+  adc_8080_cpu_heatmap *heatmap = &cpu->heatmap;
+  heatmap->pages[addr >> 8][access]++;
+  for (int i = 0; i < heatmap->range_count; i++) {
+    adc_8080_cpu_heatmap_range *range = &heatmap->ranges[i];
+    uint32_t offset = (uint16_t)(addr - range->start);
+    if (offset < range->length)
+      range->counts[offset * ADC_8080_CPU_ACCESS_KINDS + access]++;
+  }
+}
+#endif
+
+static inline bool map_test(const uint32_t *map, uint16_t addr) {
+  return map[addr >> 5] & (1u << (addr & 31));
 }
 
-static inline uint16_t read_word(adc_8080_cpu *cpu, uint16_t addr) {
-  return word_from_bytes(cpu->read_byte(cpu->userdata, addr + 1),
-                         cpu->read_byte(cpu->userdata, addr));
+// Record the first watchpoint hit of the instruction, adc_8080_cpu_run()
+// stops once it completes.
+static void debug_watch_hit(adc_8080_cpu *cpu, uint16_t addr, uint8_t value,
+                            enum adc_8080_cpu_stop_reason reason) {
+  adc_8080_cpu_stop *hit = &cpu->debug->hit;
+  if (hit->reason == ADC_8080_CPU_STOP_NONE) {
+    hit->reason = reason;
+    hit->addr = addr;
+    hit->value = value;
+  }
+}
+
+// Handler calls timed in the windows sampled by the run statistics. A clock
+// call costs more than most handlers, so the time of a reference call made
+// just before is taken off.
+static inline int64_t timed_ns(uint64_t ref, uint64_t start, uint64_t end) {
+  return (int64_t)(end - start) - (int64_t)(start - ref);
 }
 
-static inline void write_byte(adc_8080_cpu *cpu, uint16_t addr, uint8_t b) {
+static uint8_t timed_read_byte(adc_8080_cpu *cpu, uint16_t addr) {
+  adc_8080_cpu_stats *stats = cpu->stats;
+  uint64_t ref = stats->clock(), start = stats->clock();
+  uint8_t val = cpu->read_byte(cpu->userdata, addr);
+  stats->window_memory_ns += timed_ns(ref, start, stats->clock());
+  return val;
+}
+
+static void timed_write_byte(adc_8080_cpu *cpu, uint16_t addr, uint8_t b) {
+  adc_8080_cpu_stats *stats = cpu->stats;
+  uint64_t ref = stats->clock(), start = stats->clock();
   cpu->write_byte(cpu->userdata, addr, b);
+  stats->window_memory_ns += timed_ns(ref, start, stats->clock());
+}
+
+static uint8_t timed_read_device(adc_8080_cpu *cpu, uint8_t port) {
+  adc_8080_cpu_stats *stats = cpu->stats;
+  uint64_t ref = stats->clock(), start = stats->clock();
+  uint8_t val = cpu->read_device(cpu, port);
+  stats->window_device_ns += timed_ns(ref, start, stats->clock());
+  return val;
+}
+
+static void timed_write_device(adc_8080_cpu *cpu, uint8_t port, uint8_t b) {
+  adc_8080_cpu_stats *stats = cpu->stats;
+  uint64_t ref = stats->clock(), start = stats->clock();
+  cpu->write_device(cpu, port, b);
+  stats->window_device_ns += timed_ns(ref, start, stats->clock());
+}
+
+// Only run_debug() checks for a timing window, adc_8080_cpu_step() picks the
+// EXEC_TIMED executor for it.
+static inline bool timed(const adc_8080_cpu *cpu, enum exec_mode mode) {
+  return mode == EXEC_TIMED ||
+         (mode == EXEC_DEBUG && cpu->stats && cpu->stats->timing);
+}
+
+static inline uint8_t call_read_byte(adc_8080_cpu *cpu, uint16_t addr,
+                                     enum exec_mode mode) {
+  if (timed(cpu, mode))
+    return timed_read_byte(cpu, addr);
+  return cpu->read_byte(cpu->userdata, addr);
+}
+
+static inline void call_write_byte(adc_8080_cpu *cpu, uint16_t addr,
+                                   uint8_t b, enum exec_mode mode) {
+  if (timed(cpu, mode))
+    timed_write_byte(cpu, addr, b);
+  else
+    cpu->write_byte(cpu->userdata, addr, b);
+}
+
+static inline uint8_t call_read_device(adc_8080_cpu *cpu, uint8_t port,
+                                       enum exec_mode mode) {
+  if (timed(cpu, mode))
+    return timed_read_device(cpu, port);
+  return cpu->read_device(cpu, port);
+}
+
+static inline uint8_t read_byte(adc_8080_cpu *cpu, uint16_t addr,
+                                enum exec_mode mode) {
+#ifdef ADC_8080_CPU_HEATMAP
+  heatmap_count(cpu, addr, ADC_8080_CPU_ACCESS_READ);
+#endif
+  uint8_t val = call_read_byte(cpu, addr, mode);
+  if (mode == EXEC_DEBUG && map_test(cpu->debug->read_watch, addr))
+    debug_watch_hit(cpu, addr, val, ADC_8080_CPU_STOP_WATCH_READ);
+  return val;
+}
+
+static inline uint16_t read_word(adc_8080_cpu *cpu, uint16_t addr,
+                                 enum exec_mode mode) {
+  uint8_t lo = read_byte(cpu, addr, mode);
+  return word_from_bytes(read_byte(cpu, addr + 1, mode), lo);
+}
+
+// Copy a fetched byte into the trace record of the instruction, at its offset
+// from the pc the instruction started at.
+static inline void trace_fetch(adc_8080_cpu *cpu, uint16_t addr, uint8_t b) {
+  adc_8080_cpu_trace_record *record = cpu->trace->current;
+  if (record)
+    record->bytes[(uint16_t)(addr - record->pc)] = b;
 }
 
-static inline void write_word(adc_8080_cpu *cpu, uint16_t addr, uint16_t w) {
-  cpu->write_byte(cpu->userdata, addr, w & 0xFF);
-  cpu->write_byte(cpu->userdata, addr + 1, w >> 8);
+// Operand bytes, counted apart from data reads by the heatmap.
+static inline uint8_t fetch_byte(adc_8080_cpu *cpu, uint16_t addr,
+                                 enum exec_mode mode) {
+#ifdef ADC_8080_CPU_HEATMAP
+  heatmap_count(cpu, addr, ADC_8080_CPU_ACCESS_FETCH);
+#endif
+  if (mode != EXEC_PLAIN && cpu->coverage)
+    cpu->coverage->operands[addr >> 5] |= 1u << (addr & 31);
+  uint8_t b = call_read_byte(cpu, addr, mode);
+  if (mode != EXEC_PLAIN && cpu->trace)
+    trace_fetch(cpu, addr, b);
+  return b;
 }
 
-static inline uint8_t next_byte(adc_8080_cpu *cpu) {
-  return read_byte(cpu, cpu->pc++);
+static inline uint8_t fetch_opcode(adc_8080_cpu *cpu, enum exec_mode mode) {
+  uint16_t addr = cpu->pc++;
+#ifdef ADC_8080_CPU_HEATMAP
+  heatmap_count(cpu, addr, ADC_8080_CPU_ACCESS_FETCH);
+#endif
+  if (mode != EXEC_PLAIN && cpu->coverage)
+    cpu->coverage->opcodes[addr >> 5] |= 1u << (addr & 31);
+  uint8_t b = call_read_byte(cpu, addr, mode);
+  if (mode != EXEC_PLAIN && cpu->trace)
+    trace_fetch(cpu, addr, b);
+  return b;
 }
 
-static inline uint16_t next_word(adc_8080_cpu *cpu) {
-  uint16_t w = read_word(cpu, cpu->pc);
+static inline void mark_dirty(adc_8080_cpu *cpu, uint16_t addr) {
+  cpu->dirty_pages[addr >> 13] |= 1u << ((addr >> 8) & 31);
+}
+
+// Mixing function from SplitMix64.
+static inline uint64_t hash_mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Every (address, value) pair has its own hash term and a page hash is the
+// xor of the terms of its bytes, so a write can update it in O(1).
+static inline uint64_t hash_term(uint16_t addr, uint8_t val) {
+  return hash_mix(((uint64_t)addr << 8) | val);
+}
+
+static inline void hash_write(adc_8080_cpu *cpu, uint16_t addr, uint8_t b) {
+  uint8_t old = cpu->read_byte(cpu->userdata, addr);
+  if (old != b) {
+    uint64_t delta = hash_term(addr, old) ^ hash_term(addr, b);
+    cpu->hash->pages[addr >> 8] ^= delta;
+    cpu->hash->root ^= delta;
+  }
+}
+
+static inline void write_byte(adc_8080_cpu *cpu, uint16_t addr, uint8_t b,
+                              enum exec_mode mode) {
+#ifdef ADC_8080_CPU_HEATMAP
+  heatmap_count(cpu, addr, ADC_8080_CPU_ACCESS_WRITE);
+#endif
+  mark_dirty(cpu, addr);
+  if (mode != EXEC_PLAIN && cpu->hash)
+    hash_write(cpu, addr, b);
+  if (mode == EXEC_DEBUG && map_test(cpu->debug->write_watch, addr))
+    debug_watch_hit(cpu, addr, b, ADC_8080_CPU_STOP_WATCH_WRITE);
+  call_write_byte(cpu, addr, b, mode);
+}
+
+static inline void write_word(adc_8080_cpu *cpu, uint16_t addr, uint16_t w,
+                              enum exec_mode mode) {
+  write_byte(cpu, addr, w & 0xFF, mode);
+  write_byte(cpu, addr + 1, w >> 8, mode);
+}
+
+static inline uint8_t next_byte(adc_8080_cpu *cpu, enum exec_mode mode) {
+  return fetch_byte(cpu, cpu->pc++, mode);
+}
+
+static inline uint16_t next_word(adc_8080_cpu *cpu, enum exec_mode mode) {
+  uint8_t lo = fetch_byte(cpu, cpu->pc, mode);
+  uint16_t w = word_from_bytes(fetch_byte(cpu, cpu->pc + 1, mode), lo);
   cpu->pc += 2;
   return w;
 }
 
+// Input log helpers
+
+// Log events are a varint of (cycle delta << 1 | kind) followed by the port
+// and value for IN or the opcode for an interrupt.
+#define IOLOG_EVENT_IN 0
+#define IOLOG_EVENT_INTERRUPT 1
+
+static bool iolog_reserve(adc_8080_cpu_iolog *log, size_t n) {
+  if (log->size + n <= log->capacity)
+    return true;
+
+  size_t capacity = log->capacity ? log->capacity * 2 : 4096;
+  while (capacity < log->size + n)
+    capacity *= 2;
+
+  uint8_t *data = realloc(log->data, capacity);
+  if (!data)
+    return false;
+
+  log->data = data;
+  log->capacity = capacity;
+  return true;
+}
+
+// Append an event at the cycle, at or after the cycle of the previous event.
+// Returns the position of the last payload byte, 0 if recording failed.
+static size_t iolog_record(adc_8080_cpu *cpu, int kind, uint64_t cycle,
+                           uint8_t a, uint8_t b) {
+  adc_8080_cpu_iolog *log = cpu->iolog;
+  // A varint of up to 65 bits plus 2 bytes of payload.
+  if (log->error || !iolog_reserve(log, 12)) {
+    log->error = true;
+    return 0;
+  }
+
+  uint64_t v = (cycle - log->last_cycle) << 1 | kind;
+  log->last_cycle = cycle;
+  while (v >= 0x80) {
+    log->data[log->size++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  log->data[log->size++] = (uint8_t)v;
+  log->data[log->size++] = a;
+  if (kind == IOLOG_EVENT_IN)
+    log->data[log->size++] = b;
+  return log->size - 1;
+}
+
+// Decode the next replay event without consuming it.
+// Returns the number of bytes it occupies, 0 at the end of the stream.
+static size_t iolog_peek(const adc_8080_cpu_iolog *log, int *kind,
+                         uint64_t *cycle, uint8_t *a, uint8_t *b) {
+  size_t pos = log->pos;
+  uint64_t v = 0;
+  int shift = 0;
+  do {
+    if (pos >= log->size || shift > 63)
+      return 0;
+    v |= (uint64_t)(log->data[pos] & 0x7F) << shift;
+    shift += 7;
+  } while (log->data[pos++] & 0x80);
+
+  *kind = v & 1;
+  *cycle = log->last_cycle + (v >> 1);
+  size_t payload = *kind == IOLOG_EVENT_IN ? 2 : 1;
+  if (pos + payload > log->size)
+    return 0;
+  *a = log->data[pos];
+  *b = *kind == IOLOG_EVENT_IN ? log->data[pos + 1] : 0;
+  return pos + payload - log->pos;
+}
+
+// Switch a resumed log back to recording when the stream is exhausted.
+static inline bool iolog_try_resume(adc_8080_cpu_iolog *log) {
+  if (log->resume_recording && log->pos >= log->size) {
+    log->mode = ADC_8080_CPU_IOLOG_RECORD;
+    log->resume_recording = false;
+    return true;
+  }
+  return false;
+}
+
+static uint8_t iolog_replay_in(adc_8080_cpu *cpu, uint8_t port) {
+  adc_8080_cpu_iolog *log = cpu->iolog;
+  int kind;
+  uint64_t cycle;
+  uint8_t event_port, val;
+  size_t n = iolog_peek(log, &kind, &cycle, &event_port, &val);
+  if (log->error || n == 0 || kind != IOLOG_EVENT_IN ||
+      cycle != cpu->cycle_count || event_port != port) {
+    log->error = true;
+    return 0xFF;
+  }
+
+  log->pos += n;
+  log->last_cycle = cycle;
+  return val;
+}
+
+// Request the interrupts logged up to the cycle count. They are applied
+// after the step they were requested in, or when replaying starts for those
+// requested between steps.
+static void iolog_replay_interrupts(adc_8080_cpu *cpu) {
+  adc_8080_cpu_iolog *log = cpu->iolog;
+  int kind;
+  uint64_t cycle;
+  uint8_t opcode, unused;
+  size_t n;
+  while (!log->error &&
+         (n = iolog_peek(log, &kind, &cycle, &opcode, &unused)) != 0 &&
+         kind == IOLOG_EVENT_INTERRUPT && cycle <= cpu->cycle_count) {
+    log->pos += n;
+    log->last_cycle = cycle;
+    cpu->interrupt_pending = true;
+    cpu->interrupt_opcode = opcode;
+  }
+  iolog_try_resume(log);
+}
+
+static inline bool trace_trigger_fired(const adc_8080_cpu *cpu,
+                                       enum adc_8080_cpu_trace_trigger trigger,
+                                       uint64_t value) {
+  switch (trigger) {
+  case ADC_8080_CPU_TRACE_TRIGGER_PC:
+    return cpu->pc == value;
+  case ADC_8080_CPU_TRACE_TRIGGER_CYCLE:
+    return cpu->cycle_count >= value;
+  default:
+    return false;
+  }
+}
+
+// Write the trace record of the instruction about to execute. The opcode and
+// operands of a fetched instruction are filled in as they are fetched, see
+// trace_fetch(). Interrupt opcodes are not read from memory.
+static void trace_record(adc_8080_cpu *cpu, bool interrupt) {
+  adc_8080_cpu_trace *trace = cpu->trace;
+  trace->current = NULL;
+  if (!trace->active) {
+    if (!trace_trigger_fired(cpu, trace->start, trace->start_value))
+      return;
+    trace->active = true;
+    trace->start = ADC_8080_CPU_TRACE_TRIGGER_NONE;
+  }
+
+  adc_8080_cpu_trace_record *record = &trace->records[trace->next];
+  record->cycle = cpu->cycle_count;
+  record->pc = cpu->pc;
+  record->sp = cpu->sp;
+  record->a = cpu->ra, record->b = cpu->rb, record->c = cpu->rc,
+  record->d = cpu->rd, record->e = cpu->re, record->h = cpu->rh,
+  record->l = cpu->rl;
+  record->psw = get_cf_psw(cpu);
+  record->bytes[1] = record->bytes[2] = 0;
+  if (interrupt) {
+    // Operands of an interrupt opcode are fetched at the pc, not recorded.
+    record->bytes[0] = cpu->interrupt_opcode;
+    record->flags = ADC_8080_CPU_TRACE_INTERRUPT;
+  } else {
+    trace->current = record;
+    record->flags = 0;
+  }
+
+  trace->next = trace->next + 1 == trace->capacity ? 0 : trace->next + 1;
+  trace->total++;
+
+  if (trace_trigger_fired(cpu, trace->stop, trace->stop_value)) {
+    trace->active = false;
+    trace->stop = ADC_8080_CPU_TRACE_TRIGGER_NONE;
+  }
+}
+
+// Count the instruction that started at pc, or report it as a transition when
+// it did not continue at the next address.
+static inline void pctrace_step(adc_8080_cpu *cpu, uint16_t pc,
+                                uint8_t opcode) {
+  adc_8080_cpu_pctrace *pctrace = cpu->pctrace;
+  uint16_t next = (uint16_t)(pc + s_size_lut[opcode]);
+  if (cpu->pc == next) {
+    pctrace->run++;
+    return;
+  }
+
+  pctrace->transition(pctrace->userdata, pctrace->run, next, cpu->pc,
+                      cpu->cycle_count + cpu->cycles, false);
+  pctrace->run = 0;
+}
+
+// Steps of a window timed as a whole and of a window timing every handler
+// call, the second makes three clock calls per handler call. And how many
+// times longer than the mean a window is left out.
+#define STATS_WINDOW 1024
+#define STATS_HANDLER_WINDOW 256
+#define STATS_OUTLIER 4
+
+static void stats_window_end(adc_8080_cpu_stats *stats, uint64_t ns) {
+  if (stats->timing) {
+    if (stats->handler_steps > 0 &&
+        ns * stats->handler_steps >
+            STATS_OUTLIER * STATS_HANDLER_WINDOW * stats->handler_window_ns)
+      return;
+    stats->handler_steps += STATS_HANDLER_WINDOW;
+    stats->handler_window_ns += ns;
+    stats->memory_ns += stats->window_memory_ns;
+    stats->device_ns += stats->window_device_ns;
+  } else {
+    if (stats->window_steps > 0 &&
+        ns * stats->window_steps >
+            STATS_OUTLIER * STATS_WINDOW * stats->window_ns)
+      return;
+    stats->window_steps += STATS_WINDOW;
+    stats->window_ns += ns;
+  }
+}
+
+// Start or end a window at the start of the step the countdown expires on.
+static void stats_window(adc_8080_cpu_stats *stats) {
+  stats->steps += stats->period;
+  if (stats->in_window) {
+    stats_window_end(stats, stats->clock() - stats->window_start);
+    stats->period = stats->interval - stats->period;
+    stats->in_window = stats->timing = false;
+  } else {
+    // The first call after a while is slow, the clock is cold in the cache.
+    stats->clock();
+    stats->in_window = true;
+    stats->timing = stats->windows++ & 1;
+    stats->window_memory_ns = stats->window_device_ns = 0;
+    stats->period = stats->timing ? STATS_HANDLER_WINDOW : STATS_WINDOW;
+    stats->window_start = stats->clock();
+  }
+  stats->countdown = stats->period;
+}
+
+// Count the step about to be made, before its executor is picked as a window
+// starting at it may time the handler calls.
+static inline void stats_countdown(adc_8080_cpu *cpu) {
+  if (cpu->stats && --cpu->stats->countdown == 0)
+    stats_window(cpu->stats);
+}
+
+// Whether stack address a is above b. A stack set up at 0x0000 wraps to
+// 0xFFFE on the first push, so addresses are compared by their distance.
+static inline bool stack_above(uint16_t a, uint16_t b) {
+  uint16_t distance = (uint16_t)(a - b);
+  return distance != 0 && distance < 0x8000;
+}
+
+// Drop the frames returned from, once the stack pointer rose above them.
+static inline void profile_unwind(adc_8080_cpu_profile *profile,
+                                  uint16_t sp) {
+  while (profile->depth > 0 &&
+         stack_above(sp, profile->frames[profile->depth - 1].sp))
+    profile->depth--;
+}
+
+// Frames at or above the new one were left without a return, such as when a
+// function pops its return address and calls another.
+static inline void profile_push(adc_8080_cpu_profile *profile,
+                                uint16_t target, uint16_t sp) {
+  while (profile->depth > 0 &&
+         !stack_above(profile->frames[profile->depth - 1].sp, sp))
+    profile->depth--;
+  if (profile->depth < ADC_8080_CPU_PROFILE_DEPTH) {
+    profile->frames[profile->depth].target = target;
+    profile->frames[profile->depth].sp = sp;
+    profile->depth++;
+  }
+}
+
+static void profile_sample(adc_8080_cpu *cpu) {
+  adc_8080_cpu_profile *profile = cpu->profile;
+  profile_unwind(profile, cpu->sp);
+  profile->sample(profile->userdata, cpu->pc, profile->frames,
+                  profile->depth);
+  while (profile->next_sample <= cpu->cycle_count)
+    profile->next_sample += profile->interval;
+}
+
+#ifdef ADC_8080_CPU_OPCODE_STATS
+// Conditional jumps, calls and returns encode the condition in bits 3-5:
+// NZ, Z, NC, C, PO, PE, P, M. They do not change the flags, so the condition
+// can be evaluated after the instruction.
+static inline bool is_conditional(uint8_t opcode) {
+  uint8_t op = opcode & 0xC7;
+  return op == 0xC0 || op == 0xC2 || op == 0xC4;
+}
+
+static inline bool condition_met(const adc_8080_cpu *cpu, uint8_t opcode) {
+  int cond = (opcode >> 3) & 7;
+  bool flag;
+  switch (cond >> 1) {
+  case 0:
+    flag = cpu->cfz;
+    break;
+  case 1:
+    flag = cpu->cfc;
+    break;
+  case 2:
+    flag = cpu->cfp;
+    break;
+  default:
+    flag = cpu->cfs;
+    break;
+  }
+  return flag == (cond & 1);
+}
+
+static void record_opstats(adc_8080_cpu *cpu, uint8_t opcode) {
+  adc_8080_cpu_opstats *stats = &cpu->opstats;
+  stats->count[opcode]++;
+  stats->cycles[opcode] += cpu->cycles;
+  if (is_conditional(opcode)) {
+    if (condition_met(cpu, opcode))
+      stats->taken[opcode]++;
+    else
+      stats->not_taken[opcode]++;
+  }
+}
+#endif
+
+// Set adc_8080_cpu.hooks after attaching or detaching a hook.
+static void update_hooks(adc_8080_cpu *cpu) {
+  cpu->hooks = cpu->hash || cpu->coverage || cpu->iolog || cpu->trace ||
+               cpu->pctrace || cpu->stats || cpu->profile;
+}
+
 // Internal interface
 
-static void exec_next(adc_8080_cpu *cpu, uint8_t opcode);
+// The executor of each exec_mode.
+static void exec_plain(adc_8080_cpu *cpu, uint8_t opcode);
+static void exec_hooks(adc_8080_cpu *cpu, uint8_t opcode);
+static void exec_timed(adc_8080_cpu *cpu, uint8_t opcode);
+static void exec_debug(adc_8080_cpu *cpu, uint8_t opcode);
+static void (*const s_exec[])(adc_8080_cpu *cpu, uint8_t opcode) = {
+    exec_plain, exec_hooks, exec_timed, exec_debug};
 
 // Public api implementation
 
@@ -112,6 +690,16 @@ void adc_8080_cpu_init(adc_8080_cpu *cpu) {
   cpu->interrupt_opcode = 0x00;
   cpu->interrupt_delay = false;
   cpu->cycles = 0;
+  cpu->cycle_count = 0;
+  adc_8080_cpu_clear_dirty(cpu);
+  adc_8080_cpu_detach_all(cpu);
+#ifdef ADC_8080_CPU_OPCODE_STATS
+  adc_8080_cpu_opstats_reset(cpu);
+#endif
+#ifdef ADC_8080_CPU_HEATMAP
+  cpu->heatmap.range_count = 0;
+  adc_8080_cpu_heatmap_reset(cpu);
+#endif
   cpu->userdata = NULL;
   cpu->read_byte = NULL;
   cpu->write_byte = NULL;
@@ -128,12 +716,29 @@ void adc_8080_cpu_init(adc_8080_cpu *cpu) {
   }
 }
 
-int adc_8080_cpu_step(adc_8080_cpu *cpu) {
+void adc_8080_cpu_detach_all(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  cpu->hash = NULL;
+  cpu->coverage = NULL;
+  cpu->iolog = NULL;
+  cpu->trace = NULL;
+  cpu->pctrace = NULL;
+  cpu->stats = NULL;
+  cpu->profile = NULL;
+  cpu->debug = NULL;
+  cpu->hooks = false;
+}
+
+// The steps of adc_8080_cpu_step() and run_debug().
+static ALWAYS_INLINE int step(adc_8080_cpu *cpu, enum exec_mode mode) {
   assert(cpu);
   assert(cpu->read_byte);
   assert(cpu->write_byte);
-  assert(cpu->read_device);
-  assert(cpu->write_device);
+  // OUT is ignored without a write_device handler, IN needs a read_device
+  // handler unless it is replayed.
+  assert(cpu->read_device ||
+         (cpu->iolog && cpu->iolog->mode == ADC_8080_CPU_IOLOG_REPLAY));
 
   // Recognize a interrupt request when all of the following
   // conditions are met:
@@ -147,26 +752,581 @@ int adc_8080_cpu_step(adc_8080_cpu *cpu) {
     cpu->inte = false;
     cpu->halted = false;
 
+    if (mode != EXEC_PLAIN && cpu->trace)
+      trace_record(cpu, true);
+
     // The pc is not incremented here because interrupt
     // opcodes are not read from memory.
-    exec_next(cpu, cpu->interrupt_opcode);
+    uint16_t pc = cpu->pc;
+    s_exec[mode](cpu, cpu->interrupt_opcode);
+#ifdef ADC_8080_CPU_OPCODE_STATS
+    record_opstats(cpu, cpu->interrupt_opcode);
+#endif
+    if (mode != EXEC_PLAIN && cpu->pctrace) {
+      cpu->pctrace->transition(cpu->pctrace->userdata, cpu->pctrace->run, pc,
+                               cpu->pc, cpu->cycle_count + cpu->cycles, true);
+      cpu->pctrace->run = 0;
+    }
+    if (mode != EXEC_PLAIN && cpu->stats)
+      cpu->stats->interrupts++;
   } else if (!cpu->halted) {
-    exec_next(cpu, next_byte(cpu));
+    if (mode != EXEC_PLAIN && cpu->trace)
+      trace_record(cpu, false);
+    uint16_t pc = cpu->pc;
+    uint8_t opcode = fetch_opcode(cpu, mode);
+    s_exec[mode](cpu, opcode);
+#ifdef ADC_8080_CPU_OPCODE_STATS
+    record_opstats(cpu, opcode);
+#endif
+    if (mode != EXEC_PLAIN && cpu->pctrace)
+      pctrace_step(cpu, pc, opcode);
+  } else if (mode != EXEC_PLAIN && cpu->stats) {
+    cpu->stats->halted_steps++;
   }
 
   // Reset the cycle count and return the consumed cycles this step.
   int cycles = cpu->cycles;
   cpu->cycles = 0;
+  cpu->cycle_count += cycles;
+
+  if (mode == EXEC_PLAIN)
+    return cycles;
+  if (cpu->iolog && cpu->iolog->mode == ADC_8080_CPU_IOLOG_REPLAY)
+    iolog_replay_interrupts(cpu);
+  if (cpu->profile && cpu->cycle_count >= cpu->profile->next_sample)
+    profile_sample(cpu);
   return cycles;
 }
 
+int adc_8080_cpu_step(adc_8080_cpu *cpu) {
+  if (!cpu->hooks)
+    return step(cpu, EXEC_PLAIN);
+
+  stats_countdown(cpu);
+  if (cpu->stats && cpu->stats->timing)
+    return step(cpu, EXEC_TIMED);
+  return step(cpu, EXEC_HOOKS);
+}
+
+// Size of the operand of each condition opcode, -1 for invalid opcodes.
+static int cond_operand_size(uint8_t op) {
+  switch (op) {
+  case ADC_8080_CPU_COND_CONST8:
+  case ADC_8080_CPU_COND_REG:
+    return 1;
+  case ADC_8080_CPU_COND_CONST16:
+    return 2;
+  case ADC_8080_CPU_COND_CONST64:
+    return 8;
+  default:
+    return op <= ADC_8080_CPU_COND_LOR ? 0 : -1;
+  }
+}
+
+// Change in stack depth of each valid condition opcode.
+static int cond_stack_effect(uint8_t op) {
+  if (op >= ADC_8080_CPU_COND_ADD)
+    return -1;
+  if (op >= ADC_8080_CPU_COND_MEM8)
+    return 0;
+  return 1;
+}
+
+// Check that a condition only has known opcodes and registers, stays within
+// the stack and ends with one value.
+static bool cond_valid(const uint8_t *code, size_t size) {
+  int depth = 0;
+  size_t pc = 0;
+  while (pc < size) {
+    uint8_t op = code[pc++];
+    if (op == ADC_8080_CPU_COND_END)
+      return depth == 1 && pc == size;
+
+    int operand = cond_operand_size(op);
+    if (operand < 0 || pc + operand > size)
+      return false;
+    if (op == ADC_8080_CPU_COND_REG &&
+        code[pc] >= ADC_8080_CPU_COND_REG_COUNT)
+      return false;
+    pc += operand;
+
+    // Unary and binary operators need their operands.
+    if ((op >= ADC_8080_CPU_COND_MEM8 && depth < 1) ||
+        (op >= ADC_8080_CPU_COND_ADD && depth < 2))
+      return false;
+    depth += cond_stack_effect(op);
+    if (depth > ADC_8080_CPU_COND_STACK)
+      return false;
+  }
+  return false;
+}
+
+static uint64_t cond_reg(const adc_8080_cpu *cpu, uint8_t reg) {
+  switch (reg) {
+  case ADC_8080_CPU_COND_REG_A:
+    return cpu->ra;
+  case ADC_8080_CPU_COND_REG_B:
+    return cpu->rb;
+  case ADC_8080_CPU_COND_REG_C:
+    return cpu->rc;
+  case ADC_8080_CPU_COND_REG_D:
+    return cpu->rd;
+  case ADC_8080_CPU_COND_REG_E:
+    return cpu->re;
+  case ADC_8080_CPU_COND_REG_H:
+    return cpu->rh;
+  case ADC_8080_CPU_COND_REG_L:
+    return cpu->rl;
+  case ADC_8080_CPU_COND_REG_BC:
+    return word_from_bytes(cpu->rb, cpu->rc);
+  case ADC_8080_CPU_COND_REG_DE:
+    return word_from_bytes(cpu->rd, cpu->re);
+  case ADC_8080_CPU_COND_REG_HL:
+    return word_from_bytes(cpu->rh, cpu->rl);
+  case ADC_8080_CPU_COND_REG_SP:
+    return cpu->sp;
+  case ADC_8080_CPU_COND_REG_PC:
+    return cpu->pc;
+  case ADC_8080_CPU_COND_REG_PSW:
+    return get_cf_psw(cpu);
+  case ADC_8080_CPU_COND_REG_CFS:
+    return cpu->cfs;
+  case ADC_8080_CPU_COND_REG_CFZ:
+    return cpu->cfz;
+  case ADC_8080_CPU_COND_REG_CFA:
+    return cpu->cfa;
+  case ADC_8080_CPU_COND_REG_CFP:
+    return cpu->cfp;
+  default:
+    return cpu->cfc;
+  }
+}
+
+// Evaluate a condition checked by cond_valid(). Memory is peeked through the
+// handler, the reads are not guest accesses.
+static bool cond_eval(const adc_8080_cpu *cpu,
+                      const adc_8080_cpu_condition *cond) {
+  uint64_t stack[ADC_8080_CPU_COND_STACK];
+  int top = -1;
+  const uint8_t *code = cond->code;
+  for (size_t pc = 0;;) {
+    uint8_t op = code[pc++];
+    uint64_t r, v;
+    switch (op) {
+    case ADC_8080_CPU_COND_END:
+      return stack[top] != 0;
+    case ADC_8080_CPU_COND_CONST8:
+      stack[++top] = code[pc++];
+      continue;
+    case ADC_8080_CPU_COND_CONST16:
+      stack[++top] = word_from_bytes(code[pc + 1], code[pc]);
+      pc += 2;
+      continue;
+    case ADC_8080_CPU_COND_CONST64:
+      v = 0;
+      for (int i = 7; i >= 0; i--)
+        v = v << 8 | code[pc + i];
+      stack[++top] = v;
+      pc += 8;
+      continue;
+    case ADC_8080_CPU_COND_REG:
+      stack[++top] = cond_reg(cpu, code[pc++]);
+      continue;
+    case ADC_8080_CPU_COND_CYCLES:
+      stack[++top] = cpu->cycle_count;
+      continue;
+    case ADC_8080_CPU_COND_HITS:
+      stack[++top] = cond->hits;
+      continue;
+    case ADC_8080_CPU_COND_MEM8:
+      stack[top] = cpu->read_byte(cpu->userdata, (uint16_t)stack[top]);
+      continue;
+    case ADC_8080_CPU_COND_MEM16:
+      v = (uint16_t)stack[top];
+      stack[top] =
+          word_from_bytes(cpu->read_byte(cpu->userdata, (uint16_t)(v + 1)),
+                          cpu->read_byte(cpu->userdata, (uint16_t)v));
+      continue;
+    case ADC_8080_CPU_COND_NOT:
+      stack[top] = !stack[top];
+      continue;
+    case ADC_8080_CPU_COND_INV:
+      stack[top] = ~stack[top];
+      continue;
+    default:
+      break;
+    }
+
+    r = stack[top--];
+    uint64_t *l = &stack[top];
+    switch (op) {
+    case ADC_8080_CPU_COND_ADD:
+      *l += r;
+      break;
+    case ADC_8080_CPU_COND_SUB:
+      *l -= r;
+      break;
+    case ADC_8080_CPU_COND_AND:
+      *l &= r;
+      break;
+    case ADC_8080_CPU_COND_OR:
+      *l |= r;
+      break;
+    case ADC_8080_CPU_COND_XOR:
+      *l ^= r;
+      break;
+    case ADC_8080_CPU_COND_EQ:
+      *l = *l == r;
+      break;
+    case ADC_8080_CPU_COND_NE:
+      *l = *l != r;
+      break;
+    case ADC_8080_CPU_COND_LT:
+      *l = *l < r;
+      break;
+    case ADC_8080_CPU_COND_LE:
+      *l = *l <= r;
+      break;
+    case ADC_8080_CPU_COND_GT:
+      *l = *l > r;
+      break;
+    case ADC_8080_CPU_COND_GE:
+      *l = *l >= r;
+      break;
+    case ADC_8080_CPU_COND_LAND:
+      *l = *l && r;
+      break;
+    default:
+      *l = *l || r;
+      break;
+    }
+  }
+}
+
+// Whether the breakpoint at the pc stops, counting the hit of a conditional
+// breakpoint.
+static bool debug_break(const adc_8080_cpu *cpu, adc_8080_cpu_debug *debug) {
+  for (int i = 0; i < debug->condition_count; i++) {
+    adc_8080_cpu_condition *cond = &debug->conditions[i];
+    if (cond->addr == cpu->pc) {
+      cond->hits++;
+      return cond_eval(cpu, cond);
+    }
+  }
+  return true;
+}
+
+// Stop a run on a halt that no interrupt pending ends, its steps would
+// consume no cycles.
+static inline bool run_halted(const adc_8080_cpu *cpu,
+                              adc_8080_cpu_stop *stop) {
+  if (!cpu->halted || (cpu->interrupt_pending && cpu->inte))
+    return false;
+
+  stop->reason = ADC_8080_CPU_STOP_HALT;
+  stop->addr = stop->pc = cpu->pc;
+  stop->value = 0;
+  return true;
+}
+
+// The loop of adc_8080_cpu_run() with armed breakpoints or watchpoints.
+static uint64_t run_debug(adc_8080_cpu *cpu, adc_8080_cpu_debug *debug,
+                          uint64_t cycles, adc_8080_cpu_stop *stop) {
+  uint64_t consumed = 0;
+  bool check_break = false;
+
+  cpu->debug = debug;
+  debug->hit.reason = ADC_8080_CPU_STOP_NONE;
+  while (consumed < cycles && !run_halted(cpu, stop)) {
+    // An interrupt about to be taken or a halt do not execute the pc.
+    bool executes_pc =
+        !(cpu->interrupt_pending && cpu->inte && !cpu->interrupt_delay) &&
+        !cpu->halted;
+    if (check_break && executes_pc &&
+        map_test(debug->breakpoints, cpu->pc) && debug_break(cpu, debug)) {
+      stop->reason = ADC_8080_CPU_STOP_BREAKPOINT;
+      stop->addr = cpu->pc;
+      stop->pc = cpu->pc;
+      stop->value = 0;
+      break;
+    }
+    check_break = true;
+
+    uint16_t pc = cpu->pc;
+    stats_countdown(cpu);
+    consumed += step(cpu, EXEC_DEBUG);
+    if (debug->hit.reason != ADC_8080_CPU_STOP_NONE) {
+      *stop = debug->hit;
+      stop->pc = pc;
+      break;
+    }
+  }
+  cpu->debug = NULL;
+  return consumed;
+}
+
+uint64_t adc_8080_cpu_run(adc_8080_cpu *cpu, adc_8080_cpu_debug *debug,
+                          uint64_t cycles, adc_8080_cpu_stop *stop) {
+  assert(cpu);
+
+  adc_8080_cpu_stop ignored;
+  if (!stop)
+    stop = &ignored;
+  stop->reason = ADC_8080_CPU_STOP_NONE;
+
+  if (debug && (debug->breakpoint_count > 0 || debug->read_count > 0 ||
+                debug->write_count > 0))
+    return run_debug(cpu, debug, cycles, stop);
+
+  uint64_t consumed = 0;
+  while (consumed < cycles && !run_halted(cpu, stop))
+    consumed += adc_8080_cpu_step(cpu);
+  return consumed;
+}
+
+void adc_8080_cpu_debug_init(adc_8080_cpu_debug *debug) {
+  assert(debug);
+
+  memset(debug, 0, sizeof(adc_8080_cpu_debug));
+}
+
+// Set or clear a bit, returns the change in the number of bits set.
+static int map_set(uint32_t *map, uint16_t addr, bool set) {
+  uint32_t bit = 1u << (addr & 31);
+  bool was_set = map[addr >> 5] & bit;
+  if (set)
+    map[addr >> 5] |= bit;
+  else
+    map[addr >> 5] &= ~bit;
+  return (int)set - (int)was_set;
+}
+
+// Remove the condition of the breakpoint at addr, if it has one.
+static void remove_condition(adc_8080_cpu_debug *debug, uint16_t addr) {
+  for (int i = 0; i < debug->condition_count; i++) {
+    if (debug->conditions[i].addr == addr) {
+      debug->conditions[i] = debug->conditions[--debug->condition_count];
+      return;
+    }
+  }
+}
+
+void adc_8080_cpu_debug_break(adc_8080_cpu_debug *debug, uint16_t addr,
+                              bool armed) {
+  assert(debug);
+
+  remove_condition(debug, addr);
+  debug->breakpoint_count += map_set(debug->breakpoints, addr, armed);
+}
+
+bool adc_8080_cpu_debug_break_if(adc_8080_cpu_debug *debug, uint16_t addr,
+                                 const uint8_t *code, size_t size) {
+  assert(debug);
+  assert(code);
+
+  if (size > ADC_8080_CPU_COND_SIZE || !cond_valid(code, size))
+    return false;
+
+  remove_condition(debug, addr);
+  if (debug->condition_count == ADC_8080_CPU_DEBUG_CONDITIONS)
+    return false;
+
+  adc_8080_cpu_condition *cond = &debug->conditions[debug->condition_count++];
+  cond->addr = addr;
+  cond->hits = 0;
+  memcpy(cond->code, code, size);
+  debug->breakpoint_count += map_set(debug->breakpoints, addr, true);
+  return true;
+}
+
+void adc_8080_cpu_debug_watch(adc_8080_cpu_debug *debug, uint16_t addr,
+                              int access, bool armed) {
+  assert(debug);
+  assert(access & (ADC_8080_CPU_WATCH_READ | ADC_8080_CPU_WATCH_WRITE));
+
+  if (access & ADC_8080_CPU_WATCH_READ)
+    debug->read_count += map_set(debug->read_watch, addr, armed);
+  if (access & ADC_8080_CPU_WATCH_WRITE)
+    debug->write_count += map_set(debug->write_watch, addr, armed);
+}
+
 void adc_8080_cpu_interrupt(adc_8080_cpu *cpu, uint8_t opcode) {
   assert(cpu);
 
+  if (cpu->iolog) {
+    // Replayed interrupts come from the log only.
+    if (cpu->iolog->mode == ADC_8080_CPU_IOLOG_REPLAY)
+      return;
+    // Requested from a handler, the step consumes cpu->cycles. Replaying
+    // applies it once the step completes.
+    iolog_record(cpu, IOLOG_EVENT_INTERRUPT, cpu->cycle_count + cpu->cycles,
+                 opcode, 0);
+  }
+
   cpu->interrupt_pending = true;
   cpu->interrupt_opcode = opcode;
 }
 
+void adc_8080_cpu_record(adc_8080_cpu *cpu, adc_8080_cpu_iolog *log) {
+  assert(cpu);
+  assert(log);
+
+  log->mode = ADC_8080_CPU_IOLOG_RECORD;
+  log->data = NULL;
+  log->size = 0;
+  log->capacity = 0;
+  log->pos = 0;
+  log->last_cycle = cpu->cycle_count;
+  log->resume_recording = false;
+  log->error = false;
+  cpu->iolog = log;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_replay(adc_8080_cpu *cpu, adc_8080_cpu_iolog *log,
+                         const uint8_t *data, size_t size) {
+  assert(cpu);
+  assert(log);
+  assert(data || size == 0);
+
+  log->mode = ADC_8080_CPU_IOLOG_REPLAY;
+  // The stream is only read while replaying.
+  log->data = (uint8_t *)data;
+  log->size = size;
+  log->capacity = 0;
+  log->pos = 0;
+  log->last_cycle = cpu->cycle_count;
+  log->resume_recording = false;
+  log->error = false;
+  cpu->iolog = log;
+  update_hooks(cpu);
+  iolog_replay_interrupts(cpu);
+}
+
+void adc_8080_cpu_record_resume(adc_8080_cpu *cpu, adc_8080_cpu_iolog *log,
+                                size_t pos, uint64_t last_cycle) {
+  assert(cpu);
+  assert(log);
+  // The stream must be owned by the log to be appended to.
+  assert(log->capacity > 0 || log->size == 0);
+  assert(pos <= log->size);
+
+  log->mode = ADC_8080_CPU_IOLOG_REPLAY;
+  log->pos = pos;
+  log->last_cycle = last_cycle;
+  log->resume_recording = true;
+  log->error = false;
+  cpu->iolog = log;
+  update_hooks(cpu);
+  iolog_replay_interrupts(cpu);
+}
+
+void adc_8080_cpu_iolog_stop(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  cpu->iolog = NULL;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_iolog_free(adc_8080_cpu_iolog *log) {
+  assert(log);
+
+  // Only recorded streams are owned by the log.
+  if (log->capacity > 0)
+    free(log->data);
+  log->data = NULL;
+  log->size = 0;
+  log->capacity = 0;
+}
+
+void adc_8080_cpu_clear_dirty(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  memset(cpu->dirty_pages, 0, sizeof(cpu->dirty_pages));
+}
+
+void adc_8080_cpu_mark_dirty(adc_8080_cpu *cpu, uint16_t addr) {
+  assert(cpu);
+
+  mark_dirty(cpu, addr);
+}
+
+void adc_8080_cpu_hash_attach(adc_8080_cpu *cpu, adc_8080_cpu_hash *hash) {
+  assert(cpu);
+  assert(cpu->read_byte);
+  assert(hash);
+
+  hash->root = 0;
+  for (int page = 0; page < 256; page++) {
+    uint64_t h = 0;
+    for (int i = 0; i < 256; i++) {
+      uint16_t addr = (uint16_t)(page << 8 | i);
+      h ^= hash_term(addr, cpu->read_byte(cpu->userdata, addr));
+    }
+    hash->pages[page] = h;
+    hash->root ^= h;
+  }
+  cpu->hash = hash;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_hash_detach(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  cpu->hash = NULL;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_coverage_attach(adc_8080_cpu *cpu,
+                                  adc_8080_cpu_coverage *coverage) {
+  assert(cpu);
+  assert(coverage);
+
+  cpu->coverage = coverage;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_coverage_detach(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  cpu->coverage = NULL;
+  update_hooks(cpu);
+}
+
+uint64_t adc_8080_cpu_hash_state(const adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  uint64_t regs = (uint64_t)cpu->ra << 56 | (uint64_t)cpu->rb << 48 |
+                  (uint64_t)cpu->rc << 40 | (uint64_t)cpu->rd << 32 |
+                  (uint64_t)cpu->re << 24 | (uint64_t)cpu->rh << 16 |
+                  (uint64_t)cpu->rl << 8 | get_cf_psw(cpu);
+  uint64_t misc = (uint64_t)cpu->pc << 48 | (uint64_t)cpu->sp << 32 |
+                  (uint64_t)cpu->interrupt_opcode << 24 |
+                  cpu->halted << 3 | cpu->inte << 2 |
+                  cpu->interrupt_pending << 1 | cpu->interrupt_delay;
+
+  // Salt the register words so they do not alias a memory hash term.
+  uint64_t h = hash_mix(regs ^ 0x9E3779B97F4A7C15ULL) ^
+               hash_mix(misc ^ 0xC2B2AE3D27D4EB4FULL);
+  if (cpu->hash)
+    h ^= cpu->hash->root;
+  return h;
+}
+
+int adc_8080_cpu_hash_diff(const adc_8080_cpu_hash *a,
+                           const adc_8080_cpu_hash *b) {
+  assert(a);
+  assert(b);
+
+  if (a->root == b->root)
+    return -1;
+
+  for (int page = 0; page < 256; page++)
+    if (a->pages[page] != b->pages[page])
+      return page;
+  return -1;
+}
+
 #define get_rbc() word_from_bytes(cpu->rb, cpu->rc)
 #define get_rde() word_from_bytes(cpu->rd, cpu->re)
 #define get_rhl() word_from_bytes(cpu->rh, cpu->rl)
@@ -193,6 +1353,441 @@ void adc_8080_cpu_print(adc_8080_cpu *cpu, FILE *stream) {
 #undef u16
 }
 
+void adc_8080_cpu_trace_attach(adc_8080_cpu *cpu, adc_8080_cpu_trace *trace,
+                               adc_8080_cpu_trace_record *records,
+                               size_t capacity) {
+  assert(cpu);
+  assert(trace);
+  assert(records);
+  assert(capacity > 0);
+
+  trace->records = records;
+  trace->capacity = capacity;
+  trace->next = 0;
+  trace->total = 0;
+  trace->active = true;
+  trace->start = trace->stop = ADC_8080_CPU_TRACE_TRIGGER_NONE;
+  trace->start_value = trace->stop_value = 0;
+  trace->current = NULL;
+  cpu->trace = trace;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_trace_detach(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  cpu->trace = NULL;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_trace_start_on(adc_8080_cpu_trace *trace,
+                                 enum adc_8080_cpu_trace_trigger trigger,
+                                 uint64_t value) {
+  assert(trace);
+
+  trace->active = false;
+  trace->start = trigger;
+  trace->start_value = value;
+}
+
+void adc_8080_cpu_trace_stop_on(adc_8080_cpu_trace *trace,
+                                enum adc_8080_cpu_trace_trigger trigger,
+                                uint64_t value) {
+  assert(trace);
+
+  trace->stop = trigger;
+  trace->stop_value = value;
+}
+
+size_t adc_8080_cpu_trace_count(const adc_8080_cpu_trace *trace) {
+  assert(trace);
+
+  return trace->total < trace->capacity ? trace->total : trace->capacity;
+}
+
+const adc_8080_cpu_trace_record *
+adc_8080_cpu_trace_get(const adc_8080_cpu_trace *trace, size_t index) {
+  assert(trace);
+  assert(index < adc_8080_cpu_trace_count(trace));
+
+  size_t oldest = trace->total < trace->capacity ? 0 : trace->next;
+  return &trace->records[(oldest + index) % trace->capacity];
+}
+
+void adc_8080_cpu_pctrace_attach(
+    adc_8080_cpu *cpu, adc_8080_cpu_pctrace *pctrace,
+    void (*transition)(void *userdata, uint64_t run, uint16_t next,
+                       uint16_t target, uint64_t cycle_count, bool interrupt),
+    void *userdata) {
+  assert(cpu);
+  assert(pctrace);
+  assert(transition);
+
+  pctrace->run = 0;
+  pctrace->transition = transition;
+  pctrace->userdata = userdata;
+  cpu->pctrace = pctrace;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_pctrace_detach(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  cpu->pctrace = NULL;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_stats_attach(adc_8080_cpu *cpu, adc_8080_cpu_stats *stats,
+                               uint32_t interval, uint64_t (*clock)(void)) {
+  assert(cpu);
+  assert(stats);
+  assert(interval > STATS_WINDOW);
+  assert(clock);
+
+  stats->clock = clock;
+  stats->interval = interval;
+  cpu->stats = stats;
+  update_hooks(cpu);
+  adc_8080_cpu_stats_reset(cpu);
+}
+
+void adc_8080_cpu_stats_detach(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  cpu->stats = NULL;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_stats_reset(adc_8080_cpu *cpu) {
+  assert(cpu);
+  assert(cpu->stats);
+
+  adc_8080_cpu_stats *stats = cpu->stats;
+  stats->start_cycle = cpu->cycle_count;
+  stats->countdown = stats->period = stats->interval;
+  stats->steps = 0;
+  stats->interrupts = stats->halted_steps = 0;
+  stats->window_steps = stats->window_ns = 0;
+  stats->handler_steps = stats->handler_window_ns = 0;
+  stats->memory_ns = stats->device_ns = 0;
+  stats->in_window = stats->timing = false;
+  stats->windows = 0;
+  stats->start_ns = stats->clock();
+}
+
+void adc_8080_cpu_stats_query(const adc_8080_cpu *cpu, double guest_hz,
+                              adc_8080_cpu_stats_summary *summary) {
+  assert(cpu);
+  assert(cpu->stats);
+  assert(guest_hz > 0);
+  assert(summary);
+
+  const adc_8080_cpu_stats *stats = cpu->stats;
+  uint64_t steps = stats->steps + stats->period - stats->countdown;
+  uint64_t cycles = cpu->cycle_count - stats->start_cycle;
+  uint64_t elapsed = stats->clock() - stats->start_ns;
+  double ns = elapsed > 0 ? (double)elapsed : 1.0;
+  summary->seconds = elapsed / 1e9;
+  summary->instructions = steps - stats->interrupts - stats->halted_steps;
+  summary->mhz = cycles / ns * 1e3;
+  summary->mips = summary->instructions / ns * 1e3;
+  double guest_seconds = cycles / guest_hz;
+  summary->host_ns_per_guest_second =
+      guest_seconds > 0 ? ns / guest_seconds : 0.0;
+  summary->realtime = guest_seconds / (ns / 1e9);
+
+  // Mean times per step.
+  double step = 0.0, memory = 0.0, device = 0.0;
+  if (stats->window_steps > 0)
+    step = (double)stats->window_ns / stats->window_steps;
+  if (stats->handler_steps > 0) {
+    memory = (double)stats->memory_ns / stats->handler_steps;
+    device = (double)stats->device_ns / stats->handler_steps;
+  }
+  double core = step - (memory > 0 ? memory : 0) - (device > 0 ? device : 0);
+
+  double scale = steps / ns;
+  summary->core = core > 0 ? core * scale : 0.0;
+  summary->memory = memory > 0 ? memory * scale : 0.0;
+  summary->device = device > 0 ? device * scale : 0.0;
+  double inside = summary->core + summary->memory + summary->device;
+  summary->outside = inside < 1.0 ? 1.0 - inside : 0.0;
+}
+
+void adc_8080_cpu_profile_attach(
+    adc_8080_cpu *cpu, adc_8080_cpu_profile *profile, uint64_t interval,
+    void (*sample)(void *userdata, uint16_t pc,
+                   const adc_8080_cpu_frame *frames, int depth),
+    void *userdata) {
+  assert(cpu);
+  assert(profile);
+  assert(interval > 0);
+  assert(sample);
+
+  profile->interval = interval;
+  profile->next_sample = cpu->cycle_count + interval;
+  profile->sample = sample;
+  profile->userdata = userdata;
+  profile->depth = 0;
+  cpu->profile = profile;
+  update_hooks(cpu);
+}
+
+void adc_8080_cpu_profile_detach(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  cpu->profile = NULL;
+  update_hooks(cpu);
+}
+
+#ifdef ADC_8080_CPU_OPCODE_STATS
+void adc_8080_cpu_opstats_reset(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  memset(&cpu->opstats, 0, sizeof(cpu->opstats));
+}
+
+void adc_8080_cpu_opstats_print(const adc_8080_cpu *cpu, FILE *stream) {
+  assert(cpu);
+  assert(stream);
+
+  const adc_8080_cpu_opstats *stats = &cpu->opstats;
+  uint64_t total_count = 0, total_cycles = 0;
+  int order[256];
+  int n = 0;
+  for (int op = 0; op < 256; op++) {
+    total_count += stats->count[op];
+    total_cycles += stats->cycles[op];
+    if (stats->count[op] == 0)
+      continue;
+
+    // Insertion sort by cycles, descending.
+    int i = n++;
+    while (i > 0 && stats->cycles[order[i - 1]] < stats->cycles[op]) {
+      order[i] = order[i - 1];
+      i--;
+    }
+    order[i] = op;
+  }
+
+  fprintf(stream, "opcode %14s %7s %14s %7s %7s\n", "count", "", "cycles", "",
+          "taken");
+  for (int i = 0; i < n; i++) {
+    int op = order[i];
+    fprintf(stream, "  0x%02X %14" PRIu64 " %6.2f%% %14" PRIu64 " %6.2f%%",
+            op, stats->count[op], 100.0 * stats->count[op] / total_count,
+            stats->cycles[op], 100.0 * stats->cycles[op] / total_cycles);
+    if (stats->taken[op] + stats->not_taken[op] > 0)
+      fprintf(stream, " %6.2f%%",
+              100.0 * stats->taken[op] /
+                  (stats->taken[op] + stats->not_taken[op]));
+    fprintf(stream, "\n");
+  }
+  fprintf(stream, "total  %14" PRIu64 " %7s %14" PRIu64 "\n", total_count, "",
+          total_cycles);
+}
+#endif
+
+#ifdef ADC_8080_CPU_HEATMAP
+void adc_8080_cpu_heatmap_reset(adc_8080_cpu *cpu) {
+  assert(cpu);
+
+  adc_8080_cpu_heatmap *heatmap = &cpu->heatmap;
+  memset(heatmap->pages, 0, sizeof(heatmap->pages));
+  for (int i = 0; i < heatmap->range_count; i++)
+    memset(heatmap->ranges[i].counts, 0,
+           heatmap->ranges[i].length * ADC_8080_CPU_ACCESS_KINDS *
+               sizeof(uint64_t));
+}
+
+bool adc_8080_cpu_heatmap_add_range(adc_8080_cpu *cpu, uint16_t start,
+                                    uint32_t length, uint64_t *counts) {
+  assert(cpu);
+  assert(length > 0 && length <= 0x10000);
+  assert(counts);
+
+  adc_8080_cpu_heatmap *heatmap = &cpu->heatmap;
+  if (heatmap->range_count == ADC_8080_CPU_HEATMAP_RANGES)
+    return false;
+
+  adc_8080_cpu_heatmap_range *range = &heatmap->ranges[heatmap->range_count++];
+  range->start = start;
+  range->length = length;
+  range->counts = counts;
+  memset(counts, 0, length * ADC_8080_CPU_ACCESS_KINDS * sizeof(uint64_t));
+  return true;
+}
+
+void adc_8080_cpu_heatmap_write_csv(const adc_8080_cpu *cpu, FILE *stream) {
+  assert(cpu);
+  assert(stream);
+
+  const adc_8080_cpu_heatmap *heatmap = &cpu->heatmap;
+  fprintf(stream, "kind,addr,fetch,read,write\n");
+  for (int page = 0; page < 256; page++) {
+    const uint64_t *c = heatmap->pages[page];
+    fprintf(stream, "page,0x%04X,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+            page << 8, c[0], c[1], c[2]);
+  }
+  for (int i = 0; i < heatmap->range_count; i++) {
+    const adc_8080_cpu_heatmap_range *range = &heatmap->ranges[i];
+    for (uint32_t offset = 0; offset < range->length; offset++) {
+      const uint64_t *c = &range->counts[offset * ADC_8080_CPU_ACCESS_KINDS];
+      fprintf(stream, "byte,0x%04X,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+              (uint16_t)(range->start + offset), c[0], c[1], c[2]);
+    }
+  }
+}
+
+// Binary heatmap layout, all words are little-endian:
+// 0 - Magic "A80H".
+// 4 - Version.
+// 5 - Number of ranges.
+// 6 - Page counters, fetch, read and write of every page (64-bit).
+// Then for every range its start (16-bit), length (32-bit) and the fetch,
+// read and write counters of every byte (64-bit).
+#define HEATMAP_VERSION 1
+
+static const uint8_t s_heatmap_magic[4] = {'A', '8', '0', 'H'};
+
+static bool write_u64s(FILE *stream, const uint64_t *values, size_t n) {
+  uint8_t buf[8];
+  for (size_t i = 0; i < n; i++) {
+    for (int b = 0; b < 8; b++)
+      buf[b] = (values[i] >> (b * 8)) & 0xFF;
+    if (fwrite(buf, 1, 8, stream) != 8)
+      return false;
+  }
+  return true;
+}
+
+bool adc_8080_cpu_heatmap_write_binary(const adc_8080_cpu *cpu,
+                                       FILE *stream) {
+  assert(cpu);
+  assert(stream);
+
+  const adc_8080_cpu_heatmap *heatmap = &cpu->heatmap;
+  uint8_t header[6];
+  memcpy(header, s_heatmap_magic, sizeof(s_heatmap_magic));
+  header[4] = HEATMAP_VERSION;
+  header[5] = (uint8_t)heatmap->range_count;
+  if (fwrite(header, 1, sizeof(header), stream) != sizeof(header) ||
+      !write_u64s(stream, &heatmap->pages[0][0],
+                  256 * ADC_8080_CPU_ACCESS_KINDS))
+    return false;
+
+  for (int i = 0; i < heatmap->range_count; i++) {
+    const adc_8080_cpu_heatmap_range *range = &heatmap->ranges[i];
+    uint8_t info[6] = {range->start & 0xFF,         range->start >> 8,
+                       range->length & 0xFF,        (range->length >> 8) & 0xFF,
+                       (range->length >> 16) & 0xFF, range->length >> 24};
+    if (fwrite(info, 1, sizeof(info), stream) != sizeof(info) ||
+        !write_u64s(stream, range->counts,
+                    range->length * ADC_8080_CPU_ACCESS_KINDS))
+      return false;
+  }
+
+  return true;
+}
+#endif
+
+// Save state layout (version 2), all words are little-endian:
+// 0  - Magic "A80S".
+// 4  - Version.
+// 5  - Flags (bit 0: a memory image follows the cpu state).
+// 6  - Registers a, b, c, d, e, h, l.
+// 13 - pc.
+// 15 - sp.
+// 17 - PSW (S Z 0 AC 0 P 1 CY).
+// 18 - Interrupt and halt state bits (halted, inte, pending, delay).
+// 19 - Pending interrupt opcode.
+// 20 - Total cycle count (64-bit, added in version 2).
+// 28 - Optional 64 KiB memory image.
+//
+// Version 1 states are 20 bytes, without the cycle count.
+#define STATE_VERSION 2
+#define STATE_V1_SIZE 20
+#define STATE_FLAG_MEMORY (1 << 0)
+
+static const uint8_t s_state_magic[4] = {'A', '8', '0', 'S'};
+
+size_t adc_8080_cpu_save(const adc_8080_cpu *cpu, const uint8_t *memory,
+                         uint8_t *buf, size_t size) {
+  assert(cpu);
+  assert(buf);
+
+  size_t total = ADC_8080_CPU_STATE_SIZE;
+  if (memory)
+    total += ADC_8080_CPU_STATE_MEMORY_SIZE;
+  if (size < total)
+    return 0;
+
+  memcpy(buf, s_state_magic, sizeof(s_state_magic));
+  buf[4] = STATE_VERSION;
+  buf[5] = memory ? STATE_FLAG_MEMORY : 0;
+  buf[6] = cpu->ra, buf[7] = cpu->rb, buf[8] = cpu->rc, buf[9] = cpu->rd,
+  buf[10] = cpu->re, buf[11] = cpu->rh, buf[12] = cpu->rl;
+  bytes_from_word(&buf[14], &buf[13], cpu->pc);
+  bytes_from_word(&buf[16], &buf[15], cpu->sp);
+  buf[17] = get_cf_psw(cpu);
+  buf[18] = cpu->halted << 0 | cpu->inte << 1 | cpu->interrupt_pending << 2 |
+            cpu->interrupt_delay << 3;
+  buf[19] = cpu->interrupt_opcode;
+  for (int i = 0; i < 8; i++)
+    buf[20 + i] = (cpu->cycle_count >> (i * 8)) & 0xFF;
+
+  if (memory)
+    memcpy(buf + ADC_8080_CPU_STATE_SIZE, memory,
+           ADC_8080_CPU_STATE_MEMORY_SIZE);
+
+  return total;
+}
+
+size_t adc_8080_cpu_load(adc_8080_cpu *cpu, uint8_t *memory, const uint8_t *buf,
+                         size_t size) {
+  assert(cpu);
+  assert(buf);
+
+  if (size < STATE_V1_SIZE ||
+      memcmp(buf, s_state_magic, sizeof(s_state_magic)) != 0 ||
+      buf[4] < 1 || buf[4] > STATE_VERSION)
+    return 0;
+
+  size_t state_size = buf[4] == 1 ? STATE_V1_SIZE : ADC_8080_CPU_STATE_SIZE;
+  size_t total = state_size;
+  bool has_memory = buf[5] & STATE_FLAG_MEMORY;
+  if (has_memory)
+    total += ADC_8080_CPU_STATE_MEMORY_SIZE;
+  if (size < total)
+    return 0;
+
+  cpu->ra = buf[6], cpu->rb = buf[7], cpu->rc = buf[8], cpu->rd = buf[9],
+  cpu->re = buf[10], cpu->rh = buf[11], cpu->rl = buf[12];
+  cpu->pc = word_from_bytes(buf[14], buf[13]);
+  cpu->sp = word_from_bytes(buf[16], buf[15]);
+  set_cf_psw(cpu, buf[17]);
+  cpu->halted = (buf[18] >> 0) & 1;
+  cpu->inte = (buf[18] >> 1) & 1;
+  cpu->interrupt_pending = (buf[18] >> 2) & 1;
+  cpu->interrupt_delay = (buf[18] >> 3) & 1;
+  cpu->interrupt_opcode = buf[19];
+  cpu->cycles = 0;
+  cpu->cycle_count = 0;
+  if (state_size == ADC_8080_CPU_STATE_SIZE) {
+    for (int i = 0; i < 8; i++)
+      cpu->cycle_count |= (uint64_t)buf[20 + i] << (i * 8);
+  }
+
+  if (has_memory && memory) {
+    memcpy(memory, buf + state_size,
+           ADC_8080_CPU_STATE_MEMORY_SIZE);
+    if (cpu->hash)
+      adc_8080_cpu_hash_attach(cpu, cpu->hash);
+  }
+
+  return total;
+}
+
 // Internal implementation and helper macros
 
 #define set_rbc(w) bytes_from_word(&cpu->rb, &cpu->rc, w)
@@ -206,13 +1801,14 @@ void adc_8080_cpu_print(adc_8080_cpu *cpu, FILE *stream) {
     cpu->cfp = s_parity_lut[(v)];                                              \
   }
 
-static inline void stack_push(adc_8080_cpu *cpu, uint16_t w) {
+static inline void stack_push(adc_8080_cpu *cpu, uint16_t w,
+                              enum exec_mode mode) {
   cpu->sp -= 2;
-  write_word(cpu, cpu->sp, w);
+  write_word(cpu, cpu->sp, w, mode);
 }
 
-static inline uint16_t stack_pop(adc_8080_cpu *cpu) {
-  uint16_t w = read_word(cpu, cpu->sp);
+static inline uint16_t stack_pop(adc_8080_cpu *cpu, enum exec_mode mode) {
+  uint16_t w = read_word(cpu, cpu->sp, mode);
   cpu->sp += 2;
   return w;
 }
@@ -231,6 +1827,22 @@ static inline uint8_t op_dcr(adc_8080_cpu *cpu, uint8_t val) {
   return res;
 }
 
+#ifdef ADC_8080_CPU_ALU_TABLES
+// Table entries pack the result in the high byte and the PSW in the low byte.
+#define alu_lut_index(a, val, c) (((c) << 16) | ((a) << 8) | (val))
+
+static inline void op_add(adc_8080_cpu *cpu, uint8_t val, bool c) {
+  uint16_t packed = s_alu_add_lut[alu_lut_index(cpu->ra, val, c)];
+  set_cf_psw(cpu, packed & 0xFF);
+  cpu->ra = packed >> 8;
+}
+
+static inline void op_sub(adc_8080_cpu *cpu, uint8_t val, bool c) {
+  uint16_t packed = s_alu_sub_lut[alu_lut_index(cpu->ra, val, c)];
+  set_cf_psw(cpu, packed & 0xFF);
+  cpu->ra = packed >> 8;
+}
+#else
 static inline void op_add(adc_8080_cpu *cpu, uint8_t val, bool c) {
   uint8_t res = cpu->ra + val + c;
   int16_t sres = cpu->ra + val + c;
@@ -245,6 +1857,7 @@ static inline void op_sub(adc_8080_cpu *cpu, uint8_t val, bool c) {
   op_add(cpu, ~val, !c);
   cpu->cfc = !cpu->cfc;
 }
+#endif
 
 static inline void op_ana(adc_8080_cpu *cpu, uint8_t val) {
   uint8_t result = cpu->ra & val;
@@ -269,10 +1882,14 @@ static inline void op_ora(adc_8080_cpu *cpu, uint8_t val) {
 }
 
 static inline void op_cmp(adc_8080_cpu *cpu, uint8_t val) {
+#ifdef ADC_8080_CPU_ALU_TABLES
+  set_cf_psw(cpu, s_alu_sub_lut[alu_lut_index(cpu->ra, val, 0)] & 0xFF);
+#else
   int16_t res = cpu->ra - val;
   cpu->cfc = res >> 8;
   cpu->cfa = ~(cpu->ra ^ res ^ val) & 0x10;
   set_cf_zsp(res & 0xFF);
+#endif
 }
 
 static inline void op_jmp_cond(adc_8080_cpu *cpu, uint16_t addr,
@@ -281,22 +1898,32 @@ static inline void op_jmp_cond(adc_8080_cpu *cpu, uint16_t addr,
     cpu->pc = addr;
 }
 
-static inline void op_call(adc_8080_cpu *cpu, uint16_t addr) {
-  stack_push(cpu, cpu->pc);
+static inline void op_call(adc_8080_cpu *cpu, uint16_t addr,
+                           enum exec_mode mode) {
+  stack_push(cpu, cpu->pc, mode);
   cpu->pc = addr;
+  if (mode != EXEC_PLAIN && cpu->profile)
+    profile_push(cpu->profile, addr, cpu->sp);
+}
+
+static inline void op_ret(adc_8080_cpu *cpu, enum exec_mode mode) {
+  cpu->pc = stack_pop(cpu, mode);
+  if (mode != EXEC_PLAIN && cpu->profile)
+    profile_unwind(cpu->profile, cpu->sp);
 }
 
 static inline void op_call_cond(adc_8080_cpu *cpu, uint16_t addr,
-                                bool condition) {
+                                bool condition, enum exec_mode mode) {
   if (condition) {
-    op_call(cpu, addr);
+    op_call(cpu, addr, mode);
     cpu->cycles += 6;
   }
 }
 
-static inline void op_ret_cond(adc_8080_cpu *cpu, bool condition) {
+static inline void op_ret_cond(adc_8080_cpu *cpu, bool condition,
+                               enum exec_mode mode) {
   if (condition) {
-    cpu->pc = stack_pop(cpu);
+    op_ret(cpu, mode);
     cpu->cycles += 6;
   }
 }
@@ -313,9 +1940,9 @@ static inline void op_xchg(adc_8080_cpu *cpu) {
   set_rde(tmp);
 }
 
-static inline void op_xthl(adc_8080_cpu *cpu) {
-  uint16_t val = read_word(cpu, cpu->sp);
-  write_word(cpu, cpu->sp, get_rhl());
+static inline void op_xthl(adc_8080_cpu *cpu, enum exec_mode mode) {
+  uint16_t val = read_word(cpu, cpu->sp, mode);
+  write_word(cpu, cpu->sp, get_rhl(), mode);
   set_rhl(val);
 }
 
@@ -341,31 +1968,24 @@ static inline void op_rar(adc_8080_cpu *cpu) {
   cpu->ra = (cpu->ra >> 1) | (carrybit << 7);
 }
 
-static void op_push_psw(adc_8080_cpu *cpu) {
-  uint8_t psw = 0;
-  psw |= cpu->cfs << 7;
-  psw |= cpu->cfz << 6;
-  psw |= cpu->cfa << 4;
-  psw |= cpu->cfp << 2;
-  psw |= 1 << 1;
-  psw |= cpu->cfc << 0;
-
-  stack_push(cpu, word_from_bytes(cpu->ra, psw));
+static void op_push_psw(adc_8080_cpu *cpu, enum exec_mode mode) {
+  stack_push(cpu, word_from_bytes(cpu->ra, get_cf_psw(cpu)), mode);
 }
 
-static void op_pop_psw(adc_8080_cpu *cpu) {
+static void op_pop_psw(adc_8080_cpu *cpu, enum exec_mode mode) {
   uint8_t a, psw;
-  bytes_from_word(&a, &psw, stack_pop(cpu));
+  bytes_from_word(&a, &psw, stack_pop(cpu, mode));
 
   cpu->ra = a;
-  cpu->cfs = (psw >> 7) & 1;
-  cpu->cfz = (psw >> 6) & 1;
-  cpu->cfa = (psw >> 4) & 1;
-  cpu->cfp = (psw >> 2) & 1;
-  cpu->cfc = (psw >> 0) & 1;
+  set_cf_psw(cpu, psw);
 }
 
 static void op_daa(adc_8080_cpu *cpu) {
+#ifdef ADC_8080_CPU_ALU_TABLES
+  uint16_t packed = s_alu_daa_lut[(cpu->cfc << 9) | (cpu->cfa << 8) | cpu->ra];
+  set_cf_psw(cpu, packed & 0xFF);
+  cpu->ra = packed >> 8;
+#else
   uint8_t lownib = cpu->ra & 0x0F;
   uint8_t highnib = cpu->ra >> 4;
   bool carrybit = cpu->cfc;
@@ -382,9 +2002,43 @@ static void op_daa(adc_8080_cpu *cpu) {
 
   op_add(cpu, addition, 0);
   cpu->cfc = carrybit;
+#endif
 }
 
-static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
+static inline void op_in(adc_8080_cpu *cpu, uint8_t port,
+                         enum exec_mode mode) {
+  adc_8080_cpu_iolog *log = cpu->iolog;
+  if (mode == EXEC_PLAIN || !log) {
+    cpu->ra = call_read_device(cpu, port, mode);
+    return;
+  }
+
+  if (log->mode == ADC_8080_CPU_IOLOG_REPLAY && !iolog_try_resume(log)) {
+    cpu->ra = iolog_replay_in(cpu, port);
+    return;
+  }
+
+  // The event is logged before the handler runs and its value filled in
+  // after, an interrupt the handler requests is logged after the IN in the
+  // order they are replayed.
+  size_t value = iolog_record(cpu, IOLOG_EVENT_IN, cpu->cycle_count, port, 0);
+  cpu->ra = call_read_device(cpu, port, mode);
+  if (value > 0)
+    log->data[value] = cpu->ra;
+}
+
+static inline void op_out(adc_8080_cpu *cpu, uint8_t port,
+                          enum exec_mode mode) {
+  if (!cpu->write_device)
+    return;
+  if (timed(cpu, mode))
+    timed_write_device(cpu, port, cpu->ra);
+  else
+    cpu->write_device(cpu, port, cpu->ra);
+}
+
+static ALWAYS_INLINE void exec_next(adc_8080_cpu *cpu, uint8_t opcode,
+                                    enum exec_mode mode) {
   cpu->cycles = s_cycles_lut[opcode];
 
   if (cpu->interrupt_delay)
@@ -437,10 +2091,12 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     cpu->rl = op_dcr(cpu, cpu->rl);
     break;
   case 0x34: // INR M
-    write_byte(cpu, get_rhl(), op_inr(cpu, read_byte(cpu, get_rhl())));
+    write_byte(cpu, get_rhl(),
+               op_inr(cpu, read_byte(cpu, get_rhl(), mode)), mode);
     break;
   case 0x35: // DCR M
-    write_byte(cpu, get_rhl(), op_dcr(cpu, read_byte(cpu, get_rhl())));
+    write_byte(cpu, get_rhl(),
+               op_dcr(cpu, read_byte(cpu, get_rhl(), mode)), mode);
     break;
   case 0x3C: // INR A
     cpu->ra = op_inr(cpu, cpu->ra);
@@ -485,7 +2141,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     cpu->rb = cpu->rl;
     break;
   case 0X46: // MOV B,M
-    cpu->rb = read_byte(cpu, get_rhl());
+    cpu->rb = read_byte(cpu, get_rhl(), mode);
     break;
   case 0X47: // MOV B,A
     cpu->rb = cpu->ra;
@@ -508,7 +2164,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     cpu->rc = cpu->rl;
     break;
   case 0X4E: // MOV C,M
-    cpu->rc = read_byte(cpu, get_rhl());
+    cpu->rc = read_byte(cpu, get_rhl(), mode);
     break;
   case 0X4F: // MOV C,A
     cpu->rc = cpu->ra;
@@ -531,7 +2187,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     cpu->rd = cpu->rl;
     break;
   case 0X56: // MOV D,M
-    cpu->rd = read_byte(cpu, get_rhl());
+    cpu->rd = read_byte(cpu, get_rhl(), mode);
     break;
   case 0X57: // MOV D,A
     cpu->rd = cpu->ra;
@@ -554,7 +2210,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     cpu->re = cpu->rl;
     break;
   case 0X5E: // MOV E,M
-    cpu->re = read_byte(cpu, get_rhl());
+    cpu->re = read_byte(cpu, get_rhl(), mode);
     break;
   case 0X5F: // MOV E,A
     cpu->re = cpu->ra;
@@ -577,7 +2233,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     cpu->rh = cpu->rl;
     break;
   case 0X66: // MOV H,M
-    cpu->rh = read_byte(cpu, get_rhl());
+    cpu->rh = read_byte(cpu, get_rhl(), mode);
     break;
   case 0X67: // MOV H,A
     cpu->rh = cpu->ra;
@@ -600,31 +2256,31 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
   case 0X6D: // MOV L,L
     break;
   case 0X6E: // MOV L,M
-    cpu->rl = read_byte(cpu, get_rhl());
+    cpu->rl = read_byte(cpu, get_rhl(), mode);
     break;
   case 0X6F: // MOV L,A
     cpu->rl = cpu->ra;
     break;
   case 0X70: // MOV M,B
-    write_byte(cpu, get_rhl(), cpu->rb);
+    write_byte(cpu, get_rhl(), cpu->rb, mode);
     break;
   case 0X71: // MOV M,C
-    write_byte(cpu, get_rhl(), cpu->rc);
+    write_byte(cpu, get_rhl(), cpu->rc, mode);
     break;
   case 0X72: // MOV M,D
-    write_byte(cpu, get_rhl(), cpu->rd);
+    write_byte(cpu, get_rhl(), cpu->rd, mode);
     break;
   case 0X73: // MOV M,E
-    write_byte(cpu, get_rhl(), cpu->re);
+    write_byte(cpu, get_rhl(), cpu->re, mode);
     break;
   case 0X74: // MOV M,H
-    write_byte(cpu, get_rhl(), cpu->rh);
+    write_byte(cpu, get_rhl(), cpu->rh, mode);
     break;
   case 0X75: // MOV M,L
-    write_byte(cpu, get_rhl(), cpu->rl);
+    write_byte(cpu, get_rhl(), cpu->rl, mode);
     break;
   case 0X77: // MOV M,A
-    write_byte(cpu, get_rhl(), cpu->ra);
+    write_byte(cpu, get_rhl(), cpu->ra, mode);
     break;
   case 0X78: // MOV A,B
     cpu->ra = cpu->rb;
@@ -645,7 +2301,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     cpu->ra = cpu->rl;
     break;
   case 0X7E: // MOV A,M
-    cpu->ra = read_byte(cpu, get_rhl());
+    cpu->ra = read_byte(cpu, get_rhl(), mode);
     break;
   case 0X7F: // MOV A,A
     break;
@@ -670,7 +2326,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     op_add(cpu, cpu->rl, 0);
     break;
   case 0X86: // ADD M
-    op_add(cpu, read_byte(cpu, get_rhl()), 0);
+    op_add(cpu, read_byte(cpu, get_rhl(), mode), 0);
     break;
   case 0X87: // ADD A
     op_add(cpu, cpu->ra, 0);
@@ -694,7 +2350,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     op_add(cpu, cpu->rl, cpu->cfc);
     break;
   case 0X8E: // ADC M
-    op_add(cpu, read_byte(cpu, get_rhl()), cpu->cfc);
+    op_add(cpu, read_byte(cpu, get_rhl(), mode), cpu->cfc);
     break;
   case 0X8F: // ADC A
     op_add(cpu, cpu->ra, cpu->cfc);
@@ -718,7 +2374,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     op_sub(cpu, cpu->rl, 0);
     break;
   case 0X96: // SUB M
-    op_sub(cpu, read_byte(cpu, get_rhl()), 0);
+    op_sub(cpu, read_byte(cpu, get_rhl(), mode), 0);
     break;
   case 0X97: // SUB A
     op_sub(cpu, cpu->ra, 0);
@@ -742,7 +2398,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     op_sub(cpu, cpu->rl, cpu->cfc);
     break;
   case 0X9E: // SBB M
-    op_sub(cpu, read_byte(cpu, get_rhl()), cpu->cfc);
+    op_sub(cpu, read_byte(cpu, get_rhl(), mode), cpu->cfc);
     break;
   case 0X9F: // SBB A
     op_sub(cpu, cpu->ra, cpu->cfc);
@@ -766,7 +2422,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     op_ana(cpu, cpu->rl);
     break;
   case 0XA6: // ANA M
-    op_ana(cpu, read_byte(cpu, get_rhl()));
+    op_ana(cpu, read_byte(cpu, get_rhl(), mode));
     break;
   case 0XA7: // ANA A
     op_ana(cpu, cpu->ra);
@@ -790,7 +2446,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     op_xra(cpu, cpu->rl);
     break;
   case 0XAE: // XRA M
-    op_xra(cpu, read_byte(cpu, get_rhl()));
+    op_xra(cpu, read_byte(cpu, get_rhl(), mode));
     break;
   case 0XAF: // XRA A
     op_xra(cpu, cpu->ra);
@@ -814,7 +2470,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     op_ora(cpu, cpu->rl);
     break;
   case 0XB6: // ORA M
-    op_ora(cpu, read_byte(cpu, get_rhl()));
+    op_ora(cpu, read_byte(cpu, get_rhl(), mode));
     break;
   case 0XB7: // ORA A
     op_ora(cpu, cpu->ra);
@@ -838,7 +2494,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     op_cmp(cpu, cpu->rl);
     break;
   case 0XBE: // CMP M
-    op_cmp(cpu, read_byte(cpu, get_rhl()));
+    op_cmp(cpu, read_byte(cpu, get_rhl(), mode));
     break;
   case 0XBF: // CMP A
     op_cmp(cpu, cpu->ra);
@@ -860,28 +2516,28 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
 
   // Register pair ops
   case 0XC5: // PUSH B
-    stack_push(cpu, get_rbc());
+    stack_push(cpu, get_rbc(), mode);
     break;
   case 0XD5: // PUSH D
-    stack_push(cpu, get_rde());
+    stack_push(cpu, get_rde(), mode);
     break;
   case 0XE5: // PUSH H
-    stack_push(cpu, get_rhl());
+    stack_push(cpu, get_rhl(), mode);
     break;
   case 0XF5: // PUSH PSW
-    op_push_psw(cpu);
+    op_push_psw(cpu, mode);
     break;
   case 0XC1: // POP B
-    set_rbc(stack_pop(cpu));
+    set_rbc(stack_pop(cpu, mode));
     break;
   case 0XD1: // POP D
-    set_rde(stack_pop(cpu));
+    set_rde(stack_pop(cpu, mode));
     break;
   case 0XE1: // POP H
-    set_rhl(stack_pop(cpu));
+    set_rhl(stack_pop(cpu, mode));
     break;
   case 0XF1: // POP PSW
-    op_pop_psw(cpu);
+    op_pop_psw(cpu, mode);
     break;
   case 0X09: // DAD B
     op_dad(cpu, get_rbc());
@@ -923,7 +2579,7 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     op_xchg(cpu);
     break;
   case 0XE3: // XTHL
-    op_xthl(cpu);
+    op_xthl(cpu, mode);
     break;
   case 0XF9: // SPHL
     cpu->sp = get_rhl();
@@ -931,90 +2587,90 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
 
   // Immediate ops
   case 0X01: // LXI B
-    set_rbc(next_word(cpu));
+    set_rbc(next_word(cpu, mode));
     break;
   case 0X11: // LXI D
-    set_rde(next_word(cpu));
+    set_rde(next_word(cpu, mode));
     break;
   case 0X21: // LXI H
-    set_rhl(next_word(cpu));
+    set_rhl(next_word(cpu, mode));
     break;
   case 0X31: // LXI SP
-    cpu->sp = next_word(cpu);
+    cpu->sp = next_word(cpu, mode);
     break;
   case 0X06: // MVI B
-    cpu->rb = next_byte(cpu);
+    cpu->rb = next_byte(cpu, mode);
     break;
   case 0X0E: // MVI C
-    cpu->rc = next_byte(cpu);
+    cpu->rc = next_byte(cpu, mode);
     break;
   case 0X16: // MVI D
-    cpu->rd = next_byte(cpu);
+    cpu->rd = next_byte(cpu, mode);
     break;
   case 0X1E: // MVI E
-    cpu->re = next_byte(cpu);
+    cpu->re = next_byte(cpu, mode);
     break;
   case 0X26: // MVI H
-    cpu->rh = next_byte(cpu);
+    cpu->rh = next_byte(cpu, mode);
     break;
   case 0X2E: // MVI L
-    cpu->rl = next_byte(cpu);
+    cpu->rl = next_byte(cpu, mode);
     break;
   case 0X36: // MVI M
-    write_byte(cpu, get_rhl(), next_byte(cpu));
+    write_byte(cpu, get_rhl(), next_byte(cpu, mode), mode);
     break;
   case 0X3E: // MVI A
-    cpu->ra = next_byte(cpu);
+    cpu->ra = next_byte(cpu, mode);
     break;
   case 0XC6: // ADI
-    op_add(cpu, next_byte(cpu), 0);
+    op_add(cpu, next_byte(cpu, mode), 0);
     break;
   case 0XCE: // ACI
-    op_add(cpu, next_byte(cpu), cpu->cfc);
+    op_add(cpu, next_byte(cpu, mode), cpu->cfc);
     break;
   case 0XD6: // SUI
-    op_sub(cpu, next_byte(cpu), 0);
+    op_sub(cpu, next_byte(cpu, mode), 0);
     break;
   case 0XDE: // SBI
-    op_sub(cpu, next_byte(cpu), cpu->cfc);
+    op_sub(cpu, next_byte(cpu, mode), cpu->cfc);
     break;
   case 0XE6: // ANI
-    op_ana(cpu, next_byte(cpu));
+    op_ana(cpu, next_byte(cpu, mode));
     break;
   case 0XEE: // XRI
-    op_xra(cpu, next_byte(cpu));
+    op_xra(cpu, next_byte(cpu, mode));
     break;
   case 0XF6: // ORI
-    op_ora(cpu, next_byte(cpu));
+    op_ora(cpu, next_byte(cpu, mode));
     break;
   case 0XFE: // CPI
-    op_cmp(cpu, next_byte(cpu));
+    op_cmp(cpu, next_byte(cpu, mode));
     break;
 
   // Direct addressing ops
   case 0X02: // STAX B
-    write_byte(cpu, get_rbc(), cpu->ra);
+    write_byte(cpu, get_rbc(), cpu->ra, mode);
     break;
   case 0X12: // STAX D
-    write_byte(cpu, get_rde(), cpu->ra);
+    write_byte(cpu, get_rde(), cpu->ra, mode);
     break;
   case 0X32: // STA
-    write_byte(cpu, next_word(cpu), cpu->ra);
+    write_byte(cpu, next_word(cpu, mode), cpu->ra, mode);
     break;
   case 0X0A: // LDAX B
-    cpu->ra = read_byte(cpu, get_rbc());
+    cpu->ra = read_byte(cpu, get_rbc(), mode);
     break;
   case 0X1A: // LDAX D
-    cpu->ra = read_byte(cpu, get_rde());
+    cpu->ra = read_byte(cpu, get_rde(), mode);
     break;
   case 0X3A: // LDA
-    cpu->ra = read_byte(cpu, next_word(cpu));
+    cpu->ra = read_byte(cpu, next_word(cpu, mode), mode);
     break;
   case 0X22: // SHLD
-    write_word(cpu, next_word(cpu), get_rhl());
+    write_word(cpu, next_word(cpu, mode), get_rhl(), mode);
     break;
   case 0X2A: // LHLD
-    set_rhl(read_word(cpu, next_word(cpu)));
+    set_rhl(read_word(cpu, next_word(cpu, mode), mode));
     break;
 
   // Jump ops
@@ -1022,32 +2678,32 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     cpu->pc = get_rhl();
     break;
   case 0XC2: // JNZ
-    op_jmp_cond(cpu, next_word(cpu), cpu->cfz == 0);
+    op_jmp_cond(cpu, next_word(cpu, mode), cpu->cfz == 0);
     break;
   case 0XC3: // JMP
   case 0XCB: // *JMP
-    cpu->pc = next_word(cpu);
+    cpu->pc = next_word(cpu, mode);
     break;
   case 0XCA: // JZ
-    op_jmp_cond(cpu, next_word(cpu), cpu->cfz == 1);
+    op_jmp_cond(cpu, next_word(cpu, mode), cpu->cfz == 1);
     break;
   case 0XD2: // JNC
-    op_jmp_cond(cpu, next_word(cpu), cpu->cfc == 0);
+    op_jmp_cond(cpu, next_word(cpu, mode), cpu->cfc == 0);
     break;
   case 0XDA: // JC
-    op_jmp_cond(cpu, next_word(cpu), cpu->cfc == 1);
+    op_jmp_cond(cpu, next_word(cpu, mode), cpu->cfc == 1);
     break;
   case 0XE2: // JPO
-    op_jmp_cond(cpu, next_word(cpu), cpu->cfp == 0);
+    op_jmp_cond(cpu, next_word(cpu, mode), cpu->cfp == 0);
     break;
   case 0XEA: // JPE
-    op_jmp_cond(cpu, next_word(cpu), cpu->cfp == 1);
+    op_jmp_cond(cpu, next_word(cpu, mode), cpu->cfp == 1);
     break;
   case 0XF2: // JP
-    op_jmp_cond(cpu, next_word(cpu), cpu->cfs == 0);
+    op_jmp_cond(cpu, next_word(cpu, mode), cpu->cfs == 0);
     break;
   case 0XFA: // JM
-    op_jmp_cond(cpu, next_word(cpu), cpu->cfs == 1);
+    op_jmp_cond(cpu, next_word(cpu, mode), cpu->cfs == 1);
     break;
 
   // Call ops
@@ -1055,87 +2711,87 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
   case 0XDD: // *CALL
   case 0XED: // *CALL
   case 0XFD: // *CALL
-    op_call(cpu, next_word(cpu));
+    op_call(cpu, next_word(cpu, mode), mode);
     break;
   case 0XDC: // CC
-    op_call_cond(cpu, next_word(cpu), cpu->cfc == 1);
+    op_call_cond(cpu, next_word(cpu, mode), cpu->cfc == 1, mode);
     break;
   case 0XD4: // CNC
-    op_call_cond(cpu, next_word(cpu), cpu->cfc == 0);
+    op_call_cond(cpu, next_word(cpu, mode), cpu->cfc == 0, mode);
     break;
   case 0XCC: // CZ
-    op_call_cond(cpu, next_word(cpu), cpu->cfz == 1);
+    op_call_cond(cpu, next_word(cpu, mode), cpu->cfz == 1, mode);
     break;
   case 0XC4: // CNZ
-    op_call_cond(cpu, next_word(cpu), cpu->cfz == 0);
+    op_call_cond(cpu, next_word(cpu, mode), cpu->cfz == 0, mode);
     break;
   case 0XF4: // CP
-    op_call_cond(cpu, next_word(cpu), cpu->cfs == 0);
+    op_call_cond(cpu, next_word(cpu, mode), cpu->cfs == 0, mode);
     break;
   case 0XFC: // CM
-    op_call_cond(cpu, next_word(cpu), cpu->cfs == 1);
+    op_call_cond(cpu, next_word(cpu, mode), cpu->cfs == 1, mode);
     break;
   case 0XEC: // CPE
-    op_call_cond(cpu, next_word(cpu), cpu->cfp == 1);
+    op_call_cond(cpu, next_word(cpu, mode), cpu->cfp == 1, mode);
     break;
   case 0XE4: // CPO
-    op_call_cond(cpu, next_word(cpu), cpu->cfp == 0);
+    op_call_cond(cpu, next_word(cpu, mode), cpu->cfp == 0, mode);
     break;
 
   // Return ops
   case 0XC9: // RET
   case 0XD9: // *RET
-    cpu->pc = stack_pop(cpu);
+    op_ret(cpu, mode);
     break;
   case 0XD8: // RC
-    op_ret_cond(cpu, cpu->cfc == 1);
+    op_ret_cond(cpu, cpu->cfc == 1, mode);
     break;
   case 0XD0: // RNC
-    op_ret_cond(cpu, cpu->cfc == 0);
+    op_ret_cond(cpu, cpu->cfc == 0, mode);
     break;
   case 0XC8: // RZ
-    op_ret_cond(cpu, cpu->cfz == 1);
+    op_ret_cond(cpu, cpu->cfz == 1, mode);
     break;
   case 0XC0: // RNZ
-    op_ret_cond(cpu, cpu->cfz == 0);
+    op_ret_cond(cpu, cpu->cfz == 0, mode);
     break;
   case 0XF8: // RM
-    op_ret_cond(cpu, cpu->cfs == 1);
+    op_ret_cond(cpu, cpu->cfs == 1, mode);
     break;
   case 0XF0: // RP
-    op_ret_cond(cpu, cpu->cfs == 0);
+    op_ret_cond(cpu, cpu->cfs == 0, mode);
     break;
   case 0XE8: // RPE
-    op_ret_cond(cpu, cpu->cfp == 1);
+    op_ret_cond(cpu, cpu->cfp == 1, mode);
     break;
   case 0XE0: // RPO
-    op_ret_cond(cpu, cpu->cfp == 0);
+    op_ret_cond(cpu, cpu->cfp == 0, mode);
     break;
 
   // RST ops
   case 0XC7: // RST 0
-    op_call(cpu, 0x00);
+    op_call(cpu, 0x00, mode);
     break;
   case 0XCF: // RST 1
-    op_call(cpu, 0x08);
+    op_call(cpu, 0x08, mode);
     break;
   case 0XD7: // RST 2
-    op_call(cpu, 0x10);
+    op_call(cpu, 0x10, mode);
     break;
   case 0XDF: // RST 3
-    op_call(cpu, 0x18);
+    op_call(cpu, 0x18, mode);
     break;
   case 0XE7: // RST 4
-    op_call(cpu, 0x20);
+    op_call(cpu, 0x20, mode);
     break;
   case 0XEF: // RST 5
-    op_call(cpu, 0x28);
+    op_call(cpu, 0x28, mode);
     break;
   case 0XF7: // RST 6
-    op_call(cpu, 0x30);
+    op_call(cpu, 0x30, mode);
     break;
   case 0XFF: // RST 7
-    op_call(cpu, 0x38);
+    op_call(cpu, 0x38, mode);
     break;
 
   // INTE flip-flop ops
@@ -1149,10 +2805,10 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
 
   // Device read/write ops
   case 0XDB: // IN
-    cpu->ra = cpu->read_device(cpu, next_byte(cpu));
+    op_in(cpu, next_byte(cpu, mode), mode);
     break;
   case 0XD3: // OUT
-    cpu->write_device(cpu, next_byte(cpu), cpu->ra);
+    op_out(cpu, next_byte(cpu, mode), mode);
     break;
 
   // HLT ops
@@ -1164,3 +2820,19 @@ static void exec_next(adc_8080_cpu *cpu, uint8_t opcode) {
     break;
   }
 }
+
+static void exec_plain(adc_8080_cpu *cpu, uint8_t opcode) {
+  exec_next(cpu, opcode, EXEC_PLAIN);
+}
+
+static void exec_hooks(adc_8080_cpu *cpu, uint8_t opcode) {
+  exec_next(cpu, opcode, EXEC_HOOKS);
+}
+
+static void exec_timed(adc_8080_cpu *cpu, uint8_t opcode) {
+  exec_next(cpu, opcode, EXEC_TIMED);
+}
+
+static void exec_debug(adc_8080_cpu *cpu, uint8_t opcode) {
+  exec_next(cpu, opcode, EXEC_DEBUG);
+}
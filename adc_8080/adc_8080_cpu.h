@@ -6,6 +6,7 @@
 #ifndef _ADC_8080_CPU_H_
 #define _ADC_8080_CPU_H_
 
+#include <stddef.h> // For size_t
 #include <stdint.h> // For int types
 #include <stdio.h>  // For FILE*
 
@@ -13,10 +14,392 @@
 #include <stdbool.h> // For the bool type
 #endif
 
-// 0.4.1
+// 0.5.0
 #define ADC_8080_CPU_VERSION_MAJOR 0
-#define ADC_8080_CPU_VERSION_MINOR 4
-#define ADC_8080_CPU_VERSION_PATCH 1
+#define ADC_8080_CPU_VERSION_MINOR 5
+#define ADC_8080_CPU_VERSION_PATCH 0
+
+// Size in bytes of a save state without a memory image.
+#define ADC_8080_CPU_STATE_SIZE 28
+// Size in bytes of the optional memory image appended to a save state.
+#define ADC_8080_CPU_STATE_MEMORY_SIZE 0x10000
+
+// Incremental hash of the 64 KiB memory, kept up to date by the cpu on every
+// write while attached. See adc_8080_cpu_hash_attach().
+typedef struct {
+  // Hash of each 256-byte page.
+  uint64_t pages[256];
+  // Combination of all the page hashes.
+  uint64_t root;
+} adc_8080_cpu_hash;
+
+// Executed code coverage, one bit per address, kept by the cpu on every
+// fetch while attached. Bit n of map[n / 32] is address n. See
+// adc_8080_cpu_coverage_attach() and adc_8080_coverage.
+typedef struct {
+  // Addresses fetched as the first byte of an instruction.
+  uint32_t opcodes[2048];
+  // Addresses fetched as an immediate or address operand.
+  uint32_t operands[2048];
+} adc_8080_cpu_coverage;
+
+// Record and replay modes of an input log.
+enum adc_8080_cpu_iolog_mode {
+  ADC_8080_CPU_IOLOG_RECORD,
+  ADC_8080_CPU_IOLOG_REPLAY
+};
+
+// Log of every value returned by the read_device handler and every interrupt
+// request, timestamped by cycle count. Events are stored as a varint of the
+// cycle delta to the previous event, followed by the port and value for IN or
+// the opcode for an interrupt. See adc_8080_cpu_record() and
+// adc_8080_cpu_replay().
+typedef struct {
+  enum adc_8080_cpu_iolog_mode mode;
+
+  // The encoded stream. While recording it is owned by the log and grown as
+  // needed, while replaying it is owned by the caller and only read.
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+
+  // Read position while replaying.
+  size_t pos;
+
+  // Cycle count of the previous event, or of the start of the log.
+  uint64_t last_cycle;
+
+  // Switch from replaying to recording once the stream is exhausted, see
+  // adc_8080_cpu_record_resume().
+  bool resume_recording;
+
+  // Set when recording fails to grow the stream, or when replay diverges from
+  // the stream (an IN on another port or cycle, or the stream runs out).
+  bool error;
+} adc_8080_cpu_iolog;
+
+// Set in the flags of a trace record when the instruction was an interrupt
+// opcode rather than fetched from memory.
+#define ADC_8080_CPU_TRACE_INTERRUPT (1 << 0)
+
+// Binary trace record of one instruction, the state is captured before the
+// instruction executes. See adc_8080_cpu_trace_attach().
+typedef struct {
+  // Total cycle count before the instruction.
+  uint64_t cycle;
+  uint16_t pc, sp;
+  // The opcode and up to 2 operand bytes, unused bytes are zero.
+  uint8_t bytes[3];
+  uint8_t a, b, c, d, e, h, l;
+  // The flags as pushed by PUSH PSW.
+  uint8_t psw;
+  uint8_t flags;
+} adc_8080_cpu_trace_record;
+
+// Conditions that start or stop a trace.
+enum adc_8080_cpu_trace_trigger {
+  ADC_8080_CPU_TRACE_TRIGGER_NONE,
+  // The instruction at pc == value is about to execute.
+  ADC_8080_CPU_TRACE_TRIGGER_PC,
+  // The total cycle count reached value.
+  ADC_8080_CPU_TRACE_TRIGGER_CYCLE
+};
+
+// Ring buffer of trace records, the oldest records are overwritten once it is
+// full. See adc_8080_cpu_trace_attach().
+typedef struct {
+  // Preallocated records owned by the caller.
+  adc_8080_cpu_trace_record *records;
+  size_t capacity;
+
+  // Index of the next record to write and the total records written.
+  size_t next;
+  uint64_t total;
+
+  // Whether records are being written, and the triggers that change it. A
+  // trigger is cleared once it fires.
+  bool active;
+  enum adc_8080_cpu_trace_trigger start, stop;
+  uint64_t start_value, stop_value;
+
+  // Record of the instruction being executed, the bytes it fetches are
+  // copied into it. NULL when the instruction is not recorded.
+  adc_8080_cpu_trace_record *current;
+} adc_8080_cpu_trace;
+
+// Trace of the non-sequential pc transitions: taken jumps, calls and returns,
+// RST, PCHL and interrupts. Instructions that continue at the next address
+// are only counted. See adc_8080_cpu_pctrace_attach() and adc_8080_pctrace.
+typedef struct {
+  // Sequential instructions executed since the last transition.
+  uint64_t run;
+
+  // Called after an instruction or an interrupt moved the pc to target
+  // instead of next, the address following the instruction or the pc the
+  // interrupt was taken at. run does not include the instruction.
+  void (*transition)(void *userdata, uint64_t run, uint16_t next,
+                     uint16_t target, uint64_t cycle_count, bool interrupt);
+  void *userdata;
+} adc_8080_cpu_pctrace;
+
+// Run statistics of the steps made while attached. Only a countdown is kept
+// on every step, host time is measured in a window of steps every interval
+// steps. Windows alternate between timing the steps as a whole and timing
+// each memory and device handler call, a clock call costs about as much as a
+// step. See adc_8080_cpu_stats_attach().
+typedef struct {
+  // Host clock in nanoseconds.
+  uint64_t (*clock)(void);
+  uint64_t start_ns;
+  uint64_t start_cycle;
+
+  uint32_t interval;
+  // Steps left until the next window starts or the current one ends, out of
+  // period. steps counts the steps of the periods before.
+  uint32_t countdown, period;
+  uint64_t steps;
+
+  uint64_t interrupts;
+  // Steps made while halted, they consume no cycles.
+  uint64_t halted_steps;
+
+  // Totals of the windows timed as a whole, and of the windows timing every
+  // handler call. Handler times are net of the clock, so the calls of small
+  // handlers can sum below zero. Windows much longer than the mean, when the
+  // host thread was preempted, are left out.
+  uint64_t window_steps, window_ns;
+  uint64_t handler_steps, handler_window_ns;
+  int64_t memory_ns, device_ns;
+
+  // The window in progress. While timing, steps run an executor of their own
+  // that times every handler call, the others make the calls untimed.
+  bool in_window;
+  bool timing;
+  uint64_t windows;
+  uint64_t window_start;
+  int64_t window_memory_ns, window_device_ns;
+} adc_8080_cpu_stats;
+
+// Rates and host time breakdown computed from run statistics, see
+// adc_8080_cpu_stats_query().
+typedef struct {
+  // Host seconds since the stats were attached or reset.
+  double seconds;
+  // Executed instructions, interrupts and halted steps are not counted.
+  uint64_t instructions;
+  // Guest cycles and instructions per host microsecond.
+  double mhz;
+  double mips;
+  // Host nanoseconds per second of guest time, and guest seconds per host
+  // second. Below 1 the machine falls behind real time.
+  double host_ns_per_guest_second;
+  double realtime;
+  // Estimated share of the host time spent in the core, in the memory and
+  // device handlers, and outside of adc_8080_cpu_step(). Host work between
+  // the steps of a window counts as core.
+  double core;
+  double memory;
+  double device;
+  double outside;
+} adc_8080_cpu_stats_summary;
+
+// Maximum depth of the shadow call stack of a profile.
+#define ADC_8080_CPU_PROFILE_DEPTH 64
+
+// A shadow call stack frame.
+typedef struct {
+  // Address that was called.
+  uint16_t target;
+  // Stack pointer after the return address was pushed.
+  uint16_t sp;
+} adc_8080_cpu_frame;
+
+// Guest profile, samples the pc and a shadow call stack every interval
+// cycles. See adc_8080_cpu_profile_attach().
+typedef struct {
+  uint64_t interval;
+  uint64_t next_sample;
+
+  // Called with the pc and the call stack, outermost frame first.
+  void (*sample)(void *userdata, uint16_t pc, const adc_8080_cpu_frame *frames,
+                 int depth);
+  void *userdata;
+
+  // Calls deeper than ADC_8080_CPU_PROFILE_DEPTH are not tracked.
+  adc_8080_cpu_frame frames[ADC_8080_CPU_PROFILE_DEPTH];
+  int depth;
+} adc_8080_cpu_profile;
+
+// Access types of a watchpoint, may be combined.
+#define ADC_8080_CPU_WATCH_READ (1 << 0)
+#define ADC_8080_CPU_WATCH_WRITE (1 << 1)
+
+// Reasons for adc_8080_cpu_run() to return.
+enum adc_8080_cpu_stop_reason {
+  // The cycle budget was consumed.
+  ADC_8080_CPU_STOP_NONE,
+  // The instruction at a breakpoint is about to execute.
+  ADC_8080_CPU_STOP_BREAKPOINT,
+  // An instruction read or wrote a watched address.
+  ADC_8080_CPU_STOP_WATCH_READ,
+  ADC_8080_CPU_STOP_WATCH_WRITE,
+  // The cpu is halted with no interrupt pending, steps would consume no
+  // cycles until the host requests one.
+  ADC_8080_CPU_STOP_HALT
+};
+
+typedef struct {
+  enum adc_8080_cpu_stop_reason reason;
+  // The breakpoint or the watched address that was accessed.
+  uint16_t addr;
+  // Pc of the instruction that hit a watchpoint, it has completed. Equal to
+  // addr for breakpoints, the instruction has not executed, and for a halt,
+  // the address after the HLT.
+  uint16_t pc;
+  // The value read or written by a watchpoint hit.
+  uint8_t value;
+} adc_8080_cpu_stop;
+
+// Breakpoint condition bytecode. A condition is a stack program of 64-bit
+// unsigned values evaluated when the pc hits its breakpoint, the breakpoint
+// stops when the single value left at ADC_8080_CPU_COND_END is not zero.
+// Operands follow their opcode, words are little-endian. adc_8080_cond
+// compiles text expressions into this bytecode.
+enum adc_8080_cpu_cond_op {
+  ADC_8080_CPU_COND_END,
+  // Push an 8, 16 or 64-bit constant operand.
+  ADC_8080_CPU_COND_CONST8,
+  ADC_8080_CPU_COND_CONST16,
+  ADC_8080_CPU_COND_CONST64,
+  // Push the register given by an adc_8080_cpu_cond_reg operand byte.
+  ADC_8080_CPU_COND_REG,
+  // Push the total cycle count, the hit count of the breakpoint.
+  ADC_8080_CPU_COND_CYCLES,
+  ADC_8080_CPU_COND_HITS,
+  // Replace the address on top with the byte or little-endian word there.
+  ADC_8080_CPU_COND_MEM8,
+  ADC_8080_CPU_COND_MEM16,
+  // Unary operators on the top value, logical and bitwise not.
+  ADC_8080_CPU_COND_NOT,
+  ADC_8080_CPU_COND_INV,
+  // Binary operators, pop the right then the left operand and push the
+  // result. Comparisons and logical operators push 0 or 1.
+  ADC_8080_CPU_COND_ADD,
+  ADC_8080_CPU_COND_SUB,
+  ADC_8080_CPU_COND_AND,
+  ADC_8080_CPU_COND_OR,
+  ADC_8080_CPU_COND_XOR,
+  ADC_8080_CPU_COND_EQ,
+  ADC_8080_CPU_COND_NE,
+  ADC_8080_CPU_COND_LT,
+  ADC_8080_CPU_COND_LE,
+  ADC_8080_CPU_COND_GT,
+  ADC_8080_CPU_COND_GE,
+  ADC_8080_CPU_COND_LAND,
+  ADC_8080_CPU_COND_LOR
+};
+
+// Operands of ADC_8080_CPU_COND_REG. Flags push 0 or 1, psw is the flags as
+// pushed by PUSH PSW.
+enum adc_8080_cpu_cond_reg {
+  ADC_8080_CPU_COND_REG_A,
+  ADC_8080_CPU_COND_REG_B,
+  ADC_8080_CPU_COND_REG_C,
+  ADC_8080_CPU_COND_REG_D,
+  ADC_8080_CPU_COND_REG_E,
+  ADC_8080_CPU_COND_REG_H,
+  ADC_8080_CPU_COND_REG_L,
+  ADC_8080_CPU_COND_REG_BC,
+  ADC_8080_CPU_COND_REG_DE,
+  ADC_8080_CPU_COND_REG_HL,
+  ADC_8080_CPU_COND_REG_SP,
+  ADC_8080_CPU_COND_REG_PC,
+  ADC_8080_CPU_COND_REG_PSW,
+  ADC_8080_CPU_COND_REG_CFS,
+  ADC_8080_CPU_COND_REG_CFZ,
+  ADC_8080_CPU_COND_REG_CFA,
+  ADC_8080_CPU_COND_REG_CFP,
+  ADC_8080_CPU_COND_REG_CFC,
+  ADC_8080_CPU_COND_REG_COUNT
+};
+
+// Maximum size of a condition program and the values it may stack.
+#define ADC_8080_CPU_COND_SIZE 64
+#define ADC_8080_CPU_COND_STACK 16
+
+// Maximum number of conditional breakpoints of an adc_8080_cpu_debug.
+#define ADC_8080_CPU_DEBUG_CONDITIONS 16
+
+// A conditional breakpoint, see adc_8080_cpu_debug_break_if().
+typedef struct {
+  uint16_t addr;
+  // Times the pc hit the breakpoint, including the current one.
+  uint64_t hits;
+  uint8_t code[ADC_8080_CPU_COND_SIZE];
+} adc_8080_cpu_condition;
+
+// Breakpoints and watchpoints, one bit per address. Bit n of map[n / 32] is
+// address n. See adc_8080_cpu_run().
+typedef struct {
+  uint32_t breakpoints[2048];
+  uint32_t read_watch[2048];
+  uint32_t write_watch[2048];
+  // Number of bits set in each map.
+  int breakpoint_count, read_count, write_count;
+
+  // Breakpoints with a condition, the others stop unconditionally.
+  adc_8080_cpu_condition conditions[ADC_8080_CPU_DEBUG_CONDITIONS];
+  int condition_count;
+
+  // The first watchpoint hit of the current instruction.
+  adc_8080_cpu_stop hit;
+} adc_8080_cpu_debug;
+
+#ifdef ADC_8080_CPU_OPCODE_STATS
+// Per opcode execution counters, only compiled in when
+// ADC_8080_CPU_OPCODE_STATS is defined. Interrupt opcodes are counted, halted
+// steps are not. See adc_8080_cpu_opstats_print().
+typedef struct {
+  // Executions and cycles consumed of each opcode.
+  uint64_t count[256];
+  uint64_t cycles[256];
+
+  // Taken and not taken counts of the conditional jumps, calls and returns.
+  uint64_t taken[256];
+  uint64_t not_taken[256];
+} adc_8080_cpu_opstats;
+#endif
+
+#ifdef ADC_8080_CPU_HEATMAP
+// Kinds of memory access counted by the heatmap. Fetches are opcode and
+// operand bytes, reads and writes are data accesses including the stack.
+enum {
+  ADC_8080_CPU_ACCESS_FETCH,
+  ADC_8080_CPU_ACCESS_READ,
+  ADC_8080_CPU_ACCESS_WRITE,
+  ADC_8080_CPU_ACCESS_KINDS
+};
+
+// Maximum number of per byte ranges of a heatmap.
+#define ADC_8080_CPU_HEATMAP_RANGES 4
+
+// A range of addresses counted per byte, see adc_8080_cpu_heatmap_add_range().
+typedef struct {
+  uint16_t start;
+  uint32_t length;
+  // ADC_8080_CPU_ACCESS_KINDS counters per byte, provided by the caller.
+  uint64_t *counts;
+} adc_8080_cpu_heatmap_range;
+
+// Memory access counters, only compiled in when ADC_8080_CPU_HEATMAP is
+// defined. Every access the cpu makes through its memory handlers is counted
+// per 256-byte page and per byte in the added ranges.
+typedef struct {
+  uint64_t pages[256][ADC_8080_CPU_ACCESS_KINDS];
+  adc_8080_cpu_heatmap_range ranges[ADC_8080_CPU_HEATMAP_RANGES];
+  int range_count;
+} adc_8080_cpu_heatmap;
+#endif
 
 typedef struct {
   // 7 8-bit registers (accum and scratch).
@@ -41,6 +424,53 @@ typedef struct {
   // Cycles the cpu has consumed in the latest step.
   int cycles;
 
+  // Total cycles the cpu has consumed since init.
+  uint64_t cycle_count;
+
+  // Bitmap of the 256-byte memory pages written since the last call to
+  // adc_8080_cpu_clear_dirty(). Bit n of dirty_pages[n / 32] is page n.
+  uint32_t dirty_pages[8];
+
+  // Optional incremental memory hash, NULL when not attached.
+  adc_8080_cpu_hash *hash;
+
+  // Optional executed code coverage, NULL when not attached.
+  adc_8080_cpu_coverage *coverage;
+
+  // Optional input log being recorded or replayed, NULL when not attached.
+  adc_8080_cpu_iolog *iolog;
+
+  // Optional instruction trace, NULL when not attached.
+  adc_8080_cpu_trace *trace;
+
+  // Optional pc transition trace, NULL when not attached.
+  adc_8080_cpu_pctrace *pctrace;
+
+  // Optional run statistics, NULL when not attached.
+  adc_8080_cpu_stats *stats;
+
+  // Optional guest profile, NULL when not attached.
+  adc_8080_cpu_profile *profile;
+
+  // Breakpoints and watchpoints, only set while adc_8080_cpu_run() runs with
+  // any of them armed.
+  adc_8080_cpu_debug *debug;
+
+  // Set while any of the optional hooks above but debug is attached, steps
+  // skip checking them otherwise. Maintained by their attach and detach
+  // functions.
+  bool hooks;
+
+#ifdef ADC_8080_CPU_OPCODE_STATS
+  // Counters since init or the last adc_8080_cpu_opstats_reset().
+  adc_8080_cpu_opstats opstats;
+#endif
+
+#ifdef ADC_8080_CPU_HEATMAP
+  // Counters since init or the last adc_8080_cpu_heatmap_reset().
+  adc_8080_cpu_heatmap heatmap;
+#endif
+
   // Custom user data for function handlers.
   void *userdata;
 
@@ -60,18 +490,310 @@ extern "C" {
 // adc_8080_cpu_init() - Init the 8080 cpu.
 void adc_8080_cpu_init(adc_8080_cpu *cpu);
 
+// adc_8080_cpu_detach_all() - Detach every optional hook and the debug state
+// without touching what they point to, e.g. in a copy of a cpu whose hooks
+// belong to the original.
+void adc_8080_cpu_detach_all(adc_8080_cpu *cpu);
+
 // adc_8080_cpu_step() - Decode and execute the next instruction.
 //
 // Returns the number of cycles consumed from this step.
 int adc_8080_cpu_step(adc_8080_cpu *cpu);
 
+// adc_8080_cpu_run() - Step until at least the given number of cycles were
+// consumed, a breakpoint or watchpoint is hit or the cpu is halted with no
+// interrupt pending. A run made while halted returns at once, request an
+// interrupt to wake the cpu.
+//
+// Without armed breakpoints or watchpoints this is a plain loop over
+// adc_8080_cpu_step(). Otherwise a separate loop checks the pc against the
+// breakpoint map before every instruction and the memory accesses against
+// the watch maps. The instruction at the pc on entry is not checked, so a run
+// resumes from the breakpoint it stopped at.
+//
+// debug  - Breakpoints and watchpoints, may be NULL.
+// cycles - The cycle budget.
+// stop   - Set to why the run returned, may be NULL.
+//
+// Returns the number of cycles consumed.
+uint64_t adc_8080_cpu_run(adc_8080_cpu *cpu, adc_8080_cpu_debug *debug,
+                          uint64_t cycles, adc_8080_cpu_stop *stop);
+
+// adc_8080_cpu_debug_init() - Clear every breakpoint and watchpoint.
+void adc_8080_cpu_debug_init(adc_8080_cpu_debug *debug);
+
+// adc_8080_cpu_debug_break() - Arm or disarm a breakpoint at addr. Any
+// condition of the breakpoint is removed.
+void adc_8080_cpu_debug_break(adc_8080_cpu_debug *debug, uint16_t addr,
+                              bool armed);
+
+// adc_8080_cpu_debug_break_if() - Arm a breakpoint at addr that only stops
+// when its condition is true. The condition is evaluated inside the run loop
+// when the pc hits the breakpoint map, replacing any previous condition at
+// addr, and its hit count starts at zero.
+//
+// code - Condition bytecode, see enum adc_8080_cpu_cond_op.
+// size - Size of the bytecode, at most ADC_8080_CPU_COND_SIZE.
+//
+// Returns false if the bytecode is invalid or ADC_8080_CPU_DEBUG_CONDITIONS
+// conditional breakpoints are armed.
+bool adc_8080_cpu_debug_break_if(adc_8080_cpu_debug *debug, uint16_t addr,
+                                 const uint8_t *code, size_t size);
+
+// adc_8080_cpu_debug_watch() - Arm or disarm a watchpoint at addr.
+//
+// access - ADC_8080_CPU_WATCH_READ and/or ADC_8080_CPU_WATCH_WRITE. Fetches
+//          of opcodes and operands are not reads.
+void adc_8080_cpu_debug_watch(adc_8080_cpu_debug *debug, uint16_t addr,
+                              int access, bool armed);
+
 // adc_8080_cpu_interrupt() - Request an interrupt with the given opcode.
 void adc_8080_cpu_interrupt(adc_8080_cpu *cpu, uint8_t opcode);
 
+// adc_8080_cpu_record() - Start recording every IN result and interrupt
+// request into the given log. The log stream is allocated by the cpu and
+// must be released with adc_8080_cpu_iolog_free().
+void adc_8080_cpu_record(adc_8080_cpu *cpu, adc_8080_cpu_iolog *log);
+
+// adc_8080_cpu_replay() - Start replaying a recorded stream. The cpu must be
+// in the state it was in when the recording started, including cycle_count.
+//
+// While replaying, IN returns the recorded values without calling the
+// read_device handler and interrupts are requested at the recorded cycles:
+// those requested during a step once the step completes, as the handler
+// requested them, and those requested between steps before the next one.
+// Calls to adc_8080_cpu_interrupt() are ignored. The device handlers may be
+// NULL, in which case OUT is ignored.
+//
+// data - The recorded stream, for example the data of a recorded log. It is
+//        not modified and must outlive the replay.
+void adc_8080_cpu_replay(adc_8080_cpu *cpu, adc_8080_cpu_iolog *log,
+                         const uint8_t *data, size_t size);
+
+// adc_8080_cpu_record_resume() - Replay a log recorded with
+// adc_8080_cpu_record() from the given position, then continue recording new
+// events at its end once the recorded ones are exhausted.
+//
+// pos        - Byte offset of the next event in the log stream.
+// last_cycle - Cycle count of the event before pos, or of the start of the
+//              log if pos is 0.
+void adc_8080_cpu_record_resume(adc_8080_cpu *cpu, adc_8080_cpu_iolog *log,
+                                size_t pos, uint64_t last_cycle);
+
+// adc_8080_cpu_iolog_stop() - Stop recording or replaying the attached log.
+void adc_8080_cpu_iolog_stop(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_iolog_free() - Free the stream allocated while recording.
+void adc_8080_cpu_iolog_free(adc_8080_cpu_iolog *log);
+
 // adc_8080_cpu_print() - Print the state of the cpu in a readable form to the
 // given stream.
 void adc_8080_cpu_print(adc_8080_cpu *cpu, FILE *stream);
 
+// adc_8080_cpu_clear_dirty() - Clear the dirty page bitmap.
+void adc_8080_cpu_clear_dirty(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_mark_dirty() - Mark the page containing addr as dirty. Use this
+// when the host writes to memory without going through the cpu.
+void adc_8080_cpu_mark_dirty(adc_8080_cpu *cpu, uint16_t addr);
+
+// ADC_8080_CPU_PAGE_DIRTY() - Macro for checking if a page is dirty.
+#define ADC_8080_CPU_PAGE_DIRTY(cpu, page)                                     \
+  (((cpu)->dirty_pages[(page) >> 5] >> ((page)&31)) & 1)
+
+// adc_8080_cpu_hash_attach() - Attach an incremental memory hash to the cpu.
+// The hash is computed from the current memory through the read_byte handler
+// and then updated on every write made by the cpu, which costs one extra
+// read_byte per write.
+//
+// If memory is changed without going through the cpu (for example after
+// restoring a save state) the hash must be attached again.
+void adc_8080_cpu_hash_attach(adc_8080_cpu *cpu, adc_8080_cpu_hash *hash);
+
+// adc_8080_cpu_hash_detach() - Stop updating the attached hash.
+void adc_8080_cpu_hash_detach(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_hash_state() - Returns a hash of the full cpu state: the
+// attached memory hash combined with the registers, flags and interrupt
+// state. This is O(1).
+uint64_t adc_8080_cpu_hash_state(const adc_8080_cpu *cpu);
+
+// adc_8080_cpu_hash_diff() - Compare two memory hashes.
+//
+// Returns the index of the first page whose hash differs.
+// Returns -1 if the hashes match.
+int adc_8080_cpu_hash_diff(const adc_8080_cpu_hash *a,
+                           const adc_8080_cpu_hash *b);
+
+// adc_8080_cpu_coverage_attach() - Start marking the fetched bytes in the
+// given coverage. Bits already set are kept. Interrupt opcodes are not
+// fetched and not marked.
+void adc_8080_cpu_coverage_attach(adc_8080_cpu *cpu,
+                                  adc_8080_cpu_coverage *coverage);
+
+// adc_8080_cpu_coverage_detach() - Stop marking fetched bytes.
+void adc_8080_cpu_coverage_detach(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_trace_attach() - Start writing a trace record for every
+// executed instruction into the given ring buffer. Halted steps are not
+// recorded. The trace is active and has no triggers.
+//
+// The opcode and operand bytes are copied into the record as the instruction
+// fetches them, they are not read again.
+//
+// records  - Preallocated array of capacity records owned by the caller.
+void adc_8080_cpu_trace_attach(adc_8080_cpu *cpu, adc_8080_cpu_trace *trace,
+                               adc_8080_cpu_trace_record *records,
+                               size_t capacity);
+
+// adc_8080_cpu_trace_detach() - Stop tracing. The records are kept.
+void adc_8080_cpu_trace_detach(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_trace_start_on() - Deactivate the trace until the trigger
+// fires. The instruction that fires it is the first one recorded.
+void adc_8080_cpu_trace_start_on(adc_8080_cpu_trace *trace,
+                                 enum adc_8080_cpu_trace_trigger trigger,
+                                 uint64_t value);
+
+// adc_8080_cpu_trace_stop_on() - Deactivate the trace once the trigger fires.
+// The instruction that fires it is the last one recorded.
+void adc_8080_cpu_trace_stop_on(adc_8080_cpu_trace *trace,
+                                enum adc_8080_cpu_trace_trigger trigger,
+                                uint64_t value);
+
+// adc_8080_cpu_trace_count() - Returns the number of records in the buffer.
+size_t adc_8080_cpu_trace_count(const adc_8080_cpu_trace *trace);
+
+// adc_8080_cpu_trace_get() - Returns the record at index, 0 is the oldest and
+// adc_8080_cpu_trace_count() - 1 the newest.
+const adc_8080_cpu_trace_record *
+adc_8080_cpu_trace_get(const adc_8080_cpu_trace *trace, size_t index);
+
+// adc_8080_cpu_pctrace_attach() - Start reporting the pc transitions. The
+// run count starts at zero. Jumps and calls to the next instruction are
+// sequential, they do not change the instruction stream.
+//
+// transition - Called for every taken branch and every interrupt.
+// userdata   - Passed to transition.
+void adc_8080_cpu_pctrace_attach(
+    adc_8080_cpu *cpu, adc_8080_cpu_pctrace *pctrace,
+    void (*transition)(void *userdata, uint64_t run, uint16_t next,
+                       uint16_t target, uint64_t cycle_count, bool interrupt),
+    void *userdata);
+
+// adc_8080_cpu_pctrace_detach() - Stop reporting pc transitions. The run
+// count of the instructions since the last transition is kept.
+void adc_8080_cpu_pctrace_detach(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_stats_attach() - Start counting run statistics. The counters
+// are reset.
+//
+// interval - Host time is measured in a window of up to 1024 steps every
+//            interval steps, 100000 keeps the cost of the clock below 1%.
+//            Must be more than the 1024 step window.
+// clock    - Returns a monotonic host time in nanoseconds.
+void adc_8080_cpu_stats_attach(adc_8080_cpu *cpu, adc_8080_cpu_stats *stats,
+                               uint32_t interval, uint64_t (*clock)(void));
+
+// adc_8080_cpu_stats_detach() - Stop counting.
+void adc_8080_cpu_stats_detach(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_stats_reset() - Zero the counters of the attached stats and
+// restart the host time, for example to query the statistics of every second.
+void adc_8080_cpu_stats_reset(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_stats_query() - Compute the rates and the host time breakdown
+// of the attached stats since they were attached or reset.
+//
+// guest_hz - Clock rate of the emulated machine, 2000000 for a 2 MHz 8080.
+void adc_8080_cpu_stats_query(const adc_8080_cpu *cpu, double guest_hz,
+                              adc_8080_cpu_stats_summary *summary);
+
+// adc_8080_cpu_profile_attach() - Start sampling the guest every interval
+// cycles.
+//
+// CALL, conditional calls, RST and interrupts push a frame on the shadow call
+// stack, dropping the frames at or above it first. Frames are dropped once
+// the stack pointer rises above their return address, on RET and conditional
+// returns and before every sample. Returns made with stack tricks (POP then
+// PCHL, XTHL, SPHL) unwind correctly, as do stacks set up at 0x0000 that wrap
+// around to 0xFFFE.
+//
+// sample   - Called every interval cycles with the pc and the call stack.
+// userdata - Passed to sample.
+void adc_8080_cpu_profile_attach(
+    adc_8080_cpu *cpu, adc_8080_cpu_profile *profile, uint64_t interval,
+    void (*sample)(void *userdata, uint16_t pc,
+                   const adc_8080_cpu_frame *frames, int depth),
+    void *userdata);
+
+// adc_8080_cpu_profile_detach() - Stop profiling.
+void adc_8080_cpu_profile_detach(adc_8080_cpu *cpu);
+
+#ifdef ADC_8080_CPU_OPCODE_STATS
+// adc_8080_cpu_opstats_reset() - Zero the per opcode counters.
+void adc_8080_cpu_opstats_reset(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_opstats_print() - Print a histogram of the executed opcodes,
+// sorted by consumed cycles, with the taken ratio of conditional branches.
+void adc_8080_cpu_opstats_print(const adc_8080_cpu *cpu, FILE *stream);
+#endif
+
+#ifdef ADC_8080_CPU_HEATMAP
+// adc_8080_cpu_heatmap_reset() - Zero the page and range counters. The ranges
+// are kept.
+void adc_8080_cpu_heatmap_reset(adc_8080_cpu *cpu);
+
+// adc_8080_cpu_heatmap_add_range() - Count accesses to every byte of a range.
+//
+// start  - First address of the range.
+// length - Number of bytes, 1 to 0x10000. The range wraps around at 0xFFFF.
+// counts - Caller provided length * ADC_8080_CPU_ACCESS_KINDS counters, zeroed.
+//
+// Returns false if ADC_8080_CPU_HEATMAP_RANGES ranges were already added.
+bool adc_8080_cpu_heatmap_add_range(adc_8080_cpu *cpu, uint16_t start,
+                                    uint32_t length, uint64_t *counts);
+
+// adc_8080_cpu_heatmap_write_csv() - Write the counters as CSV with the
+// columns kind, addr, fetch, read and write. Every page is a 'page' row, the
+// bytes of the ranges follow as 'byte' rows.
+void adc_8080_cpu_heatmap_write_csv(const adc_8080_cpu *cpu, FILE *stream);
+
+// adc_8080_cpu_heatmap_write_binary() - Write the counters as little-endian
+// 64-bit words, the layout is documented in adc_8080_cpu.c.
+//
+// Returns false on write failure.
+bool adc_8080_cpu_heatmap_write_binary(const adc_8080_cpu *cpu,
+                                       FILE *stream);
+#endif
+
+// adc_8080_cpu_save() - Serialize the architectural state of the cpu into
+// the given buffer. The blob is versioned and endian independent, host
+// function handlers and userdata are not included.
+//
+// memory - Optional 64 KiB memory image to append to the state, may be NULL.
+// buf    - Destination buffer provided by the caller.
+// size   - Size of the buffer in bytes. Must be at least
+//          ADC_8080_CPU_STATE_SIZE, plus ADC_8080_CPU_STATE_MEMORY_SIZE when a
+//          memory image is given.
+//
+// Returns the number of bytes written.
+// Returns 0 if the buffer is too small.
+size_t adc_8080_cpu_save(const adc_8080_cpu *cpu, const uint8_t *memory,
+                         uint8_t *buf, size_t size);
+
+// adc_8080_cpu_load() - Restore the cpu state from a blob written by
+// adc_8080_cpu_save(). Host function handlers and userdata are left as is.
+//
+// memory - Optional 64 KiB destination for the memory image, may be NULL.
+//          Ignored if the blob has no memory image. If a hash is attached it
+//          is recomputed after the memory is restored.
+//
+// Returns the number of bytes consumed from the buffer.
+// Returns 0 if the blob is truncated, invalid or of an unsupported version.
+size_t adc_8080_cpu_load(adc_8080_cpu *cpu, uint8_t *memory, const uint8_t *buf,
+                         size_t size);
+
 #ifdef __cpluscplus
 }
 #endif
@@ -132,7 +132,7 @@ static void mnemonic_to_string(adc_8080_dasm_disassembly *dasm, char *dst,
 
   switch (op->def.size) {
   case 1:
-    strncpy(dst, op->def.mnemonic, num);
+    snprintf(dst, num, "%s", op->def.mnemonic);
     break;
   case 2:
     snprintf(dst, num, op->def.mnemonic, dasm->memory[op->addr + 1]);
@@ -191,6 +191,29 @@ char *adc_8080_dasm_op_to_string(adc_8080_dasm_disassembly *dasm,
   return str;
 }
 
+const adc_8080_dasm_opdef *adc_8080_dasm_opdef_get(uint8_t opcode) {
+  return &s_dasm_lut[opcode];
+}
+
+size_t adc_8080_dasm_format(const uint8_t *bytes, char *dst, size_t num) {
+  assert(bytes);
+  assert(dst);
+
+  const adc_8080_dasm_opdef *def = &s_dasm_lut[bytes[0]];
+  switch (def->size) {
+  case 2:
+    snprintf(dst, num, def->mnemonic, bytes[1]);
+    break;
+  case 3:
+    snprintf(dst, num, def->mnemonic, WORD_FROM_BYTES(bytes[2], bytes[1]));
+    break;
+  default:
+    snprintf(dst, num, "%s", def->mnemonic);
+    break;
+  }
+  return def->size;
+}
+
 // LUT
 
 #define CBITS_NONE ADC_8080_DASM_CONDBITS_NONE
@@ -8,9 +8,9 @@
 extern "C" {
 #endif
 
-// 0.1.0
+// 0.2.0
 #define ADC_8080_DASM_VERSION_MAJOR 0
-#define ADC_8080_DASM_VERSION_MINOR 1
+#define ADC_8080_DASM_VERSION_MINOR 2
 #define ADC_8080_DASM_VERSION_PATCH 0
 
 #include <stdint.h> // For int types.
@@ -93,6 +93,20 @@ int adc_8080_dasm_list(adc_8080_dasm_disassembly *dasm,
 char *adc_8080_dasm_op_to_string(adc_8080_dasm_disassembly *dasm,
                                  const adc_8080_dasm_op *op);
 
+// adc_8080_dasm_opdef_get() - Returns the definition of the given opcode.
+const adc_8080_dasm_opdef *adc_8080_dasm_opdef_get(uint8_t opcode);
+
+// adc_8080_dasm_format() - Format a single instruction, without a
+// disassembly.
+//
+// bytes - The opcode followed by its operands, the size of the opcode
+//         definition bytes long.
+// dst   - Destination buffer for the mnemonic and operands.
+// num   - Size of the destination buffer in bytes.
+//
+// Returns the size of the instruction in bytes.
+size_t adc_8080_dasm_format(const uint8_t *bytes, char *dst, size_t num);
+
 #ifdef __cplusplus
 }
 #endif
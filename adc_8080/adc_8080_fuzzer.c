@@ -0,0 +1,646 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "adc_8080_fuzzer.h"
+
+#include <assert.h> // For assert
+#include <dirent.h> // For opendir, readdir, closedir
+#include <errno.h> // For errno, EEXIST
+#include <stdio.h> // For FILE, fopen, fread, fwrite, fclose, rename
+#include <stdlib.h> // For malloc, calloc, realloc, free
+#include <string.h> // For memcpy, memmove, memset, strcmp, strlen
+#include <sys/stat.h> // For mkdir
+
+#define MEMORY_TOTAL 0x10000
+#define PAGE_SIZE 0x100
+#define MAP_SIZE 0x10000
+#define PATH_SIZE 4096
+#define CRASHES_DIR "crashes"
+#define OPCODE_IN 0xDB
+// Value of the ports not read from the input.
+#define IDLE_PORT 0xFF
+// Most mutations stacked on an input, a power of two.
+#define MAX_STACKED 16
+// Longest block deleted or spliced by a mutation.
+#define MAX_BLOCK 16
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+} corpus_entry;
+
+struct adc_8080_fuzzer {
+  adc_8080_fuzzer_config config;
+  adc_8080_cpu cpu;
+  adc_8080_cpu snapshot;
+  adc_8080_cpu_pctrace pctrace;
+  uint8_t memory[MEMORY_TOTAL];
+  uint8_t snapshot_memory[MEMORY_TOTAL];
+  // Restore the snapshot before the next case, and the cases run since it
+  // was restored.
+  bool restore;
+  uint32_t since_restore;
+
+  // The input of the running case.
+  const uint8_t *input;
+  size_t input_size, input_pos;
+
+  // Edge hit counts of the running case and the edges it hit.
+  uint8_t trace[MAP_SIZE];
+  uint16_t touched[MAP_SIZE];
+  uint32_t touched_count;
+  // Hit count buckets not yet seen by any passing case, and edges not yet
+  // seen by any failing case.
+  uint8_t virgin[MAP_SIZE];
+  uint8_t virgin_failures[MAP_SIZE];
+
+  corpus_entry *corpus;
+  size_t corpus_count, corpus_capacity;
+  // Names of the corpus directory files already imported or written.
+  char **known;
+  size_t known_count, known_capacity;
+
+  uint64_t rng;
+  // The mutated input, max_input bytes.
+  uint8_t *buffer;
+  adc_8080_fuzzer_stats stats;
+};
+
+static const char *s_outcome_names[ADC_8080_FUZZER_OUTCOMES] = {
+    "done", "timeout", "halt", "wild-pc", "stack"};
+
+// Bytes that often take other paths through input handling code: control
+// characters, digits and letter boundaries, sign and all bits.
+static const uint8_t s_interesting[] = {
+    0x00, 0x01, 0x02, 0x03, 0x07, 0x08, 0x0A, 0x0D, 0x1B, 0x20, 0x2F, 0x30,
+    0x39, 0x3A, 0x40, 0x41, 0x5A, 0x61, 0x7A, 0x7F, 0x80, 0xFE, 0xFF};
+
+static inline uint64_t next_random(adc_8080_fuzzer *fuzzer) {
+  uint64_t z = (fuzzer->rng += 0x9E3779B97F4A7C15u);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+  return z ^ (z >> 31);
+}
+
+// A random number below n, n must not be 0.
+static inline size_t random_below(adc_8080_fuzzer *fuzzer, size_t n) {
+  return (size_t)(next_random(fuzzer) % n);
+}
+
+static inline bool port_fed(const adc_8080_fuzzer *fuzzer, uint8_t port) {
+  return fuzzer->config.ports[port >> 5] & (1u << (port & 31));
+}
+
+static inline void hit(adc_8080_fuzzer *fuzzer, uint32_t key) {
+  uint16_t edge = (uint16_t)((key * 0x9E3779B1u) >> 16);
+  uint8_t *hits = &fuzzer->trace[edge];
+  if (*hits == 0)
+    fuzzer->touched[fuzzer->touched_count++] = edge;
+  if (*hits < 0xFF)
+    (*hits)++;
+}
+
+static void transition(void *userdata, uint64_t run, uint16_t next,
+                       uint16_t target, uint64_t cycle_count,
+                       bool interrupt) {
+  (void)run;
+  (void)cycle_count;
+  (void)interrupt;
+  hit(userdata, (uint32_t)next << 16 | target);
+}
+
+static uint8_t handle_memory_read(void *userdata, uint16_t addr) {
+  const adc_8080_fuzzer *fuzzer = userdata;
+  return fuzzer->memory[addr];
+}
+
+static void handle_memory_write(void *userdata, uint16_t addr, uint8_t value) {
+  adc_8080_fuzzer *fuzzer = userdata;
+  fuzzer->memory[addr] = value;
+}
+
+// Device handlers are passed the cpu.
+static uint8_t handle_device_read(void *userdata, uint8_t port) {
+  adc_8080_fuzzer *fuzzer = ((adc_8080_cpu *)userdata)->userdata;
+  if (port_fed(fuzzer, port) && fuzzer->input_pos < fuzzer->input_size)
+    return fuzzer->input[fuzzer->input_pos++];
+  return IDLE_PORT;
+}
+
+// Copy back the pages the guest wrote and the cpu state.
+static void restore(adc_8080_fuzzer *fuzzer) {
+  for (int page = 0; page < MEMORY_TOTAL / PAGE_SIZE; page++) {
+    if (fuzzer->cpu.dirty_pages[page >> 5] & (1u << (page & 31)))
+      memcpy(fuzzer->memory + page * PAGE_SIZE,
+             fuzzer->snapshot_memory + page * PAGE_SIZE, PAGE_SIZE);
+  }
+  fuzzer->cpu = fuzzer->snapshot;
+  fuzzer->since_restore = 0;
+}
+
+static enum adc_8080_fuzzer_outcome execute(adc_8080_fuzzer *fuzzer) {
+  const adc_8080_fuzzer_config *config = &fuzzer->config;
+  adc_8080_cpu *cpu = &fuzzer->cpu;
+  const uint8_t *memory = fuzzer->memory;
+  uint64_t end = cpu->cycle_count + config->cycles;
+
+  for (;;) {
+    // Stop before an IN that would read past the input, the next case of
+    // persistent mode feeds it.
+    if (fuzzer->input_pos == fuzzer->input_size &&
+        memory[cpu->pc] == OPCODE_IN &&
+        port_fed(fuzzer, memory[(uint16_t)(cpu->pc + 1)]))
+      return ADC_8080_FUZZER_DONE;
+
+    adc_8080_cpu_step(cpu);
+    if (cpu->pc < config->code_start || cpu->pc > config->code_end)
+      return ADC_8080_FUZZER_WILD_PC;
+    if (cpu->sp < config->stack_start || cpu->sp > config->stack_end)
+      return ADC_8080_FUZZER_STACK;
+    // No interrupt is ever requested, a halt ends the case either way.
+    if (cpu->halted)
+      return cpu->inte ? ADC_8080_FUZZER_DONE : ADC_8080_FUZZER_HALT;
+    if (cpu->cycle_count >= end)
+      return ADC_8080_FUZZER_TIMEOUT;
+  }
+}
+
+static enum adc_8080_fuzzer_outcome run_case(adc_8080_fuzzer *fuzzer,
+                                             const uint8_t *input,
+                                             size_t size,
+                                             bool from_snapshot) {
+  uint32_t persistent =
+      fuzzer->config.persistent > 1 ? fuzzer->config.persistent : 1;
+  if (from_snapshot || fuzzer->restore || fuzzer->since_restore >= persistent)
+    restore(fuzzer);
+  fuzzer->since_restore++;
+
+  for (uint32_t i = 0; i < fuzzer->touched_count; i++)
+    fuzzer->trace[fuzzer->touched[i]] = 0;
+  fuzzer->touched_count = 0;
+  fuzzer->input = input;
+  fuzzer->input_size = size;
+  fuzzer->input_pos = 0;
+
+  enum adc_8080_fuzzer_outcome outcome = execute(fuzzer);
+  fuzzer->restore = outcome != ADC_8080_FUZZER_DONE;
+  // Failures are told apart by where they happened as well as by the edges
+  // leading there.
+  if (outcome != ADC_8080_FUZZER_DONE)
+    hit(fuzzer, ~((uint32_t)fuzzer->cpu.pc << 16 | outcome));
+  return outcome;
+}
+
+static inline uint8_t bucket(uint8_t hits) {
+  if (hits < 3)
+    return hits;
+  if (hits < 4)
+    return 4;
+  if (hits < 8)
+    return 8;
+  if (hits < 16)
+    return 16;
+  if (hits < 32)
+    return 32;
+  if (hits < 128)
+    return 64;
+  return 128;
+}
+
+// Clear the hit count buckets of the case from the virgin map.
+//
+// Returns true if any of them were still set.
+static bool new_coverage(adc_8080_fuzzer *fuzzer) {
+  bool found = false;
+  for (uint32_t i = 0; i < fuzzer->touched_count; i++) {
+    uint16_t edge = fuzzer->touched[i];
+    uint8_t bits = bucket(fuzzer->trace[edge]) & fuzzer->virgin[edge];
+    if (bits) {
+      if (fuzzer->virgin[edge] == 0xFF)
+        fuzzer->stats.edges++;
+      fuzzer->virgin[edge] &= ~bits;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// Mark the edges of a failing case as seen. Failures looping a different
+// number of times are the same failure, so hit counts are not compared.
+//
+// Returns true if any of them were not seen by a failing case before.
+static bool new_failure(adc_8080_fuzzer *fuzzer) {
+  bool found = false;
+  for (uint32_t i = 0; i < fuzzer->touched_count; i++) {
+    uint16_t edge = fuzzer->touched[i];
+    if (fuzzer->virgin_failures[edge]) {
+      fuzzer->virgin_failures[edge] = 0;
+      found = true;
+    }
+  }
+  return found;
+}
+
+static bool corpus_add(adc_8080_fuzzer *fuzzer, const uint8_t *input,
+                       size_t size) {
+  if (fuzzer->corpus_count == fuzzer->corpus_capacity) {
+    size_t capacity =
+        fuzzer->corpus_capacity ? fuzzer->corpus_capacity * 2 : 64;
+    corpus_entry *corpus =
+        realloc(fuzzer->corpus, capacity * sizeof(corpus_entry));
+    if (!corpus)
+      return false;
+    fuzzer->corpus = corpus;
+    fuzzer->corpus_capacity = capacity;
+  }
+
+  uint8_t *data = malloc(size > 0 ? size : 1);
+  if (!data)
+    return false;
+  if (size > 0)
+    memcpy(data, input, size);
+  fuzzer->corpus[fuzzer->corpus_count].data = data;
+  fuzzer->corpus[fuzzer->corpus_count].size = size;
+  fuzzer->corpus_count++;
+  fuzzer->stats.corpus++;
+  return true;
+}
+
+static bool is_known(const adc_8080_fuzzer *fuzzer, const char *name) {
+  for (size_t i = 0; i < fuzzer->known_count; i++) {
+    if (strcmp(fuzzer->known[i], name) == 0)
+      return true;
+  }
+  return false;
+}
+
+static bool known_add(adc_8080_fuzzer *fuzzer, const char *name) {
+  if (fuzzer->known_count == fuzzer->known_capacity) {
+    size_t capacity =
+        fuzzer->known_capacity ? fuzzer->known_capacity * 2 : 64;
+    char **known = realloc(fuzzer->known, capacity * sizeof(char *));
+    if (!known)
+      return false;
+    fuzzer->known = known;
+    fuzzer->known_capacity = capacity;
+  }
+
+  size_t length = strlen(name) + 1;
+  char *copy = malloc(length);
+  if (!copy)
+    return false;
+  memcpy(copy, name, length);
+  fuzzer->known[fuzzer->known_count++] = copy;
+  return true;
+}
+
+// Write an input to the corpus directory or its crashes subdirectory, named
+// after the worker, the outcome of a failure and a hash of the input so the
+// same input is written once. The file is renamed into place so other
+// workers never import it half written.
+static void write_input(adc_8080_fuzzer *fuzzer, const char *subdir,
+                        enum adc_8080_fuzzer_outcome outcome,
+                        const uint8_t *input, size_t size) {
+  uint64_t hash = 0xCBF29CE484222325u;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ input[i]) * 0x100000001B3u;
+
+  char name[256];
+  if (subdir)
+    snprintf(name, sizeof(name), "%s-%s-%016llx", fuzzer->config.worker,
+             s_outcome_names[outcome], (unsigned long long)hash);
+  else
+    snprintf(name, sizeof(name), "%s-%016llx", fuzzer->config.worker,
+             (unsigned long long)hash);
+
+  const char *dir = fuzzer->config.corpus_dir;
+  const char *sep = subdir ? "/" : "";
+  subdir = subdir ? subdir : "";
+  char path[PATH_SIZE], tmp_path[PATH_SIZE];
+  int length = snprintf(path, sizeof(path), "%s/%s%s%s", dir, subdir, sep,
+                        name);
+  int tmp_length = snprintf(tmp_path, sizeof(tmp_path), "%s/%s%s.%s", dir,
+                            subdir, sep, name);
+  if (length < 0 || length >= PATH_SIZE || tmp_length < 0 ||
+      tmp_length >= PATH_SIZE)
+    return;
+
+  FILE *file = fopen(tmp_path, "wb");
+  if (!file)
+    return;
+  bool written = fwrite(input, 1, size, file) == size;
+  if (fclose(file) != 0 || !written || rename(tmp_path, path) != 0) {
+    remove(tmp_path);
+    return;
+  }
+  if (*subdir == '\0' && !is_known(fuzzer, name))
+    known_add(fuzzer, name);
+}
+
+// Keep the inputs reaching new edges, report the failures reaching new
+// edges. Imported inputs are not written back.
+static void process_case(adc_8080_fuzzer *fuzzer, const uint8_t *input,
+                         size_t size, enum adc_8080_fuzzer_outcome outcome,
+                         bool imported) {
+  fuzzer->stats.cases++;
+  fuzzer->stats.outcomes[outcome]++;
+
+  if (outcome == ADC_8080_FUZZER_DONE) {
+    if (!new_coverage(fuzzer) ||
+        !corpus_add(fuzzer, input, size))
+      return;
+    if (imported)
+      fuzzer->stats.imported++;
+    else if (fuzzer->config.corpus_dir)
+      write_input(fuzzer, NULL, outcome, input, size);
+    return;
+  }
+
+  if (imported || !new_failure(fuzzer))
+    return;
+  if (fuzzer->config.persistent > 1 &&
+      adc_8080_fuzzer_run(fuzzer, input, size) != outcome) {
+    fuzzer->stats.unstable++;
+    return;
+  }
+  fuzzer->stats.failures++;
+  if (fuzzer->config.corpus_dir)
+    write_input(fuzzer, CRASHES_DIR, outcome, input, size);
+  if (fuzzer->config.failure)
+    fuzzer->config.failure(fuzzer->config.userdata, outcome, input, size);
+}
+
+static size_t insert_bytes(adc_8080_fuzzer *fuzzer, uint8_t *buf, size_t size,
+                           const uint8_t *bytes, size_t length) {
+  if (length > fuzzer->config.max_input - size)
+    length = fuzzer->config.max_input - size;
+  size_t pos = random_below(fuzzer, size + 1);
+  memmove(buf + pos + length, buf + pos, size - pos);
+  memcpy(buf + pos, bytes, length);
+  return size + length;
+}
+
+// Apply a stack of random mutations.
+//
+// Returns the new size of the input.
+static size_t mutate(adc_8080_fuzzer *fuzzer, uint8_t *buf, size_t size) {
+  // A power of two up to MAX_STACKED, each as likely.
+  size_t choices = 0;
+  for (size_t n = MAX_STACKED; n > 0; n >>= 1)
+    choices++;
+  size_t stacked = (size_t)MAX_STACKED >> random_below(fuzzer, choices);
+  for (size_t i = 0; i < stacked; i++) {
+    size_t op = random_below(fuzzer, 8);
+    // An empty input can only grow.
+    if (size == 0)
+      op = 4;
+    size_t pos = size > 0 ? random_below(fuzzer, size) : 0;
+
+    switch (op) {
+    case 0:
+      buf[pos] ^= 1u << random_below(fuzzer, 8);
+      break;
+    case 1:
+      buf[pos] = (uint8_t)next_random(fuzzer);
+      break;
+    case 2:
+      buf[pos] = s_interesting[random_below(fuzzer, sizeof(s_interesting))];
+      break;
+    case 3: {
+      int delta = 1 + (int)random_below(fuzzer, 16);
+      buf[pos] += random_below(fuzzer, 2) ? delta : -delta;
+      break;
+    }
+    case 4: {
+      uint8_t b = random_below(fuzzer, 2)
+                      ? (uint8_t)next_random(fuzzer)
+                      : s_interesting[random_below(fuzzer,
+                                                   sizeof(s_interesting))];
+      size = insert_bytes(fuzzer, buf, size, &b, 1);
+      break;
+    }
+    case 5: {
+      size_t left = size - pos;
+      size_t length =
+          1 + random_below(fuzzer, left < MAX_BLOCK ? left : MAX_BLOCK);
+      memmove(buf + pos, buf + pos + length, left - length);
+      size -= length;
+      break;
+    }
+    case 6: {
+      // Copy a block over another part of the input.
+      size_t length = 1 + random_below(fuzzer, size);
+      size_t src = random_below(fuzzer, size - length + 1);
+      size_t dst = random_below(fuzzer, size - length + 1);
+      memmove(buf + dst, buf + src, length);
+      break;
+    }
+    default: {
+      // Splice in a block of another corpus input.
+      const corpus_entry *entry =
+          &fuzzer->corpus[random_below(fuzzer, fuzzer->corpus_count)];
+      if (entry->size == 0)
+        break;
+      size_t src = random_below(fuzzer, entry->size);
+      size_t left = entry->size - src;
+      size_t length =
+          1 + random_below(fuzzer, left < MAX_BLOCK ? left : MAX_BLOCK);
+      size = insert_bytes(fuzzer, buf, size, entry->data + src, length);
+      break;
+    }
+    }
+  }
+  return size;
+}
+
+// Read an input file of the corpus directory into the buffer, truncated to
+// max_input bytes.
+static bool read_input(adc_8080_fuzzer *fuzzer, const char *name,
+                       size_t *size) {
+  char path[PATH_SIZE];
+  int length =
+      snprintf(path, sizeof(path), "%s/%s", fuzzer->config.corpus_dir, name);
+  if (length < 0 || length >= PATH_SIZE)
+    return false;
+
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+  *size = fread(fuzzer->buffer, 1, fuzzer->config.max_input, file);
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+static bool make_dir(const char *path) {
+  return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+// Public api implementation
+
+void adc_8080_fuzzer_config_init(adc_8080_fuzzer_config *config) {
+  assert(config);
+
+  memset(config, 0, sizeof(adc_8080_fuzzer_config));
+  config->cycles = 100000;
+  memset(config->ports, 0xFF, sizeof(config->ports));
+  config->code_end = 0xFFFF;
+  config->stack_end = 0xFFFF;
+  config->max_input = 256;
+  config->seed = 1;
+  config->worker = "w0";
+}
+
+adc_8080_fuzzer *adc_8080_fuzzer_new(const adc_8080_fuzzer_config *config,
+                                     const adc_8080_cpu *cpu,
+                                     const uint8_t *memory) {
+  assert(config);
+  assert(config->max_input > 0);
+  assert(config->worker);
+  assert(cpu);
+  assert(memory);
+
+  adc_8080_fuzzer *fuzzer = calloc(1, sizeof(adc_8080_fuzzer));
+  if (!fuzzer)
+    return NULL;
+
+  fuzzer->config = *config;
+  fuzzer->buffer = malloc(config->max_input);
+  if (!fuzzer->buffer)
+    goto error;
+
+  // Only the architectural state of the cpu is taken.
+  uint8_t state[ADC_8080_CPU_STATE_SIZE];
+  adc_8080_cpu_init(&fuzzer->snapshot);
+  if (adc_8080_cpu_save(cpu, NULL, state, sizeof(state)) == 0 ||
+      adc_8080_cpu_load(&fuzzer->snapshot, NULL, state, sizeof(state)) == 0)
+    goto error;
+  adc_8080_cpu_clear_dirty(&fuzzer->snapshot);
+  fuzzer->snapshot.userdata = fuzzer;
+  fuzzer->snapshot.read_byte = handle_memory_read;
+  fuzzer->snapshot.write_byte = handle_memory_write;
+  fuzzer->snapshot.read_device = handle_device_read;
+  fuzzer->snapshot.write_device = NULL;
+  adc_8080_cpu_pctrace_attach(&fuzzer->snapshot, &fuzzer->pctrace,
+                              transition, fuzzer);
+  memcpy(fuzzer->snapshot_memory, memory, MEMORY_TOTAL);
+  memcpy(fuzzer->memory, memory, MEMORY_TOTAL);
+  fuzzer->cpu = fuzzer->snapshot;
+
+  memset(fuzzer->virgin, 0xFF, MAP_SIZE);
+  memset(fuzzer->virgin_failures, 0xFF, MAP_SIZE);
+  fuzzer->rng = config->seed;
+
+  if (config->corpus_dir) {
+    char path[PATH_SIZE];
+    int length = snprintf(path, sizeof(path), "%s/%s", config->corpus_dir,
+                          CRASHES_DIR);
+    if (length < 0 || length >= PATH_SIZE ||
+        !make_dir(config->corpus_dir) || !make_dir(path))
+      goto error;
+    adc_8080_fuzzer_sync(fuzzer);
+  }
+  if (fuzzer->corpus_count == 0 && !adc_8080_fuzzer_add_input(fuzzer, NULL, 0))
+    goto error;
+  return fuzzer;
+
+error:
+  adc_8080_fuzzer_free(&fuzzer);
+  return NULL;
+}
+
+void adc_8080_fuzzer_free(adc_8080_fuzzer **fuzzer) {
+  if (fuzzer && *fuzzer) {
+    for (size_t i = 0; i < (*fuzzer)->corpus_count; i++)
+      free((*fuzzer)->corpus[i].data);
+    free((*fuzzer)->corpus);
+    for (size_t i = 0; i < (*fuzzer)->known_count; i++)
+      free((*fuzzer)->known[i]);
+    free((*fuzzer)->known);
+    free((*fuzzer)->buffer);
+    free(*fuzzer);
+    *fuzzer = NULL;
+  }
+}
+
+bool adc_8080_fuzzer_add_input(adc_8080_fuzzer *fuzzer, const uint8_t *input,
+                               size_t size) {
+  assert(fuzzer);
+  assert(input || size == 0);
+
+  // Mutations are made in the max_input bytes of the buffer.
+  if (size > fuzzer->config.max_input)
+    size = fuzzer->config.max_input;
+  run_case(fuzzer, input, size, true);
+  new_coverage(fuzzer);
+  return corpus_add(fuzzer, input, size);
+}
+
+enum adc_8080_fuzzer_outcome adc_8080_fuzzer_run(adc_8080_fuzzer *fuzzer,
+                                                 const uint8_t *input,
+                                                 size_t size) {
+  assert(fuzzer);
+  assert(input || size == 0);
+
+  return run_case(fuzzer, input, size, true);
+}
+
+uint64_t adc_8080_fuzzer_fuzz(adc_8080_fuzzer *fuzzer, uint64_t cases) {
+  assert(fuzzer);
+
+  uint64_t failures = fuzzer->stats.failures;
+  for (uint64_t i = 0; i < cases; i++) {
+    const corpus_entry *entry =
+        &fuzzer->corpus[random_below(fuzzer, fuzzer->corpus_count)];
+    if (entry->size > 0)
+      memcpy(fuzzer->buffer, entry->data, entry->size);
+    size_t size = mutate(fuzzer, fuzzer->buffer, entry->size);
+    enum adc_8080_fuzzer_outcome outcome =
+        run_case(fuzzer, fuzzer->buffer, size, false);
+    process_case(fuzzer, fuzzer->buffer, size, outcome, false);
+  }
+  return fuzzer->stats.failures - failures;
+}
+
+uint64_t adc_8080_fuzzer_sync(adc_8080_fuzzer *fuzzer) {
+  assert(fuzzer);
+
+  if (!fuzzer->config.corpus_dir)
+    return 0;
+  DIR *dir = opendir(fuzzer->config.corpus_dir);
+  if (!dir)
+    return 0;
+
+  uint64_t imported = fuzzer->stats.imported;
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    const char *name = entry->d_name;
+    if (name[0] == '.' || strcmp(name, CRASHES_DIR) == 0 ||
+        is_known(fuzzer, name))
+      continue;
+    if (!known_add(fuzzer, name))
+      break;
+
+    size_t size;
+    if (!read_input(fuzzer, name, &size))
+      continue;
+    enum adc_8080_fuzzer_outcome outcome =
+        run_case(fuzzer, fuzzer->buffer, size, true);
+    process_case(fuzzer, fuzzer->buffer, size, outcome, true);
+  }
+  closedir(dir);
+  return fuzzer->stats.imported - imported;
+}
+
+void adc_8080_fuzzer_get_stats(const adc_8080_fuzzer *fuzzer,
+                               adc_8080_fuzzer_stats *stats) {
+  assert(fuzzer);
+  assert(stats);
+
+  *stats = fuzzer->stats;
+}
+
+const char *adc_8080_fuzzer_outcome_name(enum adc_8080_fuzzer_outcome outcome) {
+  assert(outcome < ADC_8080_FUZZER_OUTCOMES);
+
+  return s_outcome_names[outcome];
+}
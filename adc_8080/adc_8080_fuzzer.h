@@ -0,0 +1,143 @@
+// adc_8080_fuzzer Coverage guided fuzzing of guest input for adc_8080_cpu by
+// Anthony Del Ciotto. Runs a guest program from a snapshot with the bytes of
+// generated inputs as the values its IN instructions read, and keeps the
+// inputs that reach new branch edges as the base of further mutations.
+// Inputs that make the guest fail are reported, see enum
+// adc_8080_fuzzer_outcome.
+//
+// Edges are the taken branches reported by adc_8080_cpu_pctrace_attach(), a
+// pair of the address after the branch and its target counted in a 64 KiB
+// map of hit count buckets. Between cases only the memory pages the guest
+// wrote are restored from the snapshot, see adc_8080_cpu_clear_dirty().
+//
+// Workers share a corpus directory. Each writes the inputs it keeps there as
+// "<worker>-<hash>" and failing inputs in its crashes subdirectory as
+// "<worker>-<outcome>-<hash>", and imports the inputs of the other workers
+// on adc_8080_fuzzer_sync().
+
+#ifndef _ADC_8080_FUZZER_H_
+#define _ADC_8080_FUZZER_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct adc_8080_fuzzer adc_8080_fuzzer;
+
+// How a case ended.
+enum adc_8080_fuzzer_outcome {
+  // The guest is about to read past the end of the input, or halted with
+  // interrupts enabled.
+  ADC_8080_FUZZER_DONE,
+  // The cycle budget ran out before the guest read all of the input.
+  ADC_8080_FUZZER_TIMEOUT,
+  // Halted with interrupts disabled, nothing can resume the guest.
+  ADC_8080_FUZZER_HALT,
+  // The pc left the code range.
+  ADC_8080_FUZZER_WILD_PC,
+  // The stack pointer left the stack range.
+  ADC_8080_FUZZER_STACK,
+  ADC_8080_FUZZER_OUTCOMES
+};
+
+typedef struct {
+  // Cycles a case may run.
+  uint64_t cycles;
+  // Ports read from the input, bit n of ports[n / 32] is port n. Other ports
+  // read 0xFF.
+  uint32_t ports[8];
+  // Inclusive ranges the pc and the stack pointer must stay in.
+  uint16_t code_start, code_end;
+  uint16_t stack_start, stack_end;
+  // Cases run back to back on the same machine in persistent mode, without
+  // restoring the snapshot. 0 and 1 restore it before every case. The
+  // snapshot is always restored after a failure, and failures are only
+  // reported if they happen again from the snapshot.
+  uint32_t persistent;
+  // Longest generated input in bytes.
+  size_t max_input;
+  uint64_t seed;
+  // Directory shared with the other workers, may be NULL. Kept by pointer.
+  const char *corpus_dir;
+  // Prefix of the files this worker writes, unique among the workers. Kept
+  // by pointer.
+  const char *worker;
+  // Called with every distinct failing input, may be NULL.
+  void (*failure)(void *userdata, enum adc_8080_fuzzer_outcome outcome,
+                  const uint8_t *input, size_t size);
+  void *userdata;
+} adc_8080_fuzzer_config;
+
+typedef struct {
+  uint64_t cases;
+  uint64_t outcomes[ADC_8080_FUZZER_OUTCOMES];
+  // Distinct edges covered and inputs kept, including the imported ones.
+  uint64_t edges;
+  uint64_t corpus;
+  uint64_t imported;
+  // Failing inputs reaching new edges, and failures of persistent mode that
+  // did not happen again from the snapshot.
+  uint64_t failures;
+  uint64_t unstable;
+} adc_8080_fuzzer_stats;
+
+// adc_8080_fuzzer_config_init() - Set the defaults: 100000 cycles, every
+// port read from the input, no code or stack range, no persistent mode,
+// inputs of up to 256 bytes and seed 1, no corpus directory and worker "w0".
+void adc_8080_fuzzer_config_init(adc_8080_fuzzer_config *config);
+
+// adc_8080_fuzzer_new() - Create a fuzzer running from a snapshot of the cpu
+// state and memory. The handlers and attachments of the cpu are not used.
+// The inputs of the corpus directory are imported, the corpus starts with an
+// empty input when there are none.
+//
+// Returns NULL on allocation failure or if the corpus directory can not be
+// created.
+adc_8080_fuzzer *adc_8080_fuzzer_new(const adc_8080_fuzzer_config *config,
+                                     const adc_8080_cpu *cpu,
+                                     const uint8_t *memory);
+
+// adc_8080_fuzzer_free() - Free the fuzzer resources.
+void adc_8080_fuzzer_free(adc_8080_fuzzer **fuzzer);
+
+// adc_8080_fuzzer_add_input() - Add an input to the corpus, whatever it
+// covers. It is not written to the corpus directory. Inputs longer than
+// max_input are truncated to it, as the inputs read from the directory are.
+//
+// Returns false on allocation failure.
+bool adc_8080_fuzzer_add_input(adc_8080_fuzzer *fuzzer, const uint8_t *input,
+                               size_t size);
+
+// adc_8080_fuzzer_run() - Run an input from the snapshot, for example to
+// reproduce a failure. The corpus and statistics are left as is.
+//
+// Returns how the case ended.
+enum adc_8080_fuzzer_outcome adc_8080_fuzzer_run(adc_8080_fuzzer *fuzzer,
+                                                 const uint8_t *input,
+                                                 size_t size);
+
+// adc_8080_fuzzer_fuzz() - Run cases of mutated corpus inputs.
+//
+// Returns the number of distinct failing inputs found.
+uint64_t adc_8080_fuzzer_fuzz(adc_8080_fuzzer *fuzzer, uint64_t cases);
+
+// adc_8080_fuzzer_sync() - Import the inputs the other workers wrote to the
+// corpus directory since the last sync, keeping those that reach new edges.
+//
+// Returns the number of inputs kept.
+uint64_t adc_8080_fuzzer_sync(adc_8080_fuzzer *fuzzer);
+
+// adc_8080_fuzzer_get_stats() - Copy the statistics of the fuzzer.
+void adc_8080_fuzzer_get_stats(const adc_8080_fuzzer *fuzzer,
+                               adc_8080_fuzzer_stats *stats);
+
+// adc_8080_fuzzer_outcome_name() - Returns a short name of the outcome.
+const char *adc_8080_fuzzer_outcome_name(enum adc_8080_fuzzer_outcome outcome);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_FUZZER_H_
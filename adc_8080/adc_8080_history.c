@@ -0,0 +1,255 @@
+#include "adc_8080_history.h"
+#include "adc_8080_rewind.h"
+
+#include <assert.h> // For assert
+#include <stdlib.h> // For malloc, calloc, free
+#include <string.h> // For memmove
+
+// Compact the input log once this many bytes are older than the history.
+#define LOG_COMPACT_SIZE 0x100000
+
+// Metadata kept alongside each rewind checkpoint.
+typedef struct {
+  uint64_t position;
+  // Input log position and the cycle of the event before it.
+  size_t log_pos;
+  uint64_t log_last_cycle;
+} checkpoint_info;
+
+struct adc_8080_history {
+  adc_8080_cpu *cpu;
+  uint8_t *memory;
+  uint64_t interval;
+  uint64_t position;
+  // Furthest position reached.
+  uint64_t end;
+
+  adc_8080_rewind *rw;
+  adc_8080_cpu_iolog log;
+
+  // Mirrors the checkpoints in the rewind buffer, oldest first.
+  checkpoint_info *info;
+  size_t capacity;
+  size_t head;
+  size_t count;
+
+  // Set when a checkpoint could not be taken.
+  bool error;
+};
+
+static inline checkpoint_info *get_info(adc_8080_history *history,
+                                        size_t index) {
+  return &history->info[(history->head + index) % history->capacity];
+}
+
+static inline size_t log_pos(const adc_8080_cpu_iolog *log) {
+  return log->mode == ADC_8080_CPU_IOLOG_RECORD ? log->size : log->pos;
+}
+
+// Drop the part of the input log older than the oldest checkpoint.
+static void compact_log(adc_8080_history *history) {
+  size_t shift = get_info(history, 0)->log_pos;
+  if (shift < LOG_COMPACT_SIZE || shift < history->log.size / 2)
+    return;
+
+  memmove(history->log.data, history->log.data + shift,
+          history->log.size - shift);
+  history->log.size -= shift;
+  if (history->log.mode == ADC_8080_CPU_IOLOG_REPLAY)
+    history->log.pos -= shift;
+  for (size_t i = 0; i < history->count; i++)
+    get_info(history, i)->log_pos -= shift;
+}
+
+static bool push_checkpoint(adc_8080_history *history) {
+  if (!adc_8080_rewind_push(history->rw, history->cpu, history->memory))
+    return false;
+
+  // The rewind buffer drops its oldest checkpoint when it is full.
+  if (history->count == history->capacity) {
+    history->head = (history->head + 1) % history->capacity;
+    history->count--;
+  }
+
+  checkpoint_info *info = get_info(history, history->count++);
+  info->position = history->position;
+  info->log_pos = log_pos(&history->log);
+  info->log_last_cycle = history->log.last_cycle;
+
+  compact_log(history);
+  return true;
+}
+
+static int step(adc_8080_history *history) {
+  checkpoint_info *newest = get_info(history, history->count - 1);
+  // A failed checkpoint is retried on the next step, the history reaches
+  // back less far until one is taken.
+  if (history->position - newest->position >= history->interval &&
+      !push_checkpoint(history))
+    history->error = true;
+
+  history->position++;
+  if (history->position > history->end)
+    history->end = history->position;
+  return adc_8080_cpu_step(history->cpu);
+}
+
+// Restore the checkpoint at index and replay the log from there.
+static void restore_checkpoint(adc_8080_history *history, size_t index) {
+  checkpoint_info info = *get_info(history, index);
+
+  adc_8080_rewind_restore(history->rw, index, history->cpu, history->memory);
+  history->count = index + 1;
+  history->position = info.position;
+  adc_8080_cpu_record_resume(history->cpu, &history->log, info.log_pos,
+                             info.log_last_cycle);
+}
+
+// Step forward to the target position without forwarding OUT to the host.
+static void advance(adc_8080_history *history, uint64_t target) {
+  void (*write_device)(void *, uint8_t, uint8_t) =
+      history->cpu->write_device;
+  history->cpu->write_device = NULL;
+
+  while (history->position < target)
+    step(history);
+
+  history->cpu->write_device = write_device;
+}
+
+// Returns the index of the newest checkpoint at or before position, or -1.
+static long find_checkpoint(adc_8080_history *history, uint64_t position) {
+  for (long i = (long)history->count - 1; i >= 0; i--)
+    if (get_info(history, i)->position <= position)
+      return i;
+  return -1;
+}
+
+// Public api implementation
+
+adc_8080_history *adc_8080_history_new(adc_8080_cpu *cpu, uint8_t *memory,
+                                       uint64_t interval, size_t capacity) {
+  assert(cpu);
+  assert(memory);
+  assert(interval > 0);
+  assert(capacity > 0);
+
+  adc_8080_history *history = calloc(1, sizeof(adc_8080_history));
+  if (!history)
+    goto error;
+
+  history->rw = adc_8080_rewind_new(capacity);
+  history->info = calloc(capacity, sizeof(checkpoint_info));
+  if (!history->rw || !history->info)
+    goto error;
+
+  history->cpu = cpu;
+  history->memory = memory;
+  history->interval = interval;
+  history->capacity = capacity;
+
+  adc_8080_cpu_record(cpu, &history->log);
+  if (!push_checkpoint(history))
+    goto error;
+
+  return history;
+
+error:
+  adc_8080_history_free(&history);
+  return NULL;
+}
+
+void adc_8080_history_free(adc_8080_history **history) {
+  if (history && *history) {
+    if ((*history)->cpu && (*history)->cpu->iolog == &(*history)->log)
+      adc_8080_cpu_iolog_stop((*history)->cpu);
+
+    adc_8080_cpu_iolog_free(&(*history)->log);
+    adc_8080_rewind_free(&(*history)->rw);
+    free((*history)->info);
+    free(*history);
+    *history = NULL;
+  }
+}
+
+int adc_8080_history_step(adc_8080_history *history) {
+  assert(history);
+
+  return step(history);
+}
+
+uint64_t adc_8080_history_position(const adc_8080_history *history) {
+  assert(history);
+
+  return history->position;
+}
+
+bool adc_8080_history_error(const adc_8080_history *history) {
+  assert(history);
+
+  return history->error || history->log.error;
+}
+
+bool adc_8080_history_seek(adc_8080_history *history, uint64_t position) {
+  assert(history);
+
+  if (position > history->end)
+    return false;
+
+  // Seeking forward replays from the current position.
+  if (position >= history->position) {
+    advance(history, position);
+    return true;
+  }
+
+  long index = find_checkpoint(history, position);
+  if (index < 0)
+    return false;
+
+  restore_checkpoint(history, index);
+  advance(history, position);
+  return true;
+}
+
+bool adc_8080_history_step_back(adc_8080_history *history) {
+  assert(history);
+
+  if (history->position == 0)
+    return false;
+  return adc_8080_history_seek(history, history->position - 1);
+}
+
+bool adc_8080_history_run_back_to(adc_8080_history *history, uint16_t pc) {
+  assert(history);
+
+  uint64_t start = history->position;
+  uint64_t end = start;
+
+  // Scan the windows between checkpoints from the newest to the oldest for
+  // the last time pc was about to be executed.
+  long index = history->position > 0 ? find_checkpoint(history, end - 1) : -1;
+  while (index >= 0) {
+    restore_checkpoint(history, index);
+
+    uint64_t found = end;
+    void (*write_device)(void *, uint8_t, uint8_t) =
+        history->cpu->write_device;
+    history->cpu->write_device = NULL;
+    while (history->position < end) {
+      if (history->cpu->pc == pc && !history->cpu->halted)
+        found = history->position;
+      step(history);
+    }
+    history->cpu->write_device = write_device;
+
+    if (found < end)
+      return adc_8080_history_seek(history, found);
+
+    end = get_info(history, index)->position;
+    index = end > 0 ? find_checkpoint(history, end - 1) : -1;
+  }
+
+  // Not found, go back to where we started.
+  adc_8080_history_seek(history, start);
+  return false;
+}
@@ -0,0 +1,85 @@
+// adc_8080_history Reverse execution for adc_8080_cpu by Anthony Del Ciotto.
+// Steps a cpu forward while taking a rewind checkpoint every interval
+// instructions and recording every IN result and interrupt request. Stepping
+// backwards restores the nearest checkpoint at or before the target and
+// re-executes forward deterministically with the recorded inputs, so any step
+// back re-executes at most interval instructions.
+//
+// After stepping back, stepping forward replays the recorded history until it
+// is exhausted, then recording continues. While replaying, calls to
+// adc_8080_cpu_interrupt() are ignored.
+//
+// The memory given to the history must be the memory behind the cpu's
+// read_byte and write_byte handlers. OUT is not forwarded to the write_device
+// handler while re-executing to reach a target, so hosts must not change the
+// cpu or memory from write_device.
+
+#ifndef _ADC_8080_HISTORY_H_
+#define _ADC_8080_HISTORY_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct adc_8080_history adc_8080_history;
+
+// adc_8080_history_new() - Start recording the history of the cpu.
+//
+// memory   - The 64 KiB memory of the cpu.
+// interval - Number of instructions between checkpoints. This bounds the
+//            cost of a step back.
+// capacity - Number of checkpoints kept. The history reaches back at least
+//            interval * (capacity - 1) instructions.
+//
+// The cpu's input log is attached to the history until it is freed.
+//
+// Returns NULL on allocation failure.
+adc_8080_history *adc_8080_history_new(adc_8080_cpu *cpu, uint8_t *memory,
+                                       uint64_t interval, size_t capacity);
+
+// adc_8080_history_free() - Free the history and detach it from the cpu.
+void adc_8080_history_free(adc_8080_history **history);
+
+// adc_8080_history_step() - Decode and execute the next instruction, as
+// adc_8080_cpu_step(), while recording the history.
+//
+// Returns the number of cycles consumed from this step.
+int adc_8080_history_step(adc_8080_history *history);
+
+// adc_8080_history_position() - Returns the number of instructions stepped
+// since the history was created.
+uint64_t adc_8080_history_position(const adc_8080_history *history);
+
+// adc_8080_history_error() - Returns true if a checkpoint could not be taken
+// or the input log failed, see adc_8080_cpu_iolog. Steps are still made, but
+// the history may not reach back as far as given by its capacity, or may
+// not re-execute the recorded inputs.
+bool adc_8080_history_error(const adc_8080_history *history);
+
+// adc_8080_history_seek() - Move the cpu and memory to the state before the
+// instruction at the given position was executed. Positions after the current
+// one can be reached up to the furthest position recorded.
+//
+// Returns false if the position was never recorded or is older than the
+// history, the cpu is left as is.
+bool adc_8080_history_seek(adc_8080_history *history, uint64_t position);
+
+// adc_8080_history_step_back() - Undo the last instruction.
+//
+// Returns false if there is no history left.
+bool adc_8080_history_step_back(adc_8080_history *history);
+
+// adc_8080_history_run_back_to() - Run backwards to the most recent
+// instruction executed at the given pc.
+//
+// Returns false if pc was not executed within the history, the cpu is left as
+// is.
+bool adc_8080_history_run_back_to(adc_8080_history *history, uint16_t pc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_HISTORY_H_
@@ -0,0 +1,366 @@
+#include "adc_8080_pctrace.h"
+#include "adc_8080_dasm.h"
+
+#include <assert.h> // For assert
+#include <stdlib.h> // For calloc, free
+#include <string.h> // For memcmp, memcpy
+
+#define PCTRACE_VERSION 1
+#define BUFFER_SIZE 0x10000
+// Longest record, a head and two varints of 64 bits.
+#define MAX_RECORD 30
+
+enum record_kind {
+  RECORD_BRANCH,
+  RECORD_INTERRUPT,
+  RECORD_STOP,
+  RECORD_START,
+  RECORD_REPEAT,
+  // No record pending in the reader.
+  RECORD_NONE
+};
+
+// Bits of the record kind in the head of a record.
+#define KIND_BITS 3
+
+static const uint8_t s_pctrace_magic[4] = {'A', '8', '0', 'P'};
+
+struct adc_8080_pctrace_writer {
+  adc_8080_cpu_pctrace pctrace;
+  FILE *stream;
+  uint64_t last_cycle;
+  uint64_t instructions;
+  uint64_t flushed;
+  bool error;
+
+  // The last record if it was a branch, and the number of times it was
+  // repeated since.
+  bool has_branch;
+  uint64_t branch_run;
+  uint32_t branch_delta;
+  uint64_t branch_cycles;
+  uint64_t repeats;
+
+  size_t length;
+  uint8_t buffer[BUFFER_SIZE];
+};
+
+struct adc_8080_pctrace_reader {
+  FILE *stream;
+  const uint8_t *memory;
+  uint16_t pc;
+  uint64_t cycle_count;
+  bool started;
+  bool error;
+
+  // The record being replayed: its sequential instructions left, then the
+  // transition.
+  uint64_t run;
+  enum record_kind kind;
+  uint16_t delta;
+  uint64_t cycles;
+
+  // The last branch record, replayed repeats more times.
+  bool has_branch;
+  uint64_t branch_run;
+  uint64_t repeats;
+};
+
+static inline void put_varint(adc_8080_pctrace_writer *writer, uint64_t v) {
+  while (v >= 0x80) {
+    writer->buffer[writer->length++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  writer->buffer[writer->length++] = (uint8_t)v;
+}
+
+// Zigzag encoding of a signed 16-bit difference, small in either direction.
+static inline uint32_t zigzag(uint16_t delta) {
+  int16_t d = (int16_t)delta;
+  return d < 0 ? ((uint32_t)~d << 1) | 1 : (uint32_t)d << 1;
+}
+
+static inline uint16_t unzigzag(uint64_t v) {
+  return (uint16_t)(v & 1 ? ~(v >> 1) : v >> 1);
+}
+
+static void flush(adc_8080_pctrace_writer *writer) {
+  if (writer->length > 0 &&
+      fwrite(writer->buffer, 1, writer->length, writer->stream) !=
+          writer->length)
+    writer->error = true;
+  writer->flushed += writer->length;
+  writer->length = 0;
+}
+
+static inline void put_record(adc_8080_pctrace_writer *writer, uint64_t run,
+                              enum record_kind kind) {
+  if (writer->length > BUFFER_SIZE - MAX_RECORD)
+    flush(writer);
+  put_varint(writer, run << KIND_BITS | kind);
+}
+
+// Write the repeats of the last branch, every other record ends them.
+static void put_repeats(adc_8080_pctrace_writer *writer) {
+  if (writer->repeats > 0)
+    put_record(writer, writer->repeats, RECORD_REPEAT);
+  writer->repeats = 0;
+  writer->has_branch = false;
+}
+
+static void writer_transition(void *userdata, uint64_t run, uint16_t next,
+                              uint16_t target, uint64_t cycle_count,
+                              bool interrupt) {
+  adc_8080_pctrace_writer *writer = userdata;
+  uint32_t delta = zigzag((uint16_t)(target - next));
+  uint64_t cycles = cycle_count - writer->last_cycle;
+  writer->last_cycle = cycle_count;
+  writer->instructions += interrupt ? run : run + 1;
+
+  // Loops repeat the same branch after the same instructions.
+  if (!interrupt && writer->has_branch && writer->branch_run == run &&
+      writer->branch_delta == delta && writer->branch_cycles == cycles) {
+    writer->repeats++;
+    return;
+  }
+
+  put_repeats(writer);
+  put_record(writer, run, interrupt ? RECORD_INTERRUPT : RECORD_BRANCH);
+  put_varint(writer, delta);
+  put_varint(writer, cycles);
+  if (!interrupt) {
+    writer->has_branch = true;
+    writer->branch_run = run;
+    writer->branch_delta = delta;
+    writer->branch_cycles = cycles;
+  }
+}
+
+static bool get_varint(FILE *stream, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int b = getc(stream);
+    if (b == EOF)
+      return false;
+    *v |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static inline uint16_t instruction_size(const adc_8080_pctrace_reader *reader,
+                                        uint16_t addr) {
+  return (uint16_t)adc_8080_dasm_opdef_get(reader->memory[addr])->size;
+}
+
+// Read the next record. Returns false at the end of the stream.
+static bool read_record(adc_8080_pctrace_reader *reader) {
+  int first = getc(reader->stream);
+  if (first == EOF)
+    return false;
+  ungetc(first, reader->stream);
+
+  uint64_t head, value, cycles;
+  if (!get_varint(reader->stream, &head))
+    goto error;
+  uint64_t run = head >> KIND_BITS;
+  enum record_kind kind = (enum record_kind)(head & ((1 << KIND_BITS) - 1));
+  if (kind != RECORD_START && !reader->started)
+    goto error;
+
+  switch (kind) {
+  case RECORD_BRANCH:
+  case RECORD_INTERRUPT:
+    if (!get_varint(reader->stream, &value) ||
+        !get_varint(reader->stream, &cycles))
+      goto error;
+    reader->run = run;
+    reader->kind = kind;
+    reader->delta = unzigzag(value);
+    reader->cycles = cycles;
+    reader->has_branch = kind == RECORD_BRANCH;
+    reader->branch_run = run;
+    return true;
+  case RECORD_STOP:
+    if (!get_varint(reader->stream, &cycles))
+      goto error;
+    reader->run = run;
+    reader->kind = kind;
+    reader->cycles = cycles;
+    reader->has_branch = false;
+    return true;
+  case RECORD_START:
+    if (run != 0 || !get_varint(reader->stream, &value) || value > 0xFFFF ||
+        !get_varint(reader->stream, &cycles))
+      goto error;
+    reader->pc = (uint16_t)value;
+    reader->cycle_count = cycles;
+    reader->started = true;
+    reader->has_branch = false;
+    return true;
+  case RECORD_REPEAT:
+    if (!reader->has_branch || run == 0)
+      goto error;
+    reader->run = reader->branch_run;
+    reader->kind = RECORD_BRANCH;
+    reader->repeats = run - 1;
+    return true;
+  default:
+    goto error;
+  }
+
+error:
+  reader->error = true;
+  return false;
+}
+
+// Public api implementation
+
+adc_8080_pctrace_writer *adc_8080_pctrace_writer_new(FILE *stream) {
+  assert(stream);
+
+  adc_8080_pctrace_writer *writer = calloc(1, sizeof(adc_8080_pctrace_writer));
+  if (!writer)
+    return NULL;
+
+  writer->stream = stream;
+  memcpy(writer->buffer, s_pctrace_magic, sizeof(s_pctrace_magic));
+  writer->buffer[sizeof(s_pctrace_magic)] = PCTRACE_VERSION;
+  writer->length = sizeof(s_pctrace_magic) + 1;
+  return writer;
+}
+
+void adc_8080_pctrace_writer_free(adc_8080_pctrace_writer **writer) {
+  if (writer && *writer) {
+    free(*writer);
+    *writer = NULL;
+  }
+}
+
+void adc_8080_pctrace_writer_attach(adc_8080_pctrace_writer *writer,
+                                    adc_8080_cpu *cpu) {
+  assert(writer);
+  assert(cpu);
+
+  put_repeats(writer);
+  put_record(writer, 0, RECORD_START);
+  put_varint(writer, cpu->pc);
+  put_varint(writer, cpu->cycle_count);
+  writer->last_cycle = cpu->cycle_count;
+  adc_8080_cpu_pctrace_attach(cpu, &writer->pctrace, writer_transition,
+                              writer);
+}
+
+bool adc_8080_pctrace_writer_detach(adc_8080_pctrace_writer *writer,
+                                    adc_8080_cpu *cpu) {
+  assert(writer);
+  assert(cpu);
+  assert(cpu->pctrace == &writer->pctrace);
+
+  adc_8080_cpu_pctrace_detach(cpu);
+  put_repeats(writer);
+  put_record(writer, writer->pctrace.run, RECORD_STOP);
+  put_varint(writer, cpu->cycle_count - writer->last_cycle);
+  writer->instructions += writer->pctrace.run;
+  flush(writer);
+  return !writer->error;
+}
+
+uint64_t
+adc_8080_pctrace_writer_instructions(const adc_8080_pctrace_writer *writer) {
+  assert(writer);
+
+  return writer->instructions;
+}
+
+uint64_t adc_8080_pctrace_writer_size(const adc_8080_pctrace_writer *writer) {
+  assert(writer);
+
+  return writer->flushed + writer->length;
+}
+
+adc_8080_pctrace_reader *adc_8080_pctrace_reader_new(FILE *stream,
+                                                     const uint8_t *memory) {
+  assert(stream);
+  assert(memory);
+
+  uint8_t header[5];
+  if (fread(header, 1, sizeof(header), stream) != sizeof(header) ||
+      memcmp(header, s_pctrace_magic, sizeof(s_pctrace_magic)) != 0 ||
+      header[4] != PCTRACE_VERSION)
+    return NULL;
+
+  adc_8080_pctrace_reader *reader = calloc(1, sizeof(adc_8080_pctrace_reader));
+  if (!reader)
+    return NULL;
+
+  reader->stream = stream;
+  reader->memory = memory;
+  reader->kind = RECORD_NONE;
+  return reader;
+}
+
+void adc_8080_pctrace_reader_free(adc_8080_pctrace_reader **reader) {
+  if (reader && *reader) {
+    free(*reader);
+    *reader = NULL;
+  }
+}
+
+bool adc_8080_pctrace_reader_next(adc_8080_pctrace_reader *reader,
+                                  adc_8080_pctrace_event *event) {
+  assert(reader);
+  assert(event);
+
+  for (;;) {
+    if (reader->run > 0) {
+      event->pc = reader->pc;
+      event->interrupt = false;
+      event->cycle_count = reader->cycle_count;
+      reader->pc += instruction_size(reader, reader->pc);
+      reader->run--;
+      return true;
+    }
+
+    switch (reader->kind) {
+    case RECORD_BRANCH:
+      event->pc = reader->pc;
+      event->interrupt = false;
+      reader->cycle_count += reader->cycles;
+      event->cycle_count = reader->cycle_count;
+      reader->pc += instruction_size(reader, reader->pc) + reader->delta;
+      if (reader->repeats > 0) {
+        reader->repeats--;
+        reader->run = reader->branch_run;
+      } else {
+        reader->kind = RECORD_NONE;
+      }
+      return true;
+    case RECORD_INTERRUPT:
+      event->pc = reader->pc;
+      event->interrupt = true;
+      reader->cycle_count += reader->cycles;
+      event->cycle_count = reader->cycle_count;
+      reader->pc += reader->delta;
+      reader->kind = RECORD_NONE;
+      return true;
+    case RECORD_STOP:
+      reader->cycle_count += reader->cycles;
+      reader->started = false;
+      reader->kind = RECORD_NONE;
+      break;
+    default:
+      break;
+    }
+
+    if (reader->error || !read_record(reader))
+      return false;
+  }
+}
+
+bool adc_8080_pctrace_reader_error(const adc_8080_pctrace_reader *reader) {
+  assert(reader);
+
+  return reader->error;
+}
@@ -0,0 +1,102 @@
+// adc_8080_pctrace Compressed pc traces for adc_8080_cpu by Anthony Del
+// Ciotto. Streams the pc transitions of adc_8080_cpu_pctrace_attach() to a
+// file so traces of billions of instructions fit on disk, and replays them as
+// the full stream of executed instructions.
+//
+// Straight-line code is stored as a count, only taken branches and interrupts
+// are stored as records, and a loop repeating the same branch as a count:
+//
+//   magic "A80P" and a version byte
+//   records, each starting with a varint of the run count << 3 | kind:
+//     branch     varint zigzag target - next, varint cycle delta
+//     interrupt  varint zigzag target - pc, varint cycle delta
+//     stop       varint cycle delta
+//     start      varint pc, varint cycle count, the run count is 0
+//     repeat     the previous branch record again run count times
+//
+// The reader walks each run with the instruction sizes of adc_8080_dasm, so
+// it needs the memory the code ran from.
+
+#ifndef _ADC_8080_PCTRACE_H_
+#define _ADC_8080_PCTRACE_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct adc_8080_pctrace_writer adc_8080_pctrace_writer;
+typedef struct adc_8080_pctrace_reader adc_8080_pctrace_reader;
+
+// An executed instruction or interrupt of a replayed trace.
+typedef struct {
+  // Address of the instruction, or the pc an interrupt was taken at.
+  uint16_t pc;
+  bool interrupt;
+  // Total cycle count after the instruction when it ends a run (a taken
+  // branch or an interrupt), otherwise the cycle count at the end of the
+  // previous run.
+  uint64_t cycle_count;
+} adc_8080_pctrace_event;
+
+// adc_8080_pctrace_writer_new() - Create a writer to the given stream and
+// write the file header. The stream must stay open until the writer is freed.
+//
+// Returns NULL on allocation failure.
+adc_8080_pctrace_writer *adc_8080_pctrace_writer_new(FILE *stream);
+
+// adc_8080_pctrace_writer_free() - Free the writer, the stream is not closed.
+void adc_8080_pctrace_writer_free(adc_8080_pctrace_writer **writer);
+
+// adc_8080_pctrace_writer_attach() - Start tracing the cpu from its current
+// pc and cycle count. A writer traces one cpu at a time, attaching again
+// after a detach starts a new segment of the same file.
+void adc_8080_pctrace_writer_attach(adc_8080_pctrace_writer *writer,
+                                    adc_8080_cpu *cpu);
+
+// adc_8080_pctrace_writer_detach() - Stop tracing, write the instructions
+// since the last transition and flush the records to the stream.
+//
+// Returns false if writing to the stream failed at any point.
+bool adc_8080_pctrace_writer_detach(adc_8080_pctrace_writer *writer,
+                                    adc_8080_cpu *cpu);
+
+// adc_8080_pctrace_writer_instructions() - Returns the number of traced
+// instructions, interrupts are not counted.
+uint64_t
+adc_8080_pctrace_writer_instructions(const adc_8080_pctrace_writer *writer);
+
+// adc_8080_pctrace_writer_size() - Returns the number of bytes written,
+// including the records not yet flushed.
+uint64_t adc_8080_pctrace_writer_size(const adc_8080_pctrace_writer *writer);
+
+// adc_8080_pctrace_reader_new() - Create a reader of a trace file.
+//
+// memory - The 64 KiB memory the traced code ran from. It is read while the
+//          trace is replayed, so code changed by the program can be replayed
+//          by changing it along.
+//
+// Returns NULL on allocation failure or if the stream is not a pc trace.
+adc_8080_pctrace_reader *adc_8080_pctrace_reader_new(FILE *stream,
+                                                     const uint8_t *memory);
+
+// adc_8080_pctrace_reader_free() - Free the reader, the stream is not closed.
+void adc_8080_pctrace_reader_free(adc_8080_pctrace_reader **reader);
+
+// adc_8080_pctrace_reader_next() - Replay the next instruction or interrupt.
+//
+// Returns false at the end of the trace or if it is invalid, see
+// adc_8080_pctrace_reader_error().
+bool adc_8080_pctrace_reader_next(adc_8080_pctrace_reader *reader,
+                                  adc_8080_pctrace_event *event);
+
+// adc_8080_pctrace_reader_error() - Returns true if the trace was truncated
+// in a record or has records outside of a segment.
+bool adc_8080_pctrace_reader_error(const adc_8080_pctrace_reader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_PCTRACE_H_
@@ -0,0 +1,370 @@
+#include "adc_8080_profiler.h"
+
+#include <assert.h> // For assert
+#include <ctype.h> // For isxdigit, isalnum
+#include <stdlib.h> // For malloc, calloc, realloc, free, qsort, strtoul
+#include <string.h> // For memcpy, memcmp, memmove, strcmp, strlen
+
+// Stacks are keys of the frame targets, outermost first, followed by the pc.
+#define MAX_KEY (ADC_8080_CPU_PROFILE_DEPTH + 1)
+#define MIN_BUCKETS 1024
+#define MAX_LABEL 64
+
+typedef struct {
+  uint64_t count;
+  uint32_t hash;
+  uint32_t key; // Offset in keys.
+  uint16_t length;
+} stack_entry;
+
+typedef struct {
+  uint16_t addr;
+  char *name;
+} symbol;
+
+struct adc_8080_profiler {
+  adc_8080_cpu_profile profile;
+  uint64_t samples;
+
+  // Open addressing hash table of indices in stacks, plus one. 0 is empty.
+  uint32_t *buckets;
+  size_t bucket_count;
+  stack_entry *stacks;
+  size_t stack_count, stack_capacity;
+  uint16_t *keys;
+  size_t key_count, key_capacity;
+
+  // Sorted by address.
+  symbol *symbols;
+  size_t symbol_count, symbol_capacity;
+};
+
+typedef struct {
+  char *text;
+  uint64_t count;
+} folded_line;
+
+static inline uint32_t key_hash(const uint16_t *key, int length) {
+  // FNV-1a over the addresses.
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < length; i++) {
+    hash = (hash ^ (key[i] & 0xFF)) * 16777619u;
+    hash = (hash ^ (key[i] >> 8)) * 16777619u;
+  }
+  return hash;
+}
+
+static bool grow(void **array, size_t *capacity, size_t needed,
+                 size_t item_size) {
+  if (needed <= *capacity)
+    return true;
+
+  size_t new_capacity = *capacity ? *capacity : 64;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+  void *new_array = realloc(*array, new_capacity * item_size);
+  if (!new_array)
+    return false;
+
+  *array = new_array;
+  *capacity = new_capacity;
+  return true;
+}
+
+static bool rehash(adc_8080_profiler *profiler, size_t bucket_count) {
+  uint32_t *buckets = calloc(bucket_count, sizeof(uint32_t));
+  if (!buckets)
+    return false;
+
+  for (size_t i = 0; i < profiler->stack_count; i++) {
+    size_t b = profiler->stacks[i].hash & (bucket_count - 1);
+    while (buckets[b])
+      b = (b + 1) & (bucket_count - 1);
+    buckets[b] = (uint32_t)i + 1;
+  }
+
+  free(profiler->buckets);
+  profiler->buckets = buckets;
+  profiler->bucket_count = bucket_count;
+  return true;
+}
+
+static void profiler_sample(void *userdata, uint16_t pc,
+                            const adc_8080_cpu_frame *frames, int depth) {
+  adc_8080_profiler *profiler = userdata;
+
+  uint16_t key[MAX_KEY];
+  for (int i = 0; i < depth; i++)
+    key[i] = frames[i].target;
+  key[depth] = pc;
+  int length = depth + 1;
+  uint32_t hash = key_hash(key, length);
+
+  size_t mask = profiler->bucket_count - 1;
+  size_t b = hash & mask;
+  while (profiler->buckets[b]) {
+    stack_entry *entry = &profiler->stacks[profiler->buckets[b] - 1];
+    if (entry->hash == hash && entry->length == length &&
+        memcmp(&profiler->keys[entry->key], key, length * sizeof(uint16_t)) ==
+            0) {
+      entry->count++;
+      profiler->samples++;
+      return;
+    }
+    b = (b + 1) & mask;
+  }
+
+  // A new stack, the table is kept at most half full.
+  if (!grow((void **)&profiler->stacks, &profiler->stack_capacity,
+            profiler->stack_count + 1, sizeof(stack_entry)) ||
+      !grow((void **)&profiler->keys, &profiler->key_capacity,
+            profiler->key_count + length, sizeof(uint16_t)))
+    return;
+
+  stack_entry *entry = &profiler->stacks[profiler->stack_count];
+  entry->count = 1;
+  entry->hash = hash;
+  entry->key = (uint32_t)profiler->key_count;
+  entry->length = (uint16_t)length;
+  memcpy(&profiler->keys[profiler->key_count], key, length * sizeof(uint16_t));
+  profiler->key_count += length;
+  profiler->buckets[b] = (uint32_t)++profiler->stack_count;
+  profiler->samples++;
+
+  if (profiler->stack_count * 2 > profiler->bucket_count)
+    rehash(profiler, profiler->bucket_count * 2);
+}
+
+// Returns the label at or before addr, NULL if there is none.
+static const char *find_symbol(const adc_8080_profiler *profiler,
+                               uint16_t addr) {
+  size_t lo = 0, hi = profiler->symbol_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (profiler->symbols[mid].addr <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo ? profiler->symbols[lo - 1].name : NULL;
+}
+
+static int compare_lines(const void *a, const void *b) {
+  return strcmp(((const folded_line *)a)->text,
+                ((const folded_line *)b)->text);
+}
+
+// Parses "HHHH" at line[column]. Returns false if it is not an address.
+static bool parse_addr(const char *line, size_t column, uint16_t *addr) {
+  for (size_t i = 0; i < column; i++) {
+    if (line[i] != ' ')
+      return false;
+  }
+  for (size_t i = column; i < column + 4; i++) {
+    if (!isxdigit((unsigned char)line[i]))
+      return false;
+  }
+  if (line[column + 4] != ' ')
+    return false;
+
+  *addr = (uint16_t)strtoul(line + column, NULL, 16);
+  return true;
+}
+
+// Public api implementation
+
+adc_8080_profiler *adc_8080_profiler_new(void) {
+  adc_8080_profiler *profiler = calloc(1, sizeof(adc_8080_profiler));
+  if (!profiler)
+    return NULL;
+
+  if (!rehash(profiler, MIN_BUCKETS)) {
+    free(profiler);
+    return NULL;
+  }
+
+  return profiler;
+}
+
+void adc_8080_profiler_free(adc_8080_profiler **profiler) {
+  if (profiler && *profiler) {
+    adc_8080_profiler *p = *profiler;
+    for (size_t i = 0; i < p->symbol_count; i++)
+      free(p->symbols[i].name);
+    free(p->symbols);
+    free(p->buckets);
+    free(p->stacks);
+    free(p->keys);
+    free(p);
+    *profiler = NULL;
+  }
+}
+
+void adc_8080_profiler_attach(adc_8080_profiler *profiler, adc_8080_cpu *cpu,
+                              uint64_t interval) {
+  assert(profiler);
+  assert(cpu);
+
+  adc_8080_cpu_profile_attach(cpu, &profiler->profile, interval,
+                              profiler_sample, profiler);
+}
+
+void adc_8080_profiler_detach(adc_8080_profiler *profiler, adc_8080_cpu *cpu) {
+  assert(profiler);
+  assert(cpu);
+  assert(cpu->profile == &profiler->profile);
+  (void)profiler;
+
+  adc_8080_cpu_profile_detach(cpu);
+}
+
+void adc_8080_profiler_reset(adc_8080_profiler *profiler) {
+  assert(profiler);
+
+  memset(profiler->buckets, 0, profiler->bucket_count * sizeof(uint32_t));
+  profiler->stack_count = 0;
+  profiler->key_count = 0;
+  profiler->samples = 0;
+}
+
+uint64_t adc_8080_profiler_samples(const adc_8080_profiler *profiler) {
+  assert(profiler);
+
+  return profiler->samples;
+}
+
+bool adc_8080_profiler_add_symbol(adc_8080_profiler *profiler, uint16_t addr,
+                                  const char *name) {
+  assert(profiler);
+  assert(name);
+
+  // Insert sorted, the first label of an address wins.
+  size_t pos = profiler->symbol_count;
+  while (pos > 0 && profiler->symbols[pos - 1].addr > addr)
+    pos--;
+  if (pos > 0 && profiler->symbols[pos - 1].addr == addr)
+    return true;
+
+  size_t length = strlen(name);
+  char *copy = malloc(length + 1);
+  if (!copy ||
+      !grow((void **)&profiler->symbols, &profiler->symbol_capacity,
+            profiler->symbol_count + 1, sizeof(symbol))) {
+    free(copy);
+    return false;
+  }
+  memcpy(copy, name, length + 1);
+
+  memmove(&profiler->symbols[pos + 1], &profiler->symbols[pos],
+          (profiler->symbol_count - pos) * sizeof(symbol));
+  profiler->symbols[pos].addr = addr;
+  profiler->symbols[pos].name = copy;
+  profiler->symbol_count++;
+  return true;
+}
+
+int adc_8080_profiler_load_symbols(adc_8080_profiler *profiler,
+                                   const char *path) {
+  assert(profiler);
+  assert(path);
+
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return -1;
+
+  int added = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    // TST8080.PRN: " 016A 0F        BYTO1:  RRC"
+    // MACRO-80:    "  0122    7E                    loop:   mov a,m"
+    uint16_t addr;
+    size_t column;
+    if (parse_addr(line, 1, &addr))
+      column = 16;
+    else if (parse_addr(line, 2, &addr))
+      column = 32;
+    else
+      continue;
+
+    if (strlen(line) <= column)
+      continue;
+    const char *label = line + column;
+    size_t length = 0;
+    while (length < MAX_LABEL &&
+           (isalnum((unsigned char)label[length]) || label[length] == '_' ||
+            label[length] == '$' || label[length] == '?' ||
+            label[length] == '@' || label[length] == '.'))
+      length++;
+    if (length == 0 || length == MAX_LABEL || label[length] != ':' ||
+        label[0] == '.')
+      continue;
+
+    char name[MAX_LABEL];
+    memcpy(name, label, length);
+    name[length] = '\0';
+    if (!adc_8080_profiler_add_symbol(profiler, addr, name))
+      break;
+    added++;
+  }
+
+  fclose(file);
+  return added;
+}
+
+bool adc_8080_profiler_write_folded(const adc_8080_profiler *profiler,
+                                    FILE *stream) {
+  assert(profiler);
+  assert(stream);
+
+  bool ok = false;
+  size_t count = profiler->stack_count;
+  folded_line *lines = calloc(count ? count : 1, sizeof(folded_line));
+  if (!lines)
+    return false;
+
+  for (size_t i = 0; i < count; i++) {
+    const stack_entry *entry = &profiler->stacks[i];
+    const uint16_t *key = &profiler->keys[entry->key];
+    char *text = malloc(entry->length * (MAX_LABEL + 1));
+    if (!text)
+      goto error;
+
+    size_t pos = 0;
+    for (int j = 0; j < entry->length; j++) {
+      const char *name = find_symbol(profiler, key[j]);
+      if (j > 0)
+        text[pos++] = ';';
+      if (name) {
+        size_t length = strlen(name);
+        memcpy(text + pos, name, length);
+        pos += length;
+      } else {
+        pos += snprintf(text + pos, 7, "0x%04x", key[j]);
+      }
+    }
+    text[pos] = '\0';
+
+    lines[i].text = text;
+    lines[i].count = entry->count;
+  }
+
+  // Different addresses resolve to the same labels, merge the duplicates.
+  qsort(lines, count, sizeof(folded_line), compare_lines);
+  for (size_t i = 0; i < count;) {
+    uint64_t total = 0;
+    size_t j = i;
+    while (j < count && strcmp(lines[i].text, lines[j].text) == 0)
+      total += lines[j++].count;
+    if (fprintf(stream, "%s %llu\n", lines[i].text,
+                (unsigned long long)total) < 0)
+      goto error;
+    i = j;
+  }
+  ok = true;
+
+error:
+  for (size_t i = 0; i < count; i++)
+    free(lines[i].text);
+  free(lines);
+  return ok;
+}
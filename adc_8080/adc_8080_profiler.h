@@ -0,0 +1,71 @@
+// adc_8080_profiler Guest profiler for adc_8080_cpu by Anthony Del Ciotto.
+// Samples the emulated program, not the emulator: every interval cycles the
+// guest pc and shadow call stack of the cpu are counted, see
+// adc_8080_cpu_profile_attach(). The result is written as folded stacks, one
+// "outer;inner;leaf count" line per distinct stack, the input format of
+// flame graph tools such as flamegraph.pl and inferno.
+//
+// Addresses are resolved to the nearest preceding label when symbols are
+// loaded, for example from the .PRN listings in roms/.
+
+#ifndef _ADC_8080_PROFILER_H_
+#define _ADC_8080_PROFILER_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct adc_8080_profiler adc_8080_profiler;
+
+// adc_8080_profiler_new() - Create a new profiler.
+//
+// Returns NULL on allocation failure.
+adc_8080_profiler *adc_8080_profiler_new(void);
+
+// adc_8080_profiler_free() - Free the profiler resources. It must be detached
+// from the cpu.
+void adc_8080_profiler_free(adc_8080_profiler **profiler);
+
+// adc_8080_profiler_attach() - Start sampling the cpu every interval cycles.
+void adc_8080_profiler_attach(adc_8080_profiler *profiler, adc_8080_cpu *cpu,
+                              uint64_t interval);
+
+// adc_8080_profiler_detach() - Stop sampling the cpu. Samples are kept.
+void adc_8080_profiler_detach(adc_8080_profiler *profiler, adc_8080_cpu *cpu);
+
+// adc_8080_profiler_reset() - Discard the samples. Symbols are kept.
+void adc_8080_profiler_reset(adc_8080_profiler *profiler);
+
+// adc_8080_profiler_samples() - Returns the number of samples taken. Samples
+// lost to allocation failure are not counted.
+uint64_t adc_8080_profiler_samples(const adc_8080_profiler *profiler);
+
+// adc_8080_profiler_add_symbol() - Add a label for an address.
+//
+// Returns false on allocation failure.
+bool adc_8080_profiler_add_symbol(adc_8080_profiler *profiler, uint16_t addr,
+                                  const char *name);
+
+// adc_8080_profiler_load_symbols() - Add the labels of an assembler listing.
+// Listings in the formats of roms/TST8080.PRN (address in column 1, label in
+// column 16) and of MACRO-80 (address in column 2, label in column 32) are
+// supported. Labels generated by macros (starting with '.') are skipped.
+//
+// Returns the number of labels added, or -1 if the file can not be read.
+int adc_8080_profiler_load_symbols(adc_8080_profiler *profiler,
+                                   const char *path);
+
+// adc_8080_profiler_write_folded() - Write the samples as folded stacks,
+// sorted. Frames and the leaf are labels, or hex addresses without symbols.
+//
+// Returns false on allocation or write failure.
+bool adc_8080_profiler_write_folded(const adc_8080_profiler *profiler,
+                                    FILE *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_PROFILER_H_
@@ -0,0 +1,182 @@
+#include "adc_8080_rewind.h"
+
+#include <assert.h> // For assert
+#include <stdlib.h> // For malloc, realloc, free
+#include <string.h> // For memcpy
+
+#define MEMORY_TOTAL 0x10000
+#define PAGE_SIZE 0x100
+#define NUM_PAGES 0x100
+
+typedef struct {
+  uint8_t state[ADC_8080_CPU_STATE_SIZE];
+
+  // Pages written since the previous checkpoint, unused for the keyframe.
+  uint8_t page_index[NUM_PAGES];
+  int num_pages;
+  uint8_t *pages;
+  int pages_capacity;
+} checkpoint;
+
+struct adc_8080_rewind {
+  checkpoint *checkpoints;
+  size_t capacity;
+  size_t head; // Index of the oldest checkpoint.
+  size_t count;
+
+  // Memory image at the oldest checkpoint.
+  uint8_t keyframe[MEMORY_TOTAL];
+};
+
+static inline checkpoint *get_checkpoint(adc_8080_rewind *rw, size_t index) {
+  return &rw->checkpoints[(rw->head + index) % rw->capacity];
+}
+
+static inline void apply_pages(const checkpoint *cp, uint8_t *memory) {
+  for (int i = 0; i < cp->num_pages; i++)
+    memcpy(memory + cp->page_index[i] * PAGE_SIZE, cp->pages + i * PAGE_SIZE,
+           PAGE_SIZE);
+}
+
+adc_8080_rewind *adc_8080_rewind_new(size_t capacity) {
+  assert(capacity > 0);
+
+  adc_8080_rewind *rw = malloc(sizeof(adc_8080_rewind));
+  if (!rw)
+    goto error;
+
+  rw->checkpoints = calloc(capacity, sizeof(checkpoint));
+  if (!rw->checkpoints)
+    goto error;
+
+  rw->capacity = capacity;
+  rw->head = 0;
+  rw->count = 0;
+  return rw;
+
+error:
+  free(rw);
+  return NULL;
+}
+
+void adc_8080_rewind_free(adc_8080_rewind **rw) {
+  if (rw && *rw) {
+    for (size_t i = 0; i < (*rw)->capacity; i++)
+      free((*rw)->checkpoints[i].pages);
+
+    free((*rw)->checkpoints);
+    free(*rw);
+    *rw = NULL;
+  }
+}
+
+bool adc_8080_rewind_push(adc_8080_rewind *rw, adc_8080_cpu *cpu,
+                          const uint8_t *memory) {
+  assert(rw);
+  assert(cpu);
+  assert(memory);
+
+  // A single checkpoint ring only ever holds the keyframe.
+  if (rw->capacity == 1)
+    rw->count = 0;
+
+  // The first checkpoint is the keyframe.
+  if (rw->count == 0) {
+    checkpoint *cp = get_checkpoint(rw, 0);
+    adc_8080_cpu_save(cpu, NULL, cp->state, sizeof(cp->state));
+    cp->num_pages = 0;
+    memcpy(rw->keyframe, memory, MEMORY_TOTAL);
+    adc_8080_cpu_clear_dirty(cpu);
+    rw->count = 1;
+    return true;
+  }
+
+  // Reuse the slot of the oldest checkpoint when the ring is full.
+  size_t slot = rw->count == rw->capacity ? 0 : rw->count;
+  checkpoint *cp = get_checkpoint(rw, slot);
+
+  int num_pages = 0;
+  uint8_t page_index[NUM_PAGES];
+  for (int word = 0; word < NUM_PAGES / 32; word++) {
+    if (cpu->dirty_pages[word] == 0)
+      continue;
+    for (int page = word * 32; page < (word + 1) * 32; page++) {
+      if (ADC_8080_CPU_PAGE_DIRTY(cpu, page))
+        page_index[num_pages++] = page;
+    }
+  }
+
+  if (num_pages > cp->pages_capacity) {
+    uint8_t *pages = realloc(cp->pages, num_pages * PAGE_SIZE);
+    if (!pages)
+      return false;
+    cp->pages = pages;
+    cp->pages_capacity = num_pages;
+  }
+
+  if (slot == 0) {
+    // Fold the second oldest checkpoint into the keyframe, it becomes the
+    // new oldest checkpoint.
+    rw->head = (rw->head + 1) % rw->capacity;
+    rw->count--;
+    checkpoint *oldest = get_checkpoint(rw, 0);
+    apply_pages(oldest, rw->keyframe);
+    oldest->num_pages = 0;
+  }
+
+  adc_8080_cpu_save(cpu, NULL, cp->state, sizeof(cp->state));
+  memcpy(cp->page_index, page_index, num_pages);
+  cp->num_pages = num_pages;
+  for (int i = 0; i < num_pages; i++)
+    memcpy(cp->pages + i * PAGE_SIZE, memory + page_index[i] * PAGE_SIZE,
+           PAGE_SIZE);
+
+  adc_8080_cpu_clear_dirty(cpu);
+  rw->count++;
+  return true;
+}
+
+size_t adc_8080_rewind_count(const adc_8080_rewind *rw) {
+  assert(rw);
+
+  return rw->count;
+}
+
+bool adc_8080_rewind_restore(adc_8080_rewind *rw, size_t index,
+                             adc_8080_cpu *cpu, uint8_t *memory) {
+  assert(rw);
+  assert(cpu);
+  assert(memory);
+
+  if (index >= rw->count)
+    return false;
+
+  memcpy(memory, rw->keyframe, MEMORY_TOTAL);
+  for (size_t i = 1; i <= index; i++)
+    apply_pages(get_checkpoint(rw, i), memory);
+
+  checkpoint *cp = get_checkpoint(rw, index);
+  adc_8080_cpu_load(cpu, NULL, cp->state, sizeof(cp->state));
+  adc_8080_cpu_clear_dirty(cpu);
+  if (cpu->hash)
+    adc_8080_cpu_hash_attach(cpu, cpu->hash);
+
+  rw->count = index + 1;
+  return true;
+}
+
+void adc_8080_rewind_clear(adc_8080_rewind *rw) {
+  assert(rw);
+
+  rw->head = 0;
+  rw->count = 0;
+}
+
+size_t adc_8080_rewind_memory_usage(const adc_8080_rewind *rw) {
+  assert(rw);
+
+  size_t total = sizeof(adc_8080_rewind) + rw->capacity * sizeof(checkpoint);
+  for (size_t i = 0; i < rw->capacity; i++)
+    total += rw->checkpoints[i].pages_capacity * PAGE_SIZE;
+  return total;
+}
@@ -0,0 +1,73 @@
+// adc_8080_rewind Rewind buffer for adc_8080_cpu by Anthony Del Ciotto.
+// Keeps a fixed-size ring of checkpoints of a running cpu and its 64 KiB of
+// memory.
+//
+// Only the oldest checkpoint holds a full memory image (the keyframe). Every
+// other checkpoint holds the cpu state plus the 256-byte pages written since
+// the previous checkpoint, as tracked by the cpu's dirty page bitmap. Memory
+// use and checkpoint cost scale with what the guest writes, not with the
+// address space. When the ring is full the oldest checkpoint is folded into
+// the keyframe.
+
+#ifndef _ADC_8080_REWIND_H_
+#define _ADC_8080_REWIND_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct adc_8080_rewind adc_8080_rewind;
+
+// adc_8080_rewind_new() - Create a new rewind buffer.
+//
+// capacity - Maximum number of checkpoints kept. For N seconds of rewind with
+//            one checkpoint per frame use N * frames per second.
+//
+// Returns NULL on allocation failure.
+adc_8080_rewind *adc_8080_rewind_new(size_t capacity);
+
+// adc_8080_rewind_free() - Free the rewind buffer resources.
+void adc_8080_rewind_free(adc_8080_rewind **rw);
+
+// adc_8080_rewind_push() - Record a checkpoint of the cpu and memory.
+//
+// The first checkpoint copies the full memory image, later checkpoints copy
+// only the dirty pages. The cpu dirty page bitmap is cleared. The memory must
+// only be modified through the cpu, or the host must call
+// adc_8080_cpu_mark_dirty(), between checkpoints.
+//
+// Returns false on allocation failure, the buffer is left unchanged.
+bool adc_8080_rewind_push(adc_8080_rewind *rw, adc_8080_cpu *cpu,
+                          const uint8_t *memory);
+
+// adc_8080_rewind_count() - Returns the number of checkpoints in the buffer.
+size_t adc_8080_rewind_count(const adc_8080_rewind *rw);
+
+// adc_8080_rewind_restore() - Restore the cpu and memory to a checkpoint.
+//
+// index - Index of the checkpoint, 0 is the oldest and
+//         adc_8080_rewind_count() - 1 the newest.
+//
+// Checkpoints newer than index are discarded, so the next push continues the
+// timeline from the restored point. Host function handlers and userdata of
+// the cpu are left as is. An attached cpu hash is recomputed.
+//
+// Returns false if index is out of range.
+bool adc_8080_rewind_restore(adc_8080_rewind *rw, size_t index,
+                             adc_8080_cpu *cpu, uint8_t *memory);
+
+// adc_8080_rewind_clear() - Discard all checkpoints. The next push records a
+// new keyframe.
+void adc_8080_rewind_clear(adc_8080_rewind *rw);
+
+// adc_8080_rewind_memory_usage() - Returns the number of bytes currently
+// allocated by the rewind buffer.
+size_t adc_8080_rewind_memory_usage(const adc_8080_rewind *rw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_REWIND_H_
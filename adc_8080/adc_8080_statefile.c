@@ -0,0 +1,220 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "adc_8080_statefile.h"
+
+#include <assert.h> // For assert
+#include <fcntl.h> // For open
+#include <stdio.h> // For FILE, fopen, fwrite, fseek, fclose
+#include <stdlib.h> // For malloc, calloc, free
+#include <string.h> // For memcmp, memcpy
+#include <sys/mman.h> // For mmap, munmap
+#include <sys/stat.h> // For fstat
+#include <unistd.h> // For pread, close
+
+#define MEMORY_TOTAL 0x10000
+#define HEADER_SIZE 16
+#define ENTRY_SIZE 32
+#define STATEFILE_VERSION 1
+
+static const uint8_t s_statefile_magic[4] = {'A', '8', '0', 'F'};
+
+struct adc_8080_statefile_writer {
+  FILE *file;
+  size_t count;
+  size_t added;
+  // Header and index, written once every state was added.
+  uint8_t *header;
+  size_t data_offset;
+};
+
+struct adc_8080_statefile {
+  int fd;
+  size_t count;
+  size_t data_offset;
+  uint8_t *index;
+};
+
+static inline size_t data_offset(size_t count) {
+  size_t size = HEADER_SIZE + count * ENTRY_SIZE;
+  return (size + ADC_8080_STATEFILE_ALIGN - 1) /
+         ADC_8080_STATEFILE_ALIGN * ADC_8080_STATEFILE_ALIGN;
+}
+
+static inline void put_u32(uint8_t *buf, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    buf[i] = (v >> (i * 8)) & 0xFF;
+}
+
+static inline uint32_t get_u32(const uint8_t *buf) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++)
+    v |= (uint32_t)buf[i] << (i * 8);
+  return v;
+}
+
+// Public api implementation
+
+adc_8080_statefile_writer *adc_8080_statefile_create(const char *path,
+                                                     size_t count) {
+  assert(path);
+  assert(count > 0);
+
+  adc_8080_statefile_writer *writer =
+      calloc(1, sizeof(adc_8080_statefile_writer));
+  if (!writer)
+    goto error;
+
+  writer->count = count;
+  writer->data_offset = data_offset(count);
+  writer->header = calloc(writer->data_offset, 1);
+  if (!writer->header)
+    goto error;
+
+  // Reserve the header and index, the memory images follow.
+  writer->file = fopen(path, "wb");
+  if (!writer->file ||
+      fwrite(writer->header, 1, writer->data_offset, writer->file) !=
+          writer->data_offset)
+    goto error;
+
+  return writer;
+
+error:
+  if (writer && writer->file)
+    fclose(writer->file);
+  if (writer)
+    free(writer->header);
+  free(writer);
+  return NULL;
+}
+
+bool adc_8080_statefile_add(adc_8080_statefile_writer *writer,
+                            const adc_8080_cpu *cpu, const uint8_t *memory) {
+  assert(writer);
+  assert(cpu);
+  assert(memory);
+
+  if (writer->added == writer->count)
+    return false;
+
+  uint8_t *entry = writer->header + HEADER_SIZE + writer->added * ENTRY_SIZE;
+  if (adc_8080_cpu_save(cpu, NULL, entry, ENTRY_SIZE) == 0)
+    return false;
+  if (fwrite(memory, 1, MEMORY_TOTAL, writer->file) != MEMORY_TOTAL)
+    return false;
+
+  writer->added++;
+  return true;
+}
+
+bool adc_8080_statefile_finish(adc_8080_statefile_writer **writer) {
+  assert(writer);
+  assert(*writer);
+
+  adc_8080_statefile_writer *w = *writer;
+  uint8_t *header = w->header;
+  memcpy(header, s_statefile_magic, sizeof(s_statefile_magic));
+  header[4] = STATEFILE_VERSION;
+  put_u32(&header[8], (uint32_t)w->count);
+  put_u32(&header[12], (uint32_t)w->data_offset);
+
+  bool ok = w->added == w->count && fseek(w->file, 0, SEEK_SET) == 0 &&
+            fwrite(header, 1, HEADER_SIZE + w->count * ENTRY_SIZE, w->file) ==
+                HEADER_SIZE + w->count * ENTRY_SIZE;
+  if (fclose(w->file) != 0)
+    ok = false;
+
+  free(w->header);
+  free(w);
+  *writer = NULL;
+  return ok;
+}
+
+adc_8080_statefile *adc_8080_statefile_open(const char *path) {
+  assert(path);
+
+  adc_8080_statefile *file = calloc(1, sizeof(adc_8080_statefile));
+  if (!file)
+    return NULL;
+
+  file->fd = open(path, O_RDONLY);
+  if (file->fd < 0)
+    goto error;
+
+  uint8_t header[HEADER_SIZE];
+  if (pread(file->fd, header, HEADER_SIZE, 0) != HEADER_SIZE ||
+      memcmp(header, s_statefile_magic, sizeof(s_statefile_magic)) != 0 ||
+      header[4] != STATEFILE_VERSION)
+    goto error;
+
+  file->count = get_u32(&header[8]);
+  file->data_offset = get_u32(&header[12]);
+  if (file->count == 0 || file->data_offset != data_offset(file->count))
+    goto error;
+
+  struct stat st;
+  if (fstat(file->fd, &st) != 0 ||
+      (uint64_t)st.st_size <
+          file->data_offset + (uint64_t)file->count * MEMORY_TOTAL)
+    goto error;
+
+  size_t index_size = file->count * ENTRY_SIZE;
+  file->index = malloc(index_size);
+  if (!file->index ||
+      pread(file->fd, file->index, index_size, HEADER_SIZE) !=
+          (ssize_t)index_size)
+    goto error;
+
+  return file;
+
+error:
+  if (file->fd >= 0)
+    close(file->fd);
+  free(file->index);
+  free(file);
+  return NULL;
+}
+
+void adc_8080_statefile_close(adc_8080_statefile **file) {
+  if (file && *file) {
+    close((*file)->fd);
+    free((*file)->index);
+    free(*file);
+    *file = NULL;
+  }
+}
+
+size_t adc_8080_statefile_count(const adc_8080_statefile *file) {
+  assert(file);
+
+  return file->count;
+}
+
+uint8_t *adc_8080_statefile_map(const adc_8080_statefile *file, size_t index,
+                                adc_8080_cpu *cpu) {
+  assert(file);
+
+  if (index >= file->count)
+    return NULL;
+
+  off_t offset = (off_t)(file->data_offset + (uint64_t)index * MEMORY_TOTAL);
+  uint8_t *memory = mmap(NULL, MEMORY_TOTAL, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, file->fd, offset);
+  if (memory == MAP_FAILED)
+    return NULL;
+
+  if (cpu && adc_8080_cpu_load(cpu, NULL, file->index + index * ENTRY_SIZE,
+                               ENTRY_SIZE) == 0) {
+    munmap(memory, MEMORY_TOTAL);
+    return NULL;
+  }
+
+  return memory;
+}
+
+void adc_8080_statefile_unmap(uint8_t **memory) {
+  if (memory && *memory) {
+    munmap(*memory, MEMORY_TOTAL);
+    *memory = NULL;
+  }
+}
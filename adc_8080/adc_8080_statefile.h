@@ -0,0 +1,86 @@
+// adc_8080_statefile Memory-mapped save state files for adc_8080_cpu by
+// Anthony Del Ciotto. Stores many cpu states with their 64 KiB memory images
+// in a single file:
+//
+//   offset 0                  header: magic "A80F", version, state count and
+//                             the offset of the first memory image
+//   offset 16                 index: one adc_8080_cpu_save() blob per state,
+//                             padded to 32 bytes
+//   ADC_8080_STATEFILE_ALIGN  memory images, 64 KiB each
+//
+// Memory images start on ADC_8080_STATEFILE_ALIGN boundaries, a multiple of
+// every common host page size. A state is loaded by mapping its image
+// MAP_PRIVATE straight from the file: nothing is read until the guest touches
+// a page and writes are copy-on-write, private to the mapping. Starting many
+// instances from one file costs the page faults of the pages actually used.
+//
+// Requires a POSIX host with mmap().
+
+#ifndef _ADC_8080_STATEFILE_H_
+#define _ADC_8080_STATEFILE_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADC_8080_STATEFILE_ALIGN 0x10000
+
+typedef struct adc_8080_statefile adc_8080_statefile;
+typedef struct adc_8080_statefile_writer adc_8080_statefile_writer;
+
+// adc_8080_statefile_create() - Create a state file for count states.
+//
+// Returns NULL if the file can not be created or on allocation failure.
+adc_8080_statefile_writer *adc_8080_statefile_create(const char *path,
+                                                     size_t count);
+
+// adc_8080_statefile_add() - Append the next state.
+//
+// memory - The 64 KiB memory of the cpu.
+//
+// Returns false on write failure, if the cpu state does not fit its index
+// entry or if count states were already added.
+bool adc_8080_statefile_add(adc_8080_statefile_writer *writer,
+                            const adc_8080_cpu *cpu, const uint8_t *memory);
+
+// adc_8080_statefile_finish() - Write the index, close the file and free the
+// writer.
+//
+// Returns false on write failure or if fewer than count states were added.
+bool adc_8080_statefile_finish(adc_8080_statefile_writer **writer);
+
+// adc_8080_statefile_open() - Open a state file and read its index.
+//
+// Returns NULL if the file can not be opened, is invalid or truncated.
+adc_8080_statefile *adc_8080_statefile_open(const char *path);
+
+// adc_8080_statefile_close() - Close the state file. Memory mapped from it
+// stays valid until it is unmapped.
+void adc_8080_statefile_close(adc_8080_statefile **file);
+
+// adc_8080_statefile_count() - Returns the number of states in the file.
+size_t adc_8080_statefile_count(const adc_8080_statefile *file);
+
+// adc_8080_statefile_map() - Load a state.
+//
+// index - Index of the state, 0 to adc_8080_statefile_count() - 1.
+// cpu   - Restored from the state as adc_8080_cpu_load(), may be NULL.
+//
+// Returns a private, writable 64 KiB mapping of the state's memory image, to
+// be released with adc_8080_statefile_unmap(). An attached cpu hash is not
+// recomputed, attaching a hash reads every page.
+// Returns NULL if index is out of range or the mapping fails.
+uint8_t *adc_8080_statefile_map(const adc_8080_statefile *file, size_t index,
+                                adc_8080_cpu *cpu);
+
+// adc_8080_statefile_unmap() - Release memory returned by
+// adc_8080_statefile_map().
+void adc_8080_statefile_unmap(uint8_t **memory);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_STATEFILE_H_
@@ -0,0 +1,46 @@
+#include "adc_8080_trace.h"
+#include "adc_8080_dasm.h"
+
+#include <assert.h> // For assert
+#include <inttypes.h> // For PRIu64
+
+#define MNEMONIC_BUFSIZE 32
+
+int adc_8080_trace_format(const adc_8080_cpu_trace_record *record, char *dst,
+                          size_t num) {
+  assert(record);
+  assert(dst);
+
+  char mnemonic[MNEMONIC_BUFSIZE];
+  size_t size = adc_8080_dasm_format(record->bytes, mnemonic, sizeof(mnemonic));
+
+  // Instruction bytes, padded to 3.
+  char bytes[10];
+  for (size_t i = 0; i < 3; i++) {
+    if (i < size)
+      snprintf(bytes + i * 3, 4, "%02x ", record->bytes[i]);
+    else
+      snprintf(bytes + i * 3, 4, "   ");
+  }
+
+  return snprintf(dst, num,
+                  "%12" PRIu64 " %04x: %s %s%-14s a:%02x bc:%02x%02x "
+                  "de:%02x%02x hl:%02x%02x sp:%04x f:%02x",
+                  record->cycle, record->pc, bytes,
+                  record->flags & ADC_8080_CPU_TRACE_INTERRUPT ? "int " : "",
+                  mnemonic, record->a, record->b, record->c, record->d,
+                  record->e, record->h, record->l, record->sp, record->psw);
+}
+
+void adc_8080_trace_print(const adc_8080_cpu_trace *trace, FILE *stream) {
+  assert(trace);
+  assert(stream);
+
+  char line[128];
+  size_t count = adc_8080_cpu_trace_count(trace);
+  for (size_t i = 0; i < count; i++) {
+    adc_8080_trace_format(adc_8080_cpu_trace_get(trace, i), line,
+                          sizeof(line));
+    fprintf(stream, "%s\n", line);
+  }
+}
@@ -0,0 +1,31 @@
+// adc_8080_trace Trace decoder for adc_8080_cpu by Anthony Del Ciotto.
+// Renders the binary records of an adc_8080_cpu_trace ring buffer as text,
+// disassembling each instruction with adc_8080_dasm. Formatting only happens
+// here, when a trace is dumped, never while it is recorded.
+
+#ifndef _ADC_8080_TRACE_H_
+#define _ADC_8080_TRACE_H_
+
+#include "adc_8080_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// adc_8080_trace_format() - Format a trace record as a single line without a
+// trailing newline: the cycle count, pc, instruction bytes, disassembly and
+// registers. Interrupt opcodes are prefixed with "int".
+//
+// Returns the number of characters written, as snprintf().
+int adc_8080_trace_format(const adc_8080_cpu_trace_record *record, char *dst,
+                          size_t num);
+
+// adc_8080_trace_print() - Print every record in the trace buffer, oldest
+// first.
+void adc_8080_trace_print(const adc_8080_cpu_trace *trace, FILE *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ADC_8080_TRACE_H_